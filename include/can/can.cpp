@@ -25,90 +25,216 @@
 #include <unistd.h>
 #include <devctl.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>		/* offsetof */
+#include <time.h>
+#include <sys/mman.h>
 
 
-void can_init(int argc, char *argv[], resmgr_connect_funcs_t *pconn,
-	resmgr_io_funcs_t *pio, IOFUNC_ATTR_T *pattr)
-{
-	int opt;
-	// These are set to 1 if specified by command line arguments
-	int arg_port = 0;
-	int arg_irq = 0;
-
-	char *pconfig;
-	FILE *pfile;
+/** Set the default parameters of a channel.
+ *
+ * @param pattr
+ * 		pointer to information per device manager
+ * @param channel
+ * 		index of the channel
+ */
+static void can_init_channel(IOFUNC_ATTR_T *pattr, int channel) {
 	can_info_t *pinfo = &pattr->can_info;
 
-	// Setup default parameters.
-	pconfig = (char*)DEFAULT_CONFIG;
+	pattr->channel = channel;
 	pattr->verbose_flag = false;
 	pattr->devname = (char*)DEFAULT_DEVICE;
-	pattr->notify_pocb = NULL;
+	for (int i=0; i<CAN_MAX_CLIENTS; i++)
+		pattr->clients[i] = NULL;
 	pinfo->use_extended_frame = 1;	// by default, use extended frame
 	pinfo->irq = DEFAULT_IRQ;
 	pinfo->port = DEFAULT_PORT;
 	pinfo->filter.id = 0;			// set up to accept all messages from all
 	pinfo->filter.mask = 0xff;
 	pinfo->bit_speed = 250;
+	pinfo->poll_rate = CAN_DEFAULT_POLL_RATE;
+	pinfo->poll_period_us = CAN_DEFAULT_POLL_PERIOD_US;
+	pinfo->cpu = DEFAULT_CPU;
+	pinfo->listen_only = false;
+	pinfo->dump_file = NULL;
+	pinfo->num_routes = 0;
+}
+
+
+/** Parse a routing rule, given as id,mask,channel[,sa].
+ *
+ * The numbers may be decimal or hexadecimal (with 0x). The source address is
+ * kept if it is not given.
+ *
+ * @param arg
+ * 		the rule
+ * @param route
+ * 		updated with the rule
+ * @return
+ * 		0 for success, or -1 if the rule is malformed
+ */
+static int can_parse_route(const char *arg, can_route_t *route) {
+	char *end;
+
+	route->id = strtoul(arg, &end, 0);
+	if (*end != ',')
+		return -1;
+	route->mask = strtoul(end + 1, &end, 0);
+	if (*end != ',')
+		return -1;
+	route->channel = strtol(end + 1, &end, 0);
+	route->sa = CAN_ROUTE_KEEP_SA;
+	if (*end == ',')
+		route->sa = strtol(end + 1, &end, 0);
+	return *end == '\0' ? 0 : -1;
+}
+
+
+int can_init(int argc, char *argv[], resmgr_connect_funcs_t *pconn,
+	resmgr_io_funcs_t *pio, IOFUNC_ATTR_T *pattrs, int max_channels)
+{
+	int opt;
+	int num_channels = 1;
+	bool named = false;		// set once the first channel is named by -n
+	// These are set to 1 if specified by command line arguments
+	int arg_port[MAX_CHANNELS] = { 0 };
+	int arg_irq[MAX_CHANNELS] = { 0 };
+	int arg_cpu[MAX_CHANNELS] = { 0 };
+	bool verbose = false;
+
+	char *pconfig;
+	FILE *pfile;
+	IOFUNC_ATTR_T *pattr = &pattrs[0];
+	can_info_t *pinfo = &pattr->can_info;
+
+	if (max_channels > MAX_CHANNELS)
+		max_channels = MAX_CHANNELS;
+
+	// Setup default parameters.
+	pconfig = (char*)DEFAULT_CONFIG;
+	can_init_channel(pattr, 0);
 
 	// If arguments are specified, they override config file
-	while((opt = getopt(argc, argv, "e:f:i:n:p:s:v?")) != EOF) {
+	while((opt = getopt(argc, argv, "c:d:e:f:g:i:ln:p:r:s:t:v?")) != EOF) {
 		switch (opt) {
+		case 'c':
+			pinfo->cpu = atoi(optarg);
+			arg_cpu[pattr->channel] = 1;
+			break;
+		case 'd':
+			pinfo->dump_file = strdup(optarg);
+			break;
 		case 'e':
 			pinfo->use_extended_frame = atoi(optarg);
 			break;
 		case 'f':
 			pconfig = strdup(optarg);
 			break;
+		case 'g':
+			if (pinfo->num_routes == CAN_MAX_ROUTES) {
+				fprintf(stderr, "At most %d routes per channel, ignoring %s\n",
+						CAN_MAX_ROUTES, optarg);
+				break;
+			}
+			if (can_parse_route(optarg,
+					&pinfo->routes[pinfo->num_routes]) == -1) {
+				fprintf(stderr, "Malformed route %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			pinfo->num_routes++;
+			break;
 		case 'i':
 			pinfo->irq = atoi(optarg);
-			arg_irq = 1;
+			arg_irq[pattr->channel] = 1;
+			break;
+		case 'l':
+			pinfo->listen_only = true;
 			break;
 		case 'n':
+			if (named) {
+				if (num_channels == max_channels) {
+					fprintf(stderr, "At most %d channels, ignoring %s\n",
+							max_channels, optarg);
+					break;
+				}
+				pattr = &pattrs[num_channels];
+				pinfo = &pattr->can_info;
+				can_init_channel(pattr, num_channels++);
+			}
 			pattr->devname = strdup(optarg);
+			named = true;
 			break;
 		case 'p':
 			pinfo->port = strtol(optarg, (char**)NULL, 0);
 			printf("I/O port for base address 0x%x\n", pinfo->port);
-			arg_port = 1;
+			arg_port[pattr->channel] = 1;
+			break;
+		case 'r':
+			pinfo->poll_rate = atoi(optarg);
 			break;
 		case 's':
 			pinfo->bit_speed = atoi(optarg);
 			printf("Bit speed set to %d\n", pinfo->bit_speed);
 			break;
+		case 't':
+			pinfo->poll_period_us = atoi(optarg);
+			break;
 		case 'v':
-			pattr->verbose_flag = true;
+			verbose = true;
 			break;
 		case '?':
-			fprintf(stderr, "%s:\t-[pfv]\n", argv[0]);
-			fprintf(stderr, "\t\tp\tPath name (%s).\n", DEFAULT_DEVICE);
+			fprintf(stderr, "%s:\t-[cdefgilnprstv]\n", argv[0]);
+			fprintf(stderr, "\t\tn\tPath name (%s), repeat for more channels (at most %d).\n",
+					DEFAULT_DEVICE, max_channels);
+			fprintf(stderr, "\t\tc\tCPU running the channel thread (any).\n");
+			fprintf(stderr, "\t\td\tBinary dump of every received frame (none).\n");
 			fprintf(stderr, "\t\tf\tConfiguration file (%s).\n", DEFAULT_CONFIG);
+			fprintf(stderr, "\t\tg\tForward id,mask,channel[,sa] to the channel of that index\n"
+					"\t\t\t(from 0, in the order of -n), rewriting the source address.\n");
+			fprintf(stderr, "\t\tl\tListen only: never acknowledge or send frames.\n");
+			fprintf(stderr, "\t\tr\tRx frames/s above which the chip is polled (%d, never).\n",
+					CAN_DEFAULT_POLL_RATE);
+			fprintf(stderr, "\t\tt\tPoll period in us (%d).\n",
+					CAN_DEFAULT_POLL_PERIOD_US);
 			fprintf(stderr, "\t\tv\tVerbose mode.\n");
 			fprintf(stderr, "\t\t?\tPrints this message.\n");
+			fprintf(stderr, "\tChannel options apply to the channel of the last -n.\n");
 			exit(EXIT_SUCCESS);
 		default:
 			break;
 		}
 	}
 
-	/* Initialize from config file, if found. */
-	if ((pfile = get_ini_section(pconfig, pattr->devname)) == NULL) {
-		printf("No section %s in %s file found, using args, defaults\n",
-			pattr->devname, pconfig);
-		fflush(stdout);
-	} else {
-		if (!arg_irq)
-			pinfo->irq = get_ini_long(pfile, INI_IRQ_ENTRY, DEFAULT_IRQ);
-		if (!arg_port)
-			pinfo->port = get_ini_hex(pfile, INI_PORT_ENTRY, DEFAULT_PORT);
-		fclose(pfile);
-	}
+	for (int i=0; i<num_channels; i++) {
+		pattr = &pattrs[i];
+		pinfo = &pattr->can_info;
+		pattr->verbose_flag = verbose;
+
+		/* Routes lead to another channel of this manager. */
+		for (int j=0; j<pinfo->num_routes; j++) {
+			int channel = pinfo->routes[j].channel;
+			if (channel < 0 || channel >= num_channels || channel == i) {
+				fprintf(stderr, "%s: no channel %d to route to\n",
+						pattr->devname, channel);
+				exit(EXIT_FAILURE);
+			}
+		}
 
-	/* Initialize circular buffers for CAN read and write. */
-	pattr->in_buff->init(DEFAULT_QSIZE, sizeof(can_msg_t));
-	pattr->out_buff->init(DEFAULT_QSIZE, sizeof(can_msg_t));
-	printf("Circular buffers initialized\n");
-	fflush(stdout);
+		/* Initialize from config file, if found. */
+		if ((pfile = get_ini_section(pconfig, pattr->devname)) == NULL) {
+			printf("No section %s in %s file found, using args, defaults\n",
+				pattr->devname, pconfig);
+			fflush(stdout);
+		} else {
+			if (!arg_irq[i])
+				pinfo->irq = get_ini_long(pfile, INI_IRQ_ENTRY, DEFAULT_IRQ);
+			if (!arg_port[i])
+				pinfo->port = get_ini_hex(pfile, INI_PORT_ENTRY, DEFAULT_PORT);
+			if (!arg_cpu[i])
+				pinfo->cpu = get_ini_long(pfile, INI_CPU_ENTRY, DEFAULT_CPU);
+			fclose(pfile);
+		}
+	}
 
 	/* Initialize resource manager function tables with CAN specific function
 	 * for devctl. */
@@ -124,8 +250,10 @@ void can_init(int argc, char *argv[], resmgr_connect_funcs_t *pconn,
 	} else
 		sig_ign(sig_list, sig_hand);
 
-	printf("Leaving caninit\n");
+	printf("Leaving caninit: %d channel(s)\n", num_channels);
 	fflush(stdout);
+
+	return num_channels;
 }
 
 
@@ -139,6 +267,24 @@ int can_set_filter(int fd, unsigned long id, unsigned long mask) {
 }
 
 
+int can_set_dual_filter(int fd, unsigned long id1, unsigned long mask1,
+		unsigned long id2, unsigned long mask2) {
+	can_dual_filter_t filter_data;
+	filter_data.filter[0].id = id1;
+	filter_data.filter[0].mask = mask1;
+	filter_data.filter[1].id = id2;
+	filter_data.filter[1].mask = mask2;
+
+	return(devctl(fd, DCMD_CAN_DUAL_FILTER, (void *) &filter_data,
+			sizeof(filter_data), NULL));
+}
+
+
+int can_set_self_test(int fd, int enable) {
+	return devctl(fd, DCMD_CAN_SELF_TEST, (void *) &enable, sizeof(int), NULL);
+}
+
+
 int can_empty_queue(int fd) {
 	int num_dropped = -1;
 	devctl(fd, DCMD_CAN_EMPTY_Q, (void *) &num_dropped, sizeof(int), NULL);
@@ -146,54 +292,314 @@ int can_empty_queue(int fd) {
 }
 
 
-int can_arm(int fd, int channel_id) {
-	int coid;
+int can_get_stats(int fd, can_stats_t *stats) {
+	return devctl(fd, DCMD_CAN_GET_STATS, (void *) stats,
+			sizeof(can_stats_t), NULL);
+}
+
+
+int can_clear_errs(int fd, can_err_count_t *errs) {
+	can_err_count_t old_errs;
+	int status;
+
+	status = devctl(fd, DCMD_CAN_CLEAR_ERRS, (void *) &old_errs,
+			sizeof(old_errs), NULL);
+	if (status == EOK && errs != NULL)
+		*errs = old_errs;
+	return status;
+}
+
+
+int can_arm(int fd, int channel_id, int *pcoid) {
+	int coid = pcoid != NULL ? *pcoid : -1;
+	bool attached = coid == -1;
+	int status;
     static sigevent event;
 
-    /* We need a connection to that channel for the pulse to be delivered on. */
-    coid = ConnectAttach(0, 0, channel_id, _NTO_SIDE_CHANNEL, 0);
+    /* We need a connection to that channel for the pulse to be delivered on,
+     * unless the caller kept the one of an earlier call. */
+    if (coid == -1 &&
+    		(coid = ConnectAttach(0, 0, channel_id, _NTO_SIDE_CHANNEL, 0)) == -1)
+    	return errno;
 
     /* Fill in the event structure for a pulse; use the file descriptor of the
      * CAN device so that this pulse can be distinguished from other devices
      * that may be sending pulses to this client. */
     SIGEV_PULSE_INIT(&event, coid, SIGEV_PULSE_PRIO_INHERIT, fd, 0);
 
-    return devctl(fd, DCMD_CAN_ARM, (void *) &event,
+    status = devctl(fd, DCMD_CAN_ARM, (void *) &event,
     		sizeof(struct sigevent), NULL);
+
+    /* A new connection is only kept if the pulse was registered. */
+    if (attached && status != EOK)
+    	ConnectDetach(coid);
+    else if (attached && pcoid != NULL)
+    	*pcoid = coid;
+    return status;
 }
 
 
-int can_read(intptr_t fd, unsigned long *id, char *extended, void *data,
-		BYTE size)
-{
-	can_msg_t msg;
-	int status;
+int can_map_shm(intptr_t fd) {
 	can_dev_handle_t *phdl = (can_dev_handle_t *) fd;
-	int real_fd = phdl->fd;
-	int channel_id = phdl->channel_id;
+	can_shm_info_t info;
+	const can_shm_t *pshm;
+	int shm_fd;
+	void *addr;
+
+	memset(&info, 0, sizeof(info));
+	if (devctl(phdl->fd, DCMD_CAN_GET_SHM, (void *) &info, sizeof(info),
+			NULL) != EOK)
+		return -1;
+	info.name[CAN_SHM_NAME_MAX - 1] = '\0';
+
+	/* The driver and the client must agree on the layout of the ring. */
+	if (info.size != sizeof(can_shm_t)) {
+		fprintf(stderr, "can_map_shm: %s has %d bytes, expected %d\n",
+				info.name, info.size, (int) sizeof(can_shm_t));
+		return -1;
+	}
+
+	if ((shm_fd = shm_open(info.name, O_RDONLY, 0)) == -1) {
+		perror("can_map_shm: shm_open");
+		return -1;
+	}
+	addr = mmap(NULL, sizeof(can_shm_t), PROT_READ, MAP_SHARED, shm_fd, 0);
+	close(shm_fd);
+	if (addr == MAP_FAILED) {
+		perror("can_map_shm: mmap");
+		return -1;
+	}
+
+	pshm = (const can_shm_t *) addr;
+	if (pshm->magic != CAN_SHM_MAGIC || pshm->version != CAN_SHM_VERSION) {
+		fprintf(stderr, "can_map_shm: %s has an unknown layout\n", info.name);
+		munmap(addr, sizeof(can_shm_t));
+		return -1;
+	}
+
+	/* Only the messages received from now on are read, through the filters
+	 * the client set on the device. */
+	phdl->shm = pshm;
+	phdl->generation = pshm->generation;
+	phdl->filter[0] = info.filter[0];
+	phdl->filter[1] = info.filter[1];
+	phdl->num_filters = info.num_filters;
+	for (int lane = 0; lane < CAN_RX_NUM_LANES; lane++)
+		phdl->cursor.lanes[lane] = pshm->rx.lanes[lane].get_cursor();
+	return 0;
+}
+
+
+void can_unmap_shm(intptr_t fd) {
+	can_dev_handle_t *phdl = (can_dev_handle_t *) fd;
+
+	if (phdl->shm != NULL) {
+		munmap((void *) phdl->shm, sizeof(can_shm_t));
+		phdl->shm = NULL;
+	}
+	if (phdl->cyclic != NULL) {
+		munmap((void *) phdl->cyclic, sizeof(can_cyclic_shm_t));
+		phdl->cyclic = NULL;
+	}
+}
+
+
+/** Whether a devctl failed because the resource manager of the device
+ * stopped. */
+static inline bool can_conn_lost(int status) {
+	return status == EBADF || status == ESRCH;
+}
+
+
+/** Open the device again once its resource manager was restarted.
+ *
+ * The new connection takes the file descriptor of the old one, which still
+ * identifies the handle and the pulses of can_arm. The pulses are delivered on
+ * the connection of the first can_arm, so that no connection is opened per
+ * restart. If the restarted manager took over the input rings (see
+ * can_shm_init), the client keeps reading where it was. Otherwise the new rings
+ * are mapped, and only the messages received from now on are read. Periodic
+ * messages are sent on by the manager, and handed back to the client by the
+ * devctls below, unless the manager replaced their payloads, in which case they
+ * must be started again.
+ *
+ * @param phdl
+ * 		handle of the CAN device
+ * @return
+ * 		0 for success, or -1 if the device could not be opened again
+ */
+static int can_reconnect(can_dev_handle_t *phdl) {
+	struct timespec pause;
+	int fd = -1;
+
+	pause.tv_sec = CAN_RECONNECT_CHECK_MS / 1000;
+	pause.tv_nsec = (CAN_RECONNECT_CHECK_MS % 1000) * 1000000L;
+	for (int i = 0; i < CAN_RECONNECT_TRIES && fd == -1; i++)
+		if ((fd = open(phdl->filename.c_str(), phdl->flags)) == -1)
+			nanosleep(&pause, NULL);
+	if (fd == -1) {
+		perror("can_reconnect");
+		return -1;
+	}
+	dup2(fd, phdl->fd);
+	close(fd);
+
+	/* The filters of the client are set again before the chip is loaded with
+	 * them by can_arm. */
+	if (phdl->num_filters == 1)
+		can_set_filter(phdl->fd, phdl->filter[0].id, phdl->filter[0].mask);
+	else if (phdl->num_filters == 2)
+		can_set_dual_filter(phdl->fd, phdl->filter[0].id,
+				phdl->filter[0].mask, phdl->filter[1].id, phdl->filter[1].mask);
+
+	if (phdl->flags == O_RDONLY &&
+			can_arm(phdl->fd, phdl->channel_id, &phdl->pulse_coid) != EOK) {
+		fprintf(stderr, "can_reconnect: can_arm failed\n");
+		return -1;
+	}
+
+	/* The periodic messages are kept with their payloads, unless the manager
+	 * had to create them again. */
+	if (phdl->cyclic != NULL && phdl->cyclic->magic != CAN_CYCLIC_SHM_MAGIC) {
+		munmap((void *) phdl->cyclic, sizeof(can_cyclic_shm_t));
+		phdl->cyclic = NULL;
+	} else if (phdl->cyclic != NULL) {
+		/* Any devctl hands them back, so that closing the device stops them
+		 * again. */
+		can_err_count_t errs;
+		devctl(phdl->fd, DCMD_CAN_GET_ERRS, (void *) &errs, sizeof(errs),
+				NULL);
+	}
+
+	/* A manager that took over the rings counted itself in them. A replaced
+	 * object is unlinked, so its generation stays the same. */
+	if (phdl->shm != NULL && phdl->shm->generation == phdl->generation) {
+		munmap((void *) phdl->shm, sizeof(can_shm_t));
+		phdl->shm = NULL;
+		if (can_map_shm((intptr_t) phdl) == -1)
+			return -1;
+	} else if (phdl->shm != NULL) {
+		phdl->generation = phdl->shm->generation;
+	}
+
+	printf("can_reconnect: reconnected to %s\n", phdl->filename.c_str());
+	return 0;
+}
+
+
+/** Wait for the pulse registered with can_arm.
+ *
+ * The connection to the resource manager is checked every
+ * CAN_RECONNECT_CHECK_MS without a pulse, and made again if the manager was
+ * restarted.
+ *
+ * @param phdl
+ * 		handle of the CAN device
+ * @return
+ * 		0 for success, or -1 if anything but a pulse was received. 0 is also
+ * 		returned after a reconnection, as messages may have been received in
+ * 		the meantime.
+ */
+static int can_wait_pulse(can_dev_handle_t *phdl) {
 	char msg_buf[MAX_MSG_BUF];
 	struct _msg_info msginfo;
+	can_err_count_t errs;
+	uint64_t timeout_ns = (uint64_t) CAN_RECONNECT_CHECK_MS * 1000000;
 	int rcvid;
-	memset(&msg, 0, sizeof(msg));
 
-	rcvid = MsgReceive(channel_id, msg_buf, MAX_MSG_BUF, &msginfo);
+	while (true) {
+		TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_RECEIVE, NULL, &timeout_ns,
+				NULL);
+		rcvid = MsgReceive(phdl->channel_id, msg_buf, MAX_MSG_BUF, &msginfo);
+		if (rcvid != -1 || errno != ETIMEDOUT)
+			break;
 
-	if (rcvid == 0) {
-		status = devctl(real_fd, DCMD_CAN_I82527_READ, (void *) &msg,
-                        sizeof(msg), NULL);
-	} else {
+		/* A devctl without side effects on the client, which DCMD_CAN_GET_SHM
+		 * has (see shm_reader). */
+		if (!can_conn_lost(devctl(phdl->fd, DCMD_CAN_GET_ERRS, (void *) &errs,
+				sizeof(errs), NULL)))
+			continue;
+		if (can_reconnect(phdl) == -1)
+			return -1;
+		return 0;
+	}
+
+	if (rcvid != 0) {
 		printf("rcvid %d channel_id %d chid %d pid %d ",
-			rcvid, channel_id, msginfo.chid, msginfo.pid);
- 		printf("msglen %d coid %d scoid %d\n",
+			rcvid, phdl->channel_id, msginfo.chid, msginfo.pid);
+		printf("msglen %d coid %d scoid %d\n",
 			msginfo.msglen, msginfo.coid, msginfo.scoid);
 		perror("MsgReceive");
 		return -1;
 	}
+	return 0;
+}
 
-	if (status != EOK) {
-		printf("can_read: devctl error %d\n", status);
-		return -1;
+
+/** Copy the unread messages out of the mapped input rings.
+ *
+ * The messages of the safety lane are copied first.
+ *
+ * @param phdl
+ * 		handle of the CAN device, with the input ring mapped
+ * @param msgs
+ * 		array that is updated with the messages, oldest first
+ * @param max_msgs
+ * 		largest number of messages to read
+ * @return
+ * 		number of messages read
+ */
+static int can_pop_shm(can_dev_handle_t *phdl, can_msg_t *msgs,
+		int max_msgs) {
+	int num_msgs = 0;
+
+	for (int lane = 0; lane < CAN_RX_NUM_LANES; lane++) {
+		const can_fanout_t *ring = &phdl->shm->rx.lanes[lane];
+		while (num_msgs < max_msgs &&
+				ring->pop(&phdl->cursor.lanes[lane], &msgs[num_msgs])) {
+			/* The ring holds the messages of every client of the channel. */
+			if (!can_filter_match(phdl->filter, phdl->num_filters,
+					msgs[num_msgs]))
+				continue;
+			msgs[num_msgs].error = 0;
+			num_msgs++;
+		}
+	}
+	return num_msgs;
+}
+
+
+int can_read(intptr_t fd, unsigned long *id, char *extended, void *data,
+		BYTE size, uint64_t *rx_time_ns)
+{
+	can_msg_t msg;
+	int status;
+	can_dev_handle_t *phdl = (can_dev_handle_t *) fd;
+	int real_fd = phdl->fd;
+	memset(&msg, 0, sizeof(msg));
+
+	if (phdl->shm != NULL) {
+		/* Read in place, and only wait if every message was read. */
+		while (can_pop_shm(phdl, &msg, 1) == 0)
+			if (can_wait_pulse(phdl) == -1)
+				return -1;
+	} else {
+		/* Read at once, and only wait if every message was read. A lost
+		 * connection is made again by can_wait_pulse. */
+		while (true) {
+			status = devctl(real_fd, DCMD_CAN_I82527_READ, (void *) &msg,
+					sizeof(msg), NULL);
+			if (status != EOK && !can_conn_lost(status)) {
+				printf("can_read: devctl error %d\n", status);
+				return -1;
+			}
+			if (status == EOK && msg.error == 0)
+				break;
+			if (can_wait_pulse(phdl) == -1)
+				return -1;
+		}
 	}
+
 	if (msg.error != 0) {
 #ifdef DO_TRACE
 		printf("can_read: failed to pop msg from in buffer\n");
@@ -210,6 +616,8 @@ int can_read(intptr_t fd, unsigned long *id, char *extended, void *data,
 			*extended = 0;
 	}
 	memcpy(data, msg.data, size > 8 ? 8 : size);
+	if (rx_time_ns != NULL)
+		*rx_time_ns = msg.rx_time_ns;
 
 #ifdef DO_TRACE
 	printf("can_read: msg.id 0x%08x msg.size %hhd\n", msg.id, msg.size);
@@ -218,21 +626,103 @@ int can_read(intptr_t fd, unsigned long *id, char *extended, void *data,
 }
 
 
+int can_read_batch(intptr_t fd, can_msg_t *msgs, int max_msgs) {
+	can_msg_batch_t batch;
+	iov_t send_iov, reply_iov;
+	int status;
+	can_dev_handle_t *phdl = (can_dev_handle_t *) fd;
+	int real_fd = phdl->fd;
+	int count;
+
+	if (max_msgs > CAN_MAX_BATCH)
+		max_msgs = CAN_MAX_BATCH;
+
+	if (phdl->shm != NULL) {
+		/* Read in place, and only wait if every message was read. */
+		while ((count = can_pop_shm(phdl, msgs, max_msgs)) == 0)
+			if (can_wait_pulse(phdl) == -1)
+				return -1;
+		return count;
+	}
+
+	/* Only the count is sent to the manager, which replies with as many
+	 * messages as the batch holds. As above, the pulse is only waited for
+	 * once every message was read. */
+	SETIOV(&send_iov, &batch, offsetof(can_msg_batch_t, msgs));
+	SETIOV(&reply_iov, &batch, sizeof(batch));
+	while (true) {
+		batch.count = max_msgs;
+		status = devctlv(real_fd, DCMD_CAN_READ_BATCH, 1, 1, &send_iov,
+				&reply_iov, NULL);
+		if (status != EOK && !can_conn_lost(status)) {
+			printf("can_read_batch: devctl error %d\n", status);
+			return -1;
+		}
+		if (status == EOK && batch.count != 0)
+			break;
+		if (can_wait_pulse(phdl) == -1)
+			return -1;
+	}
+
+	memcpy(msgs, batch.msgs, batch.count * sizeof(can_msg_t));
+
+#ifdef DO_TRACE
+	printf("can_read_batch: %d messages\n", batch.count);
+#endif
+	return batch.count;
+}
+
+
 int can_write(intptr_t fd, unsigned long id, char extended, void *data,
-		BYTE size) {
+		BYTE size, unsigned int ttl_ms, uint64_t tx_time_ns) {
 	can_dev_handle_t *phdl = (can_dev_handle_t*) fd;
 	int real_fd = phdl->fd;
 	can_msg_t msg;
+	int status;
 
+	memset(&msg, 0, sizeof(msg));
 	msg.size = size > 8 ? 8 : size;
 	msg.id = id;
+	msg.tx_ttl_ms = ttl_ms;
+	msg.tx_time_ns = tx_time_ns;
 
 	if (extended) SET_EXTENDED_FRAME(msg);
 
 	memcpy(msg.data, data, msg.size);
 
-	return devctl(real_fd, DCMD_CAN_I82527_WRITE, (void *) &msg,
+	status = devctl(real_fd, DCMD_CAN_I82527_WRITE, (void *) &msg,
 			sizeof(msg), NULL);
+	if (can_conn_lost(status) && can_reconnect(phdl) == 0)
+		status = devctl(phdl->fd, DCMD_CAN_I82527_WRITE, (void *) &msg,
+				sizeof(msg), NULL);
+	return status;
+}
+
+
+int can_write_batch(intptr_t fd, can_msg_t *msgs, int num_msgs) {
+	can_dev_handle_t *phdl = (can_dev_handle_t*) fd;
+	can_msg_batch_t batch;
+	int status;
+
+	if (num_msgs < 0 || num_msgs > CAN_MAX_BATCH)
+		return -1;
+
+	batch.count = num_msgs;
+	memcpy(batch.msgs, msgs, num_msgs * sizeof(can_msg_t));
+
+	/* Only the messages are sent, and only the count comes back. */
+	status = devctl(phdl->fd, DCMD_CAN_WRITE_BATCH, (void *) &batch,
+			offsetof(can_msg_batch_t, msgs) + num_msgs * sizeof(can_msg_t),
+			NULL);
+	if (can_conn_lost(status) && can_reconnect(phdl) == 0)
+		status = devctl(phdl->fd, DCMD_CAN_WRITE_BATCH, (void *) &batch,
+				offsetof(can_msg_batch_t, msgs) + num_msgs * sizeof(can_msg_t),
+				NULL);
+	if (status != EOK) {
+		printf("can_write_batch: devctl error %d\n", status);
+		return -1;
+	}
+	return batch.count;
 }
 
 
@@ -247,12 +737,172 @@ int can_send(int fd, j1939_pdu_typ *pdu) {
 	printf("\n");
 #endif
 
-	status = can_write(fd, id, 1, &pdu->data_field,
-		(BYTE) (pdu->num_bytes & 0xff));
+	BYTE data[8];
+	for (int i = 0; i < 8; i++)
+		data[i] = (BYTE) pdu->data_field[i];
+
+	status = can_write(fd, id, 1, data, (BYTE) (pdu->num_bytes & 0xff));
 
-	if (status == -1) {
-		fprintf(stderr, "send_can: can_write failed\n");
+	/* can_write returns the error of the devctl, e.g. EAGAIN if the queue of
+	 * the driver is full or EPERM on a listen-only channel. */
+	if (status != EOK) {
+		fprintf(stderr, "send_can: can_write failed, error %d\n", status);
 		return 0;
 	} else
 		return 1;
 }
+
+
+int can_send_batch(int fd, j1939_pdu_typ *pdus, int num_pdus,
+		uint64_t tx_time_ns) {
+	can_msg_t msgs[CAN_MAX_BATCH];
+	int num_queued;
+
+	if (num_pdus < 0 || num_pdus > CAN_MAX_BATCH)
+		return -1;
+
+	memset(msgs, 0, num_pdus * sizeof(can_msg_t));
+	for (int i = 0; i < num_pdus; i++) {
+		msgs[i].id = PATH_CAN_ID(&pdus[i]);
+		SET_EXTENDED_FRAME(msgs[i]);
+		msgs[i].size = pdus[i].num_bytes > 8 ? 8 : pdus[i].num_bytes;
+		for (int j = 0; j < msgs[i].size; j++)
+			msgs[i].data[j] = (BYTE) pdus[i].data_field[j];
+		msgs[i].tx_time_ns = tx_time_ns;
+		msgs[i].tx_flags = CAN_TX_REPLACE;
+	}
+
+	num_queued = can_write_batch(fd, msgs, num_pdus);
+	if (num_queued < num_pdus)
+		fprintf(stderr, "can_send_batch: %d of %d messages queued\n",
+				num_queued, num_pdus);
+	return num_queued;
+}
+
+
+/** Map the payloads of the periodic messages into the client process.
+ *
+ * @param phdl
+ * 		handle of the CAN device
+ * @param info
+ * 		shared memory object holding the payloads, as returned by
+ * 		DCMD_CAN_CYCLIC_START
+ * @return
+ * 		0 for success, or -1 if the payloads could not be mapped
+ */
+static int can_map_cyclic(can_dev_handle_t *phdl, can_shm_info_t *info) {
+	can_cyclic_shm_t *pshm;
+	int shm_fd;
+	void *addr;
+
+	info->name[CAN_SHM_NAME_MAX - 1] = '\0';
+	if (info->size != sizeof(can_cyclic_shm_t)) {
+		fprintf(stderr, "can_cyclic_start: %s has %d bytes, expected %d\n",
+				info->name, info->size, (int) sizeof(can_cyclic_shm_t));
+		return -1;
+	}
+
+	if ((shm_fd = shm_open(info->name, O_RDWR, 0)) == -1) {
+		perror("can_cyclic_start: shm_open");
+		return -1;
+	}
+	addr = mmap(NULL, sizeof(can_cyclic_shm_t), PROT_READ | PROT_WRITE,
+			MAP_SHARED, shm_fd, 0);
+	close(shm_fd);
+	if (addr == MAP_FAILED) {
+		perror("can_cyclic_start: mmap");
+		return -1;
+	}
+
+	pshm = (can_cyclic_shm_t *) addr;
+	if (pshm->magic != CAN_CYCLIC_SHM_MAGIC ||
+			pshm->version != CAN_CYCLIC_SHM_VERSION) {
+		fprintf(stderr, "can_cyclic_start: %s has an unknown layout\n",
+				info->name);
+		munmap(addr, sizeof(can_cyclic_shm_t));
+		return -1;
+	}
+
+	phdl->cyclic = pshm;
+	return 0;
+}
+
+
+int can_cyclic_start(intptr_t fd, unsigned long id, char extended, void *data,
+		BYTE size, unsigned int period_ms) {
+	can_dev_handle_t *phdl = (can_dev_handle_t *) fd;
+	can_cyclic_t cyclic;
+	int status;
+
+	memset(&cyclic, 0, sizeof(cyclic));
+	cyclic.msg.id = id;
+	cyclic.msg.size = size > 8 ? 8 : size;
+	if (extended) SET_EXTENDED_FRAME(cyclic.msg);
+	memcpy(cyclic.msg.data, data, cyclic.msg.size);
+	cyclic.period_ms = period_ms;
+
+	status = devctl(phdl->fd, DCMD_CAN_CYCLIC_START, (void *) &cyclic,
+			sizeof(cyclic), NULL);
+	if (status != EOK) {
+		printf("can_cyclic_start: devctl error %d\n", status);
+		return -1;
+	}
+
+	/* The payloads of every message of the channel are in the same object. */
+	if (phdl->cyclic == NULL && can_map_cyclic(phdl, &cyclic.shm) == -1) {
+		can_cyclic_stop(fd, cyclic.slot);
+		return -1;
+	}
+	return cyclic.slot;
+}
+
+
+int can_cyclic_update(intptr_t fd, int slot, void *data, BYTE size) {
+	can_dev_handle_t *phdl = (can_dev_handle_t *) fd;
+	can_payload_t payload;
+
+	if (phdl->cyclic == NULL || slot < 0 || slot >= CAN_MAX_CYCLIC)
+		return -1;
+	/* A restarted manager that did not keep the messages cleared it. */
+	if (phdl->cyclic->magic != CAN_CYCLIC_SHM_MAGIC)
+		return -1;
+
+	memset(&payload, 0, sizeof(payload));
+	payload.size = size > 8 ? 8 : size;
+	memcpy(payload.data, data, payload.size);
+	phdl->cyclic->slots[slot].value.store(payload);
+	return 0;
+}
+
+
+int can_cyclic_stop(intptr_t fd, int slot) {
+	can_dev_handle_t *phdl = (can_dev_handle_t *) fd;
+
+	return devctl(phdl->fd, DCMD_CAN_CYCLIC_STOP, (void *) &slot,
+			sizeof(slot), NULL);
+}
+
+
+int can_send_cyclic(int fd, j1939_pdu_typ *pdu, unsigned int period_ms) {
+	BYTE data[8];
+	int slot;
+
+	for (int i = 0; i < 8; i++)
+		data[i] = (BYTE) pdu->data_field[i];
+
+	slot = can_cyclic_start(fd, PATH_CAN_ID(pdu), 1, data,
+			(BYTE) (pdu->num_bytes & 0xff), period_ms);
+	if (slot == -1)
+		fprintf(stderr, "can_send_cyclic: can_cyclic_start failed\n");
+	return slot;
+}
+
+
+int can_update_cyclic(int fd, int slot, j1939_pdu_typ *pdu) {
+	BYTE data[8];
+
+	for (int i = 0; i < 8; i++)
+		data[i] = (BYTE) pdu->data_field[i];
+
+	return can_cyclic_update(fd, slot, data, (BYTE) (pdu->num_bytes & 0xff));
+}
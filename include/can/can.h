@@ -15,25 +15,32 @@
 
 #include "utils/common.h"		/* BYTE */
 #include "jbus/j1939_struct.h"
+#include "can_man.h"		/* can_msg_t */
 #include <string>
 
 
 /** Initialize the CAN driver.
  *
  * This function is called from the main() during the initialization of the CAN
- * driver to read the .ini file and initialize the can_info structure, and
- * initialize the function tables.
+ * driver to read the .ini file and initialize the can_info structure of every
+ * channel, and initialize the function tables.
  *
  * Additional Arguments:
  *
+ * - -c: CPU running the channel thread
  * - -e: specifies extended frame
  * - -f: specifies whether to create a copy of pconfig (not modify the original)
  * - -i: interrupt request line
- * - -n: device name
+ * - -n: device name. Every -n after the first adds a channel.
  * - -p: port
+ * - -r: Rx frames/s above which the chip is polled
  * - -s: bit speed
+ * - -t: poll period, in us
  * - -v: verbose
  *
+ * The channel options (-c, -e, -i, -n, -p, -r, -s, -t) apply to the channel
+ * named by the last -n, or to the first channel before any -n.
+ *
  * @param argc
  * 		see additional arguments
  * @param argv
@@ -45,17 +52,25 @@
  * 		table of the POSIX-level I/O functions that are used by a resource
  * 		manager. The devctl handle is updated to support interrupt handling on
  * 		the CAN card port
- * @param pattr
- * 		pointer to information per device manager
+ * @param pattrs
+ * 		information per device manager, one per channel
+ * @param max_channels
+ * 		number of elements in pattrs
+ * @return
+ * 		number of channels that were initialized
  */
-extern void can_init(int argc, char *argv[], resmgr_connect_funcs_t *pconn,
-	resmgr_io_funcs_t *pio, IOFUNC_ATTR_T *pattr);
+extern int can_init(int argc, char *argv[], resmgr_connect_funcs_t *pconn,
+	resmgr_io_funcs_t *pio, IOFUNC_ATTR_T *pattrs, int max_channels);
 
 
 /** Set the CAN filter.
  *
  * Internal to the driver, set as part of open for read
  *
+ * The filter only applies to the messages read through this file descriptor;
+ * other clients of the channel keep their own. The chip is loaded with the
+ * filters of every armed client (see can_dev_load_filters).
+ *
  * @param fd
  * 		file descriptor for the location of the CAN card
  * @param id
@@ -82,6 +97,46 @@ extern void can_init(int argc, char *argv[], resmgr_connect_funcs_t *pconn,
 extern int can_set_filter(int fd, unsigned long id, unsigned long mask);
 
 
+/** Set two CAN filters.
+ *
+ * A message is accepted if it passes either filter. Uses the dual filter mode
+ * of the chip, which only compares bits 28-13 of 29 bit identifiers; the
+ * driver checks the remaining bits in software.
+ *
+ * @param fd
+ * 		file descriptor for the location of the CAN card
+ * @param id1
+ * 		CAN message format ID of the first filter
+ * @param mask1
+ * 		requested filter mask of the first filter
+ * @param id2
+ * 		CAN message format ID of the second filter
+ * @param mask2
+ * 		requested filter mask of the second filter
+ * @return
+ * 		EOK for success, otherwise see can_set_filter
+ */
+extern int can_set_dual_filter(int fd, unsigned long id1, unsigned long mask1,
+		unsigned long id2, unsigned long mask2);
+
+
+/** Enable or disable the self test mode of the CAN driver.
+ *
+ * In self test mode, the chip receives every message it sends, without
+ * another node on the bus, so the messages written by a client are read back
+ * by every client of the device (see CANDeviceManager::set_self_test). Meant
+ * for qualifying the CAN path of a computer, not for a bus in use.
+ *
+ * @param fd
+ * 		file descriptor for the location of the CAN card
+ * @param enable
+ * 		1 to enter self test mode, 0 to go back to normal mode
+ * @return
+ * 		EOK for success, otherwise the error returned by devctl
+ */
+extern int can_set_self_test(int fd, int enable);
+
+
 /** Empty the queue of messages in the CAN driver.
  *
  * This is internal to the driver, and done as part of open for read
@@ -94,6 +149,33 @@ extern int can_set_filter(int fd, unsigned long id, unsigned long mask);
 extern int can_empty_queue(int fd);
 
 
+/** Get the statistics of the CAN driver.
+ *
+ * The statistics do not depend on the client, so the device does not need to
+ * be armed.
+ *
+ * @param fd
+ * 		file descriptor for the location of the CAN card
+ * @param stats
+ * 		updated with the statistics of the driver
+ * @return
+ * 		EOK for success, otherwise the error returned by devctl
+ */
+extern int can_get_stats(int fd, can_stats_t *stats);
+
+
+/** Reset the error counts and statistics of the CAN driver.
+ *
+ * @param fd
+ * 		file descriptor for the location of the CAN card
+ * @param errs
+ * 		updated with the error counts before the reset. May be NULL.
+ * @return
+ * 		EOK for success, otherwise the error returned by devctl
+ */
+extern int can_clear_errs(int fd, can_err_count_t *errs);
+
+
 /** Enable pulses from the CAN driver to the client process.
  *
  * Pulses are waited for with MsgReceive or IP_Receive. Internal to the driver,
@@ -103,6 +185,11 @@ extern int can_empty_queue(int fd);
  * 		file descriptor for the location of the CAN card
  * @param channel_id
  * 		The ID of the channel that can be used to receive messages and pulses
+ * @param pcoid
+ * 		if not NULL, connection to channel_id the pulses are delivered on, or
+ * 		-1 to open one, in which case it is set to the new connection once
+ * 		the pulse is registered. Passing back the connection of an earlier
+ * 		call arms the device again without opening another connection.
  * @return
  * 		EOK    - Success.\n
  * 		EAGAIN - The devctl() command couldn't be completed because the device
@@ -120,13 +207,45 @@ extern int can_empty_queue(int fd);
  * 		EPERM  - The process doesn't have sufficient permission to carry out the
  * 				 requested command.
  */
-extern int can_arm(int fd, int channel_id);
+extern int can_arm(int fd, int channel_id, int *pcoid = NULL);
+
+
+/** Map the input rings of the CAN driver into the client process.
+ *
+ * Once mapped, can_read and can_read_batch copy the messages straight out of
+ * the rings of the driver, and only wait for the pulse registered with can_arm
+ * when every message was read. Done as part of open for read. The filters
+ * set with can_set_filter before are applied to the messages read in place.
+ *
+ * The rings outlive a restart of the driver. While waiting, the connection is
+ * checked every CAN_RECONNECT_CHECK_MS, and the device is opened and armed
+ * again once the driver is back. The client then keeps reading where it was,
+ * without losing the messages received in the meantime, unless the driver had
+ * to create new rings.
+ *
+ * @param fd
+ * 		handle of the CAN device, as returned by JBus::init
+ * @return
+ * 		0 for success, or -1 if the rings could not be mapped, in which case the
+ * 		messages are still read through devctl
+ */
+extern int can_map_shm(intptr_t fd);
+
+
+/** Unmap the input ring mapped by can_map_shm, and the payloads of the
+ * periodic messages mapped by can_cyclic_start.
+ *
+ * @param fd
+ * 		handle of the CAN device, as returned by JBus::init
+ */
+extern void can_unmap_shm(intptr_t fd);
 
 
 /** Read information from the CAN card.
  *
  * This message will update the ID, message format, and data field of a CAN
- * message.
+ * message. The pulse from the CAN driver is only waited for if no message is
+ * queued.
  *
  * @param fd
  * 		file descriptor for the location of the CAN card
@@ -140,14 +259,42 @@ extern int can_arm(int fd, int channel_id);
  * 		method.
  * @param size
  * 		number of bytes in the CAN data field
+ * @param rx_time_ns
+ * 		if not NULL, updated with the monotonic time the message was read from
+ * 		the CAN chip, in ns (see get_monotonic_ns)
  * @return
  * 		number of bytes in the data segment; -1 if error encountered
  */
 extern int can_read(intptr_t fd, unsigned long *id, char *extended, void *data,
-	BYTE size);
+	BYTE size, uint64_t *rx_time_ns = NULL);
+
+
+/** Read a burst of messages from the CAN card.
+ *
+ * Collects every message that is queued (up to max_msgs) with a single
+ * devctl, instead of one devctl per message as in can_read. If the input ring
+ * is mapped (see can_map_shm), the queued messages are read in place instead.
+ * The pulse from the CAN driver is only waited for if no message is queued.
+ *
+ * @param fd
+ * 		file descriptor for the location of the CAN card
+ * @param msgs
+ * 		array that is updated with the messages. The safety-critical messages
+ * 		(see CAN_RX_LANE_SAFETY) come first, then the others, oldest first in
+ * 		each group. Must have room for max_msgs elements.
+ * @param max_msgs
+ * 		largest number of messages to read. Values above CAN_MAX_BATCH are
+ * 		reduced to CAN_MAX_BATCH.
+ * @return
+ * 		number of messages read, at least 1; -1 if error encountered
+ */
+extern int can_read_batch(intptr_t fd, can_msg_t *msgs, int max_msgs);
 
 
 /** Write information to the CAN card.
+ *
+ * If the driver was restarted, the device is opened again and the message
+ * written once more.
  *
  * @param fd
  * 		file descriptor for the location of the CAN card
@@ -159,6 +306,11 @@ extern int can_read(intptr_t fd, unsigned long *id, char *extended, void *data,
  * 		the content of the data field
  * @param size
  * 		number of bytes to be added to the data field
+ * @param ttl_ms
+ * 		time after which the message is dropped if it could not be sent, in
+ * 		ms. 0 for the default of the driver (CAN_TX_DEFAULT_TTL_MS). Messages
+ * 		are sent in order of J1939 priority, and messages with the same
+ * 		priority in the order they were written.
  * @return
  * 		EOK	   - Success.\n
  * 		EAGAIN - The devctl() command couldn't be completed because the device
@@ -177,7 +329,28 @@ extern int can_read(intptr_t fd, unsigned long *id, char *extended, void *data,
  * 				 requested command.\n
  */
 extern int can_write(intptr_t fd, unsigned long id, char extended, void *data,
-	BYTE size);
+	BYTE size, unsigned int ttl_ms = 0, uint64_t tx_time_ns = 0);
+
+
+/** Write several messages to the CAN card with a single devctl.
+ *
+ * Each message is scheduled as in can_write, according to its tx_ttl_ms and
+ * tx_time_ns fields. Messages with a tx_time_ns in the future are held by the
+ * driver and sent once that time is reached. A message with CAN_TX_REPLACE in
+ * its tx_flags replaces the message with the same PGN and addresses the driver
+ * may still hold (see can_tx_queue_key).
+ *
+ * @param fd
+ * 		file descriptor for the location of the CAN card
+ * @param msgs
+ * 		the messages to write. Use SET_EXTENDED_FRAME for 29 bit identifiers.
+ * @param num_msgs
+ * 		number of messages in msgs, at most CAN_MAX_BATCH
+ * @return
+ * 		number of messages queued, which is less than num_msgs if the output
+ * 		queue of the driver is full; -1 if error encountered
+ */
+extern int can_write_batch(intptr_t fd, can_msg_t *msgs, int num_msgs);
 
 
 /** FIXME (merge with can_write)
@@ -190,9 +363,130 @@ extern int can_write(intptr_t fd, unsigned long id, char extended, void *data,
  * @param pdu
  * 		message to send
  * @return
- * 		0 on error, 1 on success.
+ * 		0 on error, including a full queue or a listen-only channel, 1 on
+ * 		success.
  */
 extern int can_send(int fd, j1939_pdu_typ *pdu);
 
 
+/** Send several J1939 messages with a single devctl.
+ *
+ * Used to send the commands of a control cycle together, e.g. the TSC1 of the
+ * engine and of the retarder and the brake request. Only the latest command
+ * matters, so each message replaces the one with the same PGN and addresses
+ * that the driver may still hold (see CAN_TX_REPLACE).
+ *
+ * @param fd
+ * 		file descriptor that is used when sending the messages
+ * @param pdus
+ * 		messages to send
+ * @param num_pdus
+ * 		number of messages in pdus, at most CAN_MAX_BATCH
+ * @param tx_time_ns
+ * 		monotonic time at which the messages are sent, in ns (see
+ * 		get_monotonic_ns). 0 to send them at once.
+ * @return
+ * 		number of messages queued; -1 on error
+ */
+extern int can_send_batch(int fd, j1939_pdu_typ *pdus, int num_pdus,
+		uint64_t tx_time_ns = 0);
+
+
+/** Have the CAN driver send a message periodically.
+ *
+ * The driver sends the message at once, and then every period_ms from its own
+ * timer, so the jitter of the message does not depend on the scheduling of the
+ * client. The payload is then changed with can_cyclic_update, which writes it
+ * to shared memory without a devctl. Starting a message that the client
+ * already sends (same PGN and addresses) changes its period and payload.
+ *
+ * The message is stopped by can_cyclic_stop, or when the client closes the
+ * device. A driver that is restarted keeps sending it, unless it had to
+ * create the payloads again, which can_cyclic_update then reports. Only the
+ * owner and the group of the device may write the payloads, so the client must
+ * run as one of them.
+ *
+ * @param fd
+ * 		handle of the CAN device, as returned by JBus::init
+ * @param id
+ * 		CAN device id on bus
+ * @param extended
+ * 		0 for standard (11 bit) format, 1 for extended (29 bit) format
+ * @param data
+ * 		the first content of the data field
+ * @param size
+ * 		number of bytes in the data field
+ * @param period_ms
+ * 		time between two transmissions, in ms (e.g. 10 for TSC1)
+ * @return
+ * 		slot of the message, passed to can_cyclic_update and can_cyclic_stop;
+ * 		-1 if error encountered
+ */
+extern int can_cyclic_start(intptr_t fd, unsigned long id, char extended,
+		void *data, BYTE size, unsigned int period_ms);
+
+
+/** Change the payload of a periodic message.
+ *
+ * The payload is written to shared memory, and sent from the next period on.
+ * No message is exchanged with the driver, so this may be called every
+ * control cycle.
+ *
+ * @param fd
+ * 		handle of the CAN device, as passed to can_cyclic_start
+ * @param slot
+ * 		slot of the message, as returned by can_cyclic_start
+ * @param data
+ * 		the new content of the data field
+ * @param size
+ * 		number of bytes in the data field
+ * @return
+ * 		0 for success, or -1 if the slot is invalid or the driver was restarted
+ * 		without the message, which must then be started again
+ */
+extern int can_cyclic_update(intptr_t fd, int slot, void *data, BYTE size);
+
+
+/** Stop sending a periodic message.
+ *
+ * @param fd
+ * 		handle of the CAN device, as passed to can_cyclic_start
+ * @param slot
+ * 		slot of the message, as returned by can_cyclic_start
+ * @return
+ * 		EOK for success, otherwise the error returned by devctl
+ */
+extern int can_cyclic_stop(intptr_t fd, int slot);
+
+
+/** Have the CAN driver send a J1939 message periodically.
+ *
+ * See can_cyclic_start.
+ *
+ * @param fd
+ * 		file descriptor that is used when sending the message
+ * @param pdu
+ * 		message to send
+ * @param period_ms
+ * 		time between two transmissions, in ms
+ * @return
+ * 		slot of the message; -1 on error
+ */
+extern int can_send_cyclic(int fd, j1939_pdu_typ *pdu, unsigned int period_ms);
+
+
+/** Change the payload of a J1939 message started by can_send_cyclic.
+ *
+ * @param fd
+ * 		file descriptor that is used when sending the message
+ * @param slot
+ * 		slot of the message, as returned by can_send_cyclic
+ * @param pdu
+ * 		message with the new data field
+ * @return
+ * 		0 for success, or -1 if the slot is invalid
+ */
+extern int can_update_cyclic(int fd, int slot, j1939_pdu_typ *pdu);
+
+
 #endif /* SRC_JBUS_CAN_H_ */
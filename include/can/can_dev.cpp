@@ -14,12 +14,14 @@
 
 #include <sys/mman.h>
 #include "can_man.h"
-#include "utils/buffer.h"
+#include "utils/ring.h"
 #include "sja1000.h"
 #include "delay.h"		/* atomic_t */
+#include "utils/timestamp.h"
+#include "jbus/j1939_utils.h"	/* EBC1, EEC1, CCVS, ETC1 */
 
 
-canregs_t *can_base_addr;	//FIXME
+canregs_t *can_base_addr[MAX_CHANNELS];
 
 /* timing values */
 static BYTE CanTiming[10][2] = {
@@ -35,30 +37,159 @@ static BYTE CanTiming[10][2] = {
 };
 
 
-void CANDeviceManager::init(unsigned int base_address, unsigned int bit_speed,
-		BYTE extended_frame) {
+/** Add a duration to a histogram. */
+static void hist_add(can_hist_t *hist, uint64_t duration_ns) {
+	unsigned int us = (unsigned int) (duration_ns / 1000);
+	unsigned int bin = 0;
+
+	while (bin < CAN_HIST_BINS - 1 && (us >> bin) != 0)
+		bin++;
+	hist->bins[bin]++;
+	hist->count++;
+	hist->total_us += us;
+	if (us > hist->max_us)
+		hist->max_us = us;
+}
+
+
+/** Return the PGN of a 29 bit frame, without destination address. */
+static unsigned int msg_pgn(const can_msg_t &msg) {
+	unsigned int pgn = (CAN_ID(msg) >> 8) & 0x3FFFF;
+
+	/* The PDU specific field of PDU1 format (PF below 240) PGNs is the
+	 * destination address. */
+	if (((pgn >> 8) & 0xFF) < 240)
+		pgn &= 0x3FF00;
+	return pgn;
+}
+
+
+/** Return the lane of the input rings a received frame is queued in. */
+static int rx_lane(const can_msg_t &msg) {
+	if (!IS_EXTENDED_FRAME(msg))
+		return CAN_RX_LANE_GENERAL;
+
+	switch (msg_pgn(msg)) {
+	case EBC1:
+	case EEC1:
+	case CCVS:
+	case ETC1:
+		return CAN_RX_LANE_SAFETY;
+	default:
+		return CAN_RX_LANE_GENERAL;
+	}
+}
+
+
+/** Whether a filter only accepts 11 bit (standard) frames. */
+static bool is_std_filter(can_filter_t filter) {
+	return (filter.mask & 0x80000000) && !(filter.id & 0x80000000);
+}
+
+
+void CANDeviceManager::_map(int channel, unsigned int base_address,
+		unsigned int bit_speed) {
+	this->_channel = channel;
+	this->_baud[channel] = bit_speed;
+	this->_mode_start = this->_window_start = get_monotonic_ns();
+	this->_load_start = this->_mode_start;
+
+	/* init may follow a failed restart, which already mapped the registers. */
+	if (this->_base_addr != NULL)
+		return;
+#ifdef CAN_EMULATOR
+	this->_base_addr = sja1000_emu_map(channel);
+	can_base_addr[channel] = this->_base_addr;
+
+	printf("Channel %d: using an emulated SJA1000\n", channel);
+#else
 	this->_base_addr = (canregs_t *) mmap_device_memory(NULL,
 		SJA1000_MAP_SIZE, PROT_READ | PROT_WRITE | PROT_NOCACHE,
 		0, base_address);
-	can_base_addr = this->_base_addr;	// FIXME
+	can_base_addr[channel] = this->_base_addr;
+
+	printf("Channel %d: using memory mapped access, 0x%08x mapped to 0x%08x\n",
+		channel, base_address, (intptr_t) this->_base_addr);
+#endif
+}
 
-	printf("Using memory mapped access, 0x%08x mapped to 0x%08x\n",
-		base_address, (intptr_t) this->_base_addr);
+
+void CANDeviceManager::init(int channel, unsigned int base_address,
+		unsigned int bit_speed, BYTE extended_frame) {
+	this->_map(channel, base_address, bit_speed);
 	printf("speed %d, %s\n", bit_speed,
 		extended_frame?"extended frame":"standard frame");
 	fflush(stdout);
 
 	/** Set up variables used to set up timing and acceptance. */
-	this->_baud[MY_CHANNEL] = bit_speed;
-	this->_acc_code[MY_CHANNEL] = 0x00000000;
-	this->_acc_mask[MY_CHANNEL] = 0xFFFFFFFF;  // Accept everything
-
-	if (this->_reset_chip(MY_CHANNEL) < 0)
+	this->_acc_code[this->_channel] = 0x00000000;
+	this->_acc_mask[this->_channel] = 0xFFFFFFFF;  // Accept everything
+	this->_acc_dual[this->_channel] = false;
+	this->_filter[this->_channel][0].id = 0;
+	this->_filter[this->_channel][0].mask = 0;
+	this->_num_filters[this->_channel] = 1;
+	this->_sw_filter[this->_channel][0] = false;
+	this->_sw_filter[this->_channel][1] = false;
+
+	if (this->_reset_chip(this->_channel) < 0)
 		printf("Error returned from SJA1000 reset\n");
 	else
-		this->_start_chip(MY_CHANNEL);
+		this->_start_chip(this->_channel);
 
-	printf("Phillips SJA1000 started, mode 0x%08x\n", CANin(0, canmode));
+	printf("Phillips SJA1000 started, mode 0x%08x\n", CANin(this->_channel, canmode));
+}
+
+
+bool CANDeviceManager::restart(int channel, unsigned int base_address,
+		unsigned int bit_speed) {
+	BYTE tim0, tim1;
+	int minor = channel;
+
+	this->_map(channel, base_address, bit_speed);
+
+	/* The chip must still be on the bus, with the settings init gave it. A
+	 * board that was power cycled is back in reset mode. A chip that would
+	 * acknowledge frames while a tap is wanted, or the other way round, is
+	 * reset. */
+	this->_get_timing(bit_speed, &tim0, &tim1);
+	if ((CANin(minor, canmode) & CAN_RESET_REQUEST) ||
+			(CANin(minor, canclk) & CAN_MODE_PELICAN) != CAN_MODE_PELICAN ||
+			CANin(minor, cantim0) != tim0 || CANin(minor, cantim1) != tim1 ||
+			((CANin(minor, canmode) & CAN_LISTEN_ONLY_MODE) != 0) !=
+					this->_listen_only ||
+			this->_state->num_filters < 1 || this->_state->num_filters > 2)
+		return false;
+
+	/* The acceptance registers still hold the filters of the last manager,
+	 * so only the software side of the filters is rebuilt. */
+	this->_num_filters[minor] = this->_state->num_filters;
+	this->_acc_dual[minor] = (this->_state->num_filters == 2);
+	this->_filter[minor][0] = this->_state->filter[0];
+	this->_filter[minor][1] = this->_state->filter[1];
+	this->_compile_filters(minor);
+	this->_hw_code[minor] = this->_acc_code[minor];
+	this->_hw_mask[minor] = this->_acc_mask[minor];
+	this->_hw_dual[minor] = this->_acc_dual[minor];
+	this->_hw_loaded[minor] = true;
+
+	/* The chip may have been left in self test mode. */
+	this->_self_test = CANin(minor, canmode) & CAN_SELF_TEST_MODE;
+
+	/* A transmission may be under way. If its interrupt was lost with the last
+	 * manager, _send_if_idle gives up on it after CAN_TX_TIMEOUT_MS. */
+	this->_tx_busy = !(CANin(minor, canstat) & CAN_TRANSMIT_BUFFER_ACCESS);
+	this->_last_time_can_sent = get_monotonic_ns();
+
+	/* The frames received in the meantime are still in the Rx FIFO, and raise
+	 * the receive interrupt again once it is attached. */
+	CANset(minor, canirq_enable, (CAN_OVERRUN_INT_ENABLE +
+								  CAN_ERROR_INT_ENABLE +
+								  (this->_listen_only ? 0 : CAN_TRANSMIT_INT_ENABLE) +
+								  (this->_polling ? 0 : CAN_RECEIVE_INT_ENABLE)));
+
+	printf("Phillips SJA1000 taken over, mode 0x%08x\n", CANin(minor, canmode));
+	fflush(stdout);
+	return true;
 }
 
 
@@ -75,15 +206,23 @@ int CANDeviceManager::_start_chip(int minor) {
     /* clear interrupts, value not used */
     CANin(minor, canirq);
 
-    /* Interrupts on Rx, TX, any Status change and data overrun */
+    /* Interrupts on Rx, TX, any Status change and data overrun. Rx frames
+     * are read by poll() instead while polling, and nothing is sent in listen
+     * only mode. */
     CANset(minor, canirq_enable, (CAN_OVERRUN_INT_ENABLE +
     							  CAN_ERROR_INT_ENABLE +
-                                  CAN_TRANSMIT_INT_ENABLE +
-                                  CAN_RECEIVE_INT_ENABLE));
+                                  (this->_listen_only ? 0 : CAN_TRANSMIT_INT_ENABLE) +
+                                  (this->_polling ? 0 : CAN_RECEIVE_INT_ENABLE)));
 
     CANreset(minor, canmode, CAN_RESET_REQUEST);
     DBGprint(DBG_DATA,("start mode=0x%x", CANin(minor, canmode)));
 
+    /* A message loaded into the chip was aborted by the reset, and is queued
+     * again by requeue_aborted. */
+    if (this->_tx_busy)
+    	this->_tx_aborted = true;
+    this->_tx_busy = false;
+
     DBGout();
     return 0;
 }
@@ -112,19 +251,35 @@ int CANDeviceManager::_reset_chip(int minor) {
 
     /* select mode: Basic or PeliCAN */
     CANout(minor, canclk, CAN_MODE_PELICAN + CAN_MODE_CLK);
-    CANout(minor, canmode, CAN_RESET_REQUEST + CAN_MODE_DEF);
+    CANout(minor, canmode, CAN_RESET_REQUEST + this->_mode_bits(minor));
 
     /* Board specific output control (Janus MM board) */
     CANout(minor, canoutc, 0xda);
 
     this->_set_timing(minor, this->_baud[minor]);
-    this->_set_mask(minor, this->_acc_code[minor], this->_acc_mask[minor]);
+    this->_write_acceptance(minor);
     DBGprint(DBG_DATA, ("[%d] CAN_mode 0x%x", minor, CANin(minor, canmode)));
 
     DBGout();
     return 0;
 }
 
+
+BYTE CANDeviceManager::_mode_bits(int minor) {
+	return (this->_acc_dual[minor] ? 0 : CAN_MODE_DEF) +
+			(this->_self_test ? CAN_SELF_TEST_MODE : 0) +
+			(this->_listen_only ? CAN_LISTEN_ONLY_MODE : 0);
+}
+
+
+int CANDeviceManager::_load_mode(int minor) {
+	/* These bits can only be written in reset mode. */
+	this->_stop_chip(minor);
+	CANout(minor, canmode, CAN_RESET_REQUEST + this->_mode_bits(minor));
+
+	return this->_start_chip(minor);
+}
+
 /* -------------------------------------------------------------------------- */
 /* ----------------------------- Miscellaneous ------------------------------ */
 /* -------------------------------------------------------------------------- */
@@ -133,6 +288,11 @@ int CANDeviceManager::_reset_chip(int minor) {
 CANDeviceManager::~CANDeviceManager() {};
 
 
+void CANDeviceManager::set_state(can_dev_state_t *state) {
+	this->_state = state;
+}
+
+
 /** Global per channel variables from sja1000funcs.c
  *  For PATH driver, each channel has a separate driver, so MAX_CHANNELS is 1
  *  Most of these are not really used in the PATH CAN driver for QNX6.
@@ -141,23 +301,112 @@ atomic_t Can_isopen[MAX_CHANNELS];
 
 
 can_err_count_t CANDeviceManager::clear_errs() {
-	this->_errs.intr_in_handler_count = 0;
-	this->_errs.tx_interrupt_count = 0;
-	this->_errs.rx_interrupt_count = 0;
-	this->_errs.shadow_buffer_count = 0;
-	this->_errs.rx_message_lost_count = 0;
-	return this->_errs;
+	this->_state->errs.intr_in_handler_count = 0;
+	this->_state->errs.tx_interrupt_count = 0;
+	this->_state->errs.rx_interrupt_count = 0;
+	this->_state->errs.shadow_buffer_count = 0;
+	this->_state->errs.rx_message_lost_count = 0;
+	this->_state->errs.rx_ring_full_count = 0;
+	this->_state->errs.rx_filtered_count = 0;
+	this->_state->errs.tx_expired_count = 0;
+	this->_state->errs.tx_replaced_count = 0;
+	this->_state->errs.intr_mode_ms = 0;
+	this->_state->errs.poll_mode_ms = 0;
+	this->_state->errs.poll_count = 0;
+	this->_state->errs.poll_switch_count = 0;
+	this->_state->errs.rx_safety_ring_full_count = 0;
+	this->_state->errs.rx_dump_full_count = 0;
+	this->_state->errs.route_full_count = 0;
+	this->_state->errs.route_dropped_count = 0;
+	this->_mode_ns[0] = this->_mode_ns[1] = 0;
+	this->_mode_start = get_monotonic_ns();
+	memset(&this->_state->stats, 0, sizeof(this->_state->stats));
+	this->_load_bits = 0;
+	this->_load_start = this->_mode_start;
+	return this->_state->errs;
 }
 
 
 can_err_count_t CANDeviceManager::get_errs() {
-	return this->_errs;
+	uint64_t current = get_monotonic_ns() - this->_mode_start;
+
+	this->_state->errs.intr_mode_ms =
+			(this->_mode_ns[0] + (this->_polling ? 0 : current)) / 1000000;
+	this->_state->errs.poll_mode_ms =
+			(this->_mode_ns[1] + (this->_polling ? current : 0)) / 1000000;
+	return this->_state->errs;
+}
+
+
+can_stats_t CANDeviceManager::get_stats() {
+	/* Without traffic, the load window is only ever closed here. */
+	this->_update_load(get_monotonic_ns());
+	this->_state->stats.errs = this->get_errs();
+	return this->_state->stats;
+}
+
+
+void CANDeviceManager::record_isr_time(uint64_t duration_ns) {
+	hist_add(&this->_state->stats.isr_time, duration_ns);
+}
+
+
+void CANDeviceManager::record_rx_backlog(unsigned int count) {
+	if (count > this->_state->stats.rx_backlog_max)
+		this->_state->stats.rx_backlog_max = count;
+}
+
+
+void CANDeviceManager::_count_pgn(const can_msg_t &msg) {
+	unsigned int pgn;
+	unsigned int slot;
+	can_pgn_count_t *entry;
+
+	if (!IS_EXTENDED_FRAME(msg)) {
+		this->_state->stats.std_frame_count++;
+		return;
+	}
+
+	pgn = msg_pgn(msg);
+	slot = (pgn ^ (pgn >> 8)) & (CAN_STATS_MAX_PGNS - 1);
+	for (int i = 0; i < CAN_STATS_MAX_PGNS; i++) {
+		entry = &this->_state->stats.pgns[(slot + i) & (CAN_STATS_MAX_PGNS - 1)];
+		if (entry->count == 0)
+			entry->pgn = pgn;
+		if (entry->pgn == pgn) {
+			entry->count++;
+			return;
+		}
+	}
+	this->_state->stats.pgn_overflow_count++;
+}
+
+
+void CANDeviceManager::_count_frame(const can_msg_t &msg, uint64_t now) {
+	/* SOF, arbitration, control, CRC, ACK, EOF and intermission fields,
+	 * without stuff bits. */
+	this->_load_bits += (IS_EXTENDED_FRAME(msg) ? 67 : 47) + 8 * msg.size;
+	this->_update_load(now);
 }
 
 
-int CANDeviceManager::interrupt(CircularBuffer *in_buff,
-								CircularBuffer *out_buff,
-								can_filter_t filter)
+void CANDeviceManager::_update_load(uint64_t now) {
+	uint64_t elapsed = now - this->_load_start;
+
+	if (elapsed < (uint64_t) CAN_LOAD_WINDOW_MS * 1000000 ||
+			this->_baud[this->_channel] == 0)
+		return;
+
+	/* bits/s over kbits/s of the bus gives the load in 1/1000 */
+	this->_state->stats.bus_load = (unsigned int) (this->_load_bits * 1000000000 /
+			elapsed / this->_baud[this->_channel]);
+	this->_load_bits = 0;
+	this->_load_start = now;
+}
+
+
+int CANDeviceManager::interrupt(can_rx_buff_t *in_buff,
+		can_tx_queue_t *out_buff)
 {
 	int i=0;
 	int retval = 0;	// set to 1 for receive
@@ -168,36 +417,36 @@ int CANDeviceManager::interrupt(CircularBuffer *in_buff,
 	fflush(stdout);
 #endif
 	BYTE status_val;
-	BYTE ir_val = CANin(MY_CHANNEL, canirq);
-	BYTE rmc = CANin(MY_CHANNEL, reserved3);
+	BYTE ir_val = CANin(this->_channel, canirq);
 
 	while (ir_val) {
 		if (i > 0)
-			this->_errs.intr_in_handler_count++;
+			this->_state->errs.intr_in_handler_count++;
 		++i;
 
+		/* The bus status is needed to tell a bus-off from an error warning. */
+		status_val = CANin(this->_channel, canstat);
 #ifdef DO_TRACE
-		status_val = CANin(MY_CHANNEL, canstat);
 		printf("interrupt: value 0x%02x, status 0x%02x\n",
 			ir_val, status_val);
 		fflush(stdout);
 #endif
 
 		if (ir_val & CAN_RECEIVE_INT) {
-			retval = 1;
-			this->_errs.rx_interrupt_count++;
+			this->_state->errs.rx_interrupt_count++;
 #ifdef DO_TRACE_RX
 			printf("RX interrupt\n");
 			fflush(stdout);
 #endif
-   			this->rx_process_interrupt(in_buff, filter);
-
-			CANout(MY_CHANNEL, cancmd, CAN_RELEASE_RECEIVE_BUFFER);
+			/* Empty the whole Rx FIFO, so that the clients are notified once
+			 * for every frame queued since the last interrupt. */
+   			if (this->rx_drain(in_buff) > 0)
+   				retval = 1;
 		}
 
 		if (ir_val & CAN_OVERRUN_INT) {
-			CANout(minor, cancmd, CAN_CLEAR_OVERRUN_STATUS);
-			this->_errs.rx_message_lost_count++;
+			CANout(this->_channel, cancmd, CAN_CLEAR_OVERRUN_STATUS);
+			this->_state->errs.rx_message_lost_count++;
 		}
 
 		if (ir_val & CAN_TRANSMIT_INT) {
@@ -205,7 +454,7 @@ int CANDeviceManager::interrupt(CircularBuffer *in_buff,
 			printf("TX interrupt\n");
 			fflush(stdout);
 #endif
-			this->_errs.tx_interrupt_count++;
+			this->_state->errs.tx_interrupt_count++;
 			this->tx_process_interrupt(out_buff);
 		}
 
@@ -214,11 +463,14 @@ int CANDeviceManager::interrupt(CircularBuffer *in_buff,
 				printf("Bus off; try to reset SJA1000\n");
 				fflush(stdout);
 				/* Try resetting the chip. */
-				if (this->_reset_chip((MY_CHANNEL) < 0))
+				if (this->_reset_chip(this->_channel) < 0) {
 					printf("Error on reset\n");
-				else
-					this->_start_chip(MY_CHANNEL);
-				return 0;
+				} else {
+					this->_start_chip(this->_channel);
+					this->requeue_aborted(out_buff);
+				}
+				/* Frames already drained still have to be notified. */
+				return retval;
 			}
 			if((status_val & CAN_ERROR_STATUS)!=0) {
 				printf("Warning: error status.\n");
@@ -231,33 +483,55 @@ int CANDeviceManager::interrupt(CircularBuffer *in_buff,
 			fflush(stdout);
 		}
 
-		/* Return if have received all messages there at start. Don't want to
-		 * stay here to long and starve receiver. */
-		if (i > rmc) return retval;
+		/* Don't want to stay here to long and starve receiver. Every frame
+		 * in the Rx FIFO was already read by rx_drain. */
+		if (i >= CAN_INTR_MAX_PASSES) return retval;
 
-		ir_val = CANin(MY_CHANNEL, canirq);
+		ir_val = CANin(this->_channel, canirq);
 	}
 	return retval;
 }
 
 
-can_msg_t CANDeviceManager::read(CircularBuffer *in_buff) {
+void CANDeviceManager::_count_lost(const can_rx_cursor_t &before,
+		const can_rx_cursor_t &after) {
+	this->_state->errs.rx_safety_ring_full_count +=
+			after.lanes[CAN_RX_LANE_SAFETY].lost -
+			before.lanes[CAN_RX_LANE_SAFETY].lost;
+	this->_state->errs.rx_ring_full_count +=
+			after.lanes[CAN_RX_LANE_GENERAL].lost -
+			before.lanes[CAN_RX_LANE_GENERAL].lost;
+}
+
+
+can_msg_t CANDeviceManager::read(can_rx_buff_t *in_buff,
+		can_rx_cursor_t *cursor, const can_filter_t *filters, int num_filters)
+{
 	can_msg_t msg;
-	can_msg_t *pmsg;
+	can_msg_t next;
+	can_rx_cursor_t before = *cursor;
+	int lane;
 
 	memset(&msg, 0, sizeof(can_msg_t));
 
-	pmsg = (can_msg_t*) in_buff->pop_first();
+	msg.error = 1;
+	for (lane = 0; lane < CAN_RX_NUM_LANES && msg.error; lane++) {
+		while (in_buff->lanes[lane].pop(&cursor->lanes[lane], &next)) {
+			/* The messages this client skips are still read by the others. */
+			if (!can_filter_match(filters, num_filters, next))
+				continue;
+			msg = next;
+			msg.error = 0;
+			hist_add(&this->_state->stats.delivery_time,
+					get_monotonic_ns() - msg.rx_time_ns);
+			break;
+		}
+	}
+	this->_count_lost(before, *cursor);
 
 #ifdef DO_TRACE
-	printf("can_dev_read 0x%x\n", (unsigned int) pmsg);
+	printf("can_dev_read %d left\n", can_rx_get_count(in_buff, cursor));
 #endif
-	if (pmsg == NULL)
-		msg.error = 1;
-	else {
-		msg = *pmsg;
-		msg.error = 0;
-	}
 #ifdef DO_TRACE
 	print_can_msg(&msg);
 	fflush(stdout);
@@ -266,58 +540,184 @@ can_msg_t CANDeviceManager::read(CircularBuffer *in_buff) {
 }
 
 
-void CANDeviceManager::rx_process_interrupt(CircularBuffer *in_buff,
-		can_filter_t filter)
+int CANDeviceManager::read_batch(can_rx_buff_t *in_buff,
+		can_rx_cursor_t *cursor, can_msg_t *msgs, int max_msgs,
+		const can_filter_t *filters, int num_filters)
+{
+	int num_msgs = 0;
+	can_rx_cursor_t before = *cursor;
+	uint64_t now = get_monotonic_ns();
+
+	for (int lane = 0; lane < CAN_RX_NUM_LANES; lane++) {
+		can_fanout_t *ring = &in_buff->lanes[lane];
+		fanout_cursor_t *lane_cursor = &cursor->lanes[lane];
+		while (num_msgs < max_msgs && ring->pop(lane_cursor, &msgs[num_msgs])) {
+			if (!can_filter_match(filters, num_filters, msgs[num_msgs]))
+				continue;
+			msgs[num_msgs].error = 0;
+			hist_add(&this->_state->stats.delivery_time,
+					now - msgs[num_msgs].rx_time_ns);
+			num_msgs++;
+		}
+	}
+	this->_count_lost(before, *cursor);
+
+#ifdef DO_TRACE
+	printf("can_dev_read_batch %d read, %d left\n", num_msgs,
+			can_rx_get_count(in_buff, cursor));
+#endif
+	return num_msgs;
+}
+
+
+void CANDeviceManager::rx_process_interrupt(can_rx_buff_t *in_buff,
+		uint64_t rx_time_ns)
 {
 	can_msg_t msg;
-	BYTE frm_info = CANin(MY_CHANNEL, frameinfo);
+	BYTE frm_info = CANin(this->_channel, frameinfo);
 	int ext = frm_info & CAN_EFF;
    	int i;
-	unsigned int ID[4];
+	BYTE regs[12];	/* identifier and data registers */
 
+	this->_rx_frames++;
 #ifdef DO_TRACE_RX
 	printf("RX_INTERRUPT: frm_info 0x%08x\n", frm_info);
 #endif
+	/* data length codes above 8 still mean 8 bytes */
 	msg.size = frm_info & 0x0f;
+	if (msg.size > 8)
+		msg.size = 8;
+
 	if (ext) {
-		for (i=0; i < msg.size && i < 8; i++)
-			msg.data[i] = CANin(MY_CHANNEL,
-					frame.extframe.canxdata[i]);
-
-		ID[0] = CANin(MY_CHANNEL, frame.extframe.canid1);
-		ID[1] = CANin(MY_CHANNEL, frame.extframe.canid2);
-		ID[2] = CANin(MY_CHANNEL, frame.extframe.canid3);
-		ID[3] = CANin(MY_CHANNEL, frame.extframe.canid4);
+		CANin_burst(this->_channel, frame.extframe.canid1, regs, 4 + msg.size);
 #ifdef DO_TRACE_RX
-		printf("ID: %08x %08x %08x %08x\n", ID[0], ID[1], ID[2], ID[3]);
+		printf("ID: %08x %08x %08x %08x\n", regs[0], regs[1], regs[2], regs[3]);
 #endif
-		msg.id = (ID[0] << 21) | (ID[1] << 13) |
-				 (ID[2] << 5) | (ID[3] >> 3);
+		msg.id = ((unsigned long) regs[0] << 21) | (regs[1] << 13) |
+				 (regs[2] << 5) | (regs[3] >> 3);
 #ifdef DO_TRACE_RX
 		printf("msg.id: %08x\n", msg.id);
 #endif
 		SET_EXTENDED_FRAME(msg);
+		for (i=0; i < msg.size; i++)
+			msg.data[i] = regs[4 + i];
 	} else {
-		for (i=0; i < msg.size && i < 8; i++)
-			msg.data[i] = CANin(MY_CHANNEL,
-					frame.stdframe.candata[i]);
-		ID[0] = CANin(MY_CHANNEL, frame.stdframe.canid1) << 3;
-		ID[1] = CANin(MY_CHANNEL, frame.extframe.canid2) >> 5;
-		msg.id = ID[0] | ID[1];
+		CANin_burst(this->_channel, frame.stdframe.canid1, regs, 2 + msg.size);
+		msg.id = (regs[0] << 3) | (regs[1] >> 5);
+		for (i=0; i < msg.size; i++)
+			msg.data[i] = regs[2 + i];
 	}
 #ifdef DO_TRACE_RX
 	printf("RX_INTERRUPT: msg.id %d, msg.size %d, data[0] 0x%02x\n",
 			CAN_ID(msg), msg.size, msg.data[0]);
 #endif
 
-	/* Add a new message if ID and MASK allow. */
-	if ((filter.id & filter.mask) == (msg.id & filter.mask))
-		in_buff->add(&msg);
+	msg.error = 0;
+	msg.rx_time_ns = rx_time_ns;
+	msg.tx_ttl_ms = 0;
+	msg.tx_time_ns = 0;
+	msg.tx_flags = 0;
+	this->_state->stats.rx_frame_count++;
+	this->_count_frame(msg, rx_time_ns);
+	this->_count_pgn(msg);
+
+	/* The dump records every frame the chip passed. */
+	if (this->_dump != NULL && !this->_dump->push(msg))
+		this->_state->errs.rx_dump_full_count++;
+
+	/* Frames are forwarded whether or not a client of this channel wants
+	 * them. */
+	if (this->_num_routes != 0)
+		this->_route(msg);
+
+	/* The acceptance filter of the chip already rejected most unwanted
+	 * messages. Check the rest against the ID and MASK of every filter. */
+	if (this->_sw_filter[this->_channel][ext ? 1 : 0]) {
+		bool match = false;
+		for (i=0; i < this->_num_filters[this->_channel]; i++) {
+			can_filter_t *filter = &this->_filter[this->_channel][i];
+			if ((filter->id & filter->mask) == (msg.id & filter->mask))
+				match = true;
+		}
+		if (!match) {
+			this->_state->errs.rx_filtered_count++;
+			return;
+		}
+	}
+
+	/* The message is copied into the ring, so the local variable can safely go
+	 * out of scope. Safety-critical messages have a ring of their own, which
+	 * a burst of other traffic cannot overwrite. */
+	in_buff->lanes[rx_lane(msg)].push(msg);
+}
+
+
+void CANDeviceManager::set_poll_rate(unsigned int poll_rate) {
+	this->_poll_rate = poll_rate;
+}
+
+
+int CANDeviceManager::poll(can_rx_buff_t *in_buff) {
+	this->_state->errs.poll_count++;
+
+	return this->rx_drain(in_buff);
 }
 
 
-void CANDeviceManager::tx_process_interrupt(CircularBuffer *out_buff) {
-	out_buff->pop_first();
+int CANDeviceManager::rx_drain(can_rx_buff_t *in_buff) {
+	int num_rx = 0;
+	uint64_t rx_time_ns = get_monotonic_ns();
+
+	/* The receive buffer status bit stays set while frames are queued in the
+	 * Rx FIFO. */
+	while (num_rx < CAN_RX_MAX_DRAIN &&
+			(CANin(this->_channel, canstat) & CAN_RECEIVE_BUFFER_STATUS)) {
+		this->rx_process_interrupt(in_buff, rx_time_ns);
+		CANout(this->_channel, cancmd, CAN_RELEASE_RECEIVE_BUFFER);
+		num_rx++;
+	}
+
+	return num_rx;
+}
+
+
+int CANDeviceManager::update_rx_mode() {
+	uint64_t now = get_monotonic_ns();
+	uint64_t elapsed = now - this->_window_start;
+	unsigned int rate;
+
+	if (this->_poll_rate == 0 && !this->_polling)
+		return 0;
+	if (elapsed < (uint64_t) CAN_POLL_WINDOW_MS * 1000000)
+		return 0;
+
+	/* Rx frames per second over the window that just ended. */
+	rate = (unsigned int) ((uint64_t) (this->_rx_frames - this->_window_frames)
+			* 1000000000 / elapsed);
+	this->_window_start = now;
+	this->_window_frames = this->_rx_frames;
+
+	if (!this->_polling && rate >= this->_poll_rate) {
+		this->_mode_ns[0] += now - this->_mode_start;
+		this->_polling = true;
+		CANreset(this->_channel, canirq_enable, CAN_RECEIVE_INT_ENABLE);
+	} else if (this->_polling &&
+			(this->_poll_rate == 0 || rate < this->_poll_rate / 2)) {
+		this->_mode_ns[1] += now - this->_mode_start;
+		this->_polling = false;
+		/* The Rx interrupt is raised right away if frames are still queued. */
+		CANset(this->_channel, canirq_enable, CAN_RECEIVE_INT_ENABLE);
+	} else
+		return 0;
+
+	this->_mode_start = now;
+	this->_state->errs.poll_switch_count++;
+	return this->_polling ? CAN_RX_MODE_POLL : CAN_RX_MODE_INTR;
+}
+
+
+void CANDeviceManager::tx_process_interrupt(can_tx_queue_t *out_buff) {
+	this->_tx_busy = false;
 
 	/* check is anymore messages are waiting to be sent */
 	if (out_buff->get_count() != 0)
@@ -325,19 +725,24 @@ void CANDeviceManager::tx_process_interrupt(CircularBuffer *out_buff) {
 }
 
 
-int CANDeviceManager::write(CircularBuffer *out_buff, can_msg_t *pmsg)
+int CANDeviceManager::write(can_tx_queue_t *out_buff, can_msg_t *pmsg)
 {
-	pmsg->error = 0;
+	uint64_t now = get_monotonic_ns();
+	int status;
+
 #ifdef DO_TRACE
-	printf("can_dev_write: buff 0x%x, msg 0x%x\n",
-			(unsigned int) pattr->out_buff.data_array,
-			(unsigned int) pmsg);
+	printf("can_dev_write: %d queued, msg 0x%x\n",
+			out_buff->get_count(), (unsigned int) pmsg);
 	print_can_msg(pmsg);
 	fflush(stdout);
 #endif
 
-	/* add the new element to the output buffer */
-	out_buff->add(pmsg);
+	/* A tap must never drive the bus. */
+	if (this->_listen_only)
+		return EPERM;
+
+	if ((status = this->_queue(out_buff, pmsg, now)) != EOK)
+		return status;
 
 #ifdef DO_TRACE_TX
 	printf("write id 0x%x ", (unsigned int) pmsg->id);
@@ -348,32 +753,239 @@ int CANDeviceManager::write(CircularBuffer *out_buff, can_msg_t *pmsg)
 	fflush(stdout);
 #endif
 
-	if (out_buff->get_count() == 1) {
+	this->_send_if_idle(out_buff, now);
+
+	return EOK;
+}
+
+
+int CANDeviceManager::write_batch(can_tx_queue_t *out_buff, can_msg_t *msgs,
+		int num_msgs)
+{
+	uint64_t now = get_monotonic_ns();
+	int num_queued = 0;
+
+	if (this->_listen_only)
+		return 0;
+
+	while (num_queued < num_msgs &&
+			this->_queue(out_buff, &msgs[num_queued], now) == EOK)
+		num_queued++;
+
+	this->_send_if_idle(out_buff, now);
+
+	return num_queued;
+}
+
+
+bool CANDeviceManager::get_next_tx_time(can_tx_queue_t *out_buff,
+		uint64_t *tx_time)
+{
+	/* The transmit interrupt sends the next message. */
+	if (this->_tx_busy)
+		return false;
+	return out_buff->next_release(get_monotonic_ns(), tx_time);
+}
+
+
+void CANDeviceManager::tx_timer_expired(can_tx_queue_t *out_buff) {
+	this->_send_if_idle(out_buff, get_monotonic_ns());
+}
+
+
+int CANDeviceManager::_queue(can_tx_queue_t *out_buff, can_msg_t *pmsg,
+		uint64_t now)
+{
+	unsigned int ttl_ms;
+	uint64_t tx_time;
+	int status;
+
+	pmsg->error = 0;
+
+	/* Add the new element to the output buffer. A message written with
+	 * CAN_TX_REPLACE replaces any older one with the same PGN and addresses.
+	 * Expired messages are dropped first to make room. The deadline runs from
+	 * the transmit time. */
+	ttl_ms = pmsg->tx_ttl_ms != 0 ? pmsg->tx_ttl_ms : CAN_TX_DEFAULT_TTL_MS;
+	tx_time = pmsg->tx_time_ns > now ? pmsg->tx_time_ns : now;
+	this->_state->errs.tx_expired_count += out_buff->expire(now);
+	status = out_buff->push(*pmsg, PATH_CAN_PRIORITY(pmsg->id),
+			can_tx_queue_key(*pmsg), tx_time + (uint64_t) ttl_ms * 1000000,
+			pmsg->tx_time_ns);
+	if (status == DQ_FULL)
+		return EAGAIN;
+	else if (status == DQ_REPLACED)
+		this->_state->errs.tx_replaced_count++;
+	if (out_buff->get_count() > this->_state->stats.tx_queue_max)
+		this->_state->stats.tx_queue_max = out_buff->get_count();
+
+	return EOK;
+}
+
+
+void CANDeviceManager::requeue_aborted(can_tx_queue_t *out_buff) {
+	uint64_t now = get_monotonic_ns();
+
+	if (!this->_tx_aborted)
+		return;
+	this->_tx_aborted = false;
+
+	/* A newer message with the same key replaced the aborted one already. */
+	if (!this->_listen_only &&
+			!out_buff->has_key(can_tx_queue_key(this->_tx_msg)))
+		this->_queue(out_buff, &this->_tx_msg, now);
+
+	this->_send_if_idle(out_buff, now);
+}
+
+
+void CANDeviceManager::_send_if_idle(can_tx_queue_t *out_buff, uint64_t now)
+{
+	if (this->_tx_busy && now - this->_last_time_can_sent >
+			(uint64_t) CAN_TX_TIMEOUT_MS * 1000000) {
+		/* must have missed an interrupt, consider the chip idle again */
+		this->can_timeout_count++;
+		this->_tx_busy = false;
+	}
+
+	if (!this->_tx_busy)
 		this->send(out_buff);
+}
+
+
+int CANDeviceManager::set_filter(can_filter_t filter) {
+	this->_filter[this->_channel][0] = filter;
+	this->_num_filters[this->_channel] = 1;
+	this->_acc_dual[this->_channel] = false;
+	this->_state->filter[0] = filter;
+	this->_state->num_filters = 1;
+
+	return this->_load_filters(this->_channel);
+}
+
+
+int CANDeviceManager::set_dual_filter(can_filter_t filter1,
+		can_filter_t filter2)
+{
+	this->_filter[this->_channel][0] = filter1;
+	this->_filter[this->_channel][1] = filter2;
+	this->_num_filters[this->_channel] = 2;
+	this->_acc_dual[this->_channel] = true;
+	this->_state->filter[0] = filter1;
+	this->_state->filter[1] = filter2;
+	this->_state->num_filters = 2;
+
+	return this->_load_filters(this->_channel);
+}
+
+
+int CANDeviceManager::set_self_test(bool enable) {
+	this->_self_test = enable;
+	return this->_load_mode(this->_channel);
+}
+
+
+int CANDeviceManager::set_listen_only(bool enable) {
+	/* Until init, only remembered for _reset_chip. */
+	if (this->_base_addr == NULL) {
+		this->_listen_only = enable;
+		return 0;
 	}
-	else {
-		/* Assumes message sends are at least 1 Hz */
-		if ((time((time_t *)NULL) - this->_last_time_can_sent) > 1) {
-			this->can_timeout_count++;
-			this->send(out_buff);
+	return this->_set_listen_only_mode(this->_channel, enable);
+}
+
+
+void CANDeviceManager::set_dump(can_dump_ring_t *ring) {
+	this->_dump = ring;
+}
+
+
+int CANDeviceManager::add_route(const can_route_t &route,
+		can_route_ring_t *ring) {
+	if (this->_num_routes == CAN_MAX_ROUTES || ring == NULL)
+		return -1;
+	if (route.channel < 0 || route.channel >= MAX_CHANNELS ||
+			route.channel == this->_channel)
+		return -1;
+	if (route.sa != CAN_ROUTE_KEEP_SA && (route.sa < 0 || route.sa > 0xFF))
+		return -1;
+
+	this->_routes[this->_num_routes] = route;
+	this->_route_rings[this->_num_routes] = ring;
+	this->_num_routes++;
+	return 0;
+}
+
+
+void CANDeviceManager::clear_routes() {
+	this->_num_routes = 0;
+}
+
+
+unsigned int CANDeviceManager::take_routed() {
+	unsigned int routed = this->_routed;
+	this->_routed = 0;
+	return routed;
+}
+
+
+void CANDeviceManager::_route(const can_msg_t &msg) {
+	for (int i = 0; i < this->_num_routes; i++) {
+		can_route_t *route = &this->_routes[i];
+		if ((route->id & route->mask) != (msg.id & route->mask))
+			continue;
+
+		can_msg_t fwd = msg;
+		if (route->sa != CAN_ROUTE_KEEP_SA && IS_EXTENDED_FRAME(fwd))
+			fwd.id = (fwd.id & ~0xFFUL) | route->sa;
+		if (!this->_route_rings[i]->push(fwd)) {
+			this->_state->errs.route_full_count++;
+			continue;
 		}
+		this->_routed |= 1U << route->channel;
+	}
+}
 
-		if (out_buff->get_count() > 10) {
-			/* must have missed an interrupt, throw old stuff out */
-			this->tx_buffer_flush += out_buff->empty();
+
+int CANDeviceManager::forward(can_tx_queue_t *out_buff,
+		can_route_ring_t *ring) {
+	uint64_t now = get_monotonic_ns();
+	int num_queued = 0;
+	can_msg_t msg;
+
+	while (ring->pop(&msg)) {
+		/* A tap must never drive the bus. */
+		if (this->_listen_only || this->_queue(out_buff, &msg, now) != EOK) {
+			this->_state->errs.route_dropped_count++;
+			continue;
 		}
+		num_queued++;
 	}
 
-	return EOK;
+	if (num_queued != 0)
+		this->_send_if_idle(out_buff, now);
+	return num_queued;
 }
 
 
-void CANDeviceManager::send(CircularBuffer *out_buff) {
+void CANDeviceManager::send(can_tx_queue_t *out_buff) {
 	int i;
+	can_msg_t msg;
+	can_msg_t *tx = &msg;
+	uint64_t now = get_monotonic_ns();
 	DBGin();
 
-	/* Grab the most recent element. */
-	can_msg_t *tx = (can_msg_t*) out_buff->read_first();
+	/* The transmit buffer of the chip holds a single message. */
+	if (this->_tx_busy)
+		return;
+
+	/* Grab the element with the highest priority that is still current and
+	 * whose transmit time was reached. */
+	this->_state->errs.tx_expired_count += out_buff->expire(now);
+	if (!out_buff->pop(tx, now))
+		return;
+	if (tx->tx_time_ns != 0)
+		hist_add(&this->_state->stats.tx_delay, now - tx->tx_time_ns);
 
 	/* Info and identifier fields */
 	BYTE tx2reg = tx->size;
@@ -382,33 +994,38 @@ void CANDeviceManager::send(CircularBuffer *out_buff) {
 			minor, tx->flags, tx->id, tx->length, stat));
 
 	if (IS_EXTENDED_FRAME(*tx)) {
-		CANout(MY_CHANNEL, frameinfo, CAN_EFF + tx2reg);
-		CANout(MY_CHANNEL, frame.extframe.canid1, (BYTE)(tx->id >> 21));
-		CANout(MY_CHANNEL, frame.extframe.canid2, (BYTE)(tx->id >> 13));
-		CANout(MY_CHANNEL, frame.extframe.canid3, (BYTE)(tx->id >> 5));
-		CANout(MY_CHANNEL, frame.extframe.canid4, (BYTE)(tx->id << 3) & 0xff);
+		CANout(this->_channel, frameinfo, CAN_EFF + tx2reg);
+		CANout(this->_channel, frame.extframe.canid1, (BYTE)(tx->id >> 21));
+		CANout(this->_channel, frame.extframe.canid2, (BYTE)(tx->id >> 13));
+		CANout(this->_channel, frame.extframe.canid3, (BYTE)(tx->id >> 5));
+		CANout(this->_channel, frame.extframe.canid4, (BYTE)(tx->id << 3) & 0xff);
 		for(i=0; i<tx->size; i++)
-			CANout(MY_CHANNEL, frame.extframe.canxdata[i], tx->data[i]);
-//			CANout(MY_CHANNEL, frame.extframe.canxdata[R_OFF * i], tx->data[i]);
+			CANout(this->_channel, frame.extframe.canxdata[i], tx->data[i]);
+//			CANout(this->_channel, frame.extframe.canxdata[R_OFF * i], tx->data[i]);
 	} else {
-		CANout(MY_CHANNEL, frameinfo, CAN_SFF + tx2reg);
-		CANout(MY_CHANNEL, frame.stdframe.canid1, (BYTE)((tx->id) >> 3) );
-		CANout(MY_CHANNEL, frame.stdframe.canid2, (BYTE)(tx->id << 5 ) & 0xe0);
+		CANout(this->_channel, frameinfo, CAN_SFF + tx2reg);
+		CANout(this->_channel, frame.stdframe.canid1, (BYTE)((tx->id) >> 3) );
+		CANout(this->_channel, frame.stdframe.canid2, (BYTE)(tx->id << 5 ) & 0xe0);
 		for (i=0; i<tx->size; i++)
-			CANout(MY_CHANNEL, frame.stdframe.candata[i], tx->data[i]);
-//			CANout(MY_CHANNEL, frame.stdframe.candata[R_OFF * i], tx->data[i]); FIXME
+			CANout(this->_channel, frame.stdframe.candata[i], tx->data[i]);
+//			CANout(this->_channel, frame.stdframe.candata[R_OFF * i], tx->data[i]); FIXME
 	}
 
-	CANout(MY_CHANNEL, cancmd, CAN_TRANSMISSION_REQUEST);
-	this->_last_time_can_sent = time((time_t *)NULL);
+	/* In self test mode, the message is received back through the Rx FIFO. */
+	CANout(this->_channel, cancmd, this->_self_test ?
+			CAN_SELF_RECEPTION_REQUEST : CAN_TRANSMISSION_REQUEST);
+	this->_last_time_can_sent = now;
+	this->_tx_busy = true;
+	this->_tx_msg = *tx;
+	this->_state->stats.tx_frame_count++;
+	this->_count_frame(*tx, now);
 
 	DBGout();
 }
 
 
 int CANDeviceManager::_set_timing(int minor, int baud) {
-	int i = 5;
-	int custom = 0;
+	BYTE tim0, tim1;
 
     DBGin();
 
@@ -421,6 +1038,25 @@ int CANDeviceManager::_set_timing(int minor, int baud) {
     }
 
     DBGprint(DBG_DATA, ("baud[%d]=%d", minor, baud));
+    this->_get_timing(baud, &tim0, &tim1);
+
+    /* select mode: Basic or PeliCAN */
+    CANout(minor, canclk, CAN_MODE_PELICAN + CAN_MODE_CLK);
+    CANout(minor, cantim0, tim0);
+    CANout(minor, cantim1, tim1);
+
+    DBGprint(DBG_DATA, ("tim0=0x%x tim1=0x%x",
+    		CANin(minor, cantim0), CANin(minor, cantim1)));
+
+    DBGout();
+    return 0;
+}
+
+
+void CANDeviceManager::_get_timing(int baud, BYTE *tim0, BYTE *tim1) {
+	int i = 5;
+	int custom = 0;
+
     switch (baud) {
 		case   10: i = 0; break;
 		case   20: i = 1; break;
@@ -434,21 +1070,13 @@ int CANDeviceManager::_set_timing(int minor, int baud) {
 		default  : custom=1;
     }
 
-    /* select mode: Basic or PeliCAN */
-    CANout(minor, canclk, CAN_MODE_PELICAN + CAN_MODE_CLK);
     if (custom) {
-    	CANout(minor, cantim0, (BYTE) (baud >> 8) & 0xff);
-    	CANout(minor, cantim1, (BYTE) (baud & 0xff ));
+    	*tim0 = (BYTE) (baud >> 8) & 0xff;
+    	*tim1 = (BYTE) (baud & 0xff );
     } else {
-    	CANout(minor, cantim0, (BYTE) CanTiming[i][0]);
-    	CANout(minor, cantim1, (BYTE) CanTiming[i][1]);
+    	*tim0 = (BYTE) CanTiming[i][0];
+    	*tim1 = (BYTE) CanTiming[i][1];
     }
-
-    DBGprint(DBG_DATA, ("tim0=0x%x tim1=0x%x",
-    		CANin(minor, cantim0), CANin(minor, cantim1)));
-
-    DBGout();
-    return 0;
 }
 
 
@@ -478,6 +1106,106 @@ int CANDeviceManager::_set_mask(int minor, unsigned int code, unsigned int mask)
 }
 
 
+int CANDeviceManager::_load_filters(int minor) {
+	this->_compile_filters(minor);
+
+	/* Resetting the chip flushes the Rx FIFO and aborts the message being
+	 * sent, which is not worth it if the registers would not change. */
+	if (this->_hw_loaded[minor] &&
+			this->_hw_code[minor] == this->_acc_code[minor] &&
+			this->_hw_mask[minor] == this->_acc_mask[minor] &&
+			this->_hw_dual[minor] == this->_acc_dual[minor])
+		return 0;
+
+	/* The acceptance registers can only be written in reset mode. */
+	this->_stop_chip(minor);
+	CANout(minor, canmode, CAN_RESET_REQUEST + this->_mode_bits(minor));
+	this->_write_acceptance(minor);
+
+	return this->_start_chip(minor);
+}
+
+
+void CANDeviceManager::_write_acceptance(int minor) {
+	this->_set_mask(minor, this->_acc_code[minor], this->_acc_mask[minor]);
+	this->_hw_code[minor] = this->_acc_code[minor];
+	this->_hw_mask[minor] = this->_acc_mask[minor];
+	this->_hw_dual[minor] = this->_acc_dual[minor];
+	this->_hw_loaded[minor] = true;
+}
+
+
+void CANDeviceManager::_compile_filters(int minor) {
+	unsigned int code = 0;
+	unsigned int mask = 0;
+	bool exact[2] = {true, true};	/* 11 bit and 29 bit frames */
+	bool accept_all = false;
+	int i;
+
+	for (i=0; i < this->_num_filters[minor]; i++) {
+		can_filter_t filter = this->_filter[minor][i];
+		unsigned int id11 = filter.id & 0x7FF;
+		unsigned int mask11 = filter.mask & 0x7FF;
+		unsigned int id29 = filter.id & 0x1FFFFFFF;
+		unsigned int mask29 = filter.mask & 0x1FFFFFFF;
+
+		if (filter.mask == 0) {
+			/* Nothing to compare. */
+			accept_all = true;
+			if (this->_acc_dual[minor])
+				mask |= 0xFFFF << (16 * (1 - i));
+			else
+				mask = 0xFFFFFFFF;
+		} else if (!this->_acc_dual[minor]) {
+			/* Single filter: ACR0-1 hold ID10-0 of 11 bit frames, and ACR0-3
+			 * hold ID28-0 of 29 bit frames, followed by the RTR bit. */
+			if (is_std_filter(filter)) {
+				code = id11 << 21;
+				mask = ~(mask11 << 21);
+				exact[0] = !(filter.mask & 0x7FFFF800);
+				exact[1] = false;
+			} else {
+				code = id29 << 3;
+				mask = ~(mask29 << 3);
+				exact[0] = false;
+				exact[1] = !(filter.mask & 0x60000000);
+			}
+		} else {
+			/* Dual filter: each filter is 16 bits wide (ACR0-1 for the first
+			 * and ACR2-3 for the second). It holds ID10-0 and the RTR bit of 11
+			 * bit frames, or ID28-13 of 29 bit frames. */
+			unsigned int shift = 16 * (1 - i);
+			if (is_std_filter(filter)) {
+				code |= (id11 << 5) << shift;
+				mask |= (((~(mask11 << 5)) & 0xFFE0) | 0x1F) << shift;
+				exact[0] = exact[0] && !(filter.mask & 0x7FFFF800);
+				exact[1] = false;
+			} else {
+				code |= ((id29 >> 13) & 0xFFFF) << shift;
+				mask |= ((~(mask29 >> 13)) & 0xFFFF) << shift;
+				exact[0] = false;
+				exact[1] = exact[1] && !(filter.mask & 0x60001FFF);
+			}
+		}
+	}
+
+	/* In dual filter mode, the low nibble of ACR3 is compared with the first
+	 * data byte of 11 bit frames for the first filter, so it is never used
+	 * when the first filter may accept 11 bit frames. */
+	if (this->_acc_dual[minor] && (is_std_filter(this->_filter[minor][0]) ||
+			this->_filter[minor][0].mask == 0)) {
+		if ((mask & 0xF) != 0xF)
+			exact[1] = false;
+		mask |= 0xF;
+	}
+
+	this->_acc_code[minor] = code;
+	this->_acc_mask[minor] = mask;
+	this->_sw_filter[minor][0] = !(accept_all || exact[0]);
+	this->_sw_filter[minor][1] = !(accept_all || exact[1]);
+}
+
+
 int CANDeviceManager::_set_omode(int minor, int arg) {
     DBGin();
 	DBGprint(DBG_DATA,("[%d] outc=0x%x", minor, arg));
@@ -489,11 +1217,7 @@ int CANDeviceManager::_set_omode(int minor, int arg) {
 
 
 int CANDeviceManager::_set_listen_only_mode(int minor, int arg) {
-	if (arg)
-		CANset(minor, canmode, CAN_LISTEN_ONLY_MODE);
-    else
-    	CANreset(minor, canmode, CAN_LISTEN_ONLY_MODE);
-
-	return 0;
+	this->_listen_only = (arg != 0);
+	return this->_load_mode(minor);
 }
 
@@ -8,18 +8,267 @@
  */
 
 #include "can_man.h"
+#include "utils/timestamp.h"
 #include <devctl.h>
+#include <string.h>
 
 #undef DO_TRACE
 
 
 int can_dev_arm(resmgr_context_t *ctp, iofunc_ocb_t *io_ocb, sigevent event) {
-	can_ocb_t *pocb = new can_ocb_t();
+	can_ocb_t *pocb = (can_ocb_t *) io_ocb;
+	IOFUNC_ATTR_T *pattr = (IOFUNC_ATTR_T *)io_ocb->attr;
+	int i;
+
 	pocb->rcvid = ctp->rcvid;
 	pocb->clt_event = event;
 
-	IOFUNC_ATTR_T *pattr = (IOFUNC_ATTR_T *)io_ocb->attr;
-	pattr->notify_pocb = pocb;
+	/* Already armed, only the event is updated. */
+	if (pocb->armed)
+		return EOK;
+
+	for (i=0; i<CAN_MAX_CLIENTS; i++) {
+		if (pattr->clients[i] == NULL) {
+			pattr->clients[i] = pocb;
+			pocb->armed = 1;
+			/* The chip must now pass the messages of this client too. */
+			return can_dev_load_filters(pattr);
+		}
+	}
+
+#ifdef DO_TRACE
+	printf("can_dev_arm: more than %d clients\n", CAN_MAX_CLIENTS);
+#endif
+	return EBUSY;
+}
+
+
+void can_dev_disarm(IOFUNC_ATTR_T *pattr, can_ocb_t *pocb) {
+	int i;
+
+	if (!pocb->armed)
+		return;
+
+	for (i=0; i<CAN_MAX_CLIENTS; i++) {
+		if (pattr->clients[i] == pocb)
+			pattr->clients[i] = NULL;
+	}
+	pocb->armed = 0;
+
+	/* The messages only this client wanted may be rejected again. */
+	can_dev_load_filters(pattr);
+}
+
+
+/** Return the narrowest filter that passes every message that either of two
+ * filters passes: the bits compared by both, on which their ids agree. */
+static can_filter_t can_merge_filters(can_filter_t a, can_filter_t b) {
+	can_filter_t merged;
+
+	merged.mask = a.mask & b.mask & ~(a.id ^ b.id);
+	merged.id = a.id & merged.mask;
+	return merged;
+}
+
+
+/** Whether a filter passes every message that another filter passes. */
+static bool can_filter_covers(can_filter_t a, can_filter_t b) {
+	can_filter_t merged = can_merge_filters(a, b);
+
+	return merged.id == (a.id & a.mask) && merged.mask == a.mask;
+}
+
+
+/** Return the number of bits of the identifier that a filter compares. */
+static int can_filter_bits(can_filter_t filter) {
+	int num_bits = 0;
+
+	for (unsigned long mask = filter.mask; mask != 0; mask &= mask - 1)
+		num_bits++;
+	return num_bits;
+}
+
+
+/** Add a filter to at most two filters that pass every message of the filters
+ * added so far.
+ *
+ * @param filters
+ * 		the two filters
+ * @param num_filters
+ * 		number of elements in filters, updated
+ * @param filter
+ * 		the filter to add
+ */
+static void can_add_filter(can_filter_t *filters, int *num_filters,
+		can_filter_t filter) {
+	can_filter_t merged[3];
+	int best = 0;
+
+	/* Nothing to add if one of the filters already passes its messages. */
+	for (int i=0; i<*num_filters; i++)
+		if (can_filter_covers(filters[i], filter))
+			return;
+
+	if (*num_filters < 2) {
+		filters[(*num_filters)++] = filter;
+	} else {
+		/* Three filters: merge the two whose union compares the most bits. */
+		merged[0] = can_merge_filters(filters[0], filter);
+		merged[1] = can_merge_filters(filters[1], filter);
+		merged[2] = can_merge_filters(filters[0], filters[1]);
+		for (int i=1; i<3; i++)
+			if (can_filter_bits(merged[i]) > can_filter_bits(merged[best]))
+				best = i;
 
+		if (best == 2)
+			filters[1] = filter;
+		filters[best == 1 ? 1 : 0] = merged[best];
+	}
+
+	/* One of the two filters may now pass every message of the other. */
+	if (*num_filters == 2 && can_filter_covers(filters[1], filters[0]))
+		filters[0] = filters[1];
+	if (*num_filters == 2 && can_filter_covers(filters[0], filters[1]))
+		*num_filters = 1;
+}
+
+
+int can_dev_load_filters(IOFUNC_ATTR_T *pattr) {
+	can_filter_t filters[2];
+	can_filter_t accept_all = { 0, 0 };
+	int num_filters = 0;
+	bool armed = false;
+	int status;
+
+	for (int i=0; i<CAN_MAX_CLIENTS; i++) {
+		can_ocb_t *pocb = pattr->clients[i];
+		if (pocb == NULL)
+			continue;
+		armed = true;
+		if (pocb->num_filters == 0)
+			can_add_filter(filters, &num_filters, accept_all);
+		for (int j=0; j<pocb->num_filters; j++)
+			can_add_filter(filters, &num_filters, pocb->filter[j]);
+	}
+	if (!armed)
+		can_add_filter(filters, &num_filters, pattr->can_info.filter);
+
+	if (num_filters == 1)
+		status = pattr->can_dev->set_filter(filters[0]);
+	else
+		status = pattr->can_dev->set_dual_filter(filters[0], filters[1]);
+	if (status != 0)
+		return EIO;
+
+	/* A message being sent when the chip was reset is sent again. */
+	pattr->can_dev->requeue_aborted(pattr->out_buff);
+	return EOK;
+}
+
+
+int can_dev_cyclic_start(resmgr_context_t *ctp, IOFUNC_ATTR_T *pattr,
+		can_ocb_t *pocb, can_cyclic_t *pcyclic) {
+	can_msg_t *pmsg = &pcyclic->msg;
+	can_cyclic_slot_t *pslot;
+	can_payload_t payload;
+	int slot = -1;
+	int i;
+
+	if (pcyclic->period_ms < CAN_CYCLIC_MIN_PERIOD_MS)
+		return EINVAL;
+	if (pattr->can_info.listen_only)
+		return EPERM;
+	if (pmsg->size > 8)
+		pmsg->size = 8;
+
+	/* A message is only sent by a single client, once. */
+	for (i=0; i<CAN_MAX_CYCLIC; i++) {
+		pslot = &pattr->cyclic[i];
+		if (pslot->owner_pid == 0) {
+			if (slot == -1)
+				slot = i;
+		} else if (CAN_TX_KEY(pslot->msg) == CAN_TX_KEY(*pmsg)) {
+			if (pattr->cyclic_owner[i] != pocb)
+				return EBUSY;
+			slot = i;
+			break;
+		}
+	}
+	if (slot == -1) {
+#ifdef DO_TRACE
+		printf("can_dev_cyclic_start: more than %d messages\n",
+				CAN_MAX_CYCLIC);
+#endif
+		return EBUSY;
+	}
+
+	/* A frame that was not sent within a period is replaced by the next. */
+	pslot = &pattr->cyclic[slot];
+	pattr->cyclic_owner[slot] = pocb;
+	pslot->owner_pid = ctp->info.pid;
+	pslot->owner_coid = ctp->info.coid;
+	pslot->msg = *pmsg;
+	pslot->msg.tx_ttl_ms = pcyclic->period_ms;
+	pslot->msg.tx_time_ns = 0;
+	pslot->msg.tx_flags = CAN_TX_REPLACE;
+	pslot->period_ns = (uint64_t) pcyclic->period_ms * 1000000;
+	pslot->next_time = get_monotonic_ns();
+
+	payload.size = pmsg->size;
+	memcpy(payload.data, pmsg->data, sizeof(payload.data));
+	pattr->cyclic_shm->slots[slot].value.store(payload);
+
+	pcyclic->slot = slot;
+	memset(&pcyclic->shm, 0, sizeof(pcyclic->shm));
+	strncpy(pcyclic->shm.name, pattr->cyclic_shm_name, CAN_SHM_NAME_MAX);
+	pcyclic->shm.size = sizeof(can_cyclic_shm_t);
+
+	can_set_cyclic_timer(pattr);
+	return EOK;
+}
+
+
+int can_dev_cyclic_stop(IOFUNC_ATTR_T *pattr, can_ocb_t *pocb, int slot) {
+	if (slot < 0 || slot >= CAN_MAX_CYCLIC ||
+			pattr->cyclic[slot].owner_pid == 0 ||
+			pattr->cyclic_owner[slot] != pocb)
+		return EINVAL;
+
+	pattr->cyclic[slot].owner_pid = 0;
+	pattr->cyclic_owner[slot] = NULL;
+	can_set_cyclic_timer(pattr);
 	return EOK;
 }
+
+
+void can_dev_cyclic_release(IOFUNC_ATTR_T *pattr, can_ocb_t *pocb) {
+	int i;
+	int count = 0;
+
+	for (i=0; i<CAN_MAX_CYCLIC; i++) {
+		if (pattr->cyclic[i].owner_pid != 0 &&
+				pattr->cyclic_owner[i] == pocb) {
+			pattr->cyclic[i].owner_pid = 0;
+			pattr->cyclic_owner[i] = NULL;
+			count++;
+		}
+	}
+	if (count != 0)
+		can_set_cyclic_timer(pattr);
+}
+
+
+void can_dev_cyclic_adopt(resmgr_context_t *ctp, IOFUNC_ATTR_T *pattr,
+		can_ocb_t *pocb) {
+	int i;
+
+	for (i=0; i<CAN_MAX_CYCLIC; i++) {
+		can_cyclic_slot_t *pslot = &pattr->cyclic[i];
+		if (pslot->owner_pid == ctp->info.pid &&
+				pslot->owner_coid == ctp->info.coid &&
+				pattr->cyclic_owner[i] == NULL) {
+			pattr->cyclic_owner[i] = pocb;
+			pattr->num_cyclic_orphans--;
+		}
+	}
+}
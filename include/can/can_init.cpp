@@ -15,114 +15,834 @@
 #include "can_man.h"
 #include <sys/iofunc.h>
 #include <sys/dispatch.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <errno.h>
+#include "utils/timestamp.h"
 
 #undef DO_TRACE
 
 
+/** Rings of the frames forwarded from channel i to channel j, in
+ * can_route_rings[i][j]. Static, so that the slots of the rings are aligned. */
+static can_route_ring_t can_route_rings[MAX_CHANNELS][MAX_CHANNELS];
+
+/** Device attributes of every channel whose route pulse is attached, NULL for
+ * the others. */
+static can_attr_t *can_route_attrs[MAX_CHANNELS];
+
+
+/** Deliver the event registered with can_arm to every armed client.
+ *
+ * Every armed client reads the new messages through its own cursor. The number
+ * of messages each client has not read yet is recorded in the statistics.
+ *
+ * @param pattr
+ * 		pointer to the device attributes object
+ */
+static void can_notify_clients(can_attr_t *pattr) {
+	int i;
+	int status;
+	can_ocb_t *pocb;
+
+	for (i=0; i<CAN_MAX_CLIENTS; i++) {
+		if ((pocb = pattr->clients[i]) == NULL)
+			continue;
+		/* The cursors of shared memory readers are in their own process. */
+		if (!pocb->shm_reader)
+			pattr->can_dev->record_rx_backlog(
+				can_rx_get_count(pattr->in_buff, &pocb->cursor));
+		status = MsgDeliverEvent(pocb->rcvid, &pocb->clt_event);
+#ifdef DO_TRACE
+		printf("MsgDeliverEvent %d \n", pocb->rcvid);
+		fflush(stdout);
+#endif
+		if (status == ERROR) {
+			pattr->can_dev->can_notify_client_err++;
+#ifdef DO_TRACE
+			printf("Failed to deliver CAN client notify event\n");
+#endif
+		}
+	}
+}
+
+
+/** Tell the channels that frames were forwarded to that they must queue them.
+ *
+ * The route pulse of a channel is delivered to its thread pool, which queues
+ * the frames under the lock of that channel (see can_handle_route). A channel
+ * that cannot get the pulse yet finds the frames in its ring with the next
+ * one.
+ *
+ * @param pattr
+ * 		pointer to the device attributes object of the forwarding channel
+ */
+static void can_notify_routes(can_attr_t *pattr) {
+	unsigned int routed = pattr->can_dev->take_routed();
+	can_attr_t *pdst;
+
+	for (int i=0; routed != 0; i++, routed >>= 1) {
+		if (!(routed & 1) || (pdst = can_route_attrs[i]) == NULL)
+			continue;
+		if (MsgSendPulse(pdst->route_event.sigev_coid,
+				pdst->route_event.sigev_priority,
+				pdst->route_event.sigev_code, 0) == -1)
+			perror("MsgSendPulse");
+	}
+}
+
+
+/** Start or stop the poll timer after a change of receive mode.
+ *
+ * @param pattr
+ * 		pointer to the device attributes object
+ * @param mode
+ * 		CAN_RX_MODE_POLL to start the timer, CAN_RX_MODE_INTR to stop it, as
+ * 		returned by CANDeviceManager::update_rx_mode
+ */
+static void can_set_poll_timer(can_attr_t *pattr, int mode) {
+	struct itimerspec itime;
+	unsigned int period_us = pattr->can_info.poll_period_us;
+
+	/* A zero it_value disarms the timer. */
+	memset(&itime, 0, sizeof(itime));
+	if (mode == CAN_RX_MODE_POLL) {
+		itime.it_value.tv_sec = period_us / 1000000;
+		itime.it_value.tv_nsec = (period_us % 1000000) * 1000;
+		itime.it_interval = itime.it_value;
+	}
+
+	if (timer_settime(pattr->poll_timer, 0, &itime, NULL) == -1)
+		perror("timer_settime");
+#ifdef DO_TRACE
+	printf("can_set_poll_timer: %s\n",
+			mode == CAN_RX_MODE_POLL ? "polling" : "interrupt");
+#endif
+}
+
+
+void can_set_tx_timer(can_attr_t *pattr) {
+	struct itimerspec itime;
+	uint64_t tx_time;
+
+	if (!pattr->can_dev->get_next_tx_time(pattr->out_buff, &tx_time))
+		return;
+	if (tx_time == pattr->tx_timer_time)
+		return;
+
+	/* The times of get_monotonic_ns are absolute CLOCK_MONOTONIC times. */
+	memset(&itime, 0, sizeof(itime));
+	itime.it_value.tv_sec = tx_time / 1000000000;
+	itime.it_value.tv_nsec = tx_time % 1000000000;
+	if (timer_settime(pattr->tx_timer, TIMER_ABSTIME, &itime, NULL) == -1) {
+		perror("timer_settime");
+		return;
+	}
+	pattr->tx_timer_time = tx_time;
+}
+
+
 /** Process and respond to interrupt events from the CAN card.
  *
- * When pulse is received by the resource manager as a result of the
- * InterruptAttachEvent in pulse_init the device-specific routine
- * can_dev->interrupt() is called to reset any interrupt registers, etc.
+ * When the interrupt attached by can_interrupt_thread is raised, the
+ * device-specific routine can_dev->interrupt() is called to reset any interrupt
+ * registers, etc.
  *
  * Furthermore, any event registered by the client with can_arm is delivered to
  * the client, who will then do a read to get the data that has been copied into
  * the message buffer.
  *
- * @param ctp
- * 		dummy variable
- * @param code
- * 		dummy variable
- * @param flags
- * 		dummy variable
- * @param ptr
+ * @param pattr
  * 		pointer to the device attributes object
- * @return
- * 		0 for success, or -1 if an error occurs
  */
-int can_handle_interrupt(message_context_t *ctp, int code, unsigned flags,
-		void *ptr) {
-	int status;
+static void can_service_interrupt(can_attr_t *pattr) {
 	int mask_count;
 	int is_recv = 0;	// set to 1 if interrupt is receive CAN
-	can_attr_t *pattr = (can_attr_t *) ptr;
+	int mode;
 	can_info_t *pinfo = &pattr->can_info;
-	can_ocb_t *pocb = pattr->notify_pocb;
+	uint64_t start = get_monotonic_ns();
 
 #ifdef DO_TRACE
-        printf("enter can_handle_interrupt: pocb 0x%x\n", (unsigned int) pocb);
+        printf("enter can_service_interrupt\n");
 	fflush(stdout);
 #endif
 
-	is_recv = pattr->can_dev->interrupt(pattr->in_buff, pattr->out_buff,
-			(pattr->can_info).filter);
+	/* Shared with the devctls and timers handled by the thread pool. */
+	iofunc_attr_lock(&pattr->io_attr);
+
+	is_recv = pattr->can_dev->interrupt(pattr->in_buff, pattr->out_buff);
 
 #ifdef DO_TRACE
-	printf("can_handle_interrupt: is_recv %d, pocb 0x%x\n",
-		is_recv, (unsigned int) pocb);
+	printf("can_service_interrupt: is_recv %d\n", is_recv);
 	fflush(stdout);
 #endif
 
-	if (is_recv && pocb != NULL) {
-		status = MsgDeliverEvent(pocb->rcvid, &pocb->clt_event);
-#ifdef DO_TRACE
-		printf("MsgDeliverEvent %d \n", pocb->rcvid);
-		fflush(stdout);
-#endif
-		if (status == ERROR) {
-			pattr->can_dev->can_notify_client_err++;
-#ifdef DO_TRACE
-			printf("Failed to deliver CAN client notify event\n");
-#endif
-		}
+	if (is_recv) {
+		can_notify_clients(pattr);
+		can_notify_routes(pattr);
 	}
 
+	/* The next queued message may have to wait for its transmit time. */
+	can_set_tx_timer(pattr);
+
+	/* Switch to polling if the Rx frame rate got too high. */
+	if ((mode = pattr->can_dev->update_rx_mode()) != 0)
+		can_set_poll_timer(pattr, mode);
+
 	if ((mask_count = InterruptUnmask(pinfo->irq, pinfo->intr_id)) != 0)
 		pattr->can_dev->mask_count_non_zero++;
 
+	pattr->can_dev->record_isr_time(get_monotonic_ns() - start);
+
+	iofunc_attr_unlock(&pattr->io_attr);
+
 #ifdef DO_TRACE
 	printf("mask_count %d\n", mask_count);
 	fflush(stdout);
 #endif
+}
+
+
+/** Wait for the interrupts of a channel and service them.
+ *
+ * Runs at CAN_INTR_PRIORITY, above the clients and the thread pool that
+ * handles their messages, so the latency of the Rx and Tx servicing does not
+ * depend on how the clients behave. The device attributes are locked while an
+ * interrupt is serviced. That lock is a mutex with priority inheritance, so a
+ * pool thread that holds it for a devctl runs at CAN_INTR_PRIORITY until it
+ * releases it.
+ *
+ * @param arg
+ * 		pointer to the device attributes object
+ * @return
+ * 		NULL
+ */
+static void *can_interrupt_thread(void *arg) {
+	can_attr_t *pattr = (can_attr_t *) arg;
+	can_info_t *pinfo = &pattr->can_info;
+	int mask_count;
+
+	/* InterruptWait needs the interrupt to be attached by the same thread. */
+	ThreadCtl(_NTO_TCTL_IO, NULL);
+	SIGEV_INTR_INIT(&pattr->hw_event);
+	if ((pinfo->intr_id = InterruptAttachEvent(pinfo->irq,
+			 &pattr->hw_event, _NTO_INTR_FLAGS_TRK_MSK)) == -1) {
+		perror("InterruptAttach");
+		return NULL;
+	}
+	printf("IRQ %d attached: ID %d\n", pinfo->irq, pinfo->intr_id);
+	fflush(stdout);
+	if ((mask_count = InterruptUnmask(pinfo->irq, pinfo->intr_id)) != 0) {
+		printf("mask count: %d\n", mask_count);
+	}
 
+	while (1) {
+		if (InterruptWait(0, NULL) == -1) {
+			perror("InterruptWait");
+			continue;
+		}
+		can_service_interrupt(pattr);
+	}
+	return NULL;
+}
+
+
+/** Read the frames queued in the chip while polling.
+ *
+ * Called when the poll timer started by can_set_poll_timer fires. Clients are
+ * notified once for all the frames read.
+ *
+ * @param ctp
+ * 		dummy variable
+ * @param code
+ * 		dummy variable
+ * @param flags
+ * 		dummy variable
+ * @param ptr
+ * 		pointer to the device attributes object
+ * @return
+ * 		0 for success, or -1 if an error occurs
+ */
+int can_handle_poll(message_context_t *ctp, int code, unsigned flags,
+		void *ptr) {
+	int mode;
+	can_attr_t *pattr = (can_attr_t *) ptr;
+
+	/* Pulses are not locked by the resource manager library. */
+	iofunc_attr_lock(&pattr->io_attr);
+
+	if (pattr->can_dev->poll(pattr->in_buff) > 0) {
+		can_notify_clients(pattr);
+		can_notify_routes(pattr);
+	}
+
+	/* Go back to the Rx interrupt once the bus is quiet. */
+	if ((mode = pattr->can_dev->update_rx_mode()) != 0)
+		can_set_poll_timer(pattr, mode);
+
+	iofunc_attr_unlock(&pattr->io_attr);
 	return EOK;
 }
 
 
+/** Send the messages whose transmit time was reached.
+ *
+ * Called when the timer set by can_set_tx_timer fires.
+ *
+ * @param ctp
+ * 		dummy variable
+ * @param code
+ * 		dummy variable
+ * @param flags
+ * 		dummy variable
+ * @param ptr
+ * 		pointer to the device attributes object
+ * @return
+ * 		0 for success, or -1 if an error occurs
+ */
+int can_handle_tx_timer(message_context_t *ctp, int code, unsigned flags,
+		void *ptr) {
+	can_attr_t *pattr = (can_attr_t *) ptr;
+
+	iofunc_attr_lock(&pattr->io_attr);
+	pattr->tx_timer_time = 0;
+	pattr->can_dev->tx_timer_expired(pattr->out_buff);
+	can_set_tx_timer(pattr);
+	iofunc_attr_unlock(&pattr->io_attr);
+
+	return EOK;
+}
+
+
+/** Queue the frames forwarded to a channel by the other channels.
+ *
+ * Called when a channel that forwards frames to this one sends its route
+ * pulse (see can_notify_routes).
+ *
+ * @param ctp
+ * 		dummy variable
+ * @param code
+ * 		dummy variable
+ * @param flags
+ * 		dummy variable
+ * @param ptr
+ * 		pointer to the device attributes object
+ * @return
+ * 		0 for success, or -1 if an error occurs
+ */
+int can_handle_route(message_context_t *ctp, int code, unsigned flags,
+		void *ptr) {
+	can_attr_t *pattr = (can_attr_t *) ptr;
+	int num_queued = 0;
+
+	iofunc_attr_lock(&pattr->io_attr);
+	for (int i=0; i<MAX_CHANNELS; i++)
+		if (i != pattr->channel)
+			num_queued += pattr->can_dev->forward(pattr->out_buff,
+					&can_route_rings[i][pattr->channel]);
+	if (num_queued != 0)
+		can_set_tx_timer(pattr);
+	iofunc_attr_unlock(&pattr->io_attr);
+
+	return EOK;
+}
+
+
+/** Send the periodic messages whose transmit time was reached.
+ *
+ * Called when the timer set by can_set_cyclic_timer fires. The latest payload
+ * written by the client of each message is copied from shared memory, and the
+ * messages are queued together, so the one with the highest priority goes
+ * first. A period that was missed entirely is skipped rather than made up.
+ *
+ * @param ctp
+ * 		dummy variable
+ * @param code
+ * 		dummy variable
+ * @param flags
+ * 		dummy variable
+ * @param ptr
+ * 		pointer to the device attributes object
+ * @return
+ * 		0 for success, or -1 if an error occurs
+ */
+int can_handle_cyclic(message_context_t *ctp, int code, unsigned flags,
+		void *ptr) {
+	can_attr_t *pattr = (can_attr_t *) ptr;
+	can_msg_t msgs[CAN_MAX_CYCLIC];
+	int num_msgs = 0;
+	uint64_t now = get_monotonic_ns();
+	can_payload_t payload;
+	int i;
+
+	iofunc_attr_lock(&pattr->io_attr);
+	pattr->cyclic_timer_time = 0;
+	for (i=0; i<CAN_MAX_CYCLIC; i++) {
+		can_cyclic_slot_t *pslot = &pattr->cyclic[i];
+		if (pslot->owner_pid == 0 || pslot->next_time > now)
+			continue;
+
+		/* A message kept from the last manager is sent until its client
+		 * exits, if it never opens the device again. */
+		if (pattr->cyclic_owner[i] == NULL &&
+				kill(pslot->owner_pid, 0) == -1 && errno == ESRCH) {
+			pslot->owner_pid = 0;
+			pattr->num_cyclic_orphans--;
+			continue;
+		}
+
+		/* A client that is writing the payload (or died while writing it)
+		 * gets the last payload sent. */
+		if (pattr->cyclic_shm->slots[i].value.load(&payload,
+				CAN_CYCLIC_READ_TRIES)) {
+			pslot->msg.size = payload.size > 8 ? 8 : payload.size;
+			memcpy(pslot->msg.data, payload.data, sizeof(payload.data));
+		}
+		msgs[num_msgs++] = pslot->msg;
+
+		pslot->next_time += pslot->period_ns;
+		if (pslot->next_time <= now)
+			pslot->next_time = now + pslot->period_ns;
+	}
+
+	if (num_msgs != 0) {
+		pattr->can_dev->write_batch(pattr->out_buff, msgs, num_msgs);
+		can_set_tx_timer(pattr);
+	}
+	can_set_cyclic_timer(pattr);
+	iofunc_attr_unlock(&pattr->io_attr);
+
+	return EOK;
+}
+
+
+void can_set_cyclic_timer(can_attr_t *pattr) {
+	struct itimerspec itime;
+	uint64_t next_time = 0;
+	int i;
+
+	for (i=0; i<CAN_MAX_CYCLIC; i++) {
+		can_cyclic_slot_t *pslot = &pattr->cyclic[i];
+		if (pslot->owner_pid != 0 &&
+				(next_time == 0 || pslot->next_time < next_time))
+			next_time = pslot->next_time;
+	}
+	if (next_time == pattr->cyclic_timer_time)
+		return;
+
+	/* A zero it_value disarms the timer. */
+	memset(&itime, 0, sizeof(itime));
+	itime.it_value.tv_sec = next_time / 1000000000;
+	itime.it_value.tv_nsec = next_time % 1000000000;
+	if (timer_settime(pattr->cyclic_timer, TIMER_ABSTIME, &itime, NULL) == -1) {
+		perror("timer_settime");
+		return;
+	}
+	pattr->cyclic_timer_time = next_time;
+}
+
+
+/** Create, size and map a shared memory object, replacing any object with the
+ * same name.
+ *
+ * @param name
+ * 		name of the object
+ * @param size
+ * 		size of the object, in bytes
+ * @param mode
+ * 		permissions of the object
+ * @param pattr
+ * 		attributes of the device, whose owner and group the object takes
+ * @return
+ * 		address of the mapping, or NULL if an error occurs
+ */
+static void *can_shm_create(const char *name, size_t size, mode_t mode,
+		const can_attr_t *pattr) {
+	int fd;
+	void *addr;
+
+	shm_unlink(name);
+	if ((fd = shm_open(name, O_RDWR | O_CREAT, mode)) == -1) {
+		perror("shm_open");
+		return NULL;
+	}
+	/* The mode is otherwise reduced by the umask of the driver. */
+	fchmod(fd, mode);
+	if (fchown(fd, pattr->io_attr.uid, pattr->io_attr.gid) == -1)
+		perror("fchown");
+	if (ftruncate(fd, size) == -1) {
+		perror("ftruncate");
+		close(fd);
+		return NULL;
+	}
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	return addr;
+}
+
+
+/** Map an existing shared memory object.
+ *
+ * @param name
+ * 		name of the object
+ * @param size
+ * 		expected size of the object, in bytes
+ * @return
+ * 		address of the mapping, or NULL if there is no object of that size
+ */
+static void *can_shm_attach(const char *name, size_t size) {
+	int fd;
+	void *addr;
+	struct stat st;
+
+	if ((fd = shm_open(name, O_RDWR, 0)) == -1)
+		return NULL;
+	if (fstat(fd, &st) == -1 || st.st_size != (off_t) size) {
+		close(fd);
+		return NULL;
+	}
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return (addr == MAP_FAILED) ? NULL : addr;
+}
+
+
+int can_shm_init(can_attr_t *pattr) {
+	const char *base;
+	void *addr;
+	can_cyclic_shm_t *pshm;
+	int warm = 0;
+	int i;
+
+	/* Shared memory object names have a single leading slash. */
+	base = strrchr(pattr->devname, '/');
+	base = (base == NULL) ? pattr->devname : base + 1;
+	snprintf(pattr->shm_name, CAN_SHM_NAME_MAX, "/%s.rx", base);
+	snprintf(pattr->cyclic_shm_name, CAN_SHM_NAME_MAX, "/%s.tx", base);
+
+	/* The rings of an earlier run are kept, with the read positions of the
+	 * clients still valid in them. The magic number is written last when the
+	 * object is created, so an object whose creation was interrupted is not
+	 * taken over. */
+	if ((addr = can_shm_attach(pattr->shm_name, sizeof(can_shm_t))) != NULL) {
+		pattr->shm = (can_shm_t *) addr;
+		if (pattr->shm->magic == CAN_SHM_MAGIC &&
+				pattr->shm->version == CAN_SHM_VERSION &&
+				pattr->shm->size == sizeof(can_shm_t))
+			warm = 1;
+		else
+			munmap(addr, sizeof(can_shm_t));
+	}
+
+	if (warm) {
+		pattr->in_buff = &pattr->shm->rx;
+		pattr->out_buff = &pattr->shm->tx;
+	} else {
+		/* The input rings are only read by the clients. */
+		if ((addr = can_shm_create(pattr->shm_name, sizeof(can_shm_t), 0644,
+				pattr)) == NULL)
+			return -1;
+
+		/* The mapping is page aligned, so the alignment of the rings holds. */
+		pattr->shm = new (addr) can_shm_t();
+		pattr->shm->version = CAN_SHM_VERSION;
+		pattr->shm->size = sizeof(can_shm_t);
+		pattr->shm->generation = 0;
+		memset(&pattr->shm->state, 0, sizeof(pattr->shm->state));
+		pattr->in_buff = &pattr->shm->rx;
+		pattr->out_buff = &pattr->shm->tx;
+		pattr->shm->magic = CAN_SHM_MAGIC;
+	}
+	/* Tells the clients that mapped the object that it was taken over. */
+	pattr->shm->generation++;
+
+	/* The payloads of the periodic messages that were kept are in the object
+	 * of the last manager, which their clients still update. */
+	pattr->cyclic = pattr->shm->cyclic;
+	pattr->cyclic_shm = NULL;
+	if ((addr = can_shm_attach(pattr->cyclic_shm_name,
+			sizeof(can_cyclic_shm_t))) != NULL) {
+		pshm = (can_cyclic_shm_t *) addr;
+		if (warm && pshm->magic == CAN_CYCLIC_SHM_MAGIC &&
+				pshm->version == CAN_CYCLIC_SHM_VERSION &&
+				pshm->size == sizeof(can_cyclic_shm_t)) {
+			pattr->cyclic_shm = pshm;
+		} else {
+			/* Tells the clients that mapped it that their messages are no
+			 * longer sent. */
+			pshm->magic = 0;
+			munmap(addr, sizeof(can_cyclic_shm_t));
+		}
+	}
+
+	if (pattr->cyclic_shm == NULL) {
+		/* The payloads are sent on the bus as they are, so only the owner
+		 * and the group of the device may write them. A client that starts
+		 * periodic messages must run in that group. */
+		memset(pattr->cyclic, 0, sizeof(pattr->shm->cyclic));
+		if ((addr = can_shm_create(pattr->cyclic_shm_name,
+				sizeof(can_cyclic_shm_t), 0660, pattr)) == NULL)
+			return -1;
+		pattr->cyclic_shm = new (addr) can_cyclic_shm_t();
+		pattr->cyclic_shm->version = CAN_CYCLIC_SHM_VERSION;
+		pattr->cyclic_shm->size = sizeof(can_cyclic_shm_t);
+		pattr->cyclic_shm->magic = CAN_CYCLIC_SHM_MAGIC;
+	}
+
+	/* The messages kept wait for their clients to open the device again. A
+	 * message left half written by the last manager is dropped. */
+	pattr->num_cyclic_orphans = 0;
+	for (i=0; i<CAN_MAX_CYCLIC; i++) {
+		can_cyclic_slot_t *pslot = &pattr->cyclic[i];
+		pattr->cyclic_owner[i] = NULL;
+		if (pslot->owner_pid == 0)
+			continue;
+		if (pslot->msg.size > 8 || pslot->period_ns <
+				(uint64_t) CAN_CYCLIC_MIN_PERIOD_MS * 1000000)
+			pslot->owner_pid = 0;
+		else
+			pattr->num_cyclic_orphans++;
+	}
+
+	printf("Input rings of %s in shared memory %s (%s, generation %u), "
+			"%d periodic messages in %s\n", pattr->devname, pattr->shm_name,
+			warm ? "taken over" : "created", pattr->shm->generation,
+			pattr->num_cyclic_orphans, pattr->cyclic_shm_name);
+	fflush(stdout);
+	return warm;
+}
+
+
+/** Rings of the binary dumps, one per channel. Static, so that the slots of
+ * the rings are aligned. */
+static can_dump_ring_t can_dump_rings[MAX_CHANNELS];
+
+
+/** Write the frames of a channel to its dump file, as they arrive through its
+ * dump ring.
+ *
+ * @param arg
+ * 		pointer to the device attributes object of the channel
+ */
+static void *can_dump_thread(void *arg) {
+	can_attr_t *pattr = (can_attr_t *) arg;
+	can_dump_record_t records[CAN_DUMP_BATCH];
+	can_dump_record_t *record;
+	can_msg_t msg;
+	struct timespec pause;
+	int num_records;
+
+	pause.tv_sec = 0;
+	pause.tv_nsec = CAN_DUMP_PERIOD_MS * 1000000L;
+	while (true) {
+		num_records = 0;
+		while (num_records < CAN_DUMP_BATCH &&
+				pattr->dump_ring->pop(&msg)) {
+			record = &records[num_records++];
+			memset(record, 0, sizeof(can_dump_record_t));
+			record->rx_time_ns = msg.rx_time_ns;
+			record->id = CAN_ID(msg) |
+					(IS_EXTENDED_FRAME(msg) ? 0x80000000 : 0);
+			record->size = msg.size;
+			memcpy(record->data, msg.data, msg.size);
+		}
+
+		if (num_records > 0 && fwrite(records,
+				sizeof(can_dump_record_t), num_records, pattr->dump_file)
+				!= (size_t) num_records) {
+			perror("can_dump_thread: fwrite");
+			return NULL;
+		}
+
+		/* Caught up with the chip: make the frames visible in the file. */
+		if (num_records < CAN_DUMP_BATCH) {
+			fflush(pattr->dump_file);
+			nanosleep(&pause, NULL);
+		}
+	}
+	return NULL;
+}
+
+
+int can_dump_init(can_attr_t *pattr) {
+	can_dump_header_t header;
+	struct timespec now;
+	pthread_t tid;
+
+	if ((pattr->dump_file = fopen(pattr->can_info.dump_file, "wb")) == NULL) {
+		perror(pattr->can_info.dump_file);
+		return -1;
+	}
+	/* The file is written in large blocks, not once per batch. */
+	setvbuf(pattr->dump_file, NULL, _IOFBF, 1 << 20);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = CAN_DUMP_MAGIC;
+	header.version = CAN_DUMP_VERSION;
+	header.record_size = sizeof(can_dump_record_t);
+	header.bit_speed = pattr->can_info.bit_speed;
+	clock_gettime(CLOCK_REALTIME, &now);
+	header.monotonic_ns = get_monotonic_ns();
+	header.realtime_ns = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+	if (fwrite(&header, sizeof(header), 1, pattr->dump_file) != 1) {
+		perror(pattr->can_info.dump_file);
+		fclose(pattr->dump_file);
+		return -1;
+	}
+
+	pattr->dump_ring = &can_dump_rings[pattr->channel];
+	if (pthread_create(&tid, NULL, can_dump_thread, pattr) != EOK) {
+		perror("Unable to start dump thread");
+		fclose(pattr->dump_file);
+		return -1;
+	}
+
+	printf("Frames of %s dumped to %s\n", pattr->devname,
+			pattr->can_info.dump_file);
+	fflush(stdout);
+	return 0;
+}
+
+
+int can_route_init(can_attr_t *pattr) {
+	can_info_t *pinfo = &pattr->can_info;
+	can_route_t *route;
+
+	for (int i=0; i<pinfo->num_routes; i++) {
+		route = &pinfo->routes[i];
+		if (route->channel < 0 || route->channel >= MAX_CHANNELS ||
+				pattr->can_dev->add_route(*route,
+				&can_route_rings[pattr->channel][route->channel]) == -1) {
+			fprintf(stderr, "%s: invalid route to channel %d\n",
+					pattr->devname, route->channel);
+			return -1;
+		}
+		printf("Frames 0x%lx/0x%lx of %s forwarded to channel %d\n",
+				route->id, route->mask, pattr->devname, route->channel);
+	}
+	fflush(stdout);
+	return 0;
+}
+
+
 void pulse_init(dispatch_t *dpp, can_attr_t *pattr) {
 	can_info_t *pinfo = &pattr->can_info;
-	sigevent *pevent;
-	int mask_count;
+	int coid;
+	int poll_code;
+	int tx_code;
+	int cyclic_code;
+	int route_code;
+	pthread_attr_t thread_attr;
+	struct sched_param param;
+	struct _clockperiod clock_period;
+	pthread_t tid;
 
 #ifdef DO_TRACE
 	printf("pulse_init: irq %d\n", pinfo->irq);
 	fflush(stdout);
 #endif
+	if ((coid = message_connect(dpp, MSG_FLAG_SIDE_CHANNEL)) == ERROR) {
+		fprintf(stderr, "Unable to attach pulse to channel.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* The timer pulses are sent at CAN_INTR_PRIORITY, which the pool
+	 * thread that receives them runs at. */
+
+	/* Pulse sent by the channels that forward frames to this one. */
+	if ((route_code = pulse_attach(dpp, MSG_FLAG_ALLOC_PULSE,
+			0, can_handle_route, pattr)) == ERROR) {
+		fprintf(stderr, "Unable to attach route pulse.\n");
+		exit(EXIT_FAILURE);
+	}
+	SIGEV_PULSE_INIT(&pattr->route_event, coid, CAN_INTR_PRIORITY,
+			route_code, 0);
+	can_route_attrs[pattr->channel] = pattr;
+
+	/* Timer used to send messages at their transmit time. */
+	if ((tx_code = pulse_attach(dpp, MSG_FLAG_ALLOC_PULSE,
+			0, can_handle_tx_timer, pattr)) == ERROR) {
+		fprintf(stderr, "Unable to attach transmit pulse.\n");
+		exit(EXIT_FAILURE);
+	}
+	SIGEV_PULSE_INIT(&pattr->tx_event, coid, CAN_INTR_PRIORITY,
+			tx_code, 0);
+	if (timer_create(CLOCK_MONOTONIC, &pattr->tx_event,
+			&pattr->tx_timer) == -1) {
+		perror("timer_create");
+		exit(EXIT_FAILURE);
+	}
+	pattr->tx_timer_time = 0;
+
+	/* Timer used to send the periodic messages. */
+	if ((cyclic_code = pulse_attach(dpp, MSG_FLAG_ALLOC_PULSE,
+			0, can_handle_cyclic, pattr)) == ERROR) {
+		fprintf(stderr, "Unable to attach cyclic pulse.\n");
+		exit(EXIT_FAILURE);
+	}
+	SIGEV_PULSE_INIT(&pattr->cyclic_event, coid, CAN_INTR_PRIORITY,
+			cyclic_code, 0);
+	if (timer_create(CLOCK_MONOTONIC, &pattr->cyclic_event,
+			&pattr->cyclic_timer) == -1) {
+		perror("timer_create");
+		exit(EXIT_FAILURE);
+	}
+	pattr->cyclic_timer_time = 0;
+
+	/* Without an interrupt, the chip is neither polled nor serviced, but
+	 * messages are still written, sent at their transmit time, sent
+	 * periodically and forwarded from the other channels. */
 	if (pinfo->irq != 0) {
-		pevent = &pattr->hw_event;
-		if (pulse_attach(dpp, MSG_FLAG_ALLOC_PULSE,
-				0, can_handle_interrupt, pattr) == ERROR) {
-			fprintf(stderr, "Unable to attach irq_handler pulse.\n");
-			exit(EXIT_FAILURE);
+		/* Timer used to poll the chip at high Rx frame rates. */
+		if (pinfo->poll_rate != 0) {
+			if ((poll_code = pulse_attach(dpp, MSG_FLAG_ALLOC_PULSE,
+					0, can_handle_poll, pattr)) == ERROR) {
+				fprintf(stderr, "Unable to attach poll pulse.\n");
+				exit(EXIT_FAILURE);
+			}
+			SIGEV_PULSE_INIT(&pattr->poll_event, coid, CAN_INTR_PRIORITY,
+					poll_code, 0);
+			if (timer_create(CLOCK_MONOTONIC, &pattr->poll_event,
+					&pattr->poll_timer) == -1) {
+				perror("timer_create");
+				exit(EXIT_FAILURE);
+			}
+			printf("Polling above %d frames/s, every %d us\n",
+				pinfo->poll_rate, pinfo->poll_period_us);
+
+			/* Timers expire on a clock tick, so a longer tick stretches the
+			 * period, and the delay of the time stamps of polled frames. */
+			if (ClockPeriod(CLOCK_REALTIME, NULL, &clock_period, 0) == 0 &&
+					clock_period.nsec > pinfo->poll_period_us * 1000UL)
+				printf("Warning: clock period of %lu us, above the poll "
+						"period\n", clock_period.nsec / 1000);
+			fflush(stdout);
 		}
-		if ((pevent->sigev_coid = message_connect(dpp, MSG_FLAG_SIDE_CHANNEL))
-				== ERROR) {
-			fprintf(stderr, "Unable to attach pulse to channel.\n");
+
+		/* The interrupts are serviced by a thread of their own, which the
+		 * timers above must exist for. */
+		pthread_attr_init(&thread_attr);
+		pthread_attr_setinheritsched(&thread_attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&thread_attr, SCHED_FIFO);
+		param.sched_priority = CAN_INTR_PRIORITY;
+		pthread_attr_setschedparam(&thread_attr, &param);
+		if (pthread_create(&tid, &thread_attr, can_interrupt_thread,
+				pattr) != EOK) {
+			perror("Unable to start interrupt thread");
 			exit(EXIT_FAILURE);
 		}
-		pevent->sigev_notify = SIGEV_PULSE;
-		pevent->sigev_priority = -1;
-		pevent->sigev_value.sival_int = 0;
-		if ((pinfo->intr_id = InterruptAttachEvent(pinfo->irq,
-				 pevent, _NTO_INTR_FLAGS_TRK_MSK)) == -1) {
-			perror("InterruptAttach");
-		} else {
-			printf("IRQ %d attached: ID %d\n", pinfo->irq,
-				pinfo->intr_id);
-		}
-		fflush(stdout);
-		if ((mask_count = InterruptUnmask(pinfo->irq, pinfo->intr_id)) != 0) {
-			printf("mask count: %d\n", mask_count);
-		}
+		pthread_attr_destroy(&thread_attr);
 	}
 }
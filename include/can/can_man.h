@@ -17,12 +17,19 @@
 #include <sys/iomsg.h>
 #include <sys/iofunc.h>
 #include "utils/common.h"
-#include "utils/buffer.h"
+#include "utils/ring.h"
+#include "utils/deadline_queue.h"
+#include "utils/seqlock.h"
+#include <stdint.h>
 
 
 /** Largest number of element allows in the CAN Rx buffers */
 #define MAX_MSG_BUF 1000
 
+/** Largest number of messages returned by a single DCMD_CAN_READ_BATCH. The
+ * resulting can_msg_batch_t must fit within DAS_MSG_BUF. */
+#define CAN_MAX_BATCH 32
+
 
 /* Macros used when processing can messages. */
 #define PATH_CAN_ID(j)  ((((j)->priority & 0x7) << 26) | \
@@ -49,23 +56,138 @@ typedef struct {
 	BYTE size;				/**< number of data bytes (0-8) */
 	BYTE data[8];			/**< data field (up to 8 bytes) */
 	int error;				/**< set to non-zero if error on read or write */
+	uint64_t rx_time_ns;	/**< monotonic time the message was read from the
+								 chip, in ns (see get_monotonic_ns). While the
+								 chip is polled, up to a poll period after it
+								 was received. */
+	unsigned int tx_ttl_ms;	/**< written messages that are not sent within
+								 this many ms are dropped; 0 for the default
+								 CAN_TX_DEFAULT_TTL_MS */
+	uint64_t tx_time_ns;	/**< monotonic time before which a written message
+								 is not sent, in ns (see get_monotonic_ns); 0
+								 to send it at once */
+	unsigned int tx_flags;	/**< CAN_TX_* flags of a written message */
 } can_msg_t;
 
 
-/** Used to set filtering of CAN messages. */
+/** Flag of a written message that replaces any message with the same key (see
+ * CAN_TX_KEY) still queued, and may be replaced in turn. Only meant for the
+ * commands sent every control cycle, of which only the latest value matters. */
+#define CAN_TX_REPLACE	 0x1
+
+
+/** Type used in devctl for batched CAN reads and writes.
+ *
+ * For reads, count is on input the largest number of messages the client can
+ * accept, and on output the number of valid messages in msgs. For writes, count
+ * is on input the number of messages in msgs, and on output the number of
+ * messages that were queued.
+ */
+typedef struct {
+	int count;						/**< number of messages */
+	can_msg_t msgs[CAN_MAX_BATCH];	/**< messages, oldest first */
+} can_msg_batch_t;
+
+
+/** Used to set filtering of CAN messages.
+ *
+ * A message is accepted if (msg.id & mask) == (id & mask), where msg.id has the
+ * most significant bit set for extended frames (see IS_EXTENDED_FRAME). Setting
+ * that bit in the mask and clearing it in the id selects 11 bit frames only.
+ */
 typedef struct {
 	unsigned long id;		/**< 0 any message id */
-	unsigned long mask;		/**< 0xff all messages */
+	unsigned long mask;		/**< 0 all messages */
 } can_filter_t;
 
 
+/** Largest number of routing rules of a channel. */
+#define CAN_MAX_ROUTES	 8
+
+/** Source address of a can_route_t that leaves the forwarded frames as they
+ * were received. */
+#define CAN_ROUTE_KEEP_SA	 -1
+
+
+/** A routing rule: the frames received by a channel that match the rule are
+ * forwarded to the output queue of another channel by the driver itself (see
+ * CANDeviceManager::add_route).
+ *
+ * A frame matches if (msg.id & mask) == (id & mask), as with can_filter_t.
+ */
+typedef struct {
+	unsigned long id;		/**< identifier to match */
+	unsigned long mask;		/**< bits of the identifier compared, 0 all
+							 messages */
+	int channel;			/**< index of the channel the frames are sent on */
+	int sa;					/**< J1939 source address written into the
+							 forwarded 29 bit frames, or CAN_ROUTE_KEEP_SA */
+} can_route_t;
+
+
+/** Used to set the two filters of the SJA1000 dual filter mode. A message is
+ * accepted if it passes either of the filters. */
+typedef struct {
+	can_filter_t filter[2];	/**< first and second filter */
+} can_dual_filter_t;
+
+
+/** Whether a message passes any of the filters of a client.
+ *
+ * @param filters
+ * 		the filters of the client
+ * @param num_filters
+ * 		number of elements in filters, 0 to accept every message
+ * @param msg
+ * 		the message
+ */
+inline bool can_filter_match(const can_filter_t *filters, int num_filters,
+		const can_msg_t &msg) {
+	if (num_filters == 0)
+		return true;
+	for (int i = 0; i < num_filters; i++)
+		if ((filters[i].id & filters[i].mask) == (msg.id & filters[i].mask))
+			return true;
+	return false;
+}
+
+
+/** Lane of the input rings holding the safety-critical messages (EBC1, EEC1,
+ * CCVS and ETC1), which other traffic cannot overwrite. */
+#define CAN_RX_LANE_SAFETY	 0
+
+/** Lane of the input rings holding every other message. */
+#define CAN_RX_LANE_GENERAL	 1
+
+/** Number of lanes of the input rings. Lanes are read in order, so the safety
+ * lane first. */
+#define CAN_RX_NUM_LANES	 2
+
+
+/** Read position of a client in every lane of the input rings. */
+typedef struct {
+	fanout_cursor_t lanes[CAN_RX_NUM_LANES];	/**< one per lane */
+} can_rx_cursor_t;
+
+
 /** This structure type is specific to the I82527 driver and not visible except
  * to routines in this file. */
 typedef struct {
 	int fd;
 	int channel_id;
+	int pulse_coid;				/**< connection the pulses of can_arm are
+								 delivered on, or -1 */
 	int flags;
 	std::string filename;
+	const struct can_shm *shm;	/**< input rings mapped by can_map_shm, or NULL */
+	can_rx_cursor_t cursor;		/**< next message of shm to read */
+	can_filter_t filter[2];		/**< filters of the client, applied to the
+								 messages read from shm */
+	int num_filters;			/**< number of elements in filter, 0 if the
+								 filters are not known */
+	struct can_cyclic_shm *cyclic;	/**< payloads of the periodic messages,
+									 mapped by can_cyclic_start, or NULL */
+	unsigned int generation;	/**< generation of shm when it was mapped */
 } can_dev_handle_t;
 
 
@@ -77,6 +199,13 @@ typedef struct {
 	int	bit_speed;				/**< bit speed of the CAN in Kb/s */
 	int	intr_id;				/**< ID returned by Interrupt Attach Event */
 	can_filter_t filter;		/**< Used to set filtering of CAN messages */
+	unsigned int poll_rate;		/**< Rx frames/s above which the chip is polled, 0 never */
+	unsigned int poll_period_us;	/**< time between two polls of the chip, in us */
+	int cpu;					/**< CPU running the channel thread, -1 any */
+	bool listen_only;			/**< never acknowledge or send frames */
+	char *dump_file;			/**< file of the binary dump, or NULL */
+	can_route_t routes[CAN_MAX_ROUTES];	/**< frames forwarded to other channels */
+	int num_routes;				/**< number of rules in routes */
 } can_info_t;
 
 
@@ -87,9 +216,81 @@ typedef struct {
 	unsigned int rx_interrupt_count;    /**< Rx interrupt count for the CAN card. */
 	unsigned int rx_message_lost_count; /**< Number of Rx message overrun errors. */
 	unsigned int tx_interrupt_count;    /**< Tx interrupt count for the CAN card. */
+	unsigned int rx_ring_full_count;	/**< Rx messages of the general lane missed by clients that fell a full input ring behind. */
+	unsigned int rx_filtered_count;		/**< Rx messages passed by the chip but rejected by the software filter. */
+	unsigned int tx_expired_count;		/**< Tx messages dropped because they were not sent before their deadline. */
+	unsigned int tx_replaced_count;		/**< Tx messages replaced by a newer message with the same PGN/destination. */
+	unsigned int intr_mode_ms;			/**< Time spent receiving through Rx interrupts, in ms. */
+	unsigned int poll_mode_ms;			/**< Time spent receiving by polling the chip, in ms. */
+	unsigned int poll_count;			/**< Number of times the chip was polled. */
+	unsigned int poll_switch_count;		/**< Number of switches between the two receive modes. */
+	unsigned int rx_safety_ring_full_count;	/**< Rx messages of the safety lane missed by clients that fell a full input ring behind. */
+	unsigned int rx_dump_full_count;	/**< Rx messages missed by the binary dump because its ring was full. */
+	unsigned int route_full_count;		/**< Rx messages not forwarded because the ring to the other channel was full. */
+	unsigned int route_dropped_count;	/**< Messages forwarded by other channels that could not be queued for sending. */
 } can_err_count_t;
 
 
+/** Number of bins of a can_hist_t. */
+#define CAN_HIST_BINS	 16
+
+/** Largest number of distinct PGNs counted by can_stats_t. */
+#define CAN_STATS_MAX_PGNS	 64
+
+/** Time over which the bus load is measured, in ms. */
+#define CAN_LOAD_WINDOW_MS	 1000
+
+
+/** Histogram of durations.
+ *
+ * Bin 0 counts durations below 1 us, bin i counts durations of 2^(i-1) us up to
+ * 2^i us, and the last bin counts every longer duration.
+ */
+typedef struct {
+	unsigned int count;					/**< number of durations */
+	unsigned int max_us;				/**< longest duration, in us */
+	uint64_t total_us;					/**< sum of the durations, in us */
+	unsigned int bins[CAN_HIST_BINS];	/**< number of durations per bin */
+} can_hist_t;
+
+
+/** Number of frames received with a single PGN. */
+typedef struct {
+	unsigned int pgn;		/**< J1939 PGN, without destination address */
+	unsigned int count;		/**< number of frames, 0 if the entry is unused */
+} can_pgn_count_t;
+
+
+/** struct returned to client by the can_get_stats devctl.
+ *
+ * Every count starts from the last can_clear_errs devctl.
+ */
+typedef struct {
+	can_err_count_t errs;			/**< error counts, as from can_get_errs */
+	unsigned int rx_frame_count;	/**< frames read from the chip */
+	unsigned int tx_frame_count;	/**< frames written to the chip */
+	unsigned int bus_load;			/**< share of the bus used by the frames sent
+									 and received over the last CAN_LOAD_WINDOW_MS,
+									 in 1/1000. Bit stuffing is not counted, so this
+									 is a lower bound. */
+	unsigned int rx_backlog_max;	/**< most messages of the input ring any armed
+									 client had not read yet */
+	unsigned int tx_queue_max;		/**< most messages waiting in the output
+									 queue */
+	can_hist_t isr_time;			/**< time spent handling each interrupt */
+	can_hist_t delivery_time;		/**< time from reading a frame from the chip
+									 to a client reading it from the driver */
+	can_hist_t tx_delay;			/**< time from the requested transmit time
+									 to loading the frame into the chip, for
+									 frames written with a transmit time */
+	unsigned int std_frame_count;	/**< 11 bit frames, which have no PGN */
+	unsigned int pgn_overflow_count;	/**< 29 bit frames not counted in pgns
+										 because the table was full */
+	can_pgn_count_t pgns[CAN_STATS_MAX_PGNS];	/**< 29 bit frames per PGN, in no
+												 particular order */
+} can_stats_t;
+
+
 /** Information per Open Context Block.
  *
  * May be one for CAN and one for digital I/O per instance of driver; digital
@@ -100,6 +301,13 @@ typedef struct
 	iofunc_ocb_t io_ocb;    /**< TODO */
 	int rcvid;              /**< Used to notify client. */
     sigevent clt_event;     /**< Used to notify client, from client */
+    int armed;				/**< 1 if clt_event is delivered on receive */
+    can_rx_cursor_t cursor;	/**< Next message of the input rings to read */
+    int shm_reader;			/**< 1 if the client reads the input ring through
+    						 shared memory, with its own cursor */
+    can_filter_t filter[2];	/**< filters set by the client, applied to the
+    						 messages it reads */
+    int num_filters;		/**< number of elements in filter */
 } can_ocb_t;
 
 
@@ -138,15 +346,348 @@ typedef struct
 /** TODO */
 #define INI_EXT_ENTRY	 "Ext"
 
+/** Entry of the configuration file with the CPU running the channel thread. */
+#define INI_CPU_ENTRY	 "Cpu"
+
 /** Default Interrupt Request Line. By default, set to no interrupt. */
 #define DEFAULT_IRQ		 0
 
 /** Default address of the CAN adapter. */
 #define DEFAULT_PORT	 0x210
 
-/** Default size of the buffers for the input and output buffers, stored under
- * attr.in_buff and attr.out_buff, respectively. */
-#define DEFAULT_QSIZE	 150
+/** Default CPU running the thread of a channel. By default, any CPU. */
+#define DEFAULT_CPU		 -1
+
+/** Default size of each lane of the buffer for the input messages, stored
+ * under attr.in_buff. Must be a power of two. */
+#define DEFAULT_QSIZE	 256
+
+/** Largest number of messages waiting to be written to the bus, stored under
+ * attr.out_buff. */
+#define CAN_TX_QSIZE	 32
+
+/** Time after which a written message that could not be sent is dropped, in
+ * ms, unless the client sets tx_ttl_ms. */
+#define CAN_TX_DEFAULT_TTL_MS	 1000
+
+/** Time after which a message loaded into the chip is assumed to have been
+ * sent if no transmit interrupt was received, in ms. */
+#define CAN_TX_TIMEOUT_MS	 1000
+
+/** Default Rx frame rate above which the chip is polled, in frames/s. 0 to
+ * always use the Rx interrupt. */
+#define CAN_DEFAULT_POLL_RATE	 0
+
+/** Default time between two polls of the chip, in us. The Rx FIFO of the
+ * SJA1000 holds about 5 extended frames, or 2.5 ms of a fully loaded 250 Kb/s
+ * bus, so the period must stay well below that. The frames drained by a poll
+ * are all stamped with the time of the poll, so rx_time_ns may also be up to
+ * a period late. At 250 us, that is less than the time an extended frame
+ * takes on a 250 Kb/s bus. The system clock must tick at least as often (see
+ * ClockPeriod), which is not the QNX default of 1 ms. */
+#define CAN_DEFAULT_POLL_PERIOD_US	 250
+
+/** Length of the window over which the Rx frame rate is measured, in ms. */
+#define CAN_POLL_WINDOW_MS	 100
+
+/** Largest number of frames read from the chip in a single drain of the Rx
+ * FIFO. */
+#define CAN_RX_MAX_DRAIN	 64
+
+/** Largest number of passes over the interrupt register in a single call to
+ * CANDeviceManager::interrupt. */
+#define CAN_INTR_MAX_PASSES	 4
+
+/** Returned by CANDeviceManager::update_rx_mode when the chip should be polled
+ * from now on. */
+#define CAN_RX_MODE_POLL	 1
+
+/** Returned by CANDeviceManager::update_rx_mode when the Rx interrupt is used
+ * again. */
+#define CAN_RX_MODE_INTR	 -1
+
+/** Messages written with the same key and CAN_TX_REPLACE replace each other
+ * in the output buffer. The priority bits are masked out, so the key is the PGN
+ * and addresses for J1939 messages. */
+#define CAN_TX_KEY(MSG)		((MSG).id & 0x83FFFFFF)
+
+
+/** Return the key of a written message in the output buffer: CAN_TX_KEY if it
+ * was written with CAN_TX_REPLACE, DQ_NO_KEY otherwise.
+ *
+ * The frames of the J1939 transport protocol (TP.CM and TP.DT) are never
+ * replaced, since every packet of a message carries the same identifier.
+ */
+inline unsigned int can_tx_queue_key(const can_msg_t &msg) {
+	if (!(msg.tx_flags & CAN_TX_REPLACE))
+		return DQ_NO_KEY;
+	if (IS_EXTENDED_FRAME(msg) && (PATH_CAN_PF(msg.id) == 0xEB ||	/* TPDT */
+			PATH_CAN_PF(msg.id) == 0xEC))						/* TPCM */
+		return DQ_NO_KEY;
+	return CAN_TX_KEY(msg);
+}
+
+/** Largest number of clients that can be armed to be notified of received
+ * messages at the same time. */
+#define CAN_MAX_CLIENTS	 8
+
+/** Priority of the thread servicing the interrupts of a channel, and of the
+ * timer pulses of the channel. Above the priority of the clients, so that the
+ * Rx and Tx latency does not depend on them. */
+#define CAN_INTR_PRIORITY	 21
+
+/** Number of idle threads kept to handle the messages of the clients of a
+ * channel. */
+#define CAN_POOL_MIN_THREADS	 2
+
+/** Largest number of threads handling the messages of the clients of a
+ * channel. */
+#define CAN_POOL_MAX_THREADS	 8
+
+
+/** Queue used to hold CAN messages between the clients of the device manager
+ * and the interrupt handler, before they are written to the bus. Messages are
+ * sent in order of J1939 priority. */
+typedef DeadlineQueue<can_msg_t, CAN_TX_QSIZE> can_tx_queue_t;
+
+/** Ring used to hold received CAN messages. Every client reads every message
+ * through the cursor of its OCB. */
+typedef FanoutRing<can_msg_t, DEFAULT_QSIZE> can_fanout_t;
+
+
+/** Input rings of a channel, one per lane.
+ *
+ * Received messages are sorted into the lanes by CANDeviceManager::
+ * rx_process_interrupt. Each lane overwrites only its own oldest messages when
+ * full, so a burst of low-value traffic in the general lane never evicts the
+ * safety-critical messages that the clients have not read yet.
+ */
+typedef struct {
+	can_fanout_t lanes[CAN_RX_NUM_LANES];	/**< one ring per lane */
+} can_rx_buff_t;
+
+
+/** Return the number of messages of every lane that a client has not read
+ * yet. */
+inline unsigned int can_rx_get_count(const can_rx_buff_t *in_buff,
+		const can_rx_cursor_t *cursor) {
+	unsigned int count = 0;
+	for (int lane = 0; lane < CAN_RX_NUM_LANES; lane++)
+		count += in_buff->lanes[lane].get_count(&cursor->lanes[lane]);
+	return count;
+}
+
+
+/** Identifies a can_shm_t ("CANR"). */
+#define CAN_SHM_MAGIC	 0x43414E52
+
+/** Version of the layout of can_shm_t. Changed whenever can_shm_t or one of
+ * the types it holds change. */
+#define CAN_SHM_VERSION	 8
+
+/** Largest length of the name of the shared memory object of a channel,
+ * including the terminating null character. */
+#define CAN_SHM_NAME_MAX	 64
+
+
+/** Identifies a binary dump of a channel ("CAND"). */
+#define CAN_DUMP_MAGIC	 0x43414E44
+
+/** Version of the layout of can_dump_header_t and can_dump_record_t. */
+#define CAN_DUMP_VERSION	 1
+
+/** Size of the ring between the interrupt handler and the thread writing the
+ * binary dump of a channel, in frames. Holds several seconds of a fully loaded
+ * bus. Must be a power of two. */
+#define CAN_DUMP_QSIZE	 8192
+
+/** Largest number of frames written to the dump file at once. */
+#define CAN_DUMP_BATCH	 256
+
+/** Time the dump thread sleeps once its ring is empty, in ms. */
+#define CAN_DUMP_PERIOD_MS	 10
+
+/** Frames received by a channel, on their way to the binary dump. */
+typedef Ring<can_msg_t, CAN_DUMP_QSIZE> can_dump_ring_t;
+
+
+/** Size of the ring holding the frames forwarded from one channel to another,
+ * in frames. Must be a power of two. */
+#define CAN_ROUTE_QSIZE	 64
+
+/** Frames forwarded by a channel to another, until the other channel queues
+ * them for sending. Written by the receive path of the first channel and read
+ * by the second, each under its own lock. */
+typedef Ring<can_msg_t, CAN_ROUTE_QSIZE> can_route_ring_t;
+
+
+/** Start of a binary dump file, followed by can_dump_record_t records.
+ *
+ * Every field is in the byte order of the computer that wrote the dump.
+ */
+typedef struct {
+	uint32_t magic;			/**< CAN_DUMP_MAGIC */
+	uint32_t version;		/**< CAN_DUMP_VERSION */
+	uint32_t record_size;	/**< sizeof(can_dump_record_t) */
+	uint32_t bit_speed;		/**< bit speed of the bus, in Kb/s */
+	uint64_t monotonic_ns;	/**< get_monotonic_ns when the dump started */
+	uint64_t realtime_ns;	/**< time of day at that time, in ns since the
+							 epoch, to convert the time of the records */
+} can_dump_header_t;
+
+
+/** A frame of a binary dump. */
+typedef struct {
+	uint64_t rx_time_ns;	/**< time the frame was read from the chip, from
+							 get_monotonic_ns */
+	uint32_t id;			/**< identifier, with bit 31 set for 29 bit
+							 identifiers */
+	uint8_t size;			/**< number of data bytes */
+	uint8_t reserved[3];	/**< zero */
+	uint8_t data[8];		/**< data field */
+} can_dump_record_t;
+
+
+/** Time a client waits for a message before checking that the resource
+ * manager is still running, in ms. */
+#define CAN_RECONNECT_CHECK_MS	 100
+
+/** Largest number of attempts at reopening the device once the resource
+ * manager stopped, CAN_RECONNECT_CHECK_MS apart. */
+#define CAN_RECONNECT_TRIES	 50
+
+
+/** State of a channel that is kept across restarts of the resource manager.
+ *
+ * The filters are those last set through DCMD_CAN_FILTER or
+ * DCMD_CAN_DUAL_FILTER, which are still loaded into the chip when a restarted
+ * manager takes it over (see CANDeviceManager::restart).
+ */
+typedef struct {
+	can_err_count_t errs;		/**< see DCMD_CAN_GET_ERRS */
+	can_stats_t stats;			/**< see DCMD_CAN_GET_STATS */
+	can_filter_t filter[2];		/**< filters of the channel */
+	int num_filters;			/**< 1 for a single filter, 2 for dual filters */
+} can_dev_state_t;
+
+
+/** Largest number of periodic messages sent by a channel. */
+#define CAN_MAX_CYCLIC	 16
+
+/** Shortest period of a periodic message, in ms. */
+#define CAN_CYCLIC_MIN_PERIOD_MS	 1
+
+
+/** A periodic message, as seen by the driver.
+ *
+ * The client is identified by its process and connection, which are the same
+ * for a client that opened the device again after the manager was restarted
+ * (see can_reconnect), so that a restarted manager keeps sending the message
+ * and hands it back to its client.
+ */
+typedef struct {
+	pid_t owner_pid;		/**< process of the client that started the
+							 message, 0 if the slot is free */
+	int owner_coid;			/**< connection of the client to the device */
+	can_msg_t msg;			/**< the message, with the last payload copied */
+	uint64_t period_ns;		/**< time between two transmissions, in ns */
+	uint64_t next_time;		/**< next transmit time, from get_monotonic_ns */
+} can_cyclic_slot_t;
+
+
+/** Shared memory object holding the input rings of a channel.
+ *
+ * The object is created by can_shm_init and mapped read-only by the clients
+ * (see can_map_shm), which then read the messages in place through their own
+ * cursor instead of through a devctl. The pulse registered with can_arm only
+ * tells them that new messages were added.
+ *
+ * The object outlives the resource manager, so that a manager restarted after
+ * a crash or an upgrade takes over the messages, queue and state of the last
+ * one. Clients then keep reading where they were, and only have to open the
+ * device and arm it again (see can_read). The periodic messages are kept as
+ * well, and sent on by the new manager.
+ */
+typedef struct can_shm {
+	unsigned int magic;			/**< CAN_SHM_MAGIC, set once initialized */
+	unsigned int version;		/**< CAN_SHM_VERSION */
+	unsigned int size;			/**< sizeof(can_shm_t) */
+	unsigned int generation;	/**< number of managers that used the object */
+	can_rx_buff_t rx;			/**< the input rings */
+	can_tx_queue_t tx;			/**< the output queue, only used by the manager */
+	can_dev_state_t state;		/**< state of the channel */
+	can_cyclic_slot_t cyclic[CAN_MAX_CYCLIC];	/**< periodic messages, whose
+												 payloads are in the
+												 can_cyclic_shm_t */
+} can_shm_t;
+
+
+/** Type used in devctl to get the shared memory object of a channel. */
+typedef struct {
+	char name[CAN_SHM_NAME_MAX];	/**< name passed to shm_open */
+	unsigned int size;				/**< size of the object, in bytes */
+	can_filter_t filter[2];			/**< filters of the client, which it
+									 applies itself when it reads the object
+									 (DCMD_CAN_GET_SHM only) */
+	int num_filters;				/**< number of elements in filter */
+} can_shm_info_t;
+
+
+/** Largest number of attempts at copying the payload of a periodic message
+ * while its client updates it. The last payload copied is sent otherwise. */
+#define CAN_CYCLIC_READ_TRIES	 4
+
+/** Identifies a can_cyclic_shm_t ("CANC"). */
+#define CAN_CYCLIC_SHM_MAGIC	 0x43414E43
+
+/** Version of the layout of can_cyclic_shm_t. Changed whenever it changes. */
+#define CAN_CYCLIC_SHM_VERSION	 1
+
+
+/** Data field of a periodic message. */
+typedef struct {
+	BYTE size;			/**< number of data bytes (0-8) */
+	BYTE data[8];		/**< data field (up to 8 bytes) */
+} can_payload_t;
+
+
+/** Payload of a periodic message, written by its client and read by the
+ * driver. Each payload has its own cache line, so that clients updating
+ * different messages do not contend. */
+struct alignas(CACHE_LINE_SIZE) can_cyclic_payload {
+	SeqValue<can_payload_t> value;	/**< the payload */
+};
+
+
+/** Shared memory object holding the payloads of the periodic messages of a
+ * channel.
+ *
+ * The object is created by can_shm_init and mapped read-write by the clients
+ * that start a periodic message (see can_cyclic_start). A client updates the
+ * payload of its message in place, without a devctl, and the driver copies it
+ * every time the message is sent.
+ *
+ * A restarted manager takes the object over with the periodic messages. An
+ * object that is replaced has its magic number cleared first, which tells its
+ * clients that their messages are no longer sent (see can_cyclic_update).
+ */
+typedef struct can_cyclic_shm {
+	unsigned int magic;		/**< CAN_CYCLIC_SHM_MAGIC */
+	unsigned int version;	/**< CAN_CYCLIC_SHM_VERSION */
+	unsigned int size;		/**< sizeof(can_cyclic_shm_t) */
+	struct can_cyclic_payload slots[CAN_MAX_CYCLIC];	/**< one per message */
+} can_cyclic_shm_t;
+
+
+/** Type used in devctl to start a periodic message. */
+typedef struct {
+	can_msg_t msg;			/**< identifier and first payload of the message */
+	unsigned int period_ms;	/**< time between two transmissions, in ms */
+	int slot;				/**< on output, index of the payload of the
+							 message in can_cyclic_shm_t */
+	can_shm_info_t shm;		/**< on output, shared memory object holding
+							 the payloads */
+} can_cyclic_t;
 
 
 /** CAN Device Manager class.
@@ -161,10 +702,6 @@ public:
 	 * consecutive second. */
 	int can_timeout_count = 0;
 
-	/** Number of messages that were flushed from the output buffer without ever
-	 * being sent. */
-	int tx_buffer_flush = 0;
-
 	/** TODO */
 	int can_notify_client_err = 0;
 
@@ -173,33 +710,66 @@ public:
 
 	/** Initialize the Phillips SJA1000 chip to support the CAN.
 	 *
+	 * @param channel
+	 * 		index of the channel served by this object, from 0 to
+	 * 		MAX_CHANNELS - 1. Passed to the CANin and CANout macros.
 	 * @param base_address
 	 * 		memory-mapped base address of the CAN registers. Used by the CANin
-	 * 		and CANout macros to access registers.
+	 * 		and CANout macros to access registers. Ignored if the driver is
+	 * 		built with CAN_EMULATOR, in which case the registers of an emulated
+	 * 		chip are used (see sja1000_emu.h).
 	 * @param bit_speed
 	 * 		CAN bit speed, in Kb/s
 	 * @param extended_frame
 	 * 		specifies whether the CAN is using the standard or extended frame
 	 * 		format
 	 */
-	virtual void init(unsigned int base_address, unsigned int bit_speed,
-			BYTE extended_frame);
+	virtual void init(int channel, unsigned int base_address,
+			unsigned int bit_speed, BYTE extended_frame);
+
+	/** Take over a chip left running by an earlier instance of the resource
+	 * manager, without resetting it.
+	 *
+	 * The frames received in the meantime are still in the Rx FIFO of the
+	 * chip, and are read by the next interrupt. The filters are restored from
+	 * the state set with set_state.
+	 *
+	 * @param channel
+	 * 		index of the channel, as for init
+	 * @param base_address
+	 * 		memory-mapped base address of the CAN registers, as for init
+	 * @param bit_speed
+	 * 		CAN bit speed, in Kb/s
+	 * @return
+	 * 		true if the chip was taken over, false if it is not running with
+	 * 		the same settings and must be initialized with init
+	 */
+	virtual bool restart(int channel, unsigned int base_address,
+			unsigned int bit_speed);
+
+	/** Keep the counters, statistics and filters of the channel in a state
+	 * that outlives this object, such as one in shared memory.
+	 *
+	 * Must be called before init or restart. By default, the state is a member
+	 * of this object.
+	 *
+	 * @param state
+	 * 		the state to use. Its content is kept.
+	 */
+	virtual void set_state(can_dev_state_t *state);
 
 	/** Interrupt Request, ISR
 	 *
-	 * Called by can_handle_interrupt.
+	 * Called by the interrupt thread of the channel (see pulse_init).
 	 *
 	 * @param in_buff
-	 * 		circular buffer for the input messages
+	 * 		rings for the input messages
 	 * @param out_buff
-	 * 		circular buffer for the output messages
-	 * @param filter
-	 * 		used to set filtering of CAN messages
+	 * 		queue for the output messages
 	 * @return
 	 * 		1 if the CAN received the interrupt, 0 otherwise
 	 */
-	virtual int interrupt(CircularBuffer *in_buff, CircularBuffer *out_buff,
-			can_filter_t filter);
+	virtual int interrupt(can_rx_buff_t *in_buff, can_tx_queue_t *out_buff);
 
 	/** Send a message to the bus.
 	 *
@@ -209,43 +779,308 @@ public:
 	 *  an interrupt will be generated, which will be handled in the CAN ISR
 	 *  CAN_Interrupt().
 	 *
-	 * @param pattr
-	 * 		pointer to information per device manager
+	 * Messages whose deadline has passed are dropped first. Nothing is done if
+	 * a message is already loaded into the chip.
+	 *
+	 * @param out_buff
+	 * 		queue for the output messages. The message with the highest J1939
+	 * 		priority is removed from the queue and sent.
 	 */
-	virtual void send(CircularBuffer *out_buff);
+	virtual void send(can_tx_queue_t *out_buff);
 
-	/** Read the latest element in the buffer.
+	/** Read the oldest element in the buffer that a client has not read yet.
 	 *
-	 * This will also remove the element from the buffer.
+	 * Elements of the safety lane are read before those of the general lane.
+	 * This will also advance the cursor of the client past the element. Other
+	 * clients still see it.
 	 *
 	 * @param in_buff
-	 * 		circular buffer for the input messages
+	 * 		rings for the input messages
+	 * @param cursor
+	 * 		read position of the client. Messages it missed because it fell a
+	 * 		full ring behind are added to rx_safety_ring_full_count or
+	 * 		rx_ring_full_count, depending on their lane.
+	 * @param filters
+	 * 		filters of the client. Messages that pass none of them are skipped.
+	 * @param num_filters
+	 * 		number of elements in filters, 0 to read every message
 	 * @return
-	 * 		the front-most message.
+	 * 		the front-most message. The error field is set to 1 if the client
+	 * 		has read every message.
 	 */
-	virtual can_msg_t read(CircularBuffer *in_buff);
+	virtual can_msg_t read(can_rx_buff_t *in_buff, can_rx_cursor_t *cursor,
+			const can_filter_t *filters = NULL, int num_filters = 0);
+
+	/** Read up to max_msgs of the oldest elements in the buffer that a client
+	 * has not read yet.
+	 *
+	 * This will also advance the cursor of the client past the elements.
+	 *
+	 * @param in_buff
+	 * 		rings for the input messages
+	 * @param cursor
+	 * 		read position of the client, as in read()
+	 * @param msgs
+	 * 		array that is updated with the messages of the safety lane, then
+	 * 		those of the general lane, oldest first in each lane
+	 * @param max_msgs
+	 * 		largest number of messages to read
+	 * @param filters
+	 * 		filters of the client, as in read()
+	 * @param num_filters
+	 * 		number of elements in filters, 0 to read every message
+	 * @return
+	 * 		number of messages that were read
+	 */
+	virtual int read_batch(can_rx_buff_t *in_buff, can_rx_cursor_t *cursor,
+			can_msg_t *msgs, int max_msgs, const can_filter_t *filters = NULL,
+			int num_filters = 0);
 
 	/** Write a new message to the CAN card.
 	 *
 	 * This method is responsible for performing the following tasks.
 	 *
-	 * - If a new message is provided, it is written to and stored in the
-	 * 	 provided output buffer, tHen promptly sent to the CAN card.
-	 * - If no message was sent to the CAN card within the past second (with
-	 * 	 the assumption that we are sending heartbeat messages at the frequency
-	 * 	 of 1 Hz), the can_timeout_count attribute is incremented.
-	 * - If the buffer has got more than 10 messages stored, the messages are
-	 * 	 flushed from the system and the number of removed messages is added to
-	 * 	 the tx_buffer_flush attribute.
+	 * - The message is stored in the provided output queue with a deadline of
+	 * 	 tx_ttl_ms (or CAN_TX_DEFAULT_TTL_MS) from its transmit time
+	 * 	 (tx_time_ns, or now). If the message has the CAN_TX_REPLACE flag and a
+	 * 	 message with the same PGN and addresses (see can_tx_queue_key) is
+	 * 	 still queued, it is replaced and tx_replaced_count is incremented.
+	 * - If the chip is idle, the queued message with the highest priority
+	 * 	 whose transmit time was reached is promptly sent to the CAN card.
+	 * 	 Messages with a later transmit time are sent by tx_timer_expired.
+	 * - If the message loaded into the chip was not reported as sent within
+	 * 	 CAN_TX_TIMEOUT_MS, the transmit interrupt is assumed to have been
+	 * 	 missed, the can_timeout_count attribute is incremented, and the next
+	 * 	 message is sent.
 	 *
 	 * @param out_buff
-	 * 		circular buffer that stores output messages
+	 * 		queue that stores output messages
 	 * @param pmsg
 	 * 		pointer to the CAN message that should be written
 	 * @return
+	 * 		EOK for success, EAGAIN if the output queue is full, or EPERM in
+	 * 		listen only mode
+	 */
+	virtual int write(can_tx_queue_t *out_buff, can_msg_t *pmsg);
+
+	/** Write several messages to the CAN card.
+	 *
+	 * Every message is queued as in write, and the chip is loaded once all
+	 * of them are queued, so the message with the highest priority goes first.
+	 *
+	 * @param out_buff
+	 * 		queue that stores output messages
+	 * @param msgs
+	 * 		the CAN messages that should be written
+	 * @param num_msgs
+	 * 		number of messages in msgs
+	 * @return
+	 * 		number of messages queued. Queuing stops at the first message that
+	 * 		does not fit in the output queue. Nothing is queued in listen only
+	 * 		mode.
+	 */
+	virtual int write_batch(can_tx_queue_t *out_buff, can_msg_t *msgs,
+			int num_msgs);
+
+	/** Return the time at which the next queued message may be sent.
+	 *
+	 * Used to set the timer that calls tx_timer_expired.
+	 *
+	 * @param out_buff
+	 * 		queue that stores output messages
+	 * @param tx_time
+	 * 		updated with the earliest transmit time of the queued messages,
+	 * 		from get_monotonic_ns
+	 * @return
+	 * 		true if the chip is idle and a queued message has a transmit time
+	 * 		in the future, false otherwise
+	 */
+	virtual bool get_next_tx_time(can_tx_queue_t *out_buff, uint64_t *tx_time);
+
+	/** Send the queued message with the highest priority, once the transmit
+	 * time returned by get_next_tx_time is reached.
+	 *
+	 * @param out_buff
+	 * 		queue that stores output messages
+	 */
+	virtual void tx_timer_expired(can_tx_queue_t *out_buff);
+
+	/** Queue again the message that the last reset of the chip aborted, and
+	 * send the next message if the chip is idle.
+	 *
+	 * Nothing is queued if no message was aborted, in listen only mode, or if
+	 * a newer message with the same PGN and addresses is already queued.
+	 *
+	 * @param out_buff
+	 * 		queue that stores output messages
+	 */
+	virtual void requeue_aborted(can_tx_queue_t *out_buff);
+
+	/** Set the Rx frame rate above which the chip is polled.
+	 *
+	 * Above that rate, handling an interrupt for every frame costs more than
+	 * periodically reading every frame queued in the Rx FIFO of the chip, so
+	 * the Rx interrupt is disabled and the chip is polled instead. The Rx
+	 * interrupt is enabled again once the rate falls below half of poll_rate.
+	 * Transmit and error interrupts are always used.
+	 *
+	 * @param poll_rate
+	 * 		Rx frames/s above which the chip is polled. 0 to always use the Rx
+	 * 		interrupt.
+	 */
+	virtual void set_poll_rate(unsigned int poll_rate);
+
+	/** Read every frame queued in the Rx FIFO of the chip.
+	 *
+	 * Called periodically while polling (see set_poll_rate). Uses rx_drain.
+	 *
+	 * @param in_buff
+	 * 		rings for the input messages
+	 * @return
+	 * 		number of frames read from the chip
+	 */
+	virtual int poll(can_rx_buff_t *in_buff);
+
+	/** Switch between the interrupt and polling receive modes if needed.
+	 *
+	 * The Rx frame rate is measured over windows of CAN_POLL_WINDOW_MS. At the
+	 * end of a window, the mode is switched if the rate crossed the threshold
+	 * of set_poll_rate, and the Rx interrupt of the chip is disabled or enabled
+	 * accordingly. The caller is responsible for starting or stopping the
+	 * timer that calls poll().
+	 *
+	 * @return
+	 * 		CAN_RX_MODE_POLL if the chip should now be polled, CAN_RX_MODE_INTR
+	 * 		if the Rx interrupt is used again, 0 if the mode did not change
+	 */
+	virtual int update_rx_mode();
+
+	/** Filter the messages received from the bus.
+	 *
+	 * The filter is compiled into the acceptance code and mask registers of
+	 * the chip (single filter mode), so that unwanted messages never raise an
+	 * interrupt. A software check is only kept for messages the registers
+	 * cannot classify exactly.
+	 *
+	 * Note that the chip compares both frame formats against the same
+	 * registers. A filter that does not select the frame format is compiled
+	 * for 29 bit identifiers, and may therefore also reject 11 bit frames.
+	 *
+	 * The chip is briefly put in reset mode, unless the acceptance registers
+	 * already hold the compiled filter. A message being transmitted at that
+	 * time is aborted, and queued again by requeue_aborted.
+	 *
+	 * @param filter
+	 * 		the filter to apply
+	 * @return
 	 * 		0 for success, or -1 if an error occurs
 	 */
-	virtual int write(CircularBuffer *out_buff, can_msg_t *pmsg);
+	virtual int set_filter(can_filter_t filter);
+
+	/** Filter the messages received from the bus with two filters.
+	 *
+	 * Uses the dual filter mode of the chip, in which a message is accepted if
+	 * it passes either filter. In this mode the chip only compares bits 28-13
+	 * of 29 bit identifiers (the priority, data page and PGN of a J1939
+	 * message, but not its source address), so a software check is kept for
+	 * any filter that masks the remaining bits. Frame formats are handled as
+	 * in set_filter.
+	 *
+	 * @param filter1
+	 * 		the first filter
+	 * @param filter2
+	 * 		the second filter
+	 * @return
+	 * 		0 for success, or -1 if an error occurs
+	 */
+	virtual int set_dual_filter(can_filter_t filter1, can_filter_t filter2);
+
+	/** Enable or disable the self test mode of the chip.
+	 *
+	 * In self test mode, every message is sent with a self reception request:
+	 * the chip receives its own messages, through the acceptance filters, and
+	 * does not need an acknowledge from another node. This exercises the whole
+	 * path of a message through the driver without a second node on the bus
+	 * (see src/can_selftest.cpp). The chip is reset, which aborts a message
+	 * being sent (see requeue_aborted).
+	 *
+	 * @param enable
+	 * 		true to enter self test mode, false to go back to normal mode
+	 * @return
+	 * 		0 for success, or -1 if an error occurs
+	 */
+	virtual int set_self_test(bool enable);
+
+	/** Enable or disable the listen only mode of the chip.
+	 *
+	 * In listen only mode, the chip receives every frame without acknowledging
+	 * it, and never drives the bus, not even with error frames. Nothing is
+	 * written: write and write_batch refuse every message. If called before
+	 * init, the chip never leaves reset mode in normal mode.
+	 *
+	 * @param enable
+	 * 		true to enter listen only mode, false to go back to normal mode
+	 * @return
+	 * 		0 for success, or -1 if an error occurs
+	 */
+	virtual int set_listen_only(bool enable);
+
+	/** Copy every frame received from now on into a ring, before the software
+	 * filters are applied. The frames that do not fit are counted in
+	 * rx_dump_full_count.
+	 *
+	 * @param ring
+	 * 		ring read by a single consumer, or NULL to stop copying
+	 */
+	virtual void set_dump(can_dump_ring_t *ring);
+
+	/** Forward the frames received from now on that match a rule to another
+	 * channel.
+	 *
+	 * The frames are checked against the rules as they are read from the
+	 * chip, after its acceptance filter (which must therefore pass them) but
+	 * before the software filters, and pushed to the ring of the rule. Every
+	 * rule that matches forwards its own copy. The channel the ring leads to
+	 * then queues them with forward, without going through any client. The
+	 * frames that do not fit are counted in route_full_count.
+	 *
+	 * @param route
+	 * 		the rule. The source address is only rewritten in 29 bit frames.
+	 * @param ring
+	 * 		ring read by the channel of the rule, shared by every rule to that
+	 * 		channel
+	 * @return
+	 * 		0 for success, or -1 if the rule is invalid or CAN_MAX_ROUTES rules
+	 * 		were already added
+	 */
+	virtual int add_route(const can_route_t &route, can_route_ring_t *ring);
+
+	/** Stop forwarding frames to other channels. */
+	virtual void clear_routes();
+
+	/** Return the channels that frames were forwarded to since the last call,
+	 * which must be told to call forward.
+	 *
+	 * @return
+	 * 		one bit per channel, bit i for channel i
+	 */
+	virtual unsigned int take_routed();
+
+	/** Queue the frames forwarded to this channel by another one.
+	 *
+	 * The frames are queued as if written by a client, with the default
+	 * deadline, and the first is sent at once if the chip is idle. Frames
+	 * that do not fit in the output queue, or that arrive in listen only
+	 * mode, are counted in route_dropped_count.
+	 *
+	 * @param out_buff
+	 * 		queue for the output messages
+	 * @param ring
+	 * 		ring the other channel forwards its frames to
+	 * @return
+	 * 		number of frames queued
+	 */
+	virtual int forward(can_tx_queue_t *out_buff, can_route_ring_t *ring);
 
 	/** Clear the error counts and return the old counts.
 	 *
@@ -257,22 +1092,68 @@ public:
 	/** Return the current error count. */
 	virtual can_err_count_t get_errs();
 
+	/** Return the current statistics, including the error count.
+	 *
+	 * The statistics are reset by clear_errs.
+	 */
+	virtual can_stats_t get_stats();
+
+	/** Account for the time spent handling an interrupt.
+	 *
+	 * @param duration_ns
+	 * 		time spent in interrupt, in ns
+	 */
+	virtual void record_isr_time(uint64_t duration_ns);
+
+	/** Account for the number of messages a client has not read yet.
+	 *
+	 * @param count
+	 * 		unread messages of the client, from FanoutRing::get_count
+	 */
+	virtual void record_rx_backlog(unsigned int count);
+
 	/** Send a new message after notification of transmission of old one.
 	 *
 	 * @param out_buff
-	 * 		circular buffer for the output messages
+	 * 		queue for the output messages
+	 */
+	virtual void tx_process_interrupt(can_tx_queue_t *out_buff);
+
+	/** Read every frame queued in the Rx FIFO of the chip.
+	 *
+	 * The 64 byte FIFO holds several frames, which are all read and released
+	 * one after the other while the receive buffer status bit is set, so that
+	 * the FIFO is empty again as soon as possible and does not overrun. At
+	 * most CAN_RX_MAX_DRAIN frames are read, so that a busy bus does not starve
+	 * the other work of the resource manager. The frames were all queued when
+	 * the drain started, so they share a single receive time.
+	 *
+	 * @param in_buff
+	 * 		rings for the input messages
+	 * @return
+	 * 		number of frames read from the chip
 	 */
-	virtual void tx_process_interrupt(CircularBuffer *out_buff);
+	virtual int rx_drain(can_rx_buff_t *in_buff);
 
 	/** Read message from chip and queue for the resource manager.
+	 *
+	 * The identifier and data registers of the frame are read in a single
+	 * burst.
+	 *
+	 * The message is copied by value into the ring of its lane, where it is
+	 * seen by every client: the safety lane for EBC1, EEC1, CCVS and ETC1, and
+	 * the general lane otherwise. If the ring is full, the oldest message of
+	 * the same lane is overwritten. Messages that the acceptance filter of
+	 * the chip could not classify exactly are checked against the filters in
+	 * software first.
 	 *
 	 * @param in_buff
-	 * 		circular buffer for the input messages
-	 * @param filter
-	 * 		used to set filtering of CAN messages
+	 * 		rings for the input messages
+	 * @param rx_time_ns
+	 * 		monotonic time the frame was read, in ns (see get_monotonic_ns)
 	 */
-	virtual void rx_process_interrupt(CircularBuffer *in_buff,
-			can_filter_t filter);
+	virtual void rx_process_interrupt(can_rx_buff_t *in_buff,
+			uint64_t rx_time_ns);
 
 	/** Virtual destructor. */
 	virtual ~CANDeviceManager();
@@ -280,21 +1161,168 @@ public:
 private:
 	/** bit speed of the different channels */
 	int _baud[MAX_CHANNELS]					= { 0x0 };
-	/** TODO */
+	/** value of the acceptance code registers 0-3 (most significant first) */
 	unsigned int _acc_code[MAX_CHANNELS]	= { 0x0 };
-	/** TODO */
+	/** value of the acceptance mask registers 0-3. A bit set to 1 is not
+	 * compared with the received message. */
 	unsigned int _acc_mask[MAX_CHANNELS]	= { 0x0 };
+	/** whether the chip uses the dual (true) or single (false) filter mode */
+	bool _acc_dual[MAX_CHANNELS]			= { false };
+	/** _acc_code, _acc_mask and _acc_dual as last loaded into the chip */
+	unsigned int _hw_code[MAX_CHANNELS]		= { 0x0 };
+	unsigned int _hw_mask[MAX_CHANNELS]		= { 0x0 };
+	bool _hw_dual[MAX_CHANNELS]				= { false };
+	/** whether _hw_code, _hw_mask and _hw_dual are known */
+	bool _hw_loaded[MAX_CHANNELS]			= { false };
+
+	/** filters set by the clients, used by the software check */
+	can_filter_t _filter[MAX_CHANNELS][2];
+	/** number of filters in _filter (1 in single, 2 in dual filter mode) */
+	int _num_filters[MAX_CHANNELS]			= { 0 };
+	/** whether the software check is needed for 11 bit (index 0) and 29 bit
+	 * (index 1) frames, i.e. whether the chip filter is inexact for them */
+	bool _sw_filter[MAX_CHANNELS][2];
+
+	/** Last time a CAN message was sent, from get_monotonic_ns. */
+	uint64_t _last_time_can_sent = 0;
+
+	/** Whether a message is loaded into the chip and was not reported as sent
+	 * yet. */
+	bool _tx_busy = false;
+
+	/** Last message loaded into the chip. */
+	can_msg_t _tx_msg;
+
+	/** Whether the last reset of the chip aborted _tx_msg, which was not
+	 * queued again yet (see requeue_aborted). */
+	bool _tx_aborted = false;
+
+	/** Whether the chip is in self test mode (see set_self_test) */
+	bool _self_test = false;
+
+	/** Whether the chip is in listen only mode (see set_listen_only) */
+	bool _listen_only = false;
+
+	/** ring receiving a copy of every frame, see set_dump */
+	can_dump_ring_t *_dump = NULL;
+
+	/** rules forwarding frames to other channels, see add_route */
+	can_route_t _routes[CAN_MAX_ROUTES];
+	/** ring of every rule in _routes */
+	can_route_ring_t *_route_rings[CAN_MAX_ROUTES];
+	/** number of rules in _routes */
+	int _num_routes = 0;
+	/** channels frames were forwarded to, see take_routed */
+	unsigned int _routed = 0;
+
+	/** Check a received frame against the routing rules, and forward a copy
+	 * for every rule that matches. */
+	void _route(const can_msg_t &msg);
+
+	/** Rx frames/s above which the chip is polled, 0 never */
+	unsigned int _poll_rate = 0;
+	/** whether the chip is polled (true) or uses the Rx interrupt (false) */
+	bool _polling = false;
+	/** total number of frames read from the chip */
+	unsigned int _rx_frames = 0;
+	/** value of _rx_frames at the start of the current rate window */
+	unsigned int _window_frames = 0;
+	/** start of the current rate window, from get_monotonic_ns */
+	uint64_t _window_start = 0;
+	/** start of the current receive mode, from get_monotonic_ns */
+	uint64_t _mode_start = 0;
+	/** time spent in the interrupt (index 0) and polling (index 1) modes
+	 * before the current one, in ns */
+	uint64_t _mode_ns[2] = { 0, 0 };
+
+	/** Counters, statistics and filters of the channel, unless set_state
+	 * was called. */
+	can_dev_state_t _local_state;
+	/** Counters, statistics and filters of the channel. The statistics
+	 * returned by get_stats are in _state->stats, apart from the error count,
+	 * which is in _state->errs. */
+	can_dev_state_t *_state = &this->_local_state;
+	/** bits sent and received since the start of the current load window */
+	uint64_t _load_bits = 0;
+	/** start of the current load window, from get_monotonic_ns */
+	uint64_t _load_start = 0;
+
+	/** Count a received frame under its PGN.
+	 *
+	 * The PGNs are kept in an open addressing hash table, so a frame is
+	 * counted in constant time.
+	 *
+	 * @param msg
+	 * 		the frame
+	 */
+	void _count_pgn(const can_msg_t &msg);
+
+	/** Account for the bits of a frame sent or received on the bus.
+	 *
+	 * @param msg
+	 * 		the frame
+	 * @param now
+	 * 		the current time, from get_monotonic_ns
+	 */
+	void _count_frame(const can_msg_t &msg, uint64_t now);
+
+	/** Account for the messages a client missed in each lane.
+	 *
+	 * @param before
+	 * 		read position of the client before reading
+	 * @param after
+	 * 		read position of the client after reading
+	 */
+	void _count_lost(const can_rx_cursor_t &before,
+			const can_rx_cursor_t &after);
+	/** Add a message to the output queue.
+	 *
+	 * @param out_buff
+	 * 		queue that stores output messages
+	 * @param pmsg
+	 * 		pointer to the CAN message that should be written
+	 * @param now
+	 * 		the current time, from get_monotonic_ns
+	 * @return
+	 * 		EOK for success, or EAGAIN if the output queue is full
+	 */
+	int _queue(can_tx_queue_t *out_buff, can_msg_t *pmsg, uint64_t now);
+
+	/** Load the next message into the chip if it is idle, or if its transmit
+	 * interrupt was missed (see write).
+	 *
+	 * @param out_buff
+	 * 		queue that stores output messages
+	 * @param now
+	 * 		the current time, from get_monotonic_ns
+	 */
+	void _send_if_idle(can_tx_queue_t *out_buff, uint64_t now);
+
+	/** Compute the bus load once the current load window is over.
+	 *
+	 * @param now
+	 * 		the current time, from get_monotonic_ns
+	 */
+	void _update_load(uint64_t now);
 
-	/** Last time a CAN message was sent. */
-	time_t _last_time_can_sent;
+	/** Index of the channel served by this object. */
+	int _channel = 0;
 
-	/** Stores the error count from operations performed during any devctl
-	 * procedure. */
-	can_err_count_t _errs;
+	/** Memory-mapped base address of the CAN registers of the channel. Used by
+	 * the CANin and CANout macros (through can_base_addr) to access registers. */
+	canregs_t *_base_addr = NULL;
 
-	/** Memory-mapped base address of the CAN registers. Used by the CANin and
-	 * CANout macros to access registers. */
-	canregs_t *_base_addr;
+	/** Map the CAN registers of the channel, and set up the variables used by
+	 * init and restart.
+	 *
+	 * @param channel
+	 * 		index of the channel
+	 * @param base_address
+	 * 		memory-mapped base address of the CAN registers
+	 * @param bit_speed
+	 * 		CAN bit speed, in Kb/s
+	 */
+	void _map(int channel, unsigned int base_address, unsigned int bit_speed);
 
 	/** Start board.
 	 *
@@ -333,6 +1361,25 @@ private:
 	 */
 	virtual int _reset_chip(int minor);
 
+	/** Return the bits of the mode register that select the acceptance filter
+	 * mode, self test mode and listen only mode of the channel, which can only
+	 * be written in reset mode.
+	 *
+	 * @param minor
+	 * 		index of the current device within the channels
+	 */
+	BYTE _mode_bits(int minor);
+
+	/** Load the bits of _mode_bits into the mode register. The chip is stopped
+	 * while the register is written, and restarted after.
+	 *
+	 * @param minor
+	 * 		index of the current device within the channels
+	 * @return
+	 * 		0 for success, or -1 if an error occurs
+	 */
+	int _load_mode(int minor);
+
 	/** Configure bit timing.
 	 *
 	 * Note: Chip must be in bus off state.
@@ -346,19 +1393,67 @@ private:
 	 */
 	virtual int _set_timing(int minor, int baud);
 
-	/** TODO
+	/** Return the values of the bus timing registers for a baud rate.
+	 *
+	 * @param baud
+	 * 		CAN baud rate, in Kb/s, or the value of both bus timing registers
+	 * 		for a rate that is not in CanTiming
+	 * @param tim0
+	 * 		updated with the value of bus timing register 0
+	 * @param tim1
+	 * 		updated with the value of bus timing register 1
+	 */
+	void _get_timing(int baud, BYTE *tim0, BYTE *tim1);
+
+	/** Set the acceptance code and mask registers.
+	 *
+	 * Note: Chip must be in reset mode.
 	 *
 	 * @param minor
 	 * 		index of the current device within the channels
 	 * @param code
-	 * 		TODO
+	 * 		acceptance code registers 0-3, most significant byte first
 	 * @param mask
-	 * 		TODO
+	 * 		acceptance mask registers 0-3, most significant byte first. A bit
+	 * 		set to 1 is not compared with the received message.
 	 * @return
 	 * 		0 for success, or -1 if an error occurs
 	 */
 	virtual int _set_mask(int minor, unsigned int code, unsigned int mask);
 
+	/** Write _acc_code and _acc_mask into the acceptance registers, and
+	 * remember them as loaded (see _hw_code).
+	 *
+	 * Note: Chip must be in reset mode.
+	 *
+	 * @param minor
+	 * 		index of the current device within the channels
+	 */
+	void _write_acceptance(int minor);
+
+	/** Compile the filters in _filter into the acceptance registers.
+	 *
+	 * Computes _acc_code, _acc_mask and _sw_filter from the filters of the
+	 * channel, and loads them into the chip. The chip is stopped while the
+	 * registers are written, and restarted after. Nothing is loaded if the
+	 * chip already holds the same registers, so that the Rx FIFO and the
+	 * message being sent are kept.
+	 *
+	 * @param minor
+	 * 		index of the current device within the channels
+	 * @return
+	 * 		0 for success, or -1 if an error occurs
+	 */
+	virtual int _load_filters(int minor);
+
+	/** Compute _acc_code, _acc_mask and _sw_filter from the filters in
+	 * _filter, without loading them into the chip.
+	 *
+	 * @param minor
+	 * 		index of the current device within the channels
+	 */
+	void _compile_filters(int minor);
+
 	/* Set value of the output control register.
 	 *
 	 * @param minor
@@ -377,8 +1472,8 @@ private:
 	 * in this mode the host device is capable of functioning like a monitor or
 	 * for automatic bit-rate detection.
 	 *
-	 * Must be done after CMD_START(CAN_StopChip) and before
-	 * CMD_START(CAN_StartChip).
+	 * The chip is stopped while the mode register is written, and restarted
+	 * after (see set_listen_only).
 	 *
 	 * @param minor
 	 * 		index of the current device within the channels
@@ -396,18 +1491,47 @@ private:
 /* -------------------------------------------------------------------------- */
 
 
-/** Information per device manager */
+/** Information per device manager.
+ *
+ * io_attr must come first, since the resource manager library passes a pointer
+ * to it wherever it passes the attributes of the device.
+ */
 typedef struct
 {
+	iofunc_attr_t io_attr;		/**< standard system information. Its lock
+								 protects the other fields. */
 	CANDeviceManager *can_dev;	/**< CAN device manager class */
-	iofunc_attr_t io_attr;		/**< standard system information */
+	int channel;				/**< index of the channel, see MAX_CHANNELS */
 	char *devname;				/**< device path name */
 	can_info_t can_info;  		/**< initialization info */
-	CircularBuffer *in_buff;	/**< Holds CAN messages until client reads */
-	CircularBuffer *out_buff;	/**< Holds CAN messages until written to bus */
-	can_ocb_t *notify_pocb;   	/**< OCB of client to be notified */
+	can_rx_buff_t *in_buff;		/**< Holds CAN messages until clients read, in shm */
+	can_shm_t *shm;				/**< shared memory object holding in_buff */
+	char shm_name[CAN_SHM_NAME_MAX];	/**< name of shm */
+	can_tx_queue_t *out_buff;	/**< Holds CAN messages until written to bus, in shm */
+	can_ocb_t *clients[CAN_MAX_CLIENTS];	/**< OCBs of clients to be notified */
+	timer_t poll_timer;			/**< fires poll_event while polling the chip */
+	sigevent poll_event;		/**< initialized in pulse_init */
+	timer_t tx_timer;			/**< fires tx_event at the next transmit time */
+	sigevent tx_event;			/**< initialized in pulse_init */
+	uint64_t tx_timer_time;		/**< time tx_timer is set to, 0 if not set */
+	can_cyclic_slot_t *cyclic;	/**< periodic messages, in shm */
+	can_ocb_t *cyclic_owner[CAN_MAX_CYCLIC];	/**< OCB of the client of every
+												 periodic message, NULL until
+												 a restarted manager hears from
+												 it again */
+	int num_cyclic_orphans;		/**< periodic messages without an OCB */
+	can_cyclic_shm_t *cyclic_shm;	/**< payloads of the periodic messages */
+	char cyclic_shm_name[CAN_SHM_NAME_MAX];	/**< name of cyclic_shm */
+	timer_t cyclic_timer;		/**< fires cyclic_event at the next period */
+	sigevent cyclic_event;		/**< initialized in pulse_init */
+	uint64_t cyclic_timer_time;	/**< time cyclic_timer is set to, 0 if not set */
 	bool verbose_flag;			/**< verbose flag */
-	sigevent hw_event;			/**< initialized in pulse_init */
+	can_dump_ring_t *dump_ring;	/**< frames on their way to the dump file */
+	FILE *dump_file;			/**< binary dump, see can_dump_init */
+	sigevent route_event;		/**< sent by the channels that forward frames
+								 to this one, initialized in pulse_init */
+	sigevent hw_event;			/**< interrupt event, initialized by the
+								 interrupt thread */
 } can_attr_t;
 
 
@@ -430,7 +1554,8 @@ typedef struct
 /** Arm the CAN device manager.
  *
  * Attach the hardware interrupt, and save the event to be used to notify the
- * client in the ocb structure.
+ * client in the ocb structure. The ocb is added to the clients that are
+ * notified of every received message, so several clients may be armed at once.
  *
  * @param ctp
  * 		A pointer to a resmgr_context_t structure that the resource-manager
@@ -446,15 +1571,196 @@ extern int can_dev_arm(resmgr_context_t *ctp, iofunc_ocb_t *io_ocb,
 		sigevent event);
 
 
+/** Disarm the CAN device manager for a client.
+ *
+ * Removes the ocb from the clients that are notified of received messages.
+ * Called when the ocb is freed.
+ *
+ * @param pattr
+ * 		pointer to information per device manager
+ * @param pocb
+ * 		OCB of the client
+ */
+extern void can_dev_disarm(IOFUNC_ATTR_T *pattr, can_ocb_t *pocb);
+
+
+/** Load the filters of the armed clients into the chip.
+ *
+ * Every client of a channel reads the same input rings, and applies its own
+ * filters when it reads them, so the chip only needs to reject the messages
+ * that no client wants. Up to two distinct filters are loaded as they are, in
+ * the dual filter mode. More filters are merged into the two that cover them
+ * with the fewest compared bits lost. Without an armed client, the filter of
+ * the command line is loaded.
+ *
+ * @param pattr
+ * 		pointer to information per device manager
+ * @return
+ * 		EOK for success, or EIO if the chip could not be loaded
+ */
+extern int can_dev_load_filters(IOFUNC_ATTR_T *pattr);
+
+
+/** Start sending a message periodically for a client.
+ *
+ * The message is sent at once, and then every period_ms. If the client already
+ * sends a message with the same PGN and addresses (see CAN_TX_KEY), its period
+ * and payload are updated instead.
+ *
+ * @param ctp
+ * 		context of the devctl, which identifies the client
+ * @param pattr
+ * 		pointer to information per device manager
+ * @param pocb
+ * 		OCB of the client
+ * @param pcyclic
+ * 		the message and its period. The slot and shared memory object of the
+ * 		payload are updated.
+ * @return
+ * 		EOK for success, EINVAL if the period is too short, or EBUSY if every
+ * 		slot is used or another client sends the same message
+ */
+extern int can_dev_cyclic_start(resmgr_context_t *ctp, IOFUNC_ATTR_T *pattr,
+		can_ocb_t *pocb, can_cyclic_t *pcyclic);
+
+
+/** Stop sending a periodic message.
+ *
+ * @param pattr
+ * 		pointer to information per device manager
+ * @param pocb
+ * 		OCB of the client
+ * @param slot
+ * 		slot of the message, as returned by can_dev_cyclic_start
+ * @return
+ * 		EOK for success, or EINVAL if the client does not send a message in
+ * 		this slot
+ */
+extern int can_dev_cyclic_stop(IOFUNC_ATTR_T *pattr, can_ocb_t *pocb,
+		int slot);
+
+
+/** Stop sending every periodic message of a client.
+ *
+ * Called when the ocb is freed, so that the messages of a client that exited
+ * are not sent forever.
+ *
+ * @param pattr
+ * 		pointer to information per device manager
+ * @param pocb
+ * 		OCB of the client
+ */
+extern void can_dev_cyclic_release(IOFUNC_ATTR_T *pattr, can_ocb_t *pocb);
+
+
+/** Hand the periodic messages a client started before the manager was
+ * restarted back to it.
+ *
+ * The messages sent by the process and connection of the devctl are given
+ * the OCB of the client, so that they are stopped with it again.
+ *
+ * @param ctp
+ * 		context of the devctl, which identifies the client
+ * @param pattr
+ * 		pointer to information per device manager
+ * @param pocb
+ * 		OCB of the client
+ */
+extern void can_dev_cyclic_adopt(resmgr_context_t *ctp, IOFUNC_ATTR_T *pattr,
+		can_ocb_t *pocb);
+
+
 /* -------------------------------------------------------------------------- */
 /* ---------------------- Implemented in can_init.cpp ----------------------- */
 /* -------------------------------------------------------------------------- */
 
 
-/** Attach pulses and interrupt events.
+/** Create the shared memory objects of a channel.
+ *
+ * The objects are named after the device (/dev/can1 gives /can1.rx for the
+ * input rings and /can1.tx for the payloads of the periodic messages).
+ * pattr->in_buff is set to the rings, pattr->out_buff to the output queue and
+ * pattr->cyclic_shm to the payloads.
+ *
+ * An object holding the rings with the same layout, left by an earlier run of
+ * the manager, is taken over with its messages, queue, state and periodic
+ * messages, and so are the payloads of the periodic messages. Any other object
+ * is replaced. The periodic messages are then kept without a client until
+ * their client is heard from again (see can_dev_cyclic_adopt), or its process
+ * exits.
+ *
+ * @param pattr
+ * 		pointer to information per device manager
+ * @return
+ * 		1 if the rings of an earlier run were taken over, 0 if they were
+ * 		created, or -1 if an error occurs
+ */
+extern int can_shm_init(IOFUNC_ATTR_T *pattr);
+
+
+/** Set the transmit timer to the next transmit time of the output queue.
+ *
+ * Called whenever a message was queued or sent, so that messages written with
+ * a transmit time are sent once that time is reached. The timer has the
+ * resolution of the system clock (see ClockPeriod).
+ *
+ * @param pattr
+ * 		pointer to information per device manager
+ */
+extern void can_set_tx_timer(IOFUNC_ATTR_T *pattr);
+
+
+/** Set the cyclic timer to the next transmit time of the periodic messages.
+ *
+ * Called whenever a periodic message was started, stopped or sent. The timer
+ * is stopped if no periodic message is left.
+ *
+ * @param pattr
+ * 		pointer to information per device manager
+ */
+extern void can_set_cyclic_timer(IOFUNC_ATTR_T *pattr);
+
+
+/** Open the binary dump of a channel, and start the thread that writes it.
+ *
+ * The dump file (can_info.dump_file) starts with a can_dump_header_t, followed
+ * by a can_dump_record_t for every frame received by the chip, before the
+ * software filters. The frames reach the dump thread through pattr->dump_ring,
+ * which must be passed to CANDeviceManager::set_dump, and are written to the
+ * file in batches of up to CAN_DUMP_BATCH.
+ *
+ * @param pattr
+ * 		pointer to information per device manager
+ * @return
+ * 		0 for success, or -1 if an error occurs
+ */
+extern int can_dump_init(IOFUNC_ATTR_T *pattr);
+
+
+/** Forward the frames of a channel that match its routing rules
+ * (can_info.routes) to the other channels.
+ *
+ * Every channel has a ring towards every other channel. The frames pushed to
+ * it by the receive path of the first are queued by the second when it gets
+ * its route pulse (see pulse_init), at CAN_INTR_PRIORITY and without waking
+ * any client. Each side only takes its own lock.
+ *
+ * @param pattr
+ * 		pointer to information per device manager
+ * @return
+ * 		0 for success, or -1 if a rule is invalid
+ */
+extern int can_route_init(IOFUNC_ATTR_T *pattr);
+
+
+/** Attach pulses and start the interrupt thread.
  *
- * Attach pulse to be sent by interrupt handler to event that will connected to
- * the interrupt by InterruptAttachEvent in can_dev->arm.
+ * Attach the pulse sent by the channels that forward frames to this one, and
+ * the pulses of the poll, transmit and cyclic timers, which are all sent at
+ * CAN_INTR_PRIORITY, and start the thread that attaches the interrupt of the
+ * chip with InterruptAttachEvent and services it at CAN_INTR_PRIORITY. If the
+ * channel has no interrupt, only the route pulse and the transmit and cyclic
+ * timers are set up, so that written and periodic messages are still sent.
  *
  * @param dpp
  *		The dispatch handle, as returned by dispatch_create().
@@ -45,6 +45,14 @@ enum {
 	CAN_EMPTY_Q,
 	CAN_GET_ERRS,
 	CAN_CLEAR_ERRS,
+	CAN_READ_BATCH,
+	CAN_DUAL_FILTER,
+	CAN_GET_STATS,
+	CAN_GET_SHM,
+	CAN_WRITE_BATCH,
+	CAN_CYCLIC_START,
+	CAN_CYCLIC_STOP,
+	CAN_SELF_TEST,
 };
 
 
@@ -73,6 +81,14 @@ enum {
 #define DCMD_CAN_EMPTY_Q __DIOTF(_DCMD_DAS, CAN_EMPTY_Q, int)
 #define DCMD_CAN_GET_ERRS __DIOTF(_DCMD_DAS, CAN_GET_ERRS, can_err_count_t)
 #define DCMD_CAN_CLEAR_ERRS __DIOTF(_DCMD_DAS, CAN_CLEAR_ERRS, can_err_count_t)
+#define DCMD_CAN_READ_BATCH __DIOTF(_DCMD_DAS, CAN_READ_BATCH, can_msg_batch_t)
+#define DCMD_CAN_DUAL_FILTER __DIOT(_DCMD_DAS, CAN_DUAL_FILTER, can_dual_filter_t)
+#define DCMD_CAN_GET_STATS __DIOF(_DCMD_DAS, CAN_GET_STATS, can_stats_t)
+#define DCMD_CAN_GET_SHM __DIOF(_DCMD_DAS, CAN_GET_SHM, can_shm_info_t)
+#define DCMD_CAN_WRITE_BATCH __DIOTF(_DCMD_DAS, CAN_WRITE_BATCH, can_msg_batch_t)
+#define DCMD_CAN_CYCLIC_START __DIOTF(_DCMD_DAS, CAN_CYCLIC_START, can_cyclic_t)
+#define DCMD_CAN_CYCLIC_STOP __DIOT(_DCMD_DAS, CAN_CYCLIC_STOP, int)
+#define DCMD_CAN_SELF_TEST __DIOT(_DCMD_DAS, CAN_SELF_TEST, int)
 
 /** _IOMGR_DAS is a private definition, see sys/iomgr.h
  *  IOMSG_DAS subtype values are also private
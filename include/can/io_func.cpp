@@ -12,20 +12,25 @@
 
 #include "can_man.h"
 #include <devctl.h>
+#include <stddef.h>		/* offsetof */
 
 
 int io_devctl(resmgr_context_t *ctp, io_devctl_t *msg, iofunc_ocb_t *io_ocb)
 {
-//	can_ocb_t *ocb = (can_ocb_t*) ocb_res;
 	int status;
 	int dcmd;
 	void *data;
 	IOFUNC_ATTR_T *pattr = (IOFUNC_ATTR_T*) io_ocb->attr;
+	can_ocb_t *pocb = (can_ocb_t*) io_ocb;
 
 	/* temporary variables for devctl data */
 	sigevent event;
-	can_filter_t filter;
+	can_dual_filter_t *pdual;
 	can_err_count_t *perrs;
+	can_msg_t *pmsg;
+	can_msg_batch_t *pbatch;
+	can_shm_info_t *pshm;
+	can_cyclic_t *pcyclic;
 
 	/* See if it's a standard POSIX-supported devctl() */
 	if ((status = iofunc_devctl_default(ctp, msg, io_ocb)) != _RESMGR_DEFAULT)
@@ -40,6 +45,11 @@ int io_devctl(resmgr_context_t *ctp, io_devctl_t *msg, iofunc_ocb_t *io_ocb)
 	dcmd = msg->i.dcmd;
 	memset(&msg->o, 0, sizeof(msg->o));
 
+	/* A client of the last manager is known by its first devctl after it
+	 * opened the device again. */
+	if (pattr->num_cyclic_orphans != 0)
+		can_dev_cyclic_adopt(ctp, pattr, pocb);
+
 	/* Check which command it was, and act on it. */
 	switch (dcmd) {
 	case DCMD_CAN_ARM:
@@ -48,15 +58,99 @@ int io_devctl(resmgr_context_t *ctp, io_devctl_t *msg, iofunc_ocb_t *io_ocb)
 		return can_dev_arm(ctp, io_ocb, event);
 
 	case DCMD_CAN_FILTER:
-		/* Not implemented yet at the level of the device registers. All are
-		 * received in Object 15. Later this function may include calls to
-		 * device register operations. */
-		filter = * (can_filter_t *) data;
-		pattr->can_info.filter = filter;
+		/* Applied to the messages this client reads. The filters of all the
+		 * clients are loaded into the acceptance filter of the chip, so that
+		 * messages no client wants do not raise an interrupt. */
+		pocb->filter[0] = * (can_filter_t *) data;
+		pocb->num_filters = 1;
+		return can_dev_load_filters(pattr);
+
+	case DCMD_CAN_DUAL_FILTER:
+		pdual = (can_dual_filter_t *) data;
+		pocb->filter[0] = pdual->filter[0];
+		pocb->filter[1] = pdual->filter[1];
+		pocb->num_filters = 2;
+		return can_dev_load_filters(pattr);
+
+	case DCMD_CAN_SELF_TEST:
+		/* Every client of the channel receives the messages sent from now
+		 * on. */
+		if (pattr->can_dev->set_self_test(*(int *) data != 0) != 0)
+			return EIO;
+		pattr->can_dev->requeue_aborted(pattr->out_buff);
 		return EOK;
 
+	case DCMD_CAN_I82527_READ:
+		pmsg = (can_msg_t *) data;
+		*(pmsg) = pattr->can_dev->read(pattr->in_buff, &pocb->cursor,
+				pocb->filter, pocb->num_filters);
+		msg->o.nbytes = sizeof(can_msg_t);
+		return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + msg->o.nbytes);
+
+	case DCMD_CAN_READ_BATCH:
+		/* Return as many messages as the client asked for (and the buffer
+		 * holds), up to CAN_MAX_BATCH. Only the valid messages are copied into
+		 * the reply. */
+		pbatch = (can_msg_batch_t *) data;
+		if (pbatch->count > CAN_MAX_BATCH || pbatch->count < 0)
+			pbatch->count = CAN_MAX_BATCH;
+		pbatch->count = pattr->can_dev->read_batch(
+				pattr->in_buff, &pocb->cursor, pbatch->msgs, pbatch->count,
+				pocb->filter, pocb->num_filters);
+		msg->o.nbytes = offsetof(can_msg_batch_t, msgs) +
+				pbatch->count * sizeof(can_msg_t);
+		return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + msg->o.nbytes);
+
+	case DCMD_CAN_GET_SHM:
+		/* From now on the client reads the input ring in place, so its cursor
+		 * here is no longer used. */
+		pshm = (can_shm_info_t *) data;
+		strncpy(pshm->name, pattr->shm_name, CAN_SHM_NAME_MAX);
+		pshm->size = sizeof(can_shm_t);
+		pshm->filter[0] = pocb->filter[0];
+		pshm->filter[1] = pocb->filter[1];
+		pshm->num_filters = pocb->num_filters;
+		pocb->shm_reader = 1;
+		msg->o.nbytes = sizeof(can_shm_info_t);
+		return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + msg->o.nbytes);
+
+	case DCMD_CAN_I82527_WRITE:
+		pmsg = (can_msg_t *) data;
+		status = pattr->can_dev->write(pattr->out_buff, pmsg);
+		can_set_tx_timer(pattr);
+		return status;
+
+	case DCMD_CAN_WRITE_BATCH:
+		/* Only the number of queued messages is copied into the reply. */
+		pbatch = (can_msg_batch_t *) data;
+		if (pbatch->count > CAN_MAX_BATCH || pbatch->count < 0 ||
+				msg->i.nbytes < offsetof(can_msg_batch_t, msgs) +
+				pbatch->count * sizeof(can_msg_t))
+			return EINVAL;
+		pbatch->count = pattr->can_dev->write_batch(
+				pattr->out_buff, pbatch->msgs, pbatch->count);
+		can_set_tx_timer(pattr);
+		msg->o.nbytes = offsetof(can_msg_batch_t, msgs);
+		return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + msg->o.nbytes);
+
+	case DCMD_CAN_CYCLIC_START:
+		/* The client updates the payload through shared memory from now on,
+		 * so the slot and object are returned. */
+		pcyclic = (can_cyclic_t *) data;
+		if ((status = can_dev_cyclic_start(ctp, pattr, pocb, pcyclic)) != EOK)
+			return status;
+		msg->o.nbytes = sizeof(can_cyclic_t);
+		return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + msg->o.nbytes);
+
+	case DCMD_CAN_CYCLIC_STOP:
+		return can_dev_cyclic_stop(pattr, pocb, *(int *) data);
+
 	case DCMD_CAN_EMPTY_Q:
-		pattr->in_buff->empty();
+		/* Only skips the messages of this client, in every lane. */
+		*(int *) data = 0;
+		for (int lane = 0; lane < CAN_RX_NUM_LANES; lane++)
+			*(int *) data += pattr->in_buff->lanes[lane].skip(
+					&pocb->cursor.lanes[lane]);
 		msg->o.nbytes = sizeof(int);
 		return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + msg->o.nbytes);
 
@@ -72,6 +166,11 @@ int io_devctl(resmgr_context_t *ctp, io_devctl_t *msg, iofunc_ocb_t *io_ocb)
 		msg->o.nbytes = sizeof(can_err_count_t);
         return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + msg->o.nbytes);
 
+	case DCMD_CAN_GET_STATS:
+		*((can_stats_t *) data) = pattr->can_dev->get_stats();
+		msg->o.nbytes = sizeof(can_stats_t);
+		return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + msg->o.nbytes);
+
 	case DCMD_DAS_DIG_DIR:
 		printf(" Digital I/O is not supported\n");
 	    return EOK;
@@ -248,10 +248,18 @@ typedef struct canregs {
  * Bit 4 : If set to 0, the SJA1000 wakes up, i.e. operates normally. If set to
  *         1, the SJA1000 enters sleep mode if no CAN interrupt is pending and
  *         there is no bus activity
+ *
+ * In PeliCAN mode, sleep mode is entered through the mode register instead, and
+ * bit 4 requests a self reception: a message is transmitted and received
+ * simultaneously. In self test mode (see CAN_SELF_TEST_MODE), the transmission
+ * succeeds without an acknowledge from another node, so a single chip receives
+ * its own messages.
  */
 
 #define CAN_GOTO_SLEEP				(1<<4)	/**< bit 4 in Command Register (see */
 											/**< include/can/sja1000.h for details) */
+#define CAN_SELF_RECEPTION_REQUEST	(1<<4)	/**< bit 4 in Command Register, in */
+											/**< PeliCAN mode */
 #define CAN_CLEAR_OVERRUN_STATUS	(1<<3)	/**< bit 3 in Command Register (see */
 											/**< include/can/sja1000.h for details) */
 #define CAN_RELEASE_RECEIVE_BUFFER	(1<<2)	/**< bit 2 in Command Register (see */
@@ -485,10 +493,9 @@ typedef struct canregs {
 /* External structures may not be used, declared in can_dev.c for compatibility
  * with can4linux sja1000.cpp.
  *
- * For PATH driver, each channel has a separate driver, so MAX_CHANNELS is 1
+ * A single driver serves up to MAX_CHANNELS channels, each on its own SJA1000.
  */
-#define MAX_CHANNELS	1
-#define MY_CHANNEL		0
+#define MAX_CHANNELS	4
 
 /**
  *	Fancy leveled debugging not really needed in
@@ -566,24 +573,39 @@ typedef int irqreturn_t;
 /* -------------------- Imported from sja1000/can_dev.h --------------------- */
 /* -------------------------------------------------------------------------- */
 
-/** This must be initialized to the mapped address of the CAN channel.
+/** This must be initialized to the mapped addresses of the CAN channels,
+ * indexed by channel.
  */
-extern canregs_t *can_base_addr;
+extern canregs_t *can_base_addr[MAX_CHANNELS];
+
+/* With CAN_EMULATOR defined, the registers are those of an emulated chip (see
+ * sja1000_emu.h) rather than memory-mapped ones. */
+#ifdef CAN_EMULATOR
+#include "sja1000_emu.h"
+#endif
 
 /** Read from byte register on CAN chip at address "addr" and return the value.
  */
 static inline unsigned char can_read_reg(BYTE *addr)
 {
+#ifdef CAN_EMULATOR
+	return sja1000_emu_read(addr);
+#else
 	volatile BYTE *preg = (volatile BYTE*) (addr);
 	return *preg;
+#endif
 }
 
 /** Write "value" to byte register on CAN chip at address "addr".
  */
 static inline void can_write_reg(BYTE *addr, BYTE value)
 {
+#ifdef CAN_EMULATOR
+	sja1000_emu_write(addr, value);
+#else
 	volatile BYTE *preg = (volatile BYTE*) (addr);
     *preg = value;
+#endif
 }
 
 /** Set bits in "mask" in byte register on CAN chip at address "addr"
@@ -592,8 +614,12 @@ static inline void can_write_reg(BYTE *addr, BYTE value)
  */
 static inline void can_set_reg(BYTE *addr, BYTE mask)
 {
+#ifdef CAN_EMULATOR
+	sja1000_emu_write(addr, sja1000_emu_read(addr) | mask);
+#else
 	volatile BYTE *preg = (volatile BYTE*) (addr);
 	*preg |= mask;
+#endif
 }
 
 /** Clear the bits in "mask" in byte register on CAN chip at address "addr"
@@ -602,8 +628,27 @@ static inline void can_set_reg(BYTE *addr, BYTE mask)
  */
 static inline void can_reset_reg(BYTE *addr, BYTE mask)
 {
+#ifdef CAN_EMULATOR
+	sja1000_emu_write(addr, sja1000_emu_read(addr) & ~(mask));
+#else
 	volatile BYTE *preg = (volatile BYTE *) (addr);
 	*preg &= ~(mask);
+#endif
+}
+
+/** Read "len" consecutive byte registers on CAN chip, starting at address
+ * "addr", into "buf" in a single burst.
+ */
+static inline void can_read_regs(BYTE *addr, BYTE *buf, int len)
+{
+#ifdef CAN_EMULATOR
+	for (int i = 0; i < len; i++)
+		buf[i] = sja1000_emu_read(addr + i);
+#else
+	volatile BYTE *preg = (volatile BYTE*) (addr);
+	for (int i = 0; i < len; i++)
+		buf[i] = preg[i];
+#endif
 }
 
 /* Board access macros, as used in can4linux, rely on a packed structure for
@@ -613,10 +658,11 @@ static inline void can_reset_reg(BYTE *addr, BYTE mask)
  * to one SJA 1000 chip and one CAN port. Unused bd (board) parameter to macros
  * is retained for compatibility in sja1000.cpp.
  */
-#define CANin(bd,adr) can_read_reg(&can_base_addr->adr)
-#define CANout(bd,adr,v) can_write_reg(&can_base_addr->adr, v)
-#define CANset(bd,adr,m) can_set_reg(&can_base_addr->adr, m)
-#define CANreset(bd,adr,m) can_reset_reg(&can_base_addr->adr, m)
+#define CANin(bd,adr) can_read_reg(&can_base_addr[bd]->adr)
+#define CANout(bd,adr,v) can_write_reg(&can_base_addr[bd]->adr, v)
+#define CANset(bd,adr,m) can_set_reg(&can_base_addr[bd]->adr, m)
+#define CANreset(bd,adr,m) can_reset_reg(&can_base_addr[bd]->adr, m)
+#define CANin_burst(bd,adr,buf,len) can_read_regs(&can_base_addr[bd]->adr, buf, len)
 
 
 #ifdef CPC_PCI
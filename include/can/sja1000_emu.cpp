@@ -0,0 +1,511 @@
+/**\file
+ *
+ * sja1000_emu.cpp
+ *
+ * Emulation of the registers of the Phillips SJA1000 (see sja1000_emu.h). The
+ * behavior follows SJA1000_3.pdf in ../doc for PeliCAN mode: the Rx FIFO is
+ * read through the receive buffer window at addresses 16-28, the acceptance
+ * code and mask registers take the place of that window in reset mode, and
+ * the transmit buffer is written at the same addresses in operating mode.
+ *
+ * Only built with CAN_EMULATOR defined (see tests/Makefile), so that the
+ * objects of include/can linked into can_man do not carry the emulator.
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#ifdef CAN_EMULATOR
+
+#include "sja1000_emu.h"
+#include "sja1000.h"
+#include "utils/ring.h"
+#include <pthread.h>
+#include <stddef.h>		/* offsetof */
+#include <string.h>
+
+
+/** Size of a frame in the receive or transmit buffer window, in bytes. */
+#define FRAME_REGS		13
+
+/** Largest number of frames in the Rx FIFO (11 bit identifiers, no data). */
+#define FIFO_MAX_FRAMES	(SJA1000_EMU_FIFO_SIZE / 3)
+
+/* Offsets of the registers with side effects. */
+#define REG_MODE	offsetof(canregs_t, canmode)
+#define REG_CMD		offsetof(canregs_t, cancmd)
+#define REG_STAT	offsetof(canregs_t, canstat)
+#define REG_IRQ		offsetof(canregs_t, canirq)
+#define REG_FRAME	offsetof(canregs_t, frameinfo)
+#define REG_RMC		offsetof(canregs_t, reserved3)
+
+
+/** State of the emulated chip of a channel. */
+typedef struct emu_chan {
+	/** Registers that read back their last written value. The driver accesses
+	 * the emulator through the addresses of these registers. */
+	canregs_t regs;
+
+	BYTE acr[4];				/**< acceptance code registers */
+	BYTE amr[4];				/**< acceptance mask registers */
+	BYTE tx_buf[FRAME_REGS];	/**< transmit buffer */
+
+	/** Frames in the Rx FIFO, as seen through the receive buffer window. */
+	BYTE rx_frames[FIFO_MAX_FRAMES][FRAME_REGS];
+	int rx_head;				/**< index of the oldest frame in the FIFO */
+	int rx_count;				/**< number of frames in the FIFO */
+	int rx_bytes;				/**< number of bytes taken in the FIFO */
+
+	BYTE ir;					/**< latched interrupts, except receive */
+	bool overrun;				/**< data overrun status */
+	bool bus_off;				/**< bus status, until reset mode is left */
+	bool tx_pending;			/**< a transmission was requested */
+	bool tx_complete;			/**< last transmission was completed */
+	bool hold_tx;				/**< see sja1000_emu_hold_tx */
+	bool tx_self;				/**< the pending transmission is also received */
+	sja1000_frame_t tx_frame;	/**< frame of the pending transmission */
+
+	/** Frames sent on the bus, oldest first. */
+	Ring<sja1000_frame_t, SJA1000_EMU_TX_LOG_SIZE> tx_log;
+
+	emu_chan();
+} emu_chan_t;
+
+
+static emu_chan_t emu_chans[MAX_CHANNELS];
+
+static pthread_mutex_t emu_locks[MAX_CHANNELS] = {
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER
+};
+
+
+/** Enter reset mode: the Rx FIFO is emptied and a pending transmission is
+ * aborted. */
+static void emu_enter_reset(emu_chan_t *chan) {
+	chan->rx_head = chan->rx_count = chan->rx_bytes = 0;
+	chan->ir = 0;
+	chan->overrun = false;
+	chan->tx_pending = false;
+	chan->tx_self = false;
+	chan->tx_complete = true;
+}
+
+
+/** Put the chip in its state after a hardware reset. */
+static void emu_power_on(emu_chan_t *chan) {
+	memset(&chan->regs, 0, sizeof(canregs_t));
+	memset(chan->acr, 0, sizeof(chan->acr));
+	memset(chan->amr, 0xFF, sizeof(chan->amr));
+	memset(chan->tx_buf, 0, sizeof(chan->tx_buf));
+	chan->regs.canmode = CAN_RESET_REQUEST;
+	chan->regs.errorwarninglimit = 96;
+	chan->bus_off = false;
+	chan->hold_tx = false;
+	chan->tx_log.empty();
+	emu_enter_reset(chan);
+}
+
+
+emu_chan::emu_chan() {
+	emu_power_on(this);
+}
+
+
+/** Find the channel and register offset of an emulated register. */
+static int emu_find(BYTE *addr, unsigned int *reg) {
+	for (int i = 0; i < MAX_CHANNELS; i++) {
+		BYTE *base = (BYTE*) &emu_chans[i].regs;
+		if (addr >= base && addr < base + sizeof(canregs_t)) {
+			*reg = (unsigned int) (addr - base);
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+/** Value of the interrupt register. The receive interrupt is set for as long
+ * as the Rx FIFO holds frames. */
+static BYTE emu_irq(emu_chan_t *chan) {
+	BYTE ir = chan->ir;
+	if (chan->rx_count != 0 &&
+			(chan->regs.canirq_enable & CAN_RECEIVE_INT_ENABLE))
+		ir |= CAN_RECEIVE_INT;
+	return ir;
+}
+
+
+/** Value of the status register. */
+static BYTE emu_status(emu_chan_t *chan) {
+	BYTE status = 0;
+	if (chan->rx_count != 0)
+		status |= CAN_RECEIVE_BUFFER_STATUS;
+	if (chan->overrun)
+		status |= CAN_DATA_OVERRUN;
+	if (chan->tx_pending)
+		status |= CAN_TRANSMIT_STATUS;
+	else
+		status |= CAN_TRANSMIT_BUFFER_ACCESS;
+	if (chan->tx_complete)
+		status |= CAN_TRANSMISSION_COMPLETE_STATUS;
+	/* The transmit error counter is beyond the warning limit when bus-off. */
+	if (chan->bus_off)
+		status |= CAN_BUS_STATUS | CAN_ERROR_STATUS;
+	return status;
+}
+
+
+/** Whether the bits of a value selected by care match an acceptance code,
+ * except for the bits set in the acceptance mask. */
+static bool emu_match(BYTE value, BYTE code, BYTE mask, BYTE care = 0xFF) {
+	return ((value ^ code) & ~mask & care) == 0;
+}
+
+
+/** Whether the acceptance filter passes a frame. */
+static bool emu_accept(emu_chan_t *chan, const sja1000_frame_t *frame) {
+	const BYTE *acr = chan->acr;
+	const BYTE *amr = chan->amr;
+	unsigned long id = frame->id;
+	bool single = chan->regs.canmode & CAN_ACC_FILT_MASK;
+
+	if (frame->extended) {
+		BYTE id1 = (BYTE) (id >> 21), id2 = (BYTE) (id >> 13);
+		if (single)
+			return emu_match(id1, acr[0], amr[0]) &&
+					emu_match(id2, acr[1], amr[1]) &&
+					emu_match((BYTE) (id >> 5), acr[2], amr[2]) &&
+					emu_match((BYTE) (id << 3), acr[3], amr[3], 0xFC);
+		/* Each filter only sees ID28-13. */
+		return (emu_match(id1, acr[0], amr[0]) &&
+				emu_match(id2, acr[1], amr[1])) ||
+				(emu_match(id1, acr[2], amr[2]) &&
+				emu_match(id2, acr[3], amr[3]));
+	}
+
+	BYTE id1 = (BYTE) (id >> 3), id2 = (BYTE) (id << 5);
+	if (single)
+		return emu_match(id1, acr[0], amr[0]) &&
+				emu_match(id2, acr[1], amr[1], 0xF0) &&
+				(frame->size < 1 || emu_match(frame->data[0], acr[2], amr[2])) &&
+				(frame->size < 2 || emu_match(frame->data[1], acr[3], amr[3]));
+	/* The first filter also compares the first data byte with the low nibbles
+	 * of ACR1 and ACR3. */
+	return (emu_match(id1, acr[0], amr[0]) &&
+			emu_match(id2, acr[1], amr[1], 0xF0) &&
+			(frame->size < 1 ||
+			 (emu_match(frame->data[0] >> 4, acr[1], amr[1], 0x0F) &&
+			  emu_match(frame->data[0], acr[3], amr[3], 0x0F)))) ||
+			(emu_match(id1, acr[2], amr[2]) &&
+			emu_match(id2, acr[3], amr[3], 0xF0));
+}
+
+
+/** Queue a frame in the Rx FIFO, if the acceptance filter passes it.
+ *
+ * @return
+ * 		SJA1000_EMU_QUEUED, SJA1000_EMU_REJECTED, SJA1000_EMU_OVERRUN or
+ * 		SJA1000_EMU_OFFLINE
+ */
+static int emu_queue_rx(emu_chan_t *chan, const sja1000_frame_t *frame) {
+	BYTE size = frame->size > 8 ? 8 : frame->size;
+	int header = frame->extended ? 5 : 3;
+	int tail;
+	BYTE *regs;
+	unsigned long id = frame->id;
+
+	if (chan->regs.canmode & CAN_RESET_REQUEST)
+		return SJA1000_EMU_OFFLINE;
+	if (!emu_accept(chan, frame))
+		return SJA1000_EMU_REJECTED;
+	if (chan->rx_bytes + header + size > SJA1000_EMU_FIFO_SIZE ||
+			chan->rx_count == FIFO_MAX_FRAMES) {
+		/* The data overrun interrupt is raised when the status bit is set. */
+		if (!chan->overrun &&
+				(chan->regs.canirq_enable & CAN_OVERRUN_INT_ENABLE))
+			chan->ir |= CAN_OVERRUN_INT;
+		chan->overrun = true;
+		return SJA1000_EMU_OVERRUN;
+	}
+
+	tail = (chan->rx_head + chan->rx_count) % FIFO_MAX_FRAMES;
+	regs = chan->rx_frames[tail];
+	memset(regs, 0, FRAME_REGS);
+	regs[0] = (frame->extended ? CAN_EFF : CAN_SFF) | size;
+	if (frame->extended) {
+		regs[1] = (BYTE) (id >> 21);
+		regs[2] = (BYTE) (id >> 13);
+		regs[3] = (BYTE) (id >> 5);
+		regs[4] = (BYTE) (id << 3);
+	} else {
+		regs[1] = (BYTE) (id >> 3);
+		regs[2] = (BYTE) (id << 5);
+	}
+	memcpy(&regs[header], frame->data, size);
+	chan->rx_count++;
+	chan->rx_bytes += header + size;
+	return SJA1000_EMU_QUEUED;
+}
+
+
+/** Complete the pending transmission, if any. */
+static bool emu_complete_tx(emu_chan_t *chan) {
+	if (!chan->tx_pending)
+		return false;
+
+	/* A self reception request receives the frame as it is sent. */
+	if (chan->tx_self)
+		emu_queue_rx(chan, &chan->tx_frame);
+	chan->tx_self = false;
+
+	if (!chan->tx_log.push(chan->tx_frame)) {
+		chan->tx_log.discard();
+		chan->tx_log.push(chan->tx_frame);
+	}
+	chan->tx_pending = false;
+	chan->tx_complete = true;
+	if (chan->regs.canirq_enable & CAN_TRANSMIT_INT_ENABLE)
+		chan->ir |= CAN_TRANSMIT_INT;
+	return true;
+}
+
+
+/** Load the transmit buffer into a frame and request its transmission.
+ *
+ * @param self
+ * 		whether the frame is also received (self reception request)
+ */
+static void emu_request_tx(emu_chan_t *chan, bool self) {
+	sja1000_frame_t *frame = &chan->tx_frame;
+	const BYTE *buf = chan->tx_buf;
+	const BYTE *data;
+
+	frame->extended = buf[0] & CAN_EFF;
+	frame->size = buf[0] & 0x0F;
+	if (frame->size > 8)
+		frame->size = 8;
+	if (frame->extended) {
+		frame->id = ((unsigned long) buf[1] << 21) | (buf[2] << 13) |
+				(buf[3] << 5) | (buf[4] >> 3);
+		data = &buf[5];
+	} else {
+		frame->id = (buf[1] << 3) | (buf[2] >> 5);
+		data = &buf[3];
+	}
+	memcpy(frame->data, data, frame->size);
+
+	chan->tx_pending = true;
+	chan->tx_self = self;
+	chan->tx_complete = false;
+	if (!chan->hold_tx)
+		emu_complete_tx(chan);
+}
+
+
+/** Execute the bits of a write to the command register. */
+static void emu_command(emu_chan_t *chan, BYTE cmd) {
+	/* Commands are ignored in reset mode. */
+	if (chan->regs.canmode & CAN_RESET_REQUEST)
+		return;
+
+	if (cmd & CAN_CLEAR_OVERRUN_STATUS)
+		chan->overrun = false;
+
+	if ((cmd & CAN_RELEASE_RECEIVE_BUFFER) && chan->rx_count != 0) {
+		BYTE *front = chan->rx_frames[chan->rx_head];
+		chan->rx_bytes -= ((front[0] & CAN_EFF) ? 5 : 3) + (front[0] & 0x0F);
+		chan->rx_head = (chan->rx_head + 1) % FIFO_MAX_FRAMES;
+		chan->rx_count--;
+	}
+
+	/* A transmission that has not completed yet is cancelled, which releases
+	 * the transmit buffer without completing the transmission. */
+	if ((cmd & CAN_ABORT_TRANSMISSION) && chan->tx_pending) {
+		chan->tx_pending = false;
+		chan->tx_self = false;
+		if (chan->regs.canirq_enable & CAN_TRANSMIT_INT_ENABLE)
+			chan->ir |= CAN_TRANSMIT_INT;
+	}
+
+	/* Nothing is sent in listen only mode, and the transmit buffer is locked
+	 * while a transmission is pending. */
+	if ((cmd & (CAN_TRANSMISSION_REQUEST | CAN_SELF_RECEPTION_REQUEST)) &&
+			!chan->tx_pending && !(chan->regs.canmode & CAN_LISTEN_ONLY_MODE))
+		emu_request_tx(chan, cmd & CAN_SELF_RECEPTION_REQUEST);
+}
+
+
+/** Write the mode register. */
+static void emu_set_mode(emu_chan_t *chan, BYTE mode) {
+	BYTE old = chan->regs.canmode;
+	BYTE reset_only = CAN_ACC_FILT_MASK | CAN_SELF_TEST_MODE |
+			CAN_LISTEN_ONLY_MODE;
+
+	/* The filter, self test and listen only bits can only be changed in
+	 * reset mode. */
+	if (!(old & CAN_RESET_REQUEST))
+		mode = (mode & ~reset_only) | (old & reset_only);
+	chan->regs.canmode = mode & 0x1F;
+
+	if ((mode & CAN_RESET_REQUEST) && !(old & CAN_RESET_REQUEST))
+		emu_enter_reset(chan);
+	/* The recovery sequence is taken to be over as soon as the controller is
+	 * back in operating mode. */
+	if (!(mode & CAN_RESET_REQUEST))
+		chan->bus_off = false;
+}
+
+
+/** Go bus-off: the chip enters reset mode, which aborts the pending
+ * transmission, and raises the error warning interrupt. */
+static void emu_bus_off(emu_chan_t *chan) {
+	if (!(chan->regs.canmode & CAN_RESET_REQUEST)) {
+		chan->regs.canmode |= CAN_RESET_REQUEST;
+		emu_enter_reset(chan);
+	}
+	chan->bus_off = true;
+	if (chan->regs.canirq_enable & CAN_ERROR_INT_ENABLE)
+		chan->ir |= CAN_ERROR_INT;
+}
+
+
+BYTE sja1000_emu_read(BYTE *addr) {
+	unsigned int reg;
+	int channel = emu_find(addr, &reg);
+	BYTE value;
+
+	if (channel < 0)
+		return 0xFF;
+	emu_chan_t *chan = &emu_chans[channel];
+
+	pthread_mutex_lock(&emu_locks[channel]);
+	if (reg == REG_CMD)
+		value = 0xFF;
+	else if (reg == REG_STAT)
+		value = emu_status(chan);
+	else if (reg == REG_IRQ) {
+		/* Reading clears every interrupt but the receive interrupt. */
+		value = emu_irq(chan);
+		chan->ir = 0;
+	} else if (reg == REG_RMC)
+		value = (BYTE) chan->rx_count;
+	else if (reg >= REG_FRAME && reg < REG_FRAME + FRAME_REGS) {
+		unsigned int i = reg - REG_FRAME;
+		if (chan->regs.canmode & CAN_RESET_REQUEST)
+			value = i < 4 ? chan->acr[i] : i < 8 ? chan->amr[i - 4] : 0;
+		else
+			value = chan->rx_count == 0 ? 0 :
+					chan->rx_frames[chan->rx_head][i];
+	} else
+		value = ((BYTE*) &chan->regs)[reg];
+	pthread_mutex_unlock(&emu_locks[channel]);
+
+	return value;
+}
+
+
+void sja1000_emu_write(BYTE *addr, BYTE value) {
+	unsigned int reg;
+	int channel = emu_find(addr, &reg);
+
+	if (channel < 0)
+		return;
+	emu_chan_t *chan = &emu_chans[channel];
+
+	pthread_mutex_lock(&emu_locks[channel]);
+	if (reg == REG_MODE)
+		emu_set_mode(chan, value);
+	else if (reg == REG_CMD)
+		emu_command(chan, value);
+	else if (reg >= REG_FRAME && reg < REG_FRAME + FRAME_REGS) {
+		unsigned int i = reg - REG_FRAME;
+		if (!(chan->regs.canmode & CAN_RESET_REQUEST))
+			chan->tx_buf[i] = value;
+		else if (i < 4)
+			chan->acr[i] = value;
+		else if (i < 8)
+			chan->amr[i - 4] = value;
+	} else if (reg != REG_STAT && reg != REG_IRQ && reg != REG_RMC)
+		((BYTE*) &chan->regs)[reg] = value;
+	pthread_mutex_unlock(&emu_locks[channel]);
+}
+
+
+struct canregs *sja1000_emu_map(int channel) {
+	return &emu_chans[channel].regs;
+}
+
+
+void sja1000_emu_reset(int channel) {
+	pthread_mutex_lock(&emu_locks[channel]);
+	emu_power_on(&emu_chans[channel]);
+	pthread_mutex_unlock(&emu_locks[channel]);
+}
+
+
+int sja1000_emu_receive(int channel, const sja1000_frame_t *frame) {
+	int status;
+
+	pthread_mutex_lock(&emu_locks[channel]);
+	status = emu_queue_rx(&emu_chans[channel], frame);
+	pthread_mutex_unlock(&emu_locks[channel]);
+	return status;
+}
+
+
+bool sja1000_emu_irq_pending(int channel) {
+	bool pending;
+
+	pthread_mutex_lock(&emu_locks[channel]);
+	pending = emu_irq(&emu_chans[channel]) != 0;
+	pthread_mutex_unlock(&emu_locks[channel]);
+	return pending;
+}
+
+
+unsigned int sja1000_emu_rx_count(int channel) {
+	unsigned int count;
+
+	pthread_mutex_lock(&emu_locks[channel]);
+	count = emu_chans[channel].rx_count;
+	pthread_mutex_unlock(&emu_locks[channel]);
+	return count;
+}
+
+
+void sja1000_emu_hold_tx(int channel, bool hold) {
+	pthread_mutex_lock(&emu_locks[channel]);
+	emu_chans[channel].hold_tx = hold;
+	pthread_mutex_unlock(&emu_locks[channel]);
+}
+
+
+bool sja1000_emu_complete_tx(int channel) {
+	bool completed;
+
+	pthread_mutex_lock(&emu_locks[channel]);
+	completed = emu_complete_tx(&emu_chans[channel]);
+	pthread_mutex_unlock(&emu_locks[channel]);
+	return completed;
+}
+
+
+void sja1000_emu_bus_off(int channel) {
+	pthread_mutex_lock(&emu_locks[channel]);
+	emu_bus_off(&emu_chans[channel]);
+	pthread_mutex_unlock(&emu_locks[channel]);
+}
+
+
+bool sja1000_emu_pop_tx(int channel, sja1000_frame_t *frame) {
+	bool popped;
+
+	pthread_mutex_lock(&emu_locks[channel]);
+	popped = emu_chans[channel].tx_log.pop(frame);
+	pthread_mutex_unlock(&emu_locks[channel]);
+	return popped;
+}
+
+#endif /* CAN_EMULATOR */
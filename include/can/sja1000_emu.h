@@ -0,0 +1,144 @@
+/**\file
+ *
+ * sja1000_emu.h
+ *
+ * Emulation of the registers of the Phillips SJA1000, in PeliCAN mode. When the
+ * driver is built with CAN_EMULATOR defined, the register accessors of
+ * sja1000.h (and therefore the CANin/CANout macros) read and write the
+ * emulated registers of a channel instead of the memory-mapped chip. This lets
+ * the interrupt handler, acceptance filters and transmit queue of
+ * CANDeviceManager run, be tested and be benchmarked on a machine without a
+ * CAN board.
+ *
+ * The emulator models the 64 byte Rx FIFO, the interrupt and status registers,
+ * the single and dual acceptance filters, data overruns, the completion of
+ * transmissions and self reception requests, whose frames are received
+ * through the acceptance filter once sent. The bus side of a channel is driven through the functions
+ * below: sja1000_emu_receive() puts a frame on the bus, and the frames sent by
+ * the driver are collected with sja1000_emu_pop_tx().
+ *
+ * Every register access and bus operation of a channel is serialized by a
+ * mutex of the channel, so the bus side may be driven from another thread than
+ * the driver.
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#ifndef INCLUDE_CAN_SJA1000_EMU_H_
+#define INCLUDE_CAN_SJA1000_EMU_H_
+
+#include "utils/common.h"	/* BYTE */
+
+struct canregs;
+
+
+/** Size of the Rx FIFO of the SJA1000, in bytes. A frame takes 3 (11 bit
+ * identifier) or 5 (29 bit identifier) bytes, plus its data bytes. */
+#define SJA1000_EMU_FIFO_SIZE	64
+
+/** Largest number of sent frames kept until collected by sja1000_emu_pop_tx.
+ * Older frames are dropped. Must be a power of two. */
+#define SJA1000_EMU_TX_LOG_SIZE	256
+
+/** Returned by sja1000_emu_receive if the frame was queued in the Rx FIFO. */
+#define SJA1000_EMU_QUEUED		0
+
+/** Returned by sja1000_emu_receive if the acceptance filter rejected the
+ * frame. */
+#define SJA1000_EMU_REJECTED	1
+
+/** Returned by sja1000_emu_receive if the frame was lost because the Rx FIFO
+ * is full (data overrun). */
+#define SJA1000_EMU_OVERRUN		2
+
+/** Returned by sja1000_emu_receive if the chip is in reset mode. */
+#define SJA1000_EMU_OFFLINE		3
+
+
+/** A frame on the emulated bus. */
+typedef struct {
+	unsigned long id;	/**< 11 or 29 bit identifier */
+	bool extended;		/**< whether the identifier has 29 bits */
+	BYTE size;			/**< number of data bytes (0-8) */
+	BYTE data[8];		/**< data field */
+} sja1000_frame_t;
+
+
+/** Return the emulated registers of a channel.
+ *
+ * Used by CANDeviceManager::init in place of mmap_device_memory.
+ *
+ * @param channel
+ * 		index of the channel, from 0 to MAX_CHANNELS - 1
+ */
+extern struct canregs *sja1000_emu_map(int channel);
+
+/** Put the chip of a channel in its state after a hardware reset.
+ *
+ * The chip is left in reset mode with every interrupt disabled, the Rx FIFO
+ * and the log of sent frames are emptied, and transmissions complete at once.
+ */
+extern void sja1000_emu_reset(int channel);
+
+/** Put a frame on the bus of a channel.
+ *
+ * The frame is checked against the acceptance filter of the chip, then queued
+ * in the Rx FIFO. The receive interrupt is raised while the FIFO holds frames
+ * and it is enabled.
+ *
+ * @return
+ * 		SJA1000_EMU_QUEUED, SJA1000_EMU_REJECTED, SJA1000_EMU_OVERRUN or
+ * 		SJA1000_EMU_OFFLINE
+ */
+extern int sja1000_emu_receive(int channel, const sja1000_frame_t *frame);
+
+/** Whether an enabled interrupt of the chip of a channel is pending, i.e.
+ * whether the chip drives its interrupt line. */
+extern bool sja1000_emu_irq_pending(int channel);
+
+/** Return the number of frames in the Rx FIFO of a channel. */
+extern unsigned int sja1000_emu_rx_count(int channel);
+
+/** Choose whether the transmission requests of a channel complete at once
+ * (the default), or stay pending until sja1000_emu_complete_tx is called.
+ */
+extern void sja1000_emu_hold_tx(int channel, bool hold);
+
+/** Complete the pending transmission of a channel.
+ *
+ * The frame is added to the log of sent frames, the transmit buffer is
+ * released and the transmit interrupt is raised if enabled.
+ *
+ * @return
+ * 		true if a transmission was pending, false otherwise
+ */
+extern bool sja1000_emu_complete_tx(int channel);
+
+/** Make the chip of a channel go bus-off, as after too many transmit errors.
+ *
+ * The chip enters reset mode, which empties the Rx FIFO and aborts the
+ * pending transmission, sets the bus and error status bits and raises the
+ * error warning interrupt if enabled. The bus status is cleared once the
+ * driver leaves reset mode.
+ */
+extern void sja1000_emu_bus_off(int channel);
+
+/** Remove the oldest frame sent on the bus of a channel.
+ *
+ * @param frame
+ * 		updated with the frame
+ * @return
+ * 		true if a frame was removed, false if every sent frame was collected
+ */
+extern bool sja1000_emu_pop_tx(int channel, sja1000_frame_t *frame);
+
+/** Read an emulated register. Used by can_read_reg. */
+extern BYTE sja1000_emu_read(BYTE *addr);
+
+/** Write an emulated register. Used by can_write_reg. */
+extern void sja1000_emu_write(BYTE *addr, BYTE value);
+
+
+#endif /* INCLUDE_CAN_SJA1000_EMU_H_ */
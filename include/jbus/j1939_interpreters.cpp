@@ -16,6 +16,8 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <stdlib.h>
+#include <string.h>
 
 using namespace std;
 
@@ -42,11 +44,21 @@ int PDUInterpreter::pgn() {
 }
 
 
+size_t PDUInterpreter::size() {
+	return sizeof(j1939_pdu_typ);
+}
+
+
 void *PDUInterpreter::convert(j1939_pdu_typ *pdu) {
 	return (void*) pdu;  // no changes are made
 }
 
 
+void PDUInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	*((j1939_pdu_typ*) out) = *pdu;
+}
+
+
 void PDUInterpreter::print(void *pdv, FILE *fp, bool numeric) {
 	j1939_pdu_typ *pdu = (j1939_pdu_typ*) pdv;
 
@@ -102,8 +114,21 @@ int TSC1Interpreter::pgn() {
 }
 
 
+size_t TSC1Interpreter::size() {
+	return sizeof(j1939_tsc1_typ);
+}
+
+
 void *TSC1Interpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_tsc1_typ *tsc1 = new j1939_tsc1_typ();
+	this->convert(pdu, tsc1);
+	return (void*) tsc1;
+}
+
+
+void TSC1Interpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_tsc1_typ *tsc1 = (j1939_tsc1_typ*) out;
+	memset(tsc1, 0, sizeof(j1939_tsc1_typ));
 	tsc1->timestamp = pdu->timestamp;
 
 	tsc1->src_address = pdu->src_address;
@@ -117,8 +142,6 @@ void *TSC1Interpreter::convert(j1939_pdu_typ *pdu) {
 	tsc1->req_spd_lim = speed_in_rpm_2byte(data);
 
 	tsc1->req_trq_lim = percent_m125_to_p125(pdu->data_field[3]);
-
-	return (void*) tsc1;
 }
 
 
@@ -172,8 +195,21 @@ int EBC1Interpreter::pgn() {
 }
 
 
+size_t EBC1Interpreter::size() {
+	return sizeof(j1939_ebc1_typ);
+}
+
+
 void *EBC1Interpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_ebc1_typ *ebc1 = new j1939_ebc1_typ();
+	this->convert(pdu, ebc1);
+	return (void*) ebc1;
+}
+
+
+void EBC1Interpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_ebc1_typ *ebc1 = (j1939_ebc1_typ*) out;
+	memset(ebc1, 0, sizeof(j1939_ebc1_typ));
 	ebc1->timestamp = pdu->timestamp;
 
 	ebc1->ebs_brk_switch = BITS87(pdu->data_field[0]);
@@ -202,8 +238,6 @@ void *EBC1Interpreter::convert(j1939_pdu_typ *pdu) {
 	ebc1->src_address_ctrl = pdu->data_field[6];
 
 	ebc1->total_brk_demand = brake_demand(pdu->data_field[7]);
-
-	return (void*) ebc1;
 }
 
 
@@ -304,8 +338,21 @@ int EBC2Interpreter::pgn() {
 }
 
 
+size_t EBC2Interpreter::size() {
+	return sizeof(j1939_ebc2_typ);
+}
+
+
 void *EBC2Interpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_ebc2_typ *ebc2 = new j1939_ebc2_typ();
+	this->convert(pdu, ebc2);
+	return (void*) ebc2;
+}
+
+
+void EBC2Interpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_ebc2_typ *ebc2 = (j1939_ebc2_typ*) out;
+	memset(ebc2, 0, sizeof(j1939_ebc2_typ));
 	ebc2->timestamp = pdu->timestamp;
 
 	int two_bytes = TWOBYTES(pdu->data_field[1], pdu->data_field[0]);
@@ -316,8 +363,6 @@ void *EBC2Interpreter::convert(j1939_pdu_typ *pdu) {
 	ebc2->rel_spd_rear_right_1 = wheel_based_mps_relative(pdu->data_field[5]);
 	ebc2->rel_spd_rear_left_2 = wheel_based_mps_relative(pdu->data_field[6]);
 	ebc2->rel_spd_rear_right_2 = wheel_based_mps_relative(pdu->data_field[7]);
-
-	return (void*) ebc2;
 }
 
 
@@ -375,8 +420,21 @@ int EEC1Interpreter::pgn() {
 }
 
 
+size_t EEC1Interpreter::size() {
+	return sizeof(j1939_eec1_typ);
+}
+
+
 void *EEC1Interpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_eec1_typ *eec1 = new j1939_eec1_typ();
+	this->convert(pdu, eec1);
+	return (void*) eec1;
+}
+
+
+void EEC1Interpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_eec1_typ *eec1 = (j1939_eec1_typ*) out;
+	memset(eec1, 0, sizeof(j1939_eec1_typ));
 	eec1->timestamp = pdu->timestamp;
 
 	eec1->eng_trq_mode = LONIBBLE(pdu->data_field[0]);
@@ -386,8 +444,6 @@ void *EEC1Interpreter::convert(j1939_pdu_typ *pdu) {
 	eec1->eng_spd = speed_in_rpm_2byte(two_bytes);
 	eec1->src_address = pdu->data_field[5];
 	eec1->eng_demand_trq = percent_m125_to_p125(pdu->data_field[7]);
-
-	return (void*) eec1;
 }
 
 
@@ -450,8 +506,21 @@ int EEC2Interpreter::pgn() {
 }
 
 
+size_t EEC2Interpreter::size() {
+	return sizeof(j1939_eec2_typ);
+}
+
+
 void *EEC2Interpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_eec2_typ *eec2 = new j1939_eec2_typ();
+	this->convert(pdu, eec2);
+	return (void*) eec2;
+}
+
+
+void EEC2Interpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_eec2_typ *eec2 = (j1939_eec2_typ*) out;
+	memset(eec2, 0, sizeof(j1939_eec2_typ));
 	eec2->timestamp = pdu->timestamp;
 
 	eec2->accel_pedal2_idle = BITS87(pdu->data_field[0]);
@@ -463,8 +532,6 @@ void *EEC2Interpreter::convert(j1939_pdu_typ *pdu) {
 	eec2->eng_prcnt_load_curr_spd = percent_0_to_250(pdu->data_field[2]);
 	eec2->accel_pedal2_pos = percent_0_to_100(pdu->data_field[4]);
 	eec2->act_max_avail_eng_trq = percent_0_to_100(pdu->data_field[6]);
-
-	return (void*) eec2;
 }
 
 
@@ -530,8 +597,21 @@ int EEC3Interpreter::pgn() {
 }
 
 
+size_t EEC3Interpreter::size() {
+	return sizeof(j1939_eec3_typ);
+}
+
+
 void *EEC3Interpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_eec3_typ *eec3 = new j1939_eec3_typ();
+	this->convert(pdu, eec3);
+	return (void*) eec3;
+}
+
+
+void EEC3Interpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_eec3_typ *eec3 = (j1939_eec3_typ*) out;
+	memset(eec3, 0, sizeof(j1939_eec3_typ));
 	eec3->timestamp = pdu->timestamp;
 
 	eec3->nominal_friction = percent_m125_to_p125(pdu->data_field[0]);
@@ -542,8 +622,6 @@ void *EEC3Interpreter::convert(j1939_pdu_typ *pdu) {
 	eec3->operating_spd_adjust = percent_0_to_250(pdu->data_field[3]);
 
 	eec3->est_eng_prstic_loss = percent_m125_to_p125(pdu->data_field[4]);
-
-	return (void*) eec3;
 }
 
 
@@ -600,8 +678,21 @@ int ERC1Interpreter::pgn() {
 }
 
 
+size_t ERC1Interpreter::size() {
+	return sizeof(j1939_erc1_typ);
+}
+
+
 void *ERC1Interpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_erc1_typ *erc1 = new j1939_erc1_typ();
+	this->convert(pdu, erc1);
+	return (void*) erc1;
+}
+
+
+void ERC1Interpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_erc1_typ *erc1 = (j1939_erc1_typ*) out;
+	memset(erc1, 0, sizeof(j1939_erc1_typ));
 	erc1->timestamp = pdu->timestamp;
 
 	erc1->enable_shift_assist = BITS87(pdu->data_field[0]);
@@ -615,8 +706,6 @@ void *ERC1Interpreter::convert(j1939_pdu_typ *pdu) {
 	erc1->drvrs_demand_prcnt_trq = percent_m125_to_p125(pdu->data_field[5]);
 	erc1->selection_nonengine = percent_0_to_100(pdu->data_field[6]);
 	erc1->max_available_prcnt_trq = percent_m125_to_p125(pdu->data_field[7]);
-
-	return (void*) erc1;
 }
 
 
@@ -698,8 +787,21 @@ int ETC1Interpreter::pgn() {
 }
 
 
-void* ETC1Interpreter::convert(j1939_pdu_typ *pdu) {
+size_t ETC1Interpreter::size() {
+	return sizeof(j1939_etc1_typ);
+}
+
+
+void *ETC1Interpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_etc1_typ *etc1 = new j1939_etc1_typ();
+	this->convert(pdu, etc1);
+	return (void*) etc1;
+}
+
+
+void ETC1Interpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_etc1_typ *etc1 = (j1939_etc1_typ*) out;
+	memset(etc1, 0, sizeof(j1939_etc1_typ));
 	etc1->timestamp = pdu->timestamp;
 	int two_bytes;
 
@@ -719,8 +821,6 @@ void* ETC1Interpreter::convert(j1939_pdu_typ *pdu) {
 	etc1->trans_input_shaft_spd = speed_in_rpm_2byte(two_bytes);
 
 	etc1->src_address_ctrl = pdu->data_field[7];
-
-	return (void*) etc1;
 }
 
 
@@ -781,8 +881,21 @@ int ETC2Interpreter::pgn() {
 }
 
 
+size_t ETC2Interpreter::size() {
+	return sizeof(j1939_etc2_typ);
+}
+
+
 void *ETC2Interpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_etc2_typ *etc2 = new j1939_etc2_typ();
+	this->convert(pdu, etc2);
+	return (void*) etc2;
+}
+
+
+void ETC2Interpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_etc2_typ *etc2 = (j1939_etc2_typ*) out;
+	memset(etc2, 0, sizeof(j1939_etc2_typ));
 	etc2->timestamp = pdu->timestamp;
 
 	etc2->trans_selected_gear = gear_m125_to_p125(pdu->data_field[0]);
@@ -791,8 +904,6 @@ void *ETC2Interpreter::convert(j1939_pdu_typ *pdu) {
 	etc2->trans_current_gear = gear_m125_to_p125(pdu->data_field[3]);
 	etc2->range_selected = TWOBYTES(pdu->data_field[5], pdu->data_field[4]);
 	etc2->range_attained = TWOBYTES(pdu->data_field[7], pdu->data_field[6]);
-
-	return (void*) etc2;
 }
 
 
@@ -838,15 +949,26 @@ int TURBOInterpreter::pgn() {
 }
 
 
+size_t TURBOInterpreter::size() {
+	return sizeof(j1939_turbo_typ);
+}
+
+
 void *TURBOInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_turbo_typ *turbo = new j1939_turbo_typ();
+	this->convert(pdu, turbo);
+	return (void*) turbo;
+}
+
+
+void TURBOInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_turbo_typ *turbo = (j1939_turbo_typ*) out;
+	memset(turbo, 0, sizeof(j1939_turbo_typ));
 	turbo->timestamp = pdu->timestamp;
 
 	turbo->turbo_lube_oil_pressure = pressure_0_to_1000kpa(pdu->data_field[0]);
 	int two_bytes = TWOBYTES(pdu->data_field[2], pdu->data_field[1]);
 	turbo->turbo_speed = rotor_speed_in_rpm(two_bytes);
-
-	return (void*) turbo;
 }
 
 
@@ -884,8 +1006,21 @@ int VDInterpreter::pgn() {
 }
 
 
+size_t VDInterpreter::size() {
+	return sizeof(j1939_vd_typ);
+}
+
+
 void *VDInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_vd_typ *vd = new j1939_vd_typ();
+	this->convert(pdu, vd);
+	return (void*) vd;
+}
+
+
+void VDInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_vd_typ *vd = (j1939_vd_typ*) out;
+	memset(vd, 0, sizeof(j1939_vd_typ));
 	vd->timestamp = pdu->timestamp;
 	unsigned int four_bytes;
 
@@ -897,8 +1032,6 @@ void *VDInterpreter::convert(j1939_pdu_typ *pdu) {
 	four_bytes = FOURBYTES(pdu->data_field[7], pdu->data_field[6],
 			pdu->data_field[5], pdu->data_field[4]);
 	vd->tot_vehicle_dist = distance_in_km(four_bytes);
-
-	return (void*) vd;
 }
 
 
@@ -935,8 +1068,21 @@ int RCFGInterpreter::pgn() {
 }
 
 
+size_t RCFGInterpreter::size() {
+	return sizeof(j1939_rcfg_typ);
+}
+
+
 void *RCFGInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_rcfg_typ *rcfg = new j1939_rcfg_typ();
+	this->convert(pdu, rcfg);
+	return (void*) rcfg;
+}
+
+
+void RCFGInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_rcfg_typ *rcfg = (j1939_rcfg_typ*) out;
+	memset(rcfg, 0, sizeof(j1939_rcfg_typ));
 	rcfg->timestamp = pdu->timestamp;
 	unsigned short two_bytes;
 	BYTE data[21];	 // to hold data bytes from 3 packets
@@ -963,8 +1109,6 @@ void *RCFGInterpreter::convert(j1939_pdu_typ *pdu) {
 	two_bytes = TWOBYTES(data[17], data[16]);
 	rcfg->reference_retarder_trq = torque_in_nm(two_bytes);
 	rcfg->percent_torque[4] = percent_m125_to_p125(data[18]);
-
-	return (void*) rcfg;
 }
 
 
@@ -1057,8 +1201,21 @@ int ECFGInterpreter::pgn() {
 }
 
 
+size_t ECFGInterpreter::size() {
+	return sizeof(j1939_ecfg_typ);
+}
+
+
 void *ECFGInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_ecfg_typ *ecfg = new j1939_ecfg_typ();
+	this->convert(pdu, ecfg);
+	return (void*) ecfg;
+}
+
+
+void ECFGInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_ecfg_typ *ecfg = (j1939_ecfg_typ*) out;
+	memset(ecfg, 0, sizeof(j1939_ecfg_typ));
 	ecfg->timestamp = pdu->timestamp;
 	int two_bytes;
 	int data[28];	 // to hold data bytes from 4 packets
@@ -1093,8 +1250,6 @@ void *ECFGInterpreter::convert(j1939_pdu_typ *pdu) {
 	ecfg->spd_ctrl_upper_lim = speed_in_rpm_1byte(data[25]);
 	ecfg->trq_ctrl_lower_lim = percent_m125_to_p125(data[26]);
 	ecfg->trq_ctrl_upper_lim = percent_m125_to_p125(data[27]);
-
-	return (void*) ecfg;
 }
 
 
@@ -1186,8 +1341,21 @@ int ETEMPInterpreter::pgn() {
 }
 
 
+size_t ETEMPInterpreter::size() {
+	return sizeof(j1939_etemp_typ);
+}
+
+
 void *ETEMPInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_etemp_typ *etemp = new j1939_etemp_typ();
+	this->convert(pdu, etemp);
+	return (void*) etemp;
+}
+
+
+void ETEMPInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_etemp_typ *etemp = (j1939_etemp_typ*) out;
+	memset(etemp, 0, sizeof(j1939_etemp_typ));
 	etemp->timestamp = pdu->timestamp;
 	unsigned short two_bytes;
 
@@ -1205,8 +1373,6 @@ void *ETEMPInterpreter::convert(j1939_pdu_typ *pdu) {
 
 	etemp->eng_intercooler_thermostat_opening =
 		percent_0_to_100(pdu->data_field[7]);
-
-	return (void*) etemp;
 }
 
 
@@ -1259,8 +1425,21 @@ int PTOInterpreter::pgn() {
 }
 
 
+size_t PTOInterpreter::size() {
+	return sizeof(j1939_pto_typ);
+}
+
+
 void *PTOInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_pto_typ *pto = new j1939_pto_typ();
+	this->convert(pdu, pto);
+	return (void*) pto;
+}
+
+
+void PTOInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_pto_typ *pto = (j1939_pto_typ*) out;
+	memset(pto, 0, sizeof(j1939_pto_typ));
 	pto->timestamp = pdu->timestamp;
 	int two_bytes;
 
@@ -1280,8 +1459,6 @@ void *PTOInterpreter::convert(j1939_pdu_typ *pdu) {
 	pto->resume_switch = BITS65(pdu->data_field[6]);
 	pto->coast_decel_switch = BITS43(pdu->data_field[6]);
 	pto->set_switch = BITS21(pdu->data_field[6]);
-
-	return (void*) pto;
 }
 
 
@@ -1345,8 +1522,21 @@ int CCVSInterpreter::pgn() {
 }
 
 
+size_t CCVSInterpreter::size() {
+	return sizeof(j1939_ccvs_typ);
+}
+
+
 void *CCVSInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_ccvs_typ *ccvs = new j1939_ccvs_typ();
+	this->convert(pdu, ccvs);
+	return (void*) ccvs;
+}
+
+
+void CCVSInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_ccvs_typ *ccvs = (j1939_ccvs_typ*) out;
+	memset(ccvs, 0, sizeof(j1939_ccvs_typ));
 	ccvs->timestamp = pdu->timestamp;
 	int byte;
 	int two_bytes;
@@ -1383,8 +1573,6 @@ void *CCVSInterpreter::convert(j1939_pdu_typ *pdu) {
 	ccvs->eng_test_mode_switch = BITS65(byte);
 	ccvs->eng_idle_decr_switch = BITS43(byte);
 	ccvs->eng_idle_incr_switch = BITS21(byte);
-
-	return (void*) ccvs;
 }
 
 
@@ -1499,8 +1687,21 @@ int LFEInterpreter::pgn() {
 }
 
 
+size_t LFEInterpreter::size() {
+	return sizeof(j1939_lfe_typ);
+}
+
+
 void *LFEInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_lfe_typ *lfe = new j1939_lfe_typ();
+	this->convert(pdu, lfe);
+	return (void*) lfe;
+}
+
+
+void LFEInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_lfe_typ *lfe = (j1939_lfe_typ*) out;
+	memset(lfe, 0, sizeof(j1939_lfe_typ));
 	lfe->timestamp = pdu->timestamp;
 	int two_bytes;
 
@@ -1515,8 +1716,6 @@ void *LFEInterpreter::convert(j1939_pdu_typ *pdu) {
 
 	lfe->eng_throttle1_pos = percent_0_to_100(pdu->data_field[6]);
 	lfe->eng_throttle2_pos = percent_0_to_100(pdu->data_field[7]);
-
-	return (void*) lfe;
 }
 
 
@@ -1574,8 +1773,21 @@ int AMBCInterpreter::pgn() {
 	return AMBC;
 }
 
+size_t AMBCInterpreter::size() {
+	return sizeof(j1939_ambc_typ);
+}
+
+
 void *AMBCInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_ambc_typ *ambc = new j1939_ambc_typ();
+	this->convert(pdu, ambc);
+	return (void*) ambc;
+}
+
+
+void AMBCInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_ambc_typ *ambc = (j1939_ambc_typ*) out;
+	memset(ambc, 0, sizeof(j1939_ambc_typ));
 	ambc->timestamp = pdu->timestamp;
 	int two_bytes;
 
@@ -1591,8 +1803,6 @@ void *AMBCInterpreter::convert(j1939_pdu_typ *pdu) {
 
 	two_bytes = TWOBYTES(pdu->data_field[7], pdu->data_field[6]);
 	ambc->road_surface_temp = temp_m273_to_p1735(two_bytes);
-
-	return (void*) ambc;
 }
 
 
@@ -1638,8 +1848,21 @@ int IECInterpreter::pgn() {
 }
 
 
+size_t IECInterpreter::size() {
+	return sizeof(j1939_iec_typ);
+}
+
+
 void *IECInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_iec_typ *iec = new j1939_iec_typ();
+	this->convert(pdu, iec);
+	return (void*) iec;
+}
+
+
+void IECInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_iec_typ *iec = (j1939_iec_typ*) out;
+	memset(iec, 0, sizeof(j1939_iec_typ));
 	iec->timestamp = pdu->timestamp;
 	unsigned short two_bytes;
 
@@ -1653,8 +1876,6 @@ void *IECInterpreter::convert(j1939_pdu_typ *pdu) {
 	iec->exhaust_gas_temp = temp_m273_to_p1735(two_bytes);
 
 	iec->coolant_filter_diff_pressure = pressure_0_to_125kpa(pdu->data_field[7]);
-
-	return (void*) iec;
 }
 
 
@@ -1710,8 +1931,21 @@ int VEPInterpreter::pgn() {
 }
 
 
+size_t VEPInterpreter::size() {
+	return sizeof(j1939_vep_typ);
+}
+
+
 void *VEPInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_vep_typ *vep = new j1939_vep_typ();
+	this->convert(pdu, vep);
+	return (void*) vep;
+}
+
+
+void VEPInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_vep_typ *vep = (j1939_vep_typ*) out;
+	memset(vep, 0, sizeof(j1939_vep_typ));
 	vep->timestamp = pdu->timestamp;
 	int two_bytes;
 
@@ -1726,8 +1960,6 @@ void *VEPInterpreter::convert(j1939_pdu_typ *pdu) {
 
 	two_bytes = TWOBYTES(pdu->data_field[7], pdu->data_field[6]);
 	vep->battery_potential = voltage(two_bytes);
-
-	return (void*) vep;
 }
 
 
@@ -1773,8 +2005,21 @@ int TFInterpreter::pgn() {
 }
 
 
+size_t TFInterpreter::size() {
+	return sizeof(j1939_tf_typ);
+}
+
+
 void *TFInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_tf_typ *tf = new j1939_tf_typ();
+	this->convert(pdu, tf);
+	return (void*) tf;
+}
+
+
+void TFInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_tf_typ *tf = (j1939_tf_typ*) out;
+	memset(tf, 0, sizeof(j1939_tf_typ));
 	tf->timestamp = pdu->timestamp;
 	unsigned short two_bytes;
 
@@ -1785,8 +2030,6 @@ void *TFInterpreter::convert(j1939_pdu_typ *pdu) {
 
 	two_bytes = TWOBYTES(pdu->data_field[5], pdu->data_field[4]);
 	tf->oil_temp = temp_m273_to_p1735(two_bytes);
-
-	return (void*) tf;
 }
 
 
@@ -1832,12 +2075,24 @@ int RFInterpreter::pgn() {
 }
 
 
+size_t RFInterpreter::size() {
+	return sizeof(j1939_rf_typ);
+}
+
+
 void *RFInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_rf_typ *rf = new j1939_rf_typ();
+	this->convert(pdu, rf);
+	return (void*) rf;
+}
+
+
+void RFInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_rf_typ *rf = (j1939_rf_typ*) out;
+	memset(rf, 0, sizeof(j1939_rf_typ));
 	rf->timestamp = pdu->timestamp;
 	rf->pressure = pressure_0_to_4000kpa(pdu->data_field[0]);
 	rf->oil_temp = temp_m40_to_p210(pdu->data_field[1]);
-	return (void*) rf;
 }
 
 
@@ -1874,8 +2129,21 @@ int HRVDInterpreter::pgn() {
 }
 
 
+size_t HRVDInterpreter::size() {
+	return sizeof(j1939_hrvd_typ);
+}
+
+
 void *HRVDInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_hrvd_typ *hrvd = new j1939_hrvd_typ();
+	this->convert(pdu, hrvd);
+	return (void*) hrvd;
+}
+
+
+void HRVDInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_hrvd_typ *hrvd = (j1939_hrvd_typ*) out;
+	memset(hrvd, 0, sizeof(j1939_hrvd_typ));
 	hrvd->timestamp = pdu->timestamp;
 	unsigned int four_bytes;
 
@@ -1886,8 +2154,6 @@ void *HRVDInterpreter::convert(j1939_pdu_typ *pdu) {
 	four_bytes = FOURBYTES(pdu->data_field[7], pdu->data_field[6],
 		pdu->data_field[5], pdu->data_field[4]);
 	hrvd->trip_distance = hr_distance_in_km(four_bytes);
-
-	return (void*) hrvd;
 }
 
 
@@ -1924,12 +2190,24 @@ int FDInterpreter::pgn() {
 }
 
 
+size_t FDInterpreter::size() {
+	return sizeof(j1939_fd_typ);
+}
+
+
 void *FDInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_fd_typ *fd = new j1939_fd_typ();
+	this->convert(pdu, fd);
+	return (void*) fd;
+}
+
+
+void FDInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_fd_typ *fd = (j1939_fd_typ*) out;
+	memset(fd, 0, sizeof(j1939_fd_typ));
 	fd->timestamp = pdu->timestamp;
 	fd->prcnt_fan_spd = percent_0_to_100(pdu->data_field[0]);
 	fd->fan_drive_state = LONIBBLE(pdu->data_field[1]);
-	return (void*) fd;
 }
 
 
@@ -1966,8 +2244,21 @@ int GFI2Interpreter::pgn() {
 }
 
 
+size_t GFI2Interpreter::size() {
+	return sizeof(j1939_gfi2_typ);
+}
+
+
 void *GFI2Interpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_gfi2_typ *gfi2 = new j1939_gfi2_typ();
+	this->convert(pdu, gfi2);
+	return (void*) gfi2;
+}
+
+
+void GFI2Interpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_gfi2_typ *gfi2 = (j1939_gfi2_typ*) out;
+	memset(gfi2, 0, sizeof(j1939_gfi2_typ));
 	gfi2->timestamp = pdu->timestamp;
 	int two_bytes;
 
@@ -1979,8 +2270,6 @@ void *GFI2Interpreter::convert(j1939_pdu_typ *pdu) {
 
 	gfi2->fuel_valve_pos1 = percent_0_to_100(pdu->data_field[4]);
 	gfi2->fuel_valve_pos2 = percent_0_to_100(pdu->data_field[5]);
-
-	return (void*) gfi2;
 }
 
 
@@ -2022,8 +2311,21 @@ int EIInterpreter::pgn() {
 	return EI;
 }
 
+size_t EIInterpreter::size() {
+	return sizeof(j1939_ei_typ);
+}
+
+
 void *EIInterpreter::convert(j1939_pdu_typ *pdu) {
 	j1939_ei_typ *ei = new j1939_ei_typ();
+	this->convert(pdu, ei);
+	return (void*) ei;
+}
+
+
+void EIInterpreter::convert(j1939_pdu_typ *pdu, void *out) {
+	j1939_ei_typ *ei = (j1939_ei_typ*) out;
+	memset(ei, 0, sizeof(j1939_ei_typ));
 	ei->timestamp = pdu->timestamp;
 	int data;
 
@@ -2035,8 +2337,6 @@ void *EIInterpreter::convert(j1939_pdu_typ *pdu) {
 	ei->eng_gas_mass_flow = mass_flow(data);
 	data = TWOBYTES(pdu->data_field[7], pdu->data_field[6]);
 	ei->inst_estimated_brake_power = power_in_kw(data);
-
-	return (void*) ei;
 }
 
 
@@ -2116,3 +2416,48 @@ map<int, J1939Interpreter*> get_interpreters() {
 
     return interpreters;
 }
+
+
+J1939Dispatch::J1939Dispatch() {
+    map<int, J1939Interpreter*> interpreters = get_interpreters();
+
+    /* Entry 0 is the fallback of every PGN without an interpreter. */
+    memset(this->_index, 0, sizeof(this->_index));
+    this->_entries[0].interpreter = interpreters[PDU];
+    this->_num_entries = 1;
+    interpreters.erase(PDU);
+
+    for (auto it = interpreters.begin(); it != interpreters.end(); ++it) {
+    	if (this->_num_entries == J1939_MAX_INTERPRETERS) {
+    		delete it->second;
+    		continue;
+    	}
+    	this->_index[it->first & 0xFFFF] = this->_num_entries;
+    	this->_entries[this->_num_entries++].interpreter = it->second;
+    }
+
+    for (int i=0; i<this->_num_entries; i++)
+    	this->_entries[i].storage = malloc(this->_entries[i].interpreter->size());
+}
+
+
+J1939Dispatch::~J1939Dispatch() {
+    for (int i=0; i<this->_num_entries; i++) {
+    	delete this->_entries[i].interpreter;
+    	free(this->_entries[i].storage);
+    }
+}
+
+
+bool J1939Dispatch::is_known(int pgn) {
+    return this->get(pgn)->pgn() == (pgn & 0xFFFF);
+}
+
+
+size_t J1939Dispatch::max_size() {
+    size_t max_size = 0;
+    for (int i=0; i<this->_num_entries; i++)
+    	if (this->_entries[i].interpreter->size() > max_size)
+    		max_size = this->_entries[i].interpreter->size();
+    return max_size;
+}
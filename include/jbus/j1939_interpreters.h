@@ -50,6 +50,21 @@ public:
 	 */
 	virtual void *convert(j1939_pdu_typ *pdu) = 0;
 
+	/** Convert a message from its pdu format into storage provided by the
+	 * caller, without allocating any memory.
+	 *
+	 * Every field of the storage is written, so it may be reused from one
+	 * message to the next.
+	 *
+	 * @param pdu generic format of the message
+	 * @param out data-specific format of the message, of at least size()
+	 * bytes and aligned for the type of the child class
+	 */
+	virtual void convert(j1939_pdu_typ *pdu, void *out) = 0;
+
+	/** Size of the data-specific format of the message, in bytes. */
+	virtual size_t size() = 0;
+
 	/** Check whether the incoming message is of the same pdu type as the one
 	 * covered by this (child) class.
 	 *
@@ -93,6 +108,8 @@ class PDUInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -109,6 +126,8 @@ class TSC1Interpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -120,6 +139,8 @@ class EBC1Interpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -131,6 +152,8 @@ class EBC2Interpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -147,6 +170,8 @@ class EEC1Interpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -158,6 +183,8 @@ class EEC2Interpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -169,6 +196,8 @@ class EEC3Interpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -180,6 +209,8 @@ class ETC1Interpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -191,6 +222,8 @@ class ETC2Interpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -202,6 +235,8 @@ class ERC1Interpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -213,6 +248,8 @@ class TFInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -224,6 +261,8 @@ class CCVSInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -235,6 +274,8 @@ class LFEInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -251,6 +292,8 @@ class RFInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -269,6 +312,8 @@ public:
 	// char* name = "Transmission Control (TC1)";
 	int pgn = 0;
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -280,6 +325,8 @@ class TURBOInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -291,6 +338,8 @@ class VDInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -302,6 +351,8 @@ class RCFGInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -315,6 +366,8 @@ public:
 //	// char* name = "Transmission Configuration (TCFG)";
 //	int pgn = TCFG;
 //	virtual void *convert(j1939_pdu_typ *pdu);
+//	virtual void convert(j1939_pdu_typ *pdu, void *out);
+//	virtual size_t size();
 //	virtual void print(void *pdv, FILE *fp, bool numeric);
 //	virtual void publish(void*);
 //};
@@ -326,6 +379,8 @@ class ECFGInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -337,6 +392,8 @@ class ETEMPInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -348,6 +405,8 @@ class PTOInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -359,6 +418,8 @@ class AMBCInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -370,6 +431,8 @@ class IECInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -381,6 +444,8 @@ class VEPInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -392,6 +457,8 @@ class HRVDInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -403,6 +470,8 @@ class FDInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -414,6 +483,8 @@ class GFI2Interpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -425,6 +496,8 @@ class EIInterpreter : public J1939Interpreter
 public:
 	virtual int pgn();
 	virtual void *convert(j1939_pdu_typ *pdu);
+	virtual void convert(j1939_pdu_typ *pdu, void *out);
+	virtual size_t size();
 	virtual void print(void *pdv, FILE *fp, bool numeric);
     virtual void *import(vector<string> &tokens);
 };
@@ -436,4 +509,89 @@ public:
 extern map<int, J1939Interpreter*> get_interpreters();
 
 
+/** Number of values of TWOBYTES(pdu_format, pdu_specific), i.e. of PGNs as
+ * computed from a pdu. */
+#define J1939_NUM_PGNS	65536
+
+/** Largest number of interpreters of a J1939Dispatch. */
+#define J1939_MAX_INTERPRETERS	256
+
+
+/** Constant-time table of the interpreter of every PGN.
+ *
+ * The interpreter of every received message is looked up, so this replaces
+ * the map of get_interpreters on that path. For every value of
+ * TWOBYTES(pdu_format, pdu_specific), the table holds the index of an entry
+ * (one byte, so the whole table takes 64 kB), and every entry holds an
+ * interpreter and storage for the data-specific format of its messages (see
+ * J1939Interpreter::convert(pdu, out)). A lookup is then two array reads, and
+ * converting a message allocates no memory.
+ *
+ * PGNs without an interpreter use the PDUInterpreter, so their messages are
+ * kept in their pdu format.
+ */
+class J1939Dispatch
+{
+public:
+	/** Build the table from the interpreters of get_interpreters, which are
+	 * owned by the table. */
+	J1939Dispatch();
+
+	/** Free the interpreters and their storage. */
+	~J1939Dispatch();
+
+	/** Return the interpreter of a PGN, or the PDUInterpreter if the PGN has
+	 * none. */
+	J1939Interpreter *get(int pgn) {
+		return this->_entries[this->_index[pgn & 0xFFFF]].interpreter;
+	}
+
+	/** Return the storage for the data-specific format of the messages of a
+	 * PGN, of get(pgn)->size() bytes. */
+	void *storage(int pgn) {
+		return this->_entries[this->_index[pgn & 0xFFFF]].storage;
+	}
+
+	/** Whether a PGN has an interpreter of its own. */
+	bool is_known(int pgn);
+
+	/** Return the largest size() of the interpreters, in bytes. */
+	size_t max_size();
+
+	/** Convert a message into the storage of its PGN.
+	 *
+	 * @param pdu generic format of the message
+	 * @param interpreter updated with the interpreter of the message, which
+	 * prints it
+	 * @return data-specific format of the message, valid until the next
+	 * message with the same PGN is converted
+	 */
+	void *convert(j1939_pdu_typ *pdu, J1939Interpreter **interpreter) {
+		int pgn = TWOBYTES(pdu->pdu_format, pdu->pdu_specific);
+		dispatch_entry_t *entry = &this->_entries[this->_index[pgn]];
+		entry->interpreter->convert(pdu, entry->storage);
+		*interpreter = entry->interpreter;
+		return entry->storage;
+	}
+
+private:
+	/** An interpreter and the storage of its messages. */
+	typedef struct {
+		J1939Interpreter *interpreter;
+		void *storage;
+	} dispatch_entry_t;
+
+	/** index in _entries of every PGN, 0 (the PDUInterpreter) if none */
+	unsigned char _index[J1939_NUM_PGNS];
+	/** the interpreters, the PDUInterpreter first */
+	dispatch_entry_t _entries[J1939_MAX_INTERPRETERS];
+	/** number of entries in _entries */
+	int _num_entries;
+
+	/* The table owns its interpreters and storage. */
+	J1939Dispatch(const J1939Dispatch&) = delete;
+	J1939Dispatch &operator=(const J1939Dispatch&) = delete;
+};
+
+
 #endif /* INCLUDE_JBUS_J1939_INTERPRETERS_H_ */
@@ -40,6 +40,8 @@ typedef struct
 	int src_address;	    /**< Source address */
 	int data_field[8];		/**< 64 bits maximum */
 	int num_bytes;			/**< number of bytes in data_field */
+	uint64_t rx_time_ns;	/**< monotonic time the frame was read from the
+								 CAN chip, in ns (see get_monotonic_ns) */
 } j1939_pdu_typ;
 
 
@@ -0,0 +1,298 @@
+/**\file
+ *
+ * j1939_tp.cpp
+ *
+ * Implements the methods in j1939_tp.h.
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#include "j1939_tp.h"
+#include <string.h>
+
+
+J1939Reassembler::J1939Reassembler() {
+	for (int i=0; i<J1939_TP_MAX_SESSIONS; i++) {
+		this->_sessions[i].state = TP_FREE;
+		this->_sessions[i].armed = false;
+		this->_free[i] = J1939_TP_MAX_SESSIONS - 1 - i;
+	}
+	this->_num_free = J1939_TP_MAX_SESSIONS;
+	memset(this->_by_source, 0, sizeof(this->_by_source));
+	for (int i=0; i<J1939_TP_WHEEL_SIZE; i++)
+		this->_wheel[i] = -1;
+	this->_tick = 0;
+	this->_started = false;
+	this->_num_active = 0;
+	memset(&this->_stats, 0, sizeof(this->_stats));
+}
+
+
+bool J1939Reassembler::process(j1939_pdu_typ *pdu,
+		j1939_tp_message_t **message) {
+	int slot;
+
+	this->expire(pdu->rx_time_ns);
+
+	switch (pdu->pdu_format) {
+		case HIBYTE(TPCM):
+			this->_process_cm(pdu);
+			return false;
+		case HIBYTE(TPDT):
+			if ((slot = this->_process_dt(pdu)) == -1)
+				return false;
+			*message = &this->_sessions[slot].message;
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+void J1939Reassembler::release(j1939_tp_message_t *message) {
+	/* The message is the first field of its slot. */
+	int slot = (int) ((tp_session_t *) message - this->_sessions);
+
+	if (this->_sessions[slot].state != TP_HELD)
+		return;
+	this->_sessions[slot].state = TP_FREE;
+	this->_free[this->_num_free++] = slot;
+}
+
+
+int J1939Reassembler::expire(uint64_t now_ns) {
+	unsigned int now = (unsigned int) (now_ns / (1000000 * J1939_TP_TICK_MS));
+	unsigned int steps;
+	int num_expired = 0;
+
+	if (!this->_started) {
+		this->_tick = now;
+		this->_started = true;
+		return 0;
+	}
+	if ((int) (now - this->_tick) <= 0)
+		return 0;
+
+	/* Every bucket is visited at most once, however long it has been since
+	 * the last frame. */
+	steps = now - this->_tick;
+	if (steps > J1939_TP_WHEEL_SIZE)
+		steps = J1939_TP_WHEEL_SIZE;
+
+	for (unsigned int i=1; i<=steps; i++) {
+		int slot = this->_wheel[(this->_tick + i) & (J1939_TP_WHEEL_SIZE - 1)];
+		while (slot != -1) {
+			int next = this->_sessions[slot].next;
+			if ((int) (this->_sessions[slot].deadline - now) <= 0) {
+				this->_close(slot, false);
+				this->_stats.timeouts++;
+				num_expired++;
+			}
+			slot = next;
+		}
+	}
+	this->_tick = now;
+
+	return num_expired;
+}
+
+
+int J1939Reassembler::get_num_active() {
+	return this->_num_active;
+}
+
+
+j1939_tp_stats_t J1939Reassembler::get_stats() {
+	return this->_stats;
+}
+
+
+int J1939Reassembler::_find(int src_address, int dst_address) {
+	unsigned char *entries = this->_by_source[src_address & 0xFF];
+
+	for (int i=0; i<J1939_TP_SESSIONS_PER_SOURCE; i++)
+		if (entries[i] != 0 &&
+				this->_sessions[entries[i] - 1].message.dst_address == dst_address)
+			return entries[i] - 1;
+	return -1;
+}
+
+
+int J1939Reassembler::_open(int src_address, int dst_address) {
+	unsigned char *entries = this->_by_source[src_address & 0xFF];
+	int slot;
+
+	/* A new transfer between the same addresses replaces the previous one. */
+	if ((slot = this->_find(src_address, dst_address)) != -1)
+		this->_close(slot, false);
+
+	if (this->_num_free == 0)
+		return -1;
+	for (int i=0; i<J1939_TP_SESSIONS_PER_SOURCE; i++) {
+		if (entries[i] != 0)
+			continue;
+		slot = this->_free[--this->_num_free];
+		entries[i] = slot + 1;
+		this->_sessions[slot].state = TP_ACTIVE;
+		this->_sessions[slot].message.src_address = src_address;
+		this->_sessions[slot].message.dst_address = dst_address;
+		this->_num_active++;
+		return slot;
+	}
+	return -1;
+}
+
+
+void J1939Reassembler::_close(int slot, bool held) {
+	tp_session_t *session = &this->_sessions[slot];
+	unsigned char *entries = this->_by_source[session->message.src_address];
+
+	this->_disarm(slot);
+	for (int i=0; i<J1939_TP_SESSIONS_PER_SOURCE; i++)
+		if (entries[i] == slot + 1)
+			entries[i] = 0;
+	this->_num_active--;
+
+	if (held) {
+		session->state = TP_HELD;
+	} else {
+		session->state = TP_FREE;
+		this->_free[this->_num_free++] = slot;
+	}
+}
+
+
+void J1939Reassembler::_arm(int slot, unsigned int timeout_ms) {
+	tp_session_t *session = &this->_sessions[slot];
+	unsigned int ticks = timeout_ms / J1939_TP_TICK_MS;
+	int bucket;
+
+	this->_disarm(slot);
+	session->deadline = this->_tick + (ticks == 0 ? 1 : ticks);
+	bucket = session->deadline & (J1939_TP_WHEEL_SIZE - 1);
+
+	session->prev = -1;
+	session->next = this->_wheel[bucket];
+	if (session->next != -1)
+		this->_sessions[session->next].prev = slot;
+	this->_wheel[bucket] = slot;
+	session->armed = true;
+}
+
+
+void J1939Reassembler::_disarm(int slot) {
+	tp_session_t *session = &this->_sessions[slot];
+
+	if (!session->armed)
+		return;
+	if (session->prev != -1)
+		this->_sessions[session->prev].next = session->next;
+	else
+		this->_wheel[session->deadline & (J1939_TP_WHEEL_SIZE - 1)] =
+				session->next;
+	if (session->next != -1)
+		this->_sessions[session->next].prev = session->prev;
+	session->armed = false;
+}
+
+
+void J1939Reassembler::_process_cm(j1939_pdu_typ *pdu) {
+	int src_address = pdu->src_address;
+	int dst_address = pdu->pdu_specific;
+	int num_bytes, num_packets, slot;
+	tp_session_t *session;
+
+	switch (pdu->data_field[0]) {
+		case J1939_TP_BAM:
+		case J1939_TP_RTS:
+			num_bytes = TWOBYTES(pdu->data_field[2], pdu->data_field[1]);
+			num_packets = pdu->data_field[3];
+
+			/* A BAM is sent to every node, and single frames carry at most 8
+			 * bytes. */
+			if ((pdu->data_field[0] == J1939_TP_BAM && dst_address != 0xFF) ||
+					num_bytes <= 8 || num_bytes > J1939_TP_MAX_SIZE ||
+					num_packets != (num_bytes + J1939_TP_PACKET_SIZE - 1) /
+							J1939_TP_PACKET_SIZE) {
+				this->_stats.errors++;
+				return;
+			}
+
+			if ((slot = this->_open(src_address, dst_address)) == -1) {
+				this->_stats.dropped++;
+				return;
+			}
+			session = &this->_sessions[slot];
+			session->message.pgn =
+					TWOBYTES(pdu->data_field[6], pdu->data_field[5]);
+			session->message.num_bytes = num_bytes;
+			session->message.data = session->data;
+			session->num_packets = num_packets;
+			session->next_seq = 1;
+			this->_arm(slot, dst_address == 0xFF ?
+					J1939_TP_BAM_TIMEOUT_MS : J1939_TP_RTS_TIMEOUT_MS);
+			break;
+
+		case J1939_TP_CTS:
+			/* Sent by the receiver, which may hold the transfer this way. */
+			if ((slot = this->_find(dst_address, src_address)) != -1)
+				this->_arm(slot, J1939_TP_RTS_TIMEOUT_MS);
+			break;
+
+		case J1939_TP_ABORT:
+			/* Sent by either end of the transfer. */
+			if ((slot = this->_find(src_address, dst_address)) == -1)
+				slot = this->_find(dst_address, src_address);
+			if (slot != -1) {
+				this->_close(slot, false);
+				this->_stats.aborts++;
+			}
+			break;
+	}
+}
+
+
+int J1939Reassembler::_process_dt(j1939_pdu_typ *pdu) {
+	int dst_address = pdu->pdu_specific;
+	int slot, seq, offset, num_bytes;
+	tp_session_t *session;
+
+	if ((slot = this->_find(pdu->src_address, dst_address)) == -1)
+		return -1;
+	session = &this->_sessions[slot];
+	seq = pdu->data_field[0];
+
+	if (seq != session->next_seq) {
+		/* Broadcast packets are never sent again, so the message is lost.
+		 * Packets of an RTS transfer are sent again if the receiver asks for
+		 * them with a CTS. */
+		if (dst_address == 0xFF) {
+			this->_close(slot, false);
+			this->_stats.errors++;
+		} else {
+			this->_arm(slot, J1939_TP_RTS_TIMEOUT_MS);
+		}
+		return -1;
+	}
+
+	offset = (seq - 1) * J1939_TP_PACKET_SIZE;
+	num_bytes = session->message.num_bytes - offset;
+	if (num_bytes > J1939_TP_PACKET_SIZE)
+		num_bytes = J1939_TP_PACKET_SIZE;
+	for (int i=0; i<num_bytes; i++)
+		session->data[offset + i] = (BYTE) pdu->data_field[1 + i];
+
+	if (++session->next_seq <= session->num_packets) {
+		this->_arm(slot, dst_address == 0xFF ?
+				J1939_TP_BAM_TIMEOUT_MS : J1939_TP_RTS_TIMEOUT_MS);
+		return -1;
+	}
+
+	/* The message is complete, and is held by the caller until released. */
+	session->message.rx_time_ns = pdu->rx_time_ns;
+	this->_close(slot, true);
+	this->_stats.completed++;
+	return slot;
+}
@@ -0,0 +1,221 @@
+/**\file
+ *
+ * j1939_tp.h
+ *
+ * This file contains the reassembly of J1939 messages longer than a single
+ * frame (up to 1785 bytes), such as DM1 diagnostics, from the frames of the
+ * transport protocol (see SAE J1939-21, 5.10):
+ *
+ * - TP.CM (TPCM): connection management. A broadcast announce message (BAM)
+ *   or a request to send (RTS) opens a transfer, and carries the PGN, size and
+ *   number of packets of the message. Clear to send (CTS) and end of message
+ *   acknowledgment frames are sent back by the receiver of an RTS, and an
+ *   abort closes a transfer.
+ * - TP.DT (TPDT): data transfer. Each frame carries the sequence number of the
+ *   packet and 7 bytes of the message.
+ *
+ * The reassembly only listens to the bus, so the transfers to other nodes are
+ * reassembled as well, and nothing is ever sent back.
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#ifndef INCLUDE_JBUS_J1939_TP_H_
+#define INCLUDE_JBUS_J1939_TP_H_
+
+#include "j1939_struct.h"
+#include "j1939_utils.h"
+#include "utils/common.h"	/* BYTE */
+#include <stdint.h>
+
+
+/* Control bytes of a TP.CM frame. */
+#define J1939_TP_RTS		16		/**< request to send */
+#define J1939_TP_CTS		17		/**< clear to send */
+#define J1939_TP_EOMA		19		/**< end of message acknowledgment */
+#define J1939_TP_BAM		32		/**< broadcast announce message */
+#define J1939_TP_ABORT		255		/**< connection abort */
+
+/** Largest size of a message of the transport protocol, in bytes. */
+#define J1939_TP_MAX_SIZE		1785
+
+/** Number of bytes of a message carried by a TP.DT frame. */
+#define J1939_TP_PACKET_SIZE	7
+
+/** Largest number of messages reassembled (or held by the caller) at once. */
+#define J1939_TP_MAX_SESSIONS	64
+
+/** Largest number of transfers from a single source address at once: a BAM
+ * and an RTS to each of a few destinations. */
+#define J1939_TP_SESSIONS_PER_SOURCE	4
+
+/** Time without a frame after which a broadcast transfer is dropped, in ms
+ * (T1). */
+#define J1939_TP_BAM_TIMEOUT_MS		750
+
+/** Time without a frame after which a transfer opened by an RTS is dropped,
+ * in ms (T2). */
+#define J1939_TP_RTS_TIMEOUT_MS		1250
+
+/** Period of the timer wheel of the timeouts, in ms. */
+#define J1939_TP_TICK_MS		10
+
+/** Number of buckets of the timer wheel. Must be a power of two, and cover
+ * the longest timeout. */
+#define J1939_TP_WHEEL_SIZE		256
+
+
+/** A reassembled message. */
+typedef struct {
+	int pgn;				/**< PGN of the message */
+	int src_address;		/**< source address of the message */
+	int dst_address;		/**< destination address, 255 if broadcast */
+	int num_bytes;			/**< number of bytes in data */
+	const BYTE *data;		/**< the bytes of the message */
+	uint64_t rx_time_ns;	/**< time the last frame was read from the CAN chip
+								 (see j1939_pdu_typ) */
+} j1939_tp_message_t;
+
+
+/** Counters of the reassembly. */
+typedef struct {
+	unsigned long completed;	/**< messages reassembled */
+	unsigned long timeouts;		/**< transfers dropped after a timeout */
+	unsigned long aborts;		/**< transfers closed by an abort */
+	unsigned long dropped;		/**< transfers ignored, as no slot was free */
+	unsigned long errors;		/**< transfers dropped for an invalid frame */
+} j1939_tp_stats_t;
+
+
+/** Reassembly of the messages of the J1939 transport protocol.
+ *
+ * Every transfer is held in a slot of a pool allocated with the object, so no
+ * memory is allocated while receiving, and at most J1939_TP_SESSIONS_PER_SOURCE
+ * slots are used by a single source address. The slots of a source address are
+ * found from a table indexed by the address, and the timeouts are kept in a
+ * timer wheel, so every frame costs a constant time, however many nodes send
+ * messages at once.
+ *
+ * A reassembled message is handed over in its slot, without copying it, and
+ * the slot is only reused once the caller releases the message.
+ *
+ * Objects of this class are large, and should have static storage. The class
+ * is not thread-safe.
+ */
+class J1939Reassembler
+{
+public:
+	J1939Reassembler();
+
+	/** Process a frame.
+	 *
+	 * Frames that are not TP.CM or TP.DT frames are ignored. The time stamp of
+	 * the frame (rx_time_ns) is used as the current time, and the transfers
+	 * whose timeout passed are dropped first.
+	 *
+	 * @param pdu
+	 * 		the frame
+	 * @param message
+	 * 		updated with the reassembled message if the frame completed one.
+	 * 		The message is valid until it is passed to release().
+	 * @return
+	 * 		true if the frame completed a message, false otherwise
+	 */
+	bool process(j1939_pdu_typ *pdu, j1939_tp_message_t **message);
+
+	/** Release a message returned by process(), so that its slot may be
+	 * reused. */
+	void release(j1939_tp_message_t *message);
+
+	/** Drop the transfers whose timeout passed.
+	 *
+	 * This is done by process() for every frame, and only needs to be called
+	 * if no frame is received for a while.
+	 *
+	 * @param now_ns
+	 * 		current time of the monotonic clock (see get_monotonic_ns)
+	 * @return
+	 * 		number of transfers that were dropped
+	 */
+	int expire(uint64_t now_ns);
+
+	/** Return the number of transfers being reassembled. */
+	int get_num_active();
+
+	/** Return the counters of the reassembly. */
+	j1939_tp_stats_t get_stats();
+
+private:
+	/** State of a slot. */
+	enum tp_state_t {
+		TP_FREE,		/**< not used */
+		TP_ACTIVE,		/**< the message is being reassembled */
+		TP_HELD			/**< the message is held by the caller */
+	};
+
+	/** A transfer. The message is the first field, so that release() finds
+	 * the slot of a message. */
+	typedef struct {
+		j1939_tp_message_t message;	/**< the message, once reassembled */
+		tp_state_t state;			/**< state of the slot */
+		int num_packets;			/**< number of TP.DT frames of the message */
+		int next_seq;				/**< sequence number of the next frame */
+		unsigned int deadline;		/**< tick of the timeout */
+		bool armed;					/**< whether the slot is in the wheel */
+		short prev;					/**< previous slot of the wheel bucket */
+		short next;					/**< next slot of the wheel bucket */
+		BYTE data[J1939_TP_MAX_SIZE];	/**< the bytes of the message */
+	} tp_session_t;
+
+	/** Return the slot of the transfer from a source to a destination, -1 if
+	 * none. */
+	int _find(int src_address, int dst_address);
+
+	/** Open a transfer, replacing any transfer between the same addresses.
+	 * Returns the slot of the transfer, -1 if none is free. */
+	int _open(int src_address, int dst_address);
+
+	/** Close a transfer, and free its slot unless it is held. */
+	void _close(int slot, bool held);
+
+	/** (Re)start the timeout of a transfer. */
+	void _arm(int slot, unsigned int timeout_ms);
+
+	/** Remove a transfer from the timer wheel. */
+	void _disarm(int slot);
+
+	/** Process a TP.CM frame. */
+	void _process_cm(j1939_pdu_typ *pdu);
+
+	/** Process a TP.DT frame. Returns the slot of the completed message, -1 if
+	 * none. */
+	int _process_dt(j1939_pdu_typ *pdu);
+
+	/** the transfers */
+	tp_session_t _sessions[J1939_TP_MAX_SESSIONS];
+	/** the free slots, as a stack */
+	unsigned char _free[J1939_TP_MAX_SESSIONS];
+	/** number of elements in _free */
+	int _num_free;
+	/** slot + 1 of the transfers of every source address, 0 if none */
+	unsigned char _by_source[256][J1939_TP_SESSIONS_PER_SOURCE];
+	/** first slot of every bucket of the timer wheel, -1 if none */
+	short _wheel[J1939_TP_WHEEL_SIZE];
+	/** tick up to which the timeouts were checked */
+	unsigned int _tick;
+	/** whether _tick was set by a first frame */
+	bool _started;
+	/** number of slots in the TP_ACTIVE state */
+	int _num_active;
+	/** counters of the reassembly */
+	j1939_tp_stats_t _stats;
+
+	/* The messages are handed over in their slot. */
+	J1939Reassembler(const J1939Reassembler&) = delete;
+	J1939Reassembler &operator=(const J1939Reassembler&) = delete;
+};
+
+
+#endif /* INCLUDE_JBUS_J1939_TP_H_ */
@@ -32,6 +32,8 @@
 #define TSC1	0x0000	/**< (0, 0) Torque Speed Control 1, destination 0 */
 #define EXAC	0x000b	/**< (0, 11) EXAC (WABCO proprietary) */
 #define RQST	0xea00	/**< (234, 0) request transmission of a particular PGN */
+#define TPDT	0xeb00	/**< (235, 0) transport protocol data transfer */
+#define TPCM	0xec00	/**< (236, 0) transport protocol connection management */
 #define ERC1	0xf000	/**< (240, 0) electronic retarder controller 1 */
 #define EBC1	0xf001	/**< (240, 1) electronic brake controller 1 */
 #define ETC1	0xf002	/**< (240, 2) electronic transmission controller 1 */
@@ -43,6 +45,7 @@
 #define FD		0xfebd	/**< (254, 189) fan drive */
 #define EBC2	0xfebf	/**< (254, 191) electronic brake controller 2 */
 #define HRVD	0xfec1	/**< (254, 193) high resolution vehicle distance */
+#define DM1		0xfeca	/**< (254, 202) active diagnostic trouble codes */
 #define TURBO	0xfedd	/**< (254, 221) turbocharger */
 #define EEC3	0xfedf	/**< (254, 223) electronic engine controller 3 */
 #define VD		0xfee0	/**< (254, 224) vehicle distance */
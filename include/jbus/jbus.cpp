@@ -23,6 +23,7 @@ int JBus::init(string filename, int flags, void *p_other) {
 	int fd;
 	int channel_id;
 	can_dev_handle_t *phdl = new can_dev_handle_t();
+	phdl->pulse_coid = -1;
 	fd = open(filename.c_str(), flags);
 	if (fd == -1) {
 		perror("can_open");
@@ -36,7 +37,7 @@ int JBus::init(string filename, int flags, void *p_other) {
 		}
 		can_set_filter(fd, 0, 0); // listens to all messages
 		can_empty_queue(fd);
-		if (can_arm(fd, channel_id) == -1) {
+		if (can_arm(fd, channel_id, &phdl->pulse_coid) != EOK) {
 			printf("can_arm failed\n");
 			return -1;
 		}
@@ -45,6 +46,10 @@ int JBus::init(string filename, int flags, void *p_other) {
 	phdl->channel_id = channel_id;
 	phdl->flags = flags;
 	phdl->filename = filename;
+
+	/* Read the messages in place if the driver shares its input ring. */
+	if (flags == O_RDONLY && can_map_shm((intptr_t)phdl) == -1)
+		printf("can_open: reading %s through devctl\n", filename.c_str());
 	return (intptr_t)phdl;
 }
 
@@ -59,7 +64,10 @@ int JBus::close_conn(int *pfd) {
 	}
 
 	// close the connection
+	can_unmap_shm((intptr_t)phdl);
 	int retval = close(phdl->fd);
+	if (phdl->pulse_coid != -1)
+		ConnectDetach(phdl->pulse_coid);
 
 	// free up memory
   	delete phdl;
@@ -76,19 +84,55 @@ int JBus::close_conn(int *pfd) {
 int JBus::receive(int fd, j1939_pdu_typ *pdu, int *extended, int *slot) {
 	unsigned long id;
 	char extbyte = 0;
-	int retval = can_read(fd, &id, &extbyte, &pdu->data_field, 8);
+	BYTE data[8];
+	int retval = can_read(fd, &id, &extbyte, data, 8, &pdu->rx_time_ns);
 	if (retval == -1) {
 		return J1939_RECEIVE_MESSAGE_ERROR;
 	} else {
 		*extended = (int) extbyte;
+		monotonic_to_timestamp(pdu->rx_time_ns, &pdu->timestamp);
 		pdu->priority = PATH_CAN_PRIORITY(id);
 		pdu->pdu_format = PATH_CAN_PF(id);
 		pdu->pdu_specific = PATH_CAN_PS(id);
 		pdu->src_address = PATH_CAN_SA(id);
 		pdu->num_bytes = retval;
+		for (int i=0; i<retval && i<8; i++)
+			pdu->data_field[i] = data[i];
 		return retval;
 	}
 }
 
 
+int JBus::receive_batch(int fd, j1939_pdu_typ *pdus, int max_pdus) {
+	can_msg_t msgs[JBUS_MAX_BATCH];
+	int count = 0;
+
+	if (max_pdus > JBUS_MAX_BATCH)
+		max_pdus = JBUS_MAX_BATCH;
+
+	int retval = can_read_batch(fd, msgs, max_pdus);
+	if (retval == -1)
+		return -1;
+
+	for (int i=0; i<retval; i++) {
+		if (!IS_EXTENDED_FRAME(msgs[i]))
+			continue;
+
+		unsigned long id = CAN_ID(msgs[i]);
+		j1939_pdu_typ *pdu = &pdus[count++];
+		pdu->rx_time_ns = msgs[i].rx_time_ns;
+		monotonic_to_timestamp(pdu->rx_time_ns, &pdu->timestamp);
+		pdu->priority = PATH_CAN_PRIORITY(id);
+		pdu->pdu_format = PATH_CAN_PF(id);
+		pdu->pdu_specific = PATH_CAN_PS(id);
+		pdu->src_address = PATH_CAN_SA(id);
+		pdu->num_bytes = msgs[i].size;
+		for (int j=0; j<msgs[i].size; j++)
+			pdu->data_field[j] = msgs[i].data[j];
+	}
+
+	return count;
+}
+
+
 JBus::~JBus() {}
@@ -19,10 +19,15 @@
 
 
 /** Repetition interval should be 10 milliseconds for engine, 50 milliseconds
- * for retarder, 40 milliseconds for EBS. */
+ * for retarder, 40 milliseconds for EBS. The CAN driver can repeat a command
+ * at these intervals itself, see can_send_cyclic. */
 #define JBUS_INTERVAL_MSECS	5
 
 
+/** Largest number of PDUs collected by a single call to JBus::receive_batch. */
+#define JBUS_MAX_BATCH	32
+
+
 /** Primary class used to communicate with the CAN card port.
  *
  * This class is responsible for initializing the connection with the port to
@@ -55,6 +60,9 @@ public:
 	virtual int init(std::string filename, int flags, void *p_other);
 
 	/** Update a PDU object with information from the can card.
+	 *
+	 * The timestamp of the PDU is set to the time the message was read from
+	 * the CAN chip, rather than the time it reaches the client.
 	 *
 	 * @param fd
 	 * 		file descriptor acquired while opening the connection
@@ -73,6 +81,26 @@ public:
 	 */
 	virtual int receive(int fd, j1939_pdu_typ *pdu, int *extended, int *slot);
 
+	/** Update an array of PDU objects with every message queued by the CAN card.
+	 *
+	 * A single devctl is used for the whole burst, instead of one per message
+	 * as in receive(). Messages with an unextended (11 bit)
+	 * identifier are not J1939 messages, and are skipped. Timestamps are set
+	 * as in receive().
+	 *
+	 * @param fd
+	 * 		file descriptor acquired while opening the connection
+	 * @param pdus
+	 * 		array of PDU messages that is updated with information received from
+	 * 		the CAN card, oldest first. Must have room for max_pdus elements.
+	 * @param max_pdus
+	 * 		largest number of PDUs to collect, at most JBUS_MAX_BATCH
+	 * @return
+	 * 		number of PDUs that were updated (possibly 0), or -1 on
+	 * 		can_read_batch failure
+	 */
+	virtual int receive_batch(int fd, j1939_pdu_typ *pdus, int max_pdus);
+
 	/** Wrapper for the close call.
 	 *
 	 * Sets the input "file descriptor" to NULL, so that attempts to close twice
@@ -0,0 +1,95 @@
+/**\file
+ *
+ * coalescer.cpp
+ *
+ * Implements the methods in coalescer.h.
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#include "coalescer.h"
+#include <string.h>
+
+
+PublishCoalescer::PublishCoalescer() {
+	for (int i=0; i<COALESCE_MAX_SLOTS; i++) {
+		this->_slots[i].key = -1;
+		this->_slots[i].interpreter = NULL;
+		this->_slots[i].pending = false;
+	}
+	this->_num_pending = 0;
+	this->_num_updates = 0;
+	this->_num_published = 0;
+	this->_num_probes = 0;
+}
+
+
+bool PublishCoalescer::update(int pgn, int src_address,
+		J1939Interpreter *interpreter, const void *message) {
+	int key = ((pgn & 0xFFFF) << 8) | (src_address & 0xFF);
+	/* Multiplicative hashing: the high bits of the product depend on every bit
+	 * of the key, while its low bits only depend on the source address for the
+	 * PGNs of a single source. */
+	unsigned int hash = ((unsigned int) key * 2654435761U) >>
+			(32 - COALESCE_SLOT_BITS);
+
+	/* Look for the slot of the pair, or the first free slot after it. Pairs
+	 * are never removed, so the first free slot ends the search. */
+	for (int i=0; i<COALESCE_MAX_SLOTS; i++) {
+		int index = (hash + i) & (COALESCE_MAX_SLOTS - 1);
+		coalesce_slot_t *slot = &this->_slots[index];
+
+		this->_num_probes++;
+		if (slot->key != key && slot->key != -1)
+			continue;
+
+		slot->key = key;
+		slot->interpreter = interpreter;
+		memcpy(slot->data, message, interpreter->size());
+		if (!slot->pending) {
+			slot->pending = true;
+			this->_pending[this->_num_pending++] = index;
+		}
+		this->_num_updates++;
+		return true;
+	}
+
+	return false;
+}
+
+
+int PublishCoalescer::flush(PubSub *ps) {
+	int num_published = this->_num_pending;
+
+	for (int i=0; i<this->_num_pending; i++) {
+		coalesce_slot_t *slot = &this->_slots[this->_pending[i]];
+		ps->publish(slot->interpreter->pgn(), slot->data);
+		slot->pending = false;
+	}
+	this->_num_pending = 0;
+	this->_num_published += num_published;
+
+	return num_published;
+}
+
+
+int PublishCoalescer::get_num_pending() {
+	return this->_num_pending;
+}
+
+
+unsigned long PublishCoalescer::get_num_updates() {
+	return this->_num_updates;
+}
+
+
+unsigned long PublishCoalescer::get_num_published() {
+	return this->_num_published;
+}
+
+
+unsigned long PublishCoalescer::get_num_probes() {
+	return this->_num_probes;
+}
@@ -0,0 +1,115 @@
+/**\file
+ *
+ * coalescer.h
+ *
+ * This file contains a table of the latest value of every J1939 message, which
+ * is published to the pub/sub server at a fixed rate instead of once per
+ * message. Messages sent at 100 Hz then cost a single PPS write per period of
+ * the publishing, while readers still see the newest value of every message.
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#ifndef INCLUDE_UTILS_COALESCER_H_
+#define INCLUDE_UTILS_COALESCER_H_
+
+#include "utils/pub_sub.h"
+#include "jbus/j1939_interpreters.h"
+
+
+/** Base 2 logarithm of the number of slots in the table. */
+#define COALESCE_SLOT_BITS	9
+
+/** Largest number of (PGN, source address) pairs in the table. */
+#define COALESCE_MAX_SLOTS	(1 << COALESCE_SLOT_BITS)
+
+/** Largest size of the message-specific format of a message, in bytes. */
+#define COALESCE_MSG_SIZE	256
+
+
+/** Latest value of every (PGN, source address) pair, published at a fixed
+ * rate.
+ *
+ * update() replaces the value of a pair, and flush() publishes every pair
+ * updated since the previous flush, once, with its latest value. Both are
+ * constant time per pair, and the table is fixed in size, so no memory is
+ * allocated once it is built.
+ *
+ * The table is not thread-safe: update() and flush() must be called by the
+ * same thread.
+ */
+class PublishCoalescer
+{
+public:
+	PublishCoalescer();
+
+	/** Replace the value of a (PGN, source address) pair.
+	 *
+	 * @param pgn
+	 * 		PGN of the message, TWOBYTES(pdu_format, pdu_specific)
+	 * @param src_address
+	 * 		source address of the message
+	 * @param interpreter
+	 * 		interpreter of the message. Its pgn() is the type the message is
+	 * 		published as.
+	 * @param message
+	 * 		message-specific format of the message, of interpreter->size()
+	 * 		bytes, at most COALESCE_MSG_SIZE
+	 * @return
+	 * 		true if the value was replaced, false if the table is full, in which
+	 * 		case the caller should publish the message itself
+	 */
+	bool update(int pgn, int src_address, J1939Interpreter *interpreter,
+			const void *message);
+
+	/** Publish the latest value of every pair updated since the previous
+	 * flush.
+	 *
+	 * @param ps
+	 * 		the pub/sub server the values are published to
+	 * @return
+	 * 		number of values that were published
+	 */
+	int flush(PubSub *ps);
+
+	/** Return the number of pairs updated since the previous flush. */
+	int get_num_pending();
+
+	/** Return the number of values replaced, since the table was built. */
+	unsigned long get_num_updates();
+
+	/** Return the number of values published, since the table was built. */
+	unsigned long get_num_published();
+
+	/** Return the number of slots looked at by update(), since the table was
+	 * built. */
+	unsigned long get_num_probes();
+
+private:
+	/** Latest value of a (PGN, source address) pair. */
+	typedef struct {
+		int key;						/**< the pair, -1 if the slot is free */
+		J1939Interpreter *interpreter;	/**< interpreter of the value */
+		bool pending;					/**< updated since the last flush */
+		alignas(8) char data[COALESCE_MSG_SIZE];	/**< the value */
+	} coalesce_slot_t;
+
+	/** the pairs, by open addressing on their key */
+	coalesce_slot_t _slots[COALESCE_MAX_SLOTS];
+	/** index in _slots of the pairs updated since the last flush, in the order
+	 * they were first updated */
+	unsigned short _pending[COALESCE_MAX_SLOTS];
+	/** number of elements in _pending */
+	int _num_pending;
+	/** number of values replaced */
+	unsigned long _num_updates;
+	/** number of values published */
+	unsigned long _num_published;
+	/** number of slots looked at by update() */
+	unsigned long _num_probes;
+};
+
+
+#endif /* INCLUDE_UTILS_COALESCER_H_ */
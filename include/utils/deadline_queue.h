@@ -0,0 +1,246 @@
+/**\file
+ *
+ * deadline_queue.h
+ *
+ * This file contains a fixed-capacity queue in which every element has a
+ * priority, a deadline, a release time and a key. Elements leave the queue in
+ * order of priority once their release time is reached, elements whose
+ * deadline has passed are dropped, and a new element may replace a queued
+ * element with the same key. This is used to schedule the CAN frames written
+ * by the clients of the CAN resource manager.
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#ifndef INCLUDE_UTILS_DEADLINE_QUEUE_H_
+#define INCLUDE_UTILS_DEADLINE_QUEUE_H_
+
+#include <stdint.h>
+#include <cstddef>		/* NULL */
+
+
+/** Returned by DeadlineQueue::push if the element was added. */
+#define DQ_ADDED	0
+
+/** Returned by DeadlineQueue::push if the element replaced a queued element
+ * with the same key. */
+#define DQ_REPLACED	1
+
+/** Returned by DeadlineQueue::push if the queue is full. */
+#define DQ_FULL		-1
+
+/** Key of the elements that never replace, and are never replaced by,
+ * another element. */
+#define DQ_NO_KEY	0xFFFFFFFFU
+
+
+/** Priority queue with per-element deadlines and replacement by key.
+ *
+ * Elements with a lower priority value leave the queue first (as for J1939,
+ * where 0 is the highest priority), and elements with the same priority leave
+ * in the order they were added. The queue is small, so it is kept as an
+ * unordered array that is scanned when an element is removed; no heap
+ * allocations are made.
+ *
+ * The queue is not thread-safe.
+ *
+ * @tparam T
+ * 		type of the stored elements. Must be copy-assignable.
+ * @tparam N
+ * 		largest number of elements in the queue
+ */
+template <typename T, unsigned int N>
+class DeadlineQueue
+{
+public:
+	DeadlineQueue() : _count(0), _seq(0) {}
+
+	/** Add a new element, or replace the queued element with the same key,
+	 * unless the key is DQ_NO_KEY.
+	 *
+	 * A replaced element keeps its place among the elements of the same
+	 * priority, but takes the new value, deadline and release time.
+	 *
+	 * @param item
+	 * 		the element to copy into the queue
+	 * @param priority
+	 * 		priority of the element, lowest first
+	 * @param key
+	 * 		identifies the elements that replace each other
+	 * @param deadline
+	 * 		time after which the element is dropped, in the units of the
+	 * 		times passed to expire()
+	 * @param release
+	 * 		time before which the element does not leave the queue, in the
+	 * 		units of the times passed to pop(). 0 to release it at once.
+	 * @return
+	 * 		DQ_ADDED, DQ_REPLACED, or DQ_FULL if the element was not added
+	 */
+	int push(const T &item, int priority, unsigned int key, uint64_t deadline,
+			uint64_t release = 0) {
+		for (unsigned int i = 0; i < this->_count && key != DQ_NO_KEY; i++) {
+			entry_t *entry = &this->_entries[i];
+			if (entry->key == key) {
+				entry->item = item;
+				entry->deadline = deadline;
+				entry->release = release;
+				if (priority != entry->priority) {
+					entry->priority = priority;
+					entry->seq = this->_seq++;
+				}
+				return DQ_REPLACED;
+			}
+		}
+
+		if (this->_count == N)
+			return DQ_FULL;
+
+		entry_t *entry = &this->_entries[this->_count++];
+		entry->item = item;
+		entry->priority = priority;
+		entry->key = key;
+		entry->deadline = deadline;
+		entry->release = release;
+		entry->seq = this->_seq++;
+		return DQ_ADDED;
+	}
+
+	/** Whether an element with a given key (other than DQ_NO_KEY) is
+	 * queued. */
+	bool has_key(unsigned int key) {
+		if (key == DQ_NO_KEY)
+			return false;
+		for (unsigned int i = 0; i < this->_count; i++)
+			if (this->_entries[i].key == key)
+				return true;
+		return false;
+	}
+
+	/** Drop every element whose deadline is before a given time.
+	 *
+	 * @param now
+	 * 		the current time
+	 * @return
+	 * 		number of elements that were dropped
+	 */
+	int expire(uint64_t now) {
+		int num_expired = 0;
+		unsigned int i = 0;
+
+		while (i < this->_count) {
+			if (this->_entries[i].deadline < now) {
+				this->_remove(i);
+				num_expired++;
+			} else
+				i++;
+		}
+		return num_expired;
+	}
+
+	/** Remove the element with the highest priority.
+	 *
+	 * @param item
+	 * 		updated with a copy of the element
+	 * @param now
+	 * 		the current time. Only elements whose release time is not after now
+	 * 		are considered. By default, every element is.
+	 * @return
+	 * 		true if an element was removed, false if no element is released
+	 */
+	bool pop(T *item, uint64_t now = UINT64_MAX) {
+		entry_t *best_entry = NULL;
+		unsigned int best = 0;
+
+		for (unsigned int i = 0; i < this->_count; i++) {
+			entry_t *entry = &this->_entries[i];
+			if (entry->release > now)
+				continue;
+			if (best_entry == NULL || entry->priority < best_entry->priority ||
+					(entry->priority == best_entry->priority &&
+					 (int) (entry->seq - best_entry->seq) < 0)) {
+				best = i;
+				best_entry = entry;
+			}
+		}
+		if (best_entry == NULL)
+			return false;
+
+		*item = best_entry->item;
+		this->_remove(best);
+		return true;
+	}
+
+	/** Return the earliest release time after a given time.
+	 *
+	 * @param now
+	 * 		the current time
+	 * @param release
+	 * 		updated with the earliest release time of the elements that are not
+	 * 		released at now
+	 * @return
+	 * 		true if such an element exists, false otherwise
+	 */
+	bool next_release(uint64_t now, uint64_t *release) {
+		bool found = false;
+
+		for (unsigned int i = 0; i < this->_count; i++) {
+			uint64_t entry_release = this->_entries[i].release;
+			if (entry_release > now && (!found || entry_release < *release)) {
+				*release = entry_release;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	/** Remove all elements from the queue.
+	 *
+	 * @return
+	 * 		number of elements that were removed
+	 */
+	int empty() {
+		int count = (int) this->_count;
+		this->_count = 0;
+		return count;
+	}
+
+	/** Return the number of elements in the queue. */
+	unsigned int get_count() {
+		return this->_count;
+	}
+
+	/** Return the largest number of elements in the queue. */
+	unsigned int get_capacity() {
+		return N;
+	}
+
+private:
+	/** An element and its scheduling information. */
+	typedef struct {
+		T item;				/**< the element */
+		uint64_t deadline;	/**< time after which the element is dropped */
+		uint64_t release;	/**< time before which the element is kept */
+		unsigned int key;	/**< elements with the same key replace each other */
+		int priority;		/**< lowest first */
+		unsigned int seq;	/**< order in which the element was added */
+	} entry_t;
+
+	/** Remove an element by moving the last element in its place. */
+	void _remove(unsigned int i) {
+		this->_entries[i] = this->_entries[--this->_count];
+	}
+
+	/** Queued elements, in no particular order. */
+	entry_t _entries[N];
+
+	/** Number of queued elements. */
+	unsigned int _count;
+
+	/** Sequence number of the next added element. */
+	unsigned int _seq;
+};
+
+
+#endif /* INCLUDE_UTILS_DEADLINE_QUEUE_H_ */
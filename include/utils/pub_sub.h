@@ -15,6 +15,7 @@
 #include <tuple>
 #include <fcntl.h>
 #include "jbus/j1939_interpreters.h"
+#include "jbus/j1939_tp.h"
 
 
 #define PS_EMTPY -1001
@@ -32,6 +33,14 @@ public:
 	 */
 	virtual void publish(int type, void *message);
 
+	/**Publish a message reassembled from the frames of the transport
+	 * protocol (see J1939Reassembler), as its PGN, addresses and bytes.
+	 *
+	 * @param message
+	 * 		the reassembled message
+	 */
+	virtual void publish_tp(j1939_tp_message_t *message);
+
 	/**Subscribe to a message.
 	 *
 	 * These messages can then be collected from `get_subscription_results`.
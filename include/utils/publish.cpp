@@ -77,6 +77,32 @@ void PubSub::publish(int type, void *message) {
 }
 
 
+void PubSub::publish_tp(j1939_tp_message_t *message) {
+	// initialize the encoder object
+	pps_encoder_t encoder;
+	pps_encoder_initialize(&encoder, false);
+
+	// setup the object to be encoded
+	pps_encoder_start_object(&encoder, "@TP");
+
+	pps_encoder_add_int(&encoder, "pgn", message->pgn);
+	pps_encoder_add_int(&encoder, "src_address", message->src_address);
+	pps_encoder_add_int(&encoder, "dst_address", message->dst_address);
+	pps_encoder_add_int(&encoder, "num_bytes", message->num_bytes);
+	pps_encoder_start_object(&encoder, "data_field");
+	for (int i=0; i<message->num_bytes; ++i)
+		pps_encoder_add_int(&encoder, to_string(i).c_str(), message->data[i]);
+	pps_encoder_end_object(&encoder);
+
+	pps_encoder_end_object(&encoder);
+
+	// perform the data encoding procedure
+	if (pps_encoder_buffer(&encoder) != NULL)
+		write(this->_fd_pub, pps_encoder_buffer(&encoder), pps_encoder_length(&encoder));
+	pps_encoder_cleanup(&encoder);
+}
+
+
 void PubSub::_publish_pdu(void *data) {
 	j1939_pdu_typ *pdu = (j1939_pdu_typ*) data;
 
@@ -0,0 +1,336 @@
+/**\file
+ *
+ * ring.h
+ *
+ * This file contains typed, fixed-capacity ring buffers that pass elements by
+ * value from a single producer to either a single consumer (Ring) or to any
+ * number of readers that each see every element (FanoutRing). No locks or heap
+ * allocations are needed to add or remove an element, so the cost of either
+ * operation is constant. These are used to hold CAN frames between the
+ * interrupt handler of the CAN resource manager and its clients.
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#ifndef INCLUDE_UTILS_RING_H_
+#define INCLUDE_UTILS_RING_H_
+
+#include <atomic>
+#include <cstddef>		/* NULL */
+
+
+/** Size of a cache line, in bytes. Elements and indices are aligned to this
+ * value so that the producer and consumer do not share cache lines. */
+#define CACHE_LINE_SIZE 64
+
+
+/** Single-producer/single-consumer ring buffer.
+ *
+ * Elements are stored by value in cache-line-aligned slots. The producer only
+ * ever writes the head index and the consumer only ever writes the tail index,
+ * so a single thread may add elements while another one removes them.
+ *
+ * Unlike CircularBuffer, a full ring does not overwrite its oldest element.
+ * Instead, push() fails and the caller decides how to account for the drop.
+ *
+ * Objects of this class should have static storage or be members of objects
+ * with static storage, so that the requested alignment is honored.
+ *
+ * @tparam T
+ * 		type of the stored elements. Must be copy-assignable.
+ * @tparam N
+ * 		number of slots in the ring. Must be a power of two.
+ */
+template <typename T, unsigned int N>
+class Ring
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0,
+			"The size of a Ring must be a power of two.");
+
+public:
+	Ring() : _head(0), _tail(0) {}
+
+	/** Add a new element to the back of the ring.
+	 *
+	 * May only be called by the producer.
+	 *
+	 * @param item
+	 * 		the element to copy into the ring
+	 * @return
+	 * 		true if the element was added, false if the ring is full
+	 */
+	bool push(const T &item) {
+		unsigned int head = this->_head.load(std::memory_order_relaxed);
+		if (head - this->_tail.load(std::memory_order_acquire) == N)
+			return false;
+		this->_slots[head & (N - 1)].item = item;
+		this->_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Return the slot of the next element, so that the producer may build
+	 * the element in place instead of copying it in with push().
+	 *
+	 * May only be called by the producer. The consumer only sees the element
+	 * once commit() is called.
+	 *
+	 * @return
+	 * 		pointer to the slot, or NULL if the ring is full
+	 */
+	T *reserve() {
+		unsigned int head = this->_head.load(std::memory_order_relaxed);
+		if (head - this->_tail.load(std::memory_order_acquire) == N)
+			return NULL;
+		return &this->_slots[head & (N - 1)].item;
+	}
+
+	/** Add the element built in the slot returned by reserve().
+	 *
+	 * May only be called by the producer, once for every successful call to
+	 * reserve().
+	 */
+	void commit() {
+		unsigned int head = this->_head.load(std::memory_order_relaxed);
+		this->_head.store(head + 1, std::memory_order_release);
+	}
+
+	/** Remove the front-most element from the ring.
+	 *
+	 * May only be called by the consumer.
+	 *
+	 * @param item
+	 * 		updated with a copy of the front-most element
+	 * @return
+	 * 		true if an element was removed, false if the ring is empty
+	 */
+	bool pop(T *item) {
+		unsigned int tail = this->_tail.load(std::memory_order_relaxed);
+		if (tail == this->_head.load(std::memory_order_acquire))
+			return false;
+		*item = this->_slots[tail & (N - 1)].item;
+		this->_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Return the front-most element without removing it.
+	 *
+	 * May only be called by the consumer. The element stays valid until the
+	 * consumer removes it.
+	 *
+	 * @return
+	 * 		pointer to the front-most element, or NULL if the ring is empty
+	 */
+	T *front() {
+		unsigned int tail = this->_tail.load(std::memory_order_relaxed);
+		if (tail == this->_head.load(std::memory_order_acquire))
+			return NULL;
+		return &this->_slots[tail & (N - 1)].item;
+	}
+
+	/** Remove the front-most element without copying it.
+	 *
+	 * May only be called by the consumer.
+	 *
+	 * @return
+	 * 		true if an element was removed, false if the ring is empty
+	 */
+	bool discard() {
+		unsigned int tail = this->_tail.load(std::memory_order_relaxed);
+		if (tail == this->_head.load(std::memory_order_acquire))
+			return false;
+		this->_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Remove all elements from the ring.
+	 *
+	 * May only be called by the consumer.
+	 *
+	 * @return
+	 * 		number of elements that were removed
+	 */
+	int empty() {
+		unsigned int tail = this->_tail.load(std::memory_order_relaxed);
+		unsigned int head = this->_head.load(std::memory_order_acquire);
+		this->_tail.store(head, std::memory_order_release);
+		return (int) (head - tail);
+	}
+
+	/** Return the number of elements in the ring. */
+	unsigned int get_count() {
+		return this->_head.load(std::memory_order_acquire) -
+				this->_tail.load(std::memory_order_acquire);
+	}
+
+	/** Return the number of slots in the ring. */
+	unsigned int get_capacity() {
+		return N;
+	}
+
+private:
+	/** Storage for a single element, padded to a full cache line. */
+	struct alignas(CACHE_LINE_SIZE) slot_t {
+		T item;
+	};
+
+	/** Total number of elements ever added. Written by the producer. */
+	alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> _head;
+
+	/** Total number of elements ever removed. Written by the consumer. */
+	alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> _tail;
+
+	/** Element slots, indexed by the head/tail modulo N. */
+	slot_t _slots[N];
+};
+
+
+/** Read position of a single reader of a FanoutRing. */
+typedef struct {
+	unsigned int pos;	/**< total number of elements seen by the reader */
+	unsigned int lost;	/**< elements overwritten before the reader saw them */
+} fanout_cursor_t;
+
+
+/** Single-producer/multiple-consumer broadcast ring.
+ *
+ * Every reader holds its own cursor and sees every element, instead of the
+ * readers competing for elements as they would with a Ring. The producer never
+ * waits for the readers: once the ring is full, the oldest element is
+ * overwritten, and a reader that falls a full ring behind skips ahead and
+ * counts the elements it missed in its cursor.
+ *
+ * Each slot carries a sequence number that is odd while the slot is being
+ * written, so a reader can detect that the element it copied was overwritten
+ * in the meantime (as in a seqlock) and retry.
+ *
+ * Readers never write to the ring, so the ring may be placed in shared memory
+ * and mapped read-only by readers in other processes.
+ *
+ * @tparam T
+ * 		type of the stored elements. Must be trivially copyable.
+ * @tparam N
+ * 		number of slots in the ring. Must be a power of two.
+ */
+template <typename T, unsigned int N>
+class FanoutRing
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0,
+			"The size of a FanoutRing must be a power of two.");
+
+public:
+	FanoutRing() : _head(0) {
+		for (unsigned int i = 0; i < N; i++)
+			this->_slots[i].seq.store(0, std::memory_order_relaxed);
+	}
+
+	/** Add a new element to the ring, overwriting the oldest one if full.
+	 *
+	 * May only be called by the producer.
+	 *
+	 * @param item
+	 * 		the element to copy into the ring
+	 */
+	void push(const T &item) {
+		unsigned int head = this->_head.load(std::memory_order_relaxed);
+		slot_t *slot = &this->_slots[head & (N - 1)];
+
+		slot->seq.store(2 * head + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot->item = item;
+		slot->seq.store(2 * head + 2, std::memory_order_release);
+		this->_head.store(head + 1, std::memory_order_release);
+	}
+
+	/** Return a cursor positioned after the newest element, so that the
+	 * reader only sees elements added from now on. */
+	fanout_cursor_t get_cursor() const {
+		fanout_cursor_t cursor;
+		cursor.pos = this->_head.load(std::memory_order_acquire);
+		cursor.lost = 0;
+		return cursor;
+	}
+
+	/** Copy the oldest element the reader has not seen yet.
+	 *
+	 * @param cursor
+	 * 		cursor of the reader, advanced past the element. If the reader fell
+	 * 		a full ring behind, its lost count is incremented by the number of
+	 * 		elements that were skipped.
+	 * @param item
+	 * 		updated with a copy of the element
+	 * @return
+	 * 		true if an element was copied, false if the reader has seen every
+	 * 		element
+	 */
+	bool pop(fanout_cursor_t *cursor, T *item) const {
+		while (true) {
+			unsigned int head = this->_head.load(std::memory_order_acquire);
+			if (cursor->pos == head)
+				return false;
+			if (head - cursor->pos > N) {
+				cursor->lost += head - cursor->pos - N;
+				cursor->pos = head - N;
+			}
+
+			const slot_t *slot = &this->_slots[cursor->pos & (N - 1)];
+			unsigned int seq = slot->seq.load(std::memory_order_acquire);
+			if (seq == 2 * cursor->pos + 2) {
+				*item = slot->item;
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot->seq.load(std::memory_order_relaxed) == seq) {
+					cursor->pos++;
+					return true;
+				}
+			}
+
+			/* The slot was overwritten while being read, so the reader is now
+			 * a full ring behind. Skip ahead and try again. */
+			cursor->lost++;
+			cursor->pos++;
+		}
+	}
+
+	/** Skip every element the reader has not seen yet.
+	 *
+	 * @param cursor
+	 * 		cursor of the reader
+	 * @return
+	 * 		number of elements that were skipped
+	 */
+	int skip(fanout_cursor_t *cursor) const {
+		unsigned int head = this->_head.load(std::memory_order_acquire);
+		unsigned int count = head - cursor->pos;
+		cursor->pos = head;
+		return (int) (count > N ? N : count);
+	}
+
+	/** Return the number of elements the reader has not seen yet. */
+	unsigned int get_count(const fanout_cursor_t *cursor) const {
+		unsigned int count =
+				this->_head.load(std::memory_order_acquire) - cursor->pos;
+		return count > N ? N : count;
+	}
+
+	/** Return the number of slots in the ring. */
+	unsigned int get_capacity() const {
+		return N;
+	}
+
+private:
+	/** Storage for a single element, padded to a full cache line. */
+	struct alignas(CACHE_LINE_SIZE) slot_t {
+		std::atomic<unsigned int> seq;	/**< 2 * position + 2 once written */
+		T item;
+	};
+
+	/** Total number of elements ever added. Written by the producer. */
+	alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> _head;
+
+	/** Element slots, indexed by the position modulo N. */
+	slot_t _slots[N];
+};
+
+
+#endif /* INCLUDE_UTILS_RING_H_ */
@@ -0,0 +1,89 @@
+/**\file
+ *
+ * seqlock.h
+ *
+ * This file contains a value that a single writer updates while any number of
+ * readers copy it, without locks. This is used to share the payload of the
+ * periodic messages of the CAN resource manager with its clients.
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#ifndef INCLUDE_UTILS_SEQLOCK_H_
+#define INCLUDE_UTILS_SEQLOCK_H_
+
+#include <atomic>
+
+
+/** Value protected by a sequence lock.
+ *
+ * The sequence number is odd while the writer updates the value, and changes
+ * with every update, so a reader that copied the value during an update can
+ * detect it and retry. The writer never waits for the readers, and readers
+ * never write, so the value may be placed in shared memory and written by
+ * another process than its readers.
+ *
+ * @tparam T
+ * 		type of the value. Must be trivially copyable.
+ */
+template <typename T>
+class SeqValue
+{
+public:
+	SeqValue() : _seq(0), _value() {}
+
+	/** Replace the value.
+	 *
+	 * May only be called by a single writer at a time.
+	 *
+	 * @param value
+	 * 		the new value
+	 */
+	void store(const T &value) {
+		unsigned int seq = this->_seq.load(std::memory_order_relaxed);
+
+		this->_seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		this->_value = value;
+		this->_seq.store(seq + 2, std::memory_order_release);
+	}
+
+	/** Copy the value.
+	 *
+	 * @param value
+	 * 		updated with a copy of the value. Left unchanged if no consistent
+	 * 		copy could be made.
+	 * @param max_tries
+	 * 		largest number of copies attempted while the writer updates the
+	 * 		value. Bounds the time spent by a reader if the writer stopped in
+	 * 		the middle of an update.
+	 * @return
+	 * 		true if the value was copied, false otherwise
+	 */
+	bool load(T *value, int max_tries) const {
+		for (int i = 0; i < max_tries; i++) {
+			unsigned int seq = this->_seq.load(std::memory_order_acquire);
+			if (seq & 1)
+				continue;
+			T copy = this->_value;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (this->_seq.load(std::memory_order_relaxed) == seq) {
+				*value = copy;
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	/** Twice the number of updates, plus one during an update. */
+	std::atomic<unsigned int> _seq;
+
+	/** The value. */
+	T _value;
+};
+
+
+#endif /* INCLUDE_UTILS_SEQLOCK_H_ */
@@ -13,6 +13,7 @@
 #include <string>
 #include <sys/pps.h>
 #include <sys/timeb.h>
+#include <time.h>
 
 
 /** method used to print data from a timestamp_t variable */
@@ -67,3 +68,34 @@ void get_current_timestamp(timestamp_t *t) {
     now /= 60;
     t->hour = now % 24;
 }
+
+
+/** Returns the current value of the monotonic clock, in nanoseconds. */
+uint64_t get_monotonic_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/** Converts a value of the monotonic clock into the time of day at which it
+ * was taken. */
+void monotonic_to_timestamp(uint64_t mono_ns, timestamp_t *t) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t real_ns = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	uint64_t now_ns = get_monotonic_ns();
+
+	// subtract the time elapsed since the monotonic value was taken
+	if (now_ns > mono_ns)
+		real_ns -= now_ns - mono_ns;
+
+	// move the time into a timestamp object
+	uint64_t now = real_ns / 1000000000ULL;
+	t->millisecond = (int) ((real_ns / 1000000ULL) % 1000);
+	t->second = now % 60;
+	now /= 60;
+	t->minute = now % 60;
+	now /= 60;
+	t->hour = now % 24;
+}
@@ -15,6 +15,7 @@
 #define SRC_UTILS_TIMESTAMP_H_
 
 #include <string>
+#include <stdint.h>
 #include <sys/pps.h>
 
 
@@ -43,5 +44,16 @@ extern void import_timestamp(timestamp_t*, std::string);
 /** Returns a timestamp variable for the current time. */
 extern void get_current_timestamp(timestamp_t*);
 
+/** Returns the current value of the monotonic clock, in nanoseconds.
+ *
+ * Unlike the time of day, this clock is never adjusted, so the difference
+ * between two values is an exact elapsed time.
+ */
+extern uint64_t get_monotonic_ns();
+
+/** Converts a value of the monotonic clock (see get_monotonic_ns) into the
+ * time of day at which it was taken. */
+extern void monotonic_to_timestamp(uint64_t, timestamp_t*);
+
 
 #endif /* SRC_UTILS_TIMESTAMP_H_ */
@@ -4,6 +4,11 @@
  *
  * Resource manager for the SSV CAN board. FIXME
  *
+ * A single process serves up to MAX_CHANNELS boards, each with its own threads,
+ * rings and path name (see can_init). The messages of the clients of a channel
+ * are handled by a pool of threads, and its interrupts by a thread of their own
+ * (see pulse_init).
+ *
  * Digital I/O on the board is also supported by the same devctls used by PATH
  * DAS (Data Acquisition System) drivers.
  *
@@ -12,6 +17,9 @@
  * @date February 26, 2019
  */
 
+/* The thread pool passes dispatch contexts to the dispatch functions. */
+#define THREAD_POOL_PARAM_T dispatch_context_t
+
 #include <can/can_man.h>
 #include <iostream>
 #include <sys/dispatch.h>
@@ -19,6 +27,9 @@
 #include "utils/common.h"
 #include <sys/iofunc.h>
 #include <sys/dispatch.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syspage.h>
 
 using namespace std;
 
@@ -29,7 +40,8 @@ using namespace std;
 
 static resmgr_connect_funcs_t  	connect_func;
 static resmgr_io_funcs_t	   	io_func;
-static IOFUNC_ATTR_T		   	attr;
+static IOFUNC_ATTR_T		   	attrs[MAX_CHANNELS];
+static CANDeviceManager			can_devs[MAX_CHANNELS];
 static iofunc_mount_t 			can_mount;
 static iofunc_funcs_t 			can_mount_funcs;
 
@@ -39,25 +51,93 @@ extern int can_timeout_count;
 
 
 IOFUNC_OCB_T *can_ocb_calloc(resmgr_context_t *ctp, iofunc_attr_t *attr) {
-	return (IOFUNC_OCB_T *) calloc(1, sizeof(IOFUNC_OCB_T));
+	IOFUNC_OCB_T *pocb = (IOFUNC_OCB_T *) calloc(1, sizeof(IOFUNC_OCB_T));
+
+	/* New clients only read the messages received after they open, and
+	 * accept every message until they set a filter. */
+	if (pocb != NULL) {
+		can_rx_buff_t *in_buff = ((IOFUNC_ATTR_T *) attr)->in_buff;
+		for (int lane = 0; lane < CAN_RX_NUM_LANES; lane++)
+			pocb->cursor.lanes[lane] = in_buff->lanes[lane].get_cursor();
+		pocb->num_filters = 0;
+	}
+	return pocb;
 }
 
 
 void can_ocb_free(IOFUNC_OCB_T *pocb) {
-	delete pocb;
+	IOFUNC_ATTR_T *pattr = (IOFUNC_ATTR_T *) pocb->io_ocb.attr;
+
+	/* The attribute lock is recursive, so this is safe even if the library
+	 * already holds it. */
+	iofunc_attr_lock(&pattr->io_attr);
+	can_dev_disarm(pattr, pocb);
+	can_dev_cyclic_release(pattr, pocb);
+	iofunc_attr_unlock(&pattr->io_attr);
+	free(pocb);
 }
 
 
-int main (int argc, char **argv) {
-	bool verbose = false;
+/** Keep the calling thread, and every thread it creates, on a single CPU.
+ *
+ * @param cpu
+ * 		index of the CPU
+ */
+static void can_set_runmask(int cpu) {
+	int num_elements = RMSK_SIZE(_syspage_ptr->num_cpu);
+	int size = sizeof(int) + 2 * num_elements * sizeof(unsigned);
+	int *rsizep = (int *) calloc(1, size);
+	unsigned *rmaskp;
+	unsigned *inheritp;
+
+	if (rsizep == NULL)
+		return;
+	*rsizep = num_elements;
+	rmaskp = (unsigned *) (rsizep + 1);
+	inheritp = rmaskp + num_elements;
+	RMSK_SET(cpu, rmaskp);
+	RMSK_SET(cpu, inheritp);
+	if (ThreadCtl(_NTO_TCTL_RUNMASK_GET_AND_SET_INHERIT, rsizep) == -1)
+		perror("ThreadCtl runmask");
+	free(rsizep);
+}
+
 
+/** Serve a single CAN channel.
+ *
+ * Every channel has its own dispatch structure, whose messages and timer pulses
+ * are handled by a pool of CAN_POOL_MIN_THREADS to CAN_POOL_MAX_THREADS
+ * threads, so a client with a slow devctl does not hold up the other clients.
+ * Each pool thread runs at the priority of the client whose message it handles
+ * (QNX priority inheritance). The interrupts of the chip are serviced by a
+ * thread at CAN_INTR_PRIORITY started by pulse_init.
+ *
+ * The state of the channel is shared by these threads, and protected by the
+ * lock of its attribute structure. The resource manager library holds that
+ * lock while an I/O message is handled; the interrupt thread and the timer
+ * pulse handlers take it themselves.
+ *
+ * The calling thread joins the pool, and never returns.
+ *
+ * @param arg
+ * 		pointer to the device attributes object of the channel
+ */
+static void *can_channel_thread(void *arg) {
+	IOFUNC_ATTR_T *pattr = (IOFUNC_ATTR_T *) arg;
+	can_info_t *pinfo = &pattr->can_info;
+	CANDeviceManager *pdev = &can_devs[pattr->channel];
 	dispatch_t *dpp;
 	resmgr_attr_t resmgr_attr;
-	dispatch_context_t *ctp;
-	can_info_t *pinfo = &attr.can_info;
+	thread_pool_attr_t pool_attr;
+	thread_pool_t *tpp;
+	int warm;
 
 	ThreadCtl(_NTO_TCTL_IO, NULL);  /* required to access I/O ports */
 
+	/* Keep the threads of the channel on a single CPU, if requested. */
+	if (pinfo->cpu >= 0)
+		can_set_runmask(pinfo->cpu);
+
 	/* Create the dispatch structure. */
 	if ((dpp = dispatch_create()) == NULL) {
 		perror ("Unable to dispatch_create\n");
@@ -69,10 +149,107 @@ int main (int argc, char **argv) {
 	resmgr_attr.nparts_max = 2;
 	resmgr_attr.msg_max_size = DAS_MSG_BUF;
 
+	/* The input ring is shared with the clients, so it must exist before they
+	 * can open the device. The ring of an earlier run is taken over. */
+	if ((warm = can_shm_init(pattr)) == -1) {
+		fprintf(stderr, "Unable to create the input ring of %s\n",
+				pattr->devname);
+		exit (EXIT_FAILURE);
+	}
+
+	/* Establish a name in the pathname space. */
+	if (resmgr_attach(dpp, &resmgr_attr, pattr->devname, _FTYPE_ANY,
+			0, &connect_func, &io_func, &pattr->io_attr) == -1) {
+		perror ("Unable to resmgr_attach\n");
+		exit (EXIT_FAILURE);
+	}
+
+	if (pattr->verbose_flag) {
+		printf("Calling can_dev_init: channel %d base address 0x%x speed %d extended %d\n",
+			pattr->channel, pinfo->port, pinfo->bit_speed,
+			pinfo->use_extended_frame);
+		fflush(stdout);
+	}
+
+	/* Record every frame from the moment the chip is started. */
+	if (pinfo->dump_file != NULL) {
+		if (can_dump_init(pattr) == -1) {
+			fprintf(stderr, "Unable to start the dump of %s\n",
+					pattr->devname);
+			exit (EXIT_FAILURE);
+		}
+		pdev->set_dump(pattr->dump_ring);
+	}
+
+	/* Initialize device, unless the chip is still running with the settings
+	 * of the earlier run, whose counters and filters are then kept. A tap
+	 * leaves reset mode in listen only mode, so it never acknowledges a
+	 * frame. */
+	pdev->set_state(&pattr->shm->state);
+	pdev->set_listen_only(pinfo->listen_only);
+	if (warm && pdev->restart(pattr->channel, pinfo->port, pinfo->bit_speed)) {
+		printf("Channel %d: warm restart, generation %u\n", pattr->channel,
+				pattr->shm->generation);
+		fflush(stdout);
+	} else {
+		pdev->init(pattr->channel, pinfo->port, pinfo->bit_speed,
+				pinfo->use_extended_frame);
+		pdev->set_filter(pinfo->filter);
+	}
+	pdev->set_poll_rate(pinfo->poll_rate);
+	pattr->can_dev = pdev;
+
+	/* Forward frames to the other channels from the first one received. */
+	if (can_route_init(pattr) == -1)
+		exit (EXIT_FAILURE);
+
+	if (pattr->verbose_flag) {
+		printf("Attaching pulses\n");
+		fflush(stdout);
+	}
+
+	/* Attach pulses and start the interrupt thread. */
+	pulse_init(dpp, pattr);
+
+	/* The periodic messages kept from the last manager are sent on. */
+	iofunc_attr_lock(&pattr->io_attr);
+	can_set_cyclic_timer(pattr);
+	iofunc_attr_unlock(&pattr->io_attr);
+
+	/* Handle the messages of the clients with a pool of threads. */
+	memset(&pool_attr, 0, sizeof(pool_attr));
+	pool_attr.handle = dpp;
+	pool_attr.context_alloc = dispatch_context_alloc;
+	pool_attr.block_func = dispatch_block;
+	pool_attr.unblock_func = dispatch_unblock;
+	pool_attr.handler_func = dispatch_handler;
+	pool_attr.context_free = dispatch_context_free;
+	pool_attr.lo_water = CAN_POOL_MIN_THREADS;
+	pool_attr.increment = 1;
+	pool_attr.hi_water = CAN_POOL_MIN_THREADS + 1;
+	pool_attr.maximum = CAN_POOL_MAX_THREADS;
+	if ((tpp = thread_pool_create(&pool_attr, POOL_FLAG_USE_SELF)) == NULL) {
+		perror("Unable to thread_pool_create\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Wait here forever, handling messages. */
+	thread_pool_start(tpp);
+	return NULL;
+}
+
+
+int main (int argc, char **argv) {
+	int num_channels;
+	int i;
+	pthread_t tids[MAX_CHANNELS];
+	sigset_t sigs;
+
+	ThreadCtl(_NTO_TCTL_IO, NULL);  /* required to access I/O ports */
+
 	/* Bind default functions into the outcall tables. */
 	iofunc_func_init(_RESMGR_CONNECT_NFUNCS, &connect_func,
 		_RESMGR_IO_NFUNCS, &io_func);
-	iofunc_attr_init(&attr.io_attr, S_IFNAM | 0666, 0, 0);
 
 	/* Add allocation and deallocation for extended OCB. */
 	can_mount_funcs.nfuncs = _IOFUNC_NFUNCS;
@@ -80,73 +257,66 @@ int main (int argc, char **argv) {
 	can_mount_funcs.ocb_free = can_ocb_free;
 	memset(&can_mount, 0, sizeof(can_mount));
 	can_mount.funcs = &can_mount_funcs;
-	attr.io_attr.mount = &can_mount;
 
 	/* Read configuration files and bind device-specific functions. */
-	can_init(argc, argv, &connect_func, &io_func, &attr);
+	num_channels = can_init(argc, argv, &connect_func, &io_func, attrs,
+			MAX_CHANNELS);
 
-	/* Establish a name in the pathname space. */
-	if (resmgr_attach(dpp, &resmgr_attr, attr.devname, _FTYPE_ANY,
-			0, &connect_func, &io_func, (_iofunc_attr*)&attr) == -1) {  // FIXME: _iofunc_attr*
-		perror ("Unable to resmgr_attach\n");
-		exit (EXIT_FAILURE);
-	}
-
-	if (verbose) {
-		printf("Calling can_dev_init: base address 0x%x speed %d extended %d\n",
-			pinfo->port, pinfo->bit_speed, pinfo->use_extended_frame);
-		fflush(stdout);
+	for (i=0; i<num_channels; i++) {
+		iofunc_attr_init(&attrs[i].io_attr, S_IFNAM | 0666, 0, 0);
+		attrs[i].io_attr.mount = &can_mount;
 	}
 
-	/* Initialize device. */
-	CANDeviceManager can_dev;
-	can_dev.init(pinfo->port, pinfo->bit_speed, pinfo->use_extended_frame);
-	attr.can_dev = &can_dev;
+	/* The kill signals are only handled by this thread, which jumps back to
+	 * exit_env, so the channel threads are started with them blocked. */
+	sigemptyset(&sigs);
+	for (i=0; sig_list[i] != ERROR; i++)
+		sigaddset(&sigs, sig_list[i]);
+	pthread_sigmask(SIG_BLOCK, &sigs, NULL);
 
-	/* Initialize all classes within the attr object. */
-	attr.in_buff = new CircularBuffer();
-	attr.out_buff = new CircularBuffer();
-
-	if (verbose) {
-		printf("Attaching pulses\n");
-		fflush(stdout);
+	for (i=0; i<num_channels; i++) {
+		if (pthread_create(&tids[i], NULL, can_channel_thread,
+				&attrs[i]) != EOK) {
+			perror("Unable to start channel thread\n");
+			exit(EXIT_FAILURE);
+		}
 	}
 
-	/* Attach pulses and interrupt event. */
-	pulse_init(dpp, &attr);
-
-	/* Allocate dispatch context. */
-	ctp = dispatch_context_alloc(dpp);
-
 	if(setjmp(exit_env) != 0) {
-		can_err_count_t err = can_dev.get_errs();
 		printf("%s exiting\n", argv[0]);
-		printf("can_notify_client_err %d\n", can_dev.can_notify_client_err);
-		printf("mask_count_non_zero %d\n", can_dev.mask_count_non_zero);
-		printf("shadow_buffer_count %d\n", err.shadow_buffer_count);
-		printf("intr_in_handler_count %d\n", err.intr_in_handler_count);
-		printf("rx_interrupt_count %d\n", err.rx_interrupt_count);
-		printf("rx_message_lost_count %d\n", err.rx_message_lost_count);
-		printf("tx_interrupt_count %d\n", err.tx_interrupt_count);
-		printf("tx_buffer_flush %d\n", can_dev.tx_buffer_flush);
-		printf("can_timeout_count %d\n", can_dev.can_timeout_count);
+		for (i=0; i<num_channels; i++) {
+			CANDeviceManager *pdev = &can_devs[i];
+			can_err_count_t err = pdev->get_errs();
+			printf("%s:\n", attrs[i].devname);
+			printf("can_notify_client_err %d\n", pdev->can_notify_client_err);
+			printf("mask_count_non_zero %d\n", pdev->mask_count_non_zero);
+			printf("shadow_buffer_count %d\n", err.shadow_buffer_count);
+			printf("intr_in_handler_count %d\n", err.intr_in_handler_count);
+			printf("rx_interrupt_count %d\n", err.rx_interrupt_count);
+			printf("rx_message_lost_count %d\n", err.rx_message_lost_count);
+			printf("rx_ring_full_count %d\n", err.rx_ring_full_count);
+			printf("rx_safety_ring_full_count %d\n",
+					err.rx_safety_ring_full_count);
+			printf("rx_filtered_count %d\n", err.rx_filtered_count);
+			printf("tx_interrupt_count %d\n", err.tx_interrupt_count);
+			printf("tx_expired_count %d\n", err.tx_expired_count);
+			printf("tx_replaced_count %d\n", err.tx_replaced_count);
+			printf("intr_mode_ms %d\n", err.intr_mode_ms);
+			printf("poll_mode_ms %d\n", err.poll_mode_ms);
+			printf("poll_count %d\n", err.poll_count);
+			printf("poll_switch_count %d\n", err.poll_switch_count);
+			printf("can_timeout_count %d\n", pdev->can_timeout_count);
+		}
 		fflush(stdout);
 		exit(EXIT_SUCCESS);
 	} else {
 		sig_ign(sig_list, sig_hand);
+		pthread_sigmask(SIG_UNBLOCK, &sigs, NULL);
 	}
 
-	/* Wait here forever, handling messages. */
-	while (1) {
-		if ((ctp = dispatch_block(ctp)) == NULL) {
-			perror("Unable to dispatch_block\n");
-			exit(EXIT_FAILURE);
-		}
-		dispatch_handler(ctp);
-	}
+	/* The channel threads handle all the messages. */
+	for (i=0; i<num_channels; i++)
+		pthread_join(tids[i], NULL);
 
-	/* free up memory */
-	delete attr.in_buff;
-	delete attr.out_buff;
-	delete attr.can_dev;
+	return EXIT_SUCCESS;
 }
@@ -0,0 +1,242 @@
+/**\file
+ *
+ * can_selftest.cpp
+ *
+ * This script qualifies the CAN path of a computer without a second node on
+ * the bus. It puts the CAN driver in self test mode (see DCMD_CAN_SELF_TEST),
+ * in which the chip receives every frame it sends, and pumps numbered frames
+ * through the driver: a thread writes them with can_write_batch while another
+ * reads them back with can_read_batch. The time from the write to the read of
+ * every frame and the sustained frame rate are then printed, and the result is
+ * checked against the given limits.
+ *
+ * At most a window of frames is in flight at any time, so that the output
+ * queue of the driver never overflows, and the frame rate is that of the
+ * whole path: client, driver, chip and back.
+ *
+ * Arguments:
+ *
+ * - -n: path name of the CAN device (/dev/can1)
+ * - -c: number of frames to send (10000)
+ * - -w: largest number of frames in flight (16)
+ * - -r: lowest frame rate that passes, in frames/s (0, no limit)
+ * - -l: highest 99th percentile of the latency that passes, in us (0, no
+ *       limit)
+ * - -t: time without a frame after which the remaining frames are lost, in ms
+ *       (1000)
+ *
+ * The exit status is EXIT_SUCCESS if every frame came back within the limits,
+ * EXIT_FAILURE otherwise.
+ *
+ * Usage:
+ *  can_selftest -n /dev/can1 -c 100000 -r 2000 -l 5000
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#include "can/can.h"
+#include "can/can_man.h"
+#include "jbus/jbus.h"
+#include "utils/timestamp.h"
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace std;
+
+
+/** Identifier of the test frames: proprietary B PGN 0xFFFE, with the lowest
+ * priority. The source address is the low byte of the number of the frame. */
+#define SELFTEST_ID		((7UL << 26) | (0xFFFEUL << 8))
+
+
+/** State shared by the writing and reading threads. */
+typedef struct {
+	intptr_t handle;				/**< CAN device, as returned by JBus::init */
+	int count;						/**< number of frames to send */
+	uint64_t *tx_ns;				/**< write time of every frame */
+	uint64_t *latency_ns;			/**< write to read time of every frame */
+	std::atomic<int> received;		/**< number of frames read back */
+	std::atomic<int> duplicates;	/**< number of frames read twice */
+	std::atomic<uint64_t> last_rx_ns;	/**< time the last frame was read */
+} selftest_t;
+
+
+/** Read the test frames back, until every frame was read. */
+static void *selftest_reader(void *arg) {
+	selftest_t *test = (selftest_t *) arg;
+	can_msg_t msgs[CAN_MAX_BATCH];
+	int num_msgs;
+	uint64_t now;
+
+	while (test->received < test->count) {
+		if ((num_msgs = can_read_batch(test->handle, msgs, CAN_MAX_BATCH)) < 0)
+			continue;
+		now = get_monotonic_ns();
+
+		for (int i = 0; i < num_msgs; i++) {
+			if (!IS_EXTENDED_FRAME(msgs[i]) ||
+					(CAN_ID(msgs[i]) & ~0xFFUL) != SELFTEST_ID)
+				continue;
+			int seq = msgs[i].data[0] | (msgs[i].data[1] << 8) |
+					(msgs[i].data[2] << 16) | (msgs[i].data[3] << 24);
+			if (seq < 0 || seq >= test->count)
+				continue;
+			if (test->latency_ns[seq] != 0) {
+				test->duplicates++;
+				continue;
+			}
+			test->latency_ns[seq] = max(now - test->tx_ns[seq], (uint64_t) 1);
+			test->last_rx_ns = now;
+			test->received++;
+		}
+	}
+	return NULL;
+}
+
+
+int main(int argc, char **argv) {
+	char *devname = (char*)DEFAULT_DEVICE;	/* path to the CAN device */
+	int window = CAN_TX_QSIZE / 2;	/* largest number of frames in flight */
+	unsigned int min_rate = 0;		/* lowest frame rate that passes */
+	unsigned int max_latency_us = 0;	/* highest 99th percentile that passes */
+	int timeout_ms = 1000;			/* time after which frames are lost */
+	static selftest_t test;
+	JBus jfunc;
+	can_msg_t msgs[CAN_MAX_BATCH];
+	can_stats_t stats;
+	pthread_t reader;
+	int sent = 0;
+	int fd;
+
+	test.count = 10000;
+	int ch;
+	while ((ch = getopt(argc, argv, "c:l:n:r:t:w:")) != EOF) {
+		switch (ch) {
+			case 'c': test.count = atoi(optarg); break;
+			case 'l': max_latency_us = atoi(optarg); break;
+			case 'n': devname = strdup(optarg); break;
+			case 'r': min_rate = atoi(optarg); break;
+			case 't': timeout_ms = atoi(optarg); break;
+			case 'w': window = atoi(optarg); break;
+			default:
+				printf("Usage: %s -n <device> -c <frames> -w <window> "
+						"-r <min frames/s> -l <max latency us> -t <timeout ms>\n",
+						argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	if (test.count <= 0)
+		test.count = 10000;
+	if (window <= 0 || window > CAN_TX_QSIZE)
+		window = CAN_TX_QSIZE / 2;
+
+	if ((test.handle = jfunc.init(devname, O_RDONLY, NULL)) == -1) {
+		fprintf(stderr, "Error opening CAN device %s\n", devname);
+		exit(EXIT_FAILURE);
+	}
+	fd = ((can_dev_handle_t *) test.handle)->fd;
+
+	if (can_set_self_test(fd, 1) != EOK) {
+		fprintf(stderr, "%s: failed to enter self test mode\n", devname);
+		exit(EXIT_FAILURE);
+	}
+	can_clear_errs(fd, NULL);
+
+	test.tx_ns = new uint64_t[test.count];
+	test.latency_ns = new uint64_t[test.count];
+	memset(test.latency_ns, 0, test.count * sizeof(uint64_t));
+
+	if (pthread_create(&reader, NULL, selftest_reader, &test) != EOK) {
+		perror("pthread_create");
+		can_set_self_test(fd, 0);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Keep the window full until every frame was sent, and then wait for the
+	 * last ones to come back. */
+	uint64_t start_ns = get_monotonic_ns();
+	uint64_t timeout_ns = (uint64_t) timeout_ms * 1000000;
+	test.last_rx_ns = start_ns;
+	while (test.received < test.count &&
+			get_monotonic_ns() - test.last_rx_ns < timeout_ns) {
+		int num_msgs = min(window - (sent - test.received),
+				min(test.count - sent, CAN_MAX_BATCH));
+		if (num_msgs <= 0) {
+			sched_yield();
+			continue;
+		}
+
+		for (int i = 0; i < num_msgs; i++) {
+			memset(&msgs[i], 0, sizeof(can_msg_t));
+			msgs[i].id = SELFTEST_ID | ((sent + i) & 0xFF);
+			SET_EXTENDED_FRAME(msgs[i]);
+			msgs[i].size = 8;
+			for (int j = 0; j < 4; j++)
+				msgs[i].data[j] = (BYTE) ((sent + i) >> (8 * j));
+		}
+		uint64_t now = get_monotonic_ns();
+		for (int i = 0; i < num_msgs; i++)
+			test.tx_ns[sent + i] = now;
+
+		/* The queue may take fewer messages than written. */
+		int written = can_write_batch(test.handle, msgs, num_msgs);
+		if (written < 0) {
+			fprintf(stderr, "%s: can_write_batch failed\n", devname);
+			break;
+		}
+		sent += written;
+	}
+
+	can_set_self_test(fd, 0);
+	can_get_stats(fd, &stats);
+
+	/* Latencies of the frames read back, lowest first. */
+	int received = test.received;
+	uint64_t *latencies = new uint64_t[received > 0 ? received : 1];
+	uint64_t total_ns = 0;
+	int n = 0;
+	for (int i = 0; i < test.count; i++)
+		if (test.latency_ns[i] != 0) {
+			latencies[n++] = test.latency_ns[i];
+			total_ns += test.latency_ns[i];
+		}
+	sort(latencies, latencies + n);
+
+	uint64_t elapsed_ns = test.last_rx_ns - start_ns;
+	unsigned int rate = elapsed_ns == 0 ? 0 :
+			(unsigned int) ((uint64_t) received * 1000000000 / elapsed_ns);
+	unsigned int p99_us = n == 0 ? 0 :
+			(unsigned int) (latencies[(n - 1) * 99 / 100] / 1000);
+
+	printf("frames: sent %d received %d lost %d duplicate %d\n", sent,
+			received, test.count - received, (int) test.duplicates);
+	printf("rate: %u frames/s over %u ms\n", rate,
+			(unsigned int) (elapsed_ns / 1000000));
+	if (n != 0)
+		printf("latency: min %u mean %u median %u p99 %u max %u us\n",
+				(unsigned int) (latencies[0] / 1000),
+				(unsigned int) (total_ns / n / 1000),
+				(unsigned int) (latencies[(n - 1) / 2] / 1000), p99_us,
+				(unsigned int) (latencies[n - 1] / 1000));
+	printf("driver: isr max %u us, tx delay max %u us, delivery max %u us, "
+			"bus load %u.%u%%\n", stats.isr_time.max_us, stats.tx_delay.max_us,
+			stats.delivery_time.max_us, stats.bus_load / 10,
+			stats.bus_load % 10);
+
+	bool pass = received == test.count && rate >= min_rate &&
+			(max_latency_us == 0 || p99_us <= max_latency_us);
+	printf("%s\n", pass ? "PASS" : "FAIL");
+	fflush(stdout);
+
+	/* The reader may still wait for frames that were lost. */
+	exit(pass ? EXIT_SUCCESS : EXIT_FAILURE);
+}
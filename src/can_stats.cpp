@@ -0,0 +1,163 @@
+/**\file
+ *
+ * can_stats.cpp
+ *
+ * This script periodically reads the statistics of the CAN driver (see
+ * DCMD_CAN_GET_STATS) and prints them on stdout, so that the load of the bus
+ * and the backlog of the clients can be watched while the driver runs.
+ *
+ * Arguments:
+ *
+ * - -n: path name of the CAN device (/dev/can1)
+ * - -t: time between two reads of the statistics, in ms (1000)
+ * - -c: reset the statistics of the driver before the first read
+ * - -o: read the statistics once and exit
+ * - -v: also print the histograms and the frame count of every PGN
+ *
+ * Usage:
+ *  can_stats -n /dev/can1 -t 500
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#include "can/can.h"
+#include "can/can_man.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+using namespace std;
+
+
+/** Print a histogram of durations, one bin per column. */
+static void print_hist(const char *name, const can_hist_t *hist) {
+	printf("%s: count %u mean %u us max %u us\n", name, hist->count,
+			hist->count == 0 ? 0 : (unsigned int) (hist->total_us / hist->count),
+			hist->max_us);
+	printf("  <1us");
+	for (int i = 1; i < CAN_HIST_BINS - 1; i++)
+		printf(" <%uus", 1u << i);
+	printf(" more\n ");
+	for (int i = 0; i < CAN_HIST_BINS; i++)
+		printf(" %u", hist->bins[i]);
+	printf("\n");
+}
+
+
+/** Used to sort the PGNs by decreasing frame count. */
+static bool more_frames(const can_pgn_count_t &a, const can_pgn_count_t &b) {
+	return a.count > b.count;
+}
+
+
+/** Print the frame count of every PGN, most frequent first. */
+static void print_pgns(const can_stats_t *stats) {
+	can_pgn_count_t pgns[CAN_STATS_MAX_PGNS];
+	int num_pgns = 0;
+
+	for (int i = 0; i < CAN_STATS_MAX_PGNS; i++)
+		if (stats->pgns[i].count != 0)
+			pgns[num_pgns++] = stats->pgns[i];
+	sort(pgns, pgns + num_pgns, more_frames);
+
+	printf("PGN     frames\n");
+	for (int i = 0; i < num_pgns; i++)
+		printf("%6u  %u\n", pgns[i].pgn, pgns[i].count);
+	printf("11 bit  %u\n", stats->std_frame_count);
+	if (stats->pgn_overflow_count != 0)
+		printf("other   %u\n", stats->pgn_overflow_count);
+}
+
+
+int main(int argc, char **argv) {
+	char *devname = (char*)DEFAULT_DEVICE;	/* path to the CAN device */
+	int period_ms = 1000;	/* time between two reads of the statistics */
+	bool clear = false;		/* whether to reset the statistics first */
+	bool once = false;		/* whether to read the statistics a single time */
+	bool verbose = false;	/* whether to print histograms and PGNs */
+	can_stats_t stats;
+	can_stats_t last;
+	bool first = true;
+	struct timespec period;
+	int fd;
+	int status;
+
+	int ch;
+	while ((ch = getopt(argc, argv, "cn:ot:v")) != EOF) {
+		switch (ch) {
+			case 'c': clear = true; break;
+			case 'n': devname = strdup(optarg); break;
+			case 'o': once = true; break;
+			case 't': period_ms = atoi(optarg); break;
+			case 'v': verbose = true; break;
+			default:
+				printf("Usage: %s -n <device> -t <period ms> -c -o -v\n",
+						argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	if (period_ms <= 0)
+		period_ms = 1000;
+	period.tv_sec = period_ms / 1000;
+	period.tv_nsec = (period_ms % 1000) * 1000000L;
+
+	if ((fd = open(devname, O_RDONLY)) == -1) {
+		perror(devname);
+		exit(EXIT_FAILURE);
+	}
+
+	if (clear && can_clear_errs(fd, NULL) != EOK)
+		fprintf(stderr, "%s: failed to reset the statistics\n", devname);
+
+	printf("  rx/s   tx/s  load%%  backlog  txq  lost  missed  safety missed  "
+			"isr max us  delivery max us\n");
+	while (true) {
+		if ((status = can_get_stats(fd, &stats)) != EOK) {
+			fprintf(stderr, "%s: DCMD_CAN_GET_STATS failed (%s)\n", devname,
+					strerror(status));
+			exit(EXIT_FAILURE);
+		}
+		/* The frame rates are only known from the second read on. */
+		if (first) {
+			last = stats;
+			first = false;
+		}
+
+		printf("%6u %6u %5u.%u %8u %4u %5u %7u %14u %11u %16u\n",
+				(stats.rx_frame_count - last.rx_frame_count) * 1000 / period_ms,
+				(stats.tx_frame_count - last.tx_frame_count) * 1000 / period_ms,
+				stats.bus_load / 10, stats.bus_load % 10,
+				stats.rx_backlog_max, stats.tx_queue_max,
+				stats.errs.rx_message_lost_count,
+				stats.errs.rx_ring_full_count,
+				stats.errs.rx_safety_ring_full_count,
+				stats.isr_time.max_us, stats.delivery_time.max_us);
+		if (verbose) {
+			print_hist("isr", &stats.isr_time);
+			print_hist("delivery", &stats.delivery_time);
+			print_pgns(&stats);
+			if (stats.errs.rx_dump_full_count != 0)
+				printf("dump    %u missed\n", stats.errs.rx_dump_full_count);
+			if (stats.errs.route_full_count != 0 ||
+					stats.errs.route_dropped_count != 0)
+				printf("route   %u missed %u dropped\n",
+						stats.errs.route_full_count,
+						stats.errs.route_dropped_count);
+		}
+		fflush(stdout);
+
+		if (once)
+			break;
+		last = stats;
+		nanosleep(&period, NULL);
+	}
+
+	close(fd);
+	return EXIT_SUCCESS;
+}
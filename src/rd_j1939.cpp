@@ -8,6 +8,28 @@
  * to the SSV CAN Board). If any new messages are received, they are published
  * to the pub/sub server for use by other processes.
  *
+ * The work is split into three stages, each running in a thread of its own
+ * and connected by lock-free queues:
+ *
+ * - receive: reads every frame queued in the driver and passes it on. It never
+ *   waits for the other stages, so the driver is always drained; the frames
+ *   that do not fit in a full queue are dropped and counted.
+ * - decode: converts the frames to their message-specific format, in place in
+ *   the queue to the publish stage, and prints them with -t. The messages of
+ *   the transport protocol, such as DM1 diagnostics, are reassembled from their
+ *   frames (see J1939Reassembler), and passed on without copying.
+ * - publish: prints the messages with -v, and publishes them. The latest value
+ *   of every (PGN, source address) pair is kept, and the values updated since
+ *   the last publish are published at a fixed rate (see PublishCoalescer), so
+ *   that frequent messages do not each cost a write to the pub/sub server.
+ *   Reassembled messages are published at once, and handed back to the decode
+ *   stage, which owns the reassembly.
+ *
+ * The CPU and priority of every stage may be set, and the latency of every
+ * stage is measured: from the driver reading the frame from the chip to the
+ * receive stage reading it from the driver, from there to the end of the
+ * decode, and from there to the end of the publish.
+ *
  * Arguments:
  * 	-f	filename for input
  * 	-t 	puts bytes from every frame received on stdout
@@ -17,6 +39,12 @@
  * 	-v 	run in verbose mode, messages are printed in stdout
  * 	-n	specifies whether to print messages in numeric or non-numeric mode. Only
  * 		used if the process is running in debug mode.
+ * 	-A	CPUs of the receive, decode and publish stages, as r,d,p (-1 any)
+ * 	-P	priorities of the receive, decode and publish stages, as r,d,p (0 to
+ * 		inherit the priority of the process)
+ * 	-L	period of the report of the stage latencies, in s (0, never)
+ * 	-r	rate at which the messages are published, in Hz (50, 0 to publish every
+ * 		message as it is received)
  *
  * @author Abdul Rahman Kreidieh
  * @version 1.0.0
@@ -27,118 +55,519 @@
 #include "jbus/j1939_utils.h"
 #include "jbus/j1939_struct.h"
 #include "jbus/j1939_interpreters.h"
-#include <map>
+#include "jbus/j1939_tp.h"
+#include "utils/ring.h"
+#include "utils/pub_sub.h"
+#include "utils/coalescer.h"
+#include "utils/timestamp.h"
+#include <atomic>
 #include <string>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/neutrino.h>
 
 using namespace std;
 
 
+/** Number of slots of each queue between two stages. Must be a power of two.
+ */
+#define RD_QSIZE		1024
+
+/** Largest size of the message-specific format of a message, in bytes. */
+#define RD_MSG_SIZE		256
+
+/** Largest number of messages decoded before the publish stage is woken up. */
+#define RD_WAKE_BATCH	32
+
+/** Time the decode stage waits for room in a full queue, in us. */
+#define RD_FULL_WAIT_US	100
+
+/** Longest time the decode stage waits for frames while messages are being
+ * reassembled, so that the transfers that stopped time out, in ms. */
+#define RD_TP_IDLE_MS	100
+
+/** Default rate at which the messages are published, in Hz. */
+#define RD_PUBLISH_HZ	50
+
+/** Index of the receive, decode and publish stages. */
+#define RD_RECEIVE		0
+#define RD_DECODE		1
+#define RD_PUBLISH		2
+#define RD_NUM_STAGES	3
+
+
+/** A frame on its way from the receive stage to the decode stage. */
+typedef struct {
+	j1939_pdu_typ pdu;		/**< the frame, timed by the driver */
+	uint64_t received_ns;	/**< time the frame was read from the driver */
+} rd_frame_t;
+
+
+/** A message on its way from the decode stage to the publish stage. */
+typedef struct {
+	J1939Interpreter *interpreter;	/**< interpreter of the message, NULL for
+									 a reassembled message */
+	j1939_tp_message_t *tp;			/**< the reassembled message, in the
+									 reassembly of the decode stage */
+	int pgn;						/**< PGN of the message */
+	int src_address;				/**< source address of the message */
+	uint64_t decoded_ns;			/**< time the message was decoded */
+	alignas(8) char data[RD_MSG_SIZE];	/**< message-specific format */
+} rd_message_t;
+
+
+/** Latency of a stage, written by the stage and read by the report. */
+typedef struct {
+	std::atomic<uint64_t> count;	/**< number of messages */
+	std::atomic<uint64_t> total_ns;	/**< sum of the latencies, in ns */
+	std::atomic<uint64_t> max_ns;	/**< largest latency, in ns */
+} rd_latency_t;
+
+
+/** Where and how a stage runs. */
+typedef struct {
+	int cpu;			/**< CPU of the stage, -1 any */
+	int priority;		/**< priority of the stage, 0 that of the process */
+} rd_stage_attr_t;
+
+
+/** State shared by the stages. */
+typedef struct {
+	JBus jfunc;					/**< object responsible to r/w messages */
+	int fd;						/**< the CAN device, from JBus::init */
+	J1939Dispatch interpreters;	/**< interpreter of every PGN */
+	bool generic;				/**< whether to run in "generic" mode */
+	bool trace;					/**< whether to print the raw frames */
+	bool debug;					/**< whether to print the messages */
+	bool numeric;				/**< print the messages in numeric form */
+	unsigned int publish_hz;	/**< rate of the publishing, 0 every message */
+	PublishCoalescer coalescer;	/**< latest value of every message */
+	Ring<rd_frame_t, RD_QSIZE> frames;		/**< receive to decode */
+	Ring<rd_message_t, RD_QSIZE> messages;	/**< decode to publish */
+	/** publish to decode, the reassembled messages to release. Holds every
+	 * message the reassembly may hand out, so it never fills. */
+	Ring<j1939_tp_message_t *, J1939_TP_MAX_SESSIONS> published;
+	sem_t frames_ready;			/**< posted once frames were received */
+	sem_t messages_ready;		/**< posted once messages were decoded */
+	rd_latency_t latency[RD_NUM_STAGES];	/**< latency of every stage */
+	std::atomic<unsigned long> num_received;	/**< frames received */
+	std::atomic<unsigned long> rcv_errors;		/**< failed receives */
+	std::atomic<unsigned long> num_dropped;		/**< frames dropped by the
+												 receive stage */
+	std::atomic<unsigned long> num_published;	/**< messages published */
+	std::atomic<unsigned long> num_reassembled;	/**< messages reassembled */
+} rd_pipeline_t;
+
+
+/** The pipeline. Static, so that the slots of the queues are aligned. */
+static rd_pipeline_t pipeline;
+
+
+/** Account for the latency of a message in a stage. */
+static void latency_add(rd_latency_t *latency, uint64_t duration_ns) {
+	latency->count.fetch_add(1, std::memory_order_relaxed);
+	latency->total_ns.fetch_add(duration_ns, std::memory_order_relaxed);
+	if (duration_ns > latency->max_ns.load(std::memory_order_relaxed))
+		latency->max_ns.store(duration_ns, std::memory_order_relaxed);
+}
+
+
+/** Read every frame queued in the driver, and pass it to the decode stage. */
+static void *receive_stage(void *arg) {
+	rd_pipeline_t *rd = (rd_pipeline_t *) arg;
+	j1939_pdu_typ pdus[JBUS_MAX_BATCH];
+	rd_frame_t *frame;
+	int rcv_val;
+	uint64_t now;
+
+	while (true) {
+		/* Receive every value currently queued on the J-bus. */
+		rcv_val = rd->jfunc.receive_batch(rd->fd, pdus, JBUS_MAX_BATCH);
+
+		/* If an error occurred while receiving, increment the number of
+		 * errors received and try again. */
+		if (rcv_val == -1) {
+			rd->rcv_errors++;
+			continue;
+		}
+
+		/* Increment by the number of valid messages received. */
+		rd->num_received += rcv_val;
+
+		/* The time stamp was set by the driver when the frame was read from
+		 * the CAN chip. The driver must keep being drained, so frames are
+		 * dropped rather than waiting for the decode stage. */
+		now = get_monotonic_ns();
+		for (int i=0; i<rcv_val; i++) {
+			if ((frame = rd->frames.reserve()) == NULL) {
+				rd->num_dropped++;
+				continue;
+			}
+			frame->pdu = pdus[i];
+			frame->received_ns = now;
+			rd->frames.commit();
+			latency_add(&rd->latency[RD_RECEIVE], now - pdus[i].rx_time_ns);
+		}
+
+		if (rcv_val > 0)
+			sem_post(&rd->frames_ready);
+	}
+	return NULL;
+}
+
+
+/** Wait for a semaphore, until a time of the monotonic clock. */
+static void wait_until(sem_t *sem, uint64_t deadline_ns) {
+	struct timespec timeout;
+	uint64_t now = get_monotonic_ns();
+	uint64_t timeout_ns;
+
+	if (deadline_ns <= now)
+		return;
+
+	/* sem_timedwait() waits until a time of the realtime clock. */
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout_ns = (uint64_t) timeout.tv_sec * 1000000000 + timeout.tv_nsec +
+			(deadline_ns - now);
+	timeout.tv_sec = timeout_ns / 1000000000;
+	timeout.tv_nsec = timeout_ns % 1000000000;
+	sem_timedwait(sem, &timeout);
+}
+
+
+/** Convert the received frames to their message-specific format, in the queue
+ * of the publish stage. */
+static void *decode_stage(void *arg) {
+	rd_pipeline_t *rd = (rd_pipeline_t *) arg;
+	static J1939Reassembler tp;
+	struct timespec full_wait = { 0, RD_FULL_WAIT_US * 1000 };
+	rd_frame_t *frame;
+	rd_message_t *message;
+	j1939_tp_message_t *tp_message;
+	int num_decoded = 0;
+	int pgn;
+
+	while (true) {
+		/* The reassembled messages that were published free their slots. */
+		while (rd->published.pop(&tp_message))
+			tp.release(tp_message);
+
+		/* Wake the publish stage up before waiting for more frames. While
+		 * messages are being reassembled, the transfers that stopped are
+		 * dropped once their timeout passed. */
+		if ((frame = rd->frames.front()) == NULL) {
+			if (num_decoded != 0) {
+				sem_post(&rd->messages_ready);
+				num_decoded = 0;
+			}
+			tp.expire(get_monotonic_ns());
+			if (tp.get_num_active() == 0)
+				sem_wait(&rd->frames_ready);
+			else
+				wait_until(&rd->frames_ready,
+						get_monotonic_ns() + RD_TP_IDLE_MS * 1000000ULL);
+			continue;
+		}
+
+		if (rd->trace) {
+			rd->interpreters.get(PDU)->print(&frame->pdu, stdout, false);
+			fflush(stdout);
+		}
+
+		/* The receive stage queues frames in the meantime. */
+		while ((message = rd->messages.reserve()) == NULL) {
+			sem_post(&rd->messages_ready);
+			nanosleep(&full_wait, NULL);
+		}
+
+		/* In "generic" mode, write all PDUs to publish/subscribe database as
+		 * a byte streams, don't translate into specific PDU formats. PGNs
+		 * without an interpreter are kept in their pdu format. */
+		pgn = TWOBYTES(frame->pdu.pdu_format, frame->pdu.pdu_specific);
+		message->interpreter = rd->interpreters.get(rd->generic ? PDU : pgn);
+		message->tp = NULL;
+		message->pgn = pgn;
+		message->src_address = frame->pdu.src_address;
+		message->interpreter->convert(&frame->pdu, message->data);
+		message->decoded_ns = get_monotonic_ns();
+		rd->messages.commit();
+		latency_add(&rd->latency[RD_DECODE],
+				message->decoded_ns - frame->received_ns);
+
+		/* A frame that completes a message of the transport protocol is
+		 * followed by the message, which the publish stage hands back. */
+		if (!rd->generic && tp.process(&frame->pdu, &tp_message)) {
+			while ((message = rd->messages.reserve()) == NULL) {
+				sem_post(&rd->messages_ready);
+				nanosleep(&full_wait, NULL);
+			}
+			message->interpreter = NULL;
+			message->tp = tp_message;
+			message->pgn = tp_message->pgn;
+			message->src_address = tp_message->src_address;
+			message->decoded_ns = get_monotonic_ns();
+			rd->messages.commit();
+			rd->num_reassembled++;
+			num_decoded++;
+		}
+		rd->frames.discard();
+
+		if (++num_decoded >= RD_WAKE_BATCH) {
+			sem_post(&rd->messages_ready);
+			num_decoded = 0;
+		}
+	}
+	return NULL;
+}
+
+
+/** Print a reassembled message, like PDUInterpreter::print. */
+static void print_tp(j1939_tp_message_t *message, FILE *fp, bool numeric) {
+	if (numeric) {
+		fprintf(fp, "TP %d %d %d %d", message->pgn, message->src_address,
+				message->dst_address, message->num_bytes);
+		for (int i=0; i<message->num_bytes; ++i)
+			fprintf(fp, " %d", message->data[i]);
+		fprintf(fp, "\n");
+	} else {
+		fprintf(fp, "TP\n");
+		fprintf(fp, " Parameter Group Number %d\n", message->pgn);
+		fprintf(fp, " Source Address %d\n", message->src_address);
+		fprintf(fp, " Destination Address %d\n", message->dst_address);
+		fprintf(fp, " Number of bytes %d\n", message->num_bytes);
+		fprintf(fp, " Data Field");
+		for (int i=0; i<message->num_bytes; ++i)
+			fprintf(fp, " %d", message->data[i]);
+		fprintf(fp, "\n");
+	}
+}
+
+
+/** Print and publish the decoded messages. */
+static void *publish_stage(void *arg) {
+	rd_pipeline_t *rd = (rd_pipeline_t *) arg;
+	PubSub *ps = new PubSub();
+	rd_message_t *message;
+	uint64_t period_ns = rd->publish_hz == 0 ? 0 :
+			1000000000ULL / rd->publish_hz;
+	uint64_t next_publish_ns = get_monotonic_ns() + period_ns;
+	uint64_t now;
+
+	while (true) {
+		/* Publish the latest value of every message updated since the last
+		 * publish, once per period. */
+		if (period_ns != 0 && (now = get_monotonic_ns()) >= next_publish_ns) {
+			rd->num_published += rd->coalescer.flush(ps);
+			next_publish_ns += period_ns;
+			if (next_publish_ns <= now)
+				next_publish_ns = now + period_ns;
+		}
+
+		if ((message = rd->messages.front()) == NULL) {
+			if (period_ns == 0)
+				sem_wait(&rd->messages_ready);
+			else
+				wait_until(&rd->messages_ready, next_publish_ns);
+			continue;
+		}
+
+		/* A reassembled message has no interpreter yet, so its bytes are
+		 * printed and published as they are. It is not kept, since its slot
+		 * goes back to the reassembly. */
+		if (message->tp != NULL) {
+			if (rd->debug)
+				print_tp(message->tp, stdout, rd->numeric);
+			ps->publish_tp(message->tp);
+			rd->num_published++;
+			rd->published.push(message->tp);
+			latency_add(&rd->latency[RD_PUBLISH],
+					get_monotonic_ns() - message->decoded_ns);
+			rd->messages.discard();
+			continue;
+		}
+
+		/* Print the message in it's message-specific format. */
+		if (rd->debug)
+			message->interpreter->print(message->data, stdout, rd->numeric);
+
+		/* Keep the message as the latest value of its PGN and source address.
+		 * If every message is published, or the table is full, the message is
+		 * published right away. */
+		if (period_ns == 0 || !rd->coalescer.update(message->pgn,
+				message->src_address, message->interpreter, message->data)) {
+			ps->publish(message->interpreter->pgn(), message->data);
+			rd->num_published++;
+		}
+
+		latency_add(&rd->latency[RD_PUBLISH],
+				get_monotonic_ns() - message->decoded_ns);
+		rd->messages.discard();
+	}
+	return NULL;
+}
+
+
+/** Arguments of a stage thread. */
+typedef struct {
+	void *(*func)(void *);		/**< the stage */
+	rd_stage_attr_t attr;		/**< CPU of the stage */
+} rd_stage_t;
+
+
+/** Keep the calling stage on its CPU, and run it. */
+static void *run_stage(void *arg) {
+	rd_stage_t *stage = (rd_stage_t *) arg;
+
+	if (stage->attr.cpu >= 0 && ThreadCtl(_NTO_TCTL_RUNMASK,
+			(void *) (uintptr_t) (1 << stage->attr.cpu)) == -1)
+		perror("ThreadCtl runmask");
+	return stage->func(&pipeline);
+}
+
+
+/** Start a stage, at its priority. */
+static void start_stage(rd_stage_t *stage) {
+	pthread_attr_t thread_attr;
+	struct sched_param param;
+	pthread_t tid;
+
+	pthread_attr_init(&thread_attr);
+	if (stage->attr.priority > 0) {
+		pthread_attr_setinheritsched(&thread_attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&thread_attr, SCHED_FIFO);
+		param.sched_priority = stage->attr.priority;
+		pthread_attr_setschedparam(&thread_attr, &param);
+	}
+	if (pthread_create(&tid, &thread_attr, run_stage, stage) != EOK) {
+		perror("Unable to start stage");
+		exit(EXIT_FAILURE);
+	}
+	pthread_attr_destroy(&thread_attr);
+}
+
+
+/** Parse a value per stage, given as r,d,p. */
+static void parse_stages(const char *arg, rd_stage_t *stages, bool cpu) {
+	char *end = (char *) arg;
+
+	for (int i=0; i<RD_NUM_STAGES; i++) {
+		int value = strtol(end, &end, 0);
+		if (cpu)
+			stages[i].attr.cpu = value;
+		else
+			stages[i].attr.priority = value;
+		if (*end != ',')
+			break;
+		end++;
+	}
+}
+
+
+/** Print the latency of every stage since the last report. */
+static void report_latency(rd_pipeline_t *rd) {
+	static const char *names[RD_NUM_STAGES] = {
+		"receive", "decode", "publish"
+	};
+
+	printf("received %lu dropped %lu errors %lu reassembled %lu "
+			"published %lu\n",
+			(unsigned long) rd->num_received,
+			(unsigned long) rd->num_dropped,
+			(unsigned long) rd->rcv_errors,
+			(unsigned long) rd->num_reassembled,
+			(unsigned long) rd->num_published);
+	for (int i=0; i<RD_NUM_STAGES; i++) {
+		rd_latency_t *latency = &rd->latency[i];
+		uint64_t count = latency->count.exchange(0);
+		uint64_t total_ns = latency->total_ns.exchange(0);
+		uint64_t max_ns = latency->max_ns.exchange(0);
+		printf("%-8s %10llu messages, mean %6llu us, max %6llu us\n",
+				names[i], (unsigned long long) count,
+				(unsigned long long) (count == 0 ? 0 : total_ns / count / 1000),
+				(unsigned long long) (max_ns / 1000));
+	}
+	fflush(stdout);
+}
+
+
 int main(int argc, char **argv) {
-	JBus jfunc;				/* object responsible to r/w messages */
-	int external = 0;		/* external from jbus, internal converter */
-	int slot_or_type;		/* external slot, internal type */
-	int trace = 0;			/* whether to print the input (raw) message */
-	bool generic = false;	/* whether to run in "generic" mode */
-	long rcv_errors = 0;	/* number of errors during the receiving process */
-	long num_received = 0;	/* number of messages successfully received */
-	int j1939_debug = 0;	/* whether to print during the receive process */
-	j1939_pdu_typ *pdu = new j1939_pdu_typ();	/* placeholder for messages */
 	char *fname = "/dev/ser1";					/* path to serial port */
+	rd_pipeline_t *rd = &pipeline;
+	unsigned int report_s = 0;	/* period of the latency report, in s */
+	static rd_stage_t stages[RD_NUM_STAGES] = {
+		{ receive_stage, { -1, 0 } },
+		{ decode_stage, { -1, 0 } },
+		{ publish_stage, { -1, 0 } },
+	};
 
-    /* Collect initial variables for interpreting J1939 messages. */
-    map <int, J1939Interpreter*> interpreters = get_interpreters();
-    bool numeric = false;
-    void *message;
-
+	rd->publish_hz = RD_PUBLISH_HZ;
 	int ch;
-	while ((ch = getopt(argc, argv, "a:cd:f:s:tvg")) != EOF) {
+	while ((ch = getopt(argc, argv, "a:A:cd:f:L:nP:r:s:tvg")) != EOF) {
 		switch (ch) {
 			case 'f': fname = strdup(optarg); break;
-			case 't': trace = 1; break;
-			case 'g': generic = true; break;  /* save as generic to database */
-			case 'v': j1939_debug = 1; break;
-			case 'n': numeric = true; break;
+			case 't': rd->trace = true; break;
+			case 'g': rd->generic = true; break;  /* save as generic to database */
+			case 'v': rd->debug = true; break;
+			case 'n': rd->numeric = true; break;
+			case 'A': parse_stages(optarg, stages, true); break;
+			case 'P': parse_stages(optarg, stages, false); break;
+			case 'L': report_s = atoi(optarg); break;
+			case 'r': rd->publish_hz = atoi(optarg); break;
 			default	: {
 				printf("Usage: %s [-a <AVCS timing output>", argv[0]);
 				printf("\t -c (CAN card vs serial STB) -d (debug)\n");
 				printf("\t -t (trace) -f <CAN port>\n");
 				printf("\t -s <db num to save> \n");
-				printf("\t-g (generic save to DB)]\n");
+				printf("\t-g (generic save to DB)\n");
+				printf("\t -A <CPUs of the stages r,d,p> -P <priorities r,d,p>\n");
+				printf("\t -L <latency report period in s>");
+				printf("\t -r <publish rate in Hz>]\n");
 				break;
 			}
 		}
 	}
 
+	/* Every message is decoded into a slot of the publish queue, and kept in
+	 * a slot of the latest values. */
+	if (rd->interpreters.max_size() > RD_MSG_SIZE ||
+			rd->interpreters.max_size() > COALESCE_MSG_SIZE) {
+		fprintf(stderr, "Messages of %u bytes do not fit in the queue\n",
+				(unsigned int) rd->interpreters.max_size());
+		exit(EXIT_FAILURE);
+	}
+
 	/* Initialize the device port. */
     printf("Initializing device port: %s\n", fname);
-    int fpin = jfunc.init(fname, O_RDONLY, NULL);
+    rd->fd = rd->jfunc.init(fname, O_RDONLY, NULL);
 
-    if (fpin == -1) {
+    if (rd->fd == -1) {
 		printf("Error opening CAN device %s for input\n", fname);
 		exit(EXIT_FAILURE);
 	}
 
-	int pgn;
-	int rcv_val;
-	while (true) {
-		/* Receive a new value from the J-bus. */
-		rcv_val = jfunc.receive(fpin, pdu, &external, &slot_or_type);
-
-		/* If the retrieved message is an error message, increment the number of
-		 * errors received and try again. */
-		if (rcv_val == J1939_RECEIVE_MESSAGE_ERROR) {
-			rcv_errors++;
-			continue;
-		}
-
-		/* If a fatal error occurred when trying to receive a message, stop the
-		 * message collecting process. */
-		if (rcv_val == J1939_RECEIVE_FATAL_ERROR)
-			break;
-
-		/* Increment if received valid message. */
-		num_received++;
+	sem_init(&rd->frames_ready, 0, 0);
+	sem_init(&rd->messages_ready, 0, 0);
 
-        /* Update the time stamp of the PDU object. */
-		get_current_timestamp(&pdu->timestamp);
+	/* The consumers first, so that the first frames are not waiting. */
+	for (int i=RD_NUM_STAGES-1; i>=0; i--)
+		start_stage(&stages[i]);
 
-        if (trace) {
-			if (external) {
-				interpreters[PDU]->print(pdu, stdout, false);
-			} else
-				printf("internal 0x%2x\n", slot_or_type);
-			fflush(stdout);
-		}
-
-        if (!external) {
-			printf("Received internal message\n");
+	/* Report the latencies for as long as the stages run. */
+	while (true) {
+		if (report_s == 0) {
+			pause();
 			continue;
 		}
-
-		/* In "generic" mode, write all PDUs to publish/subscribe database as a
-		 * byte streams, don't translate into specific PDU formats. */
-		if (generic) {
-			pgn = PDU;
-			message = (void*)pdu;
-		} else {
-			/* Compute the PGN value from the PDU format and specific terms. */
-	        pgn = (unsigned int) TWOBYTES(pdu->pdu_format, pdu->pdu_specific);
-
-            /* Convert the message to its message-specific format. */
-            message = interpreters[pgn]->convert(pdu);
-		}
-
-        /* Print the message in it's message-specific format. */
-		if (j1939_debug)
-			interpreters[pgn]->print(message, stdout, numeric);
-
-		/* TODO: Publish the message to the pub/sub server. */
+		sleep(report_s);
+		report_latency(rd);
 	}
 
 	/* Close the connection. */
-	jfunc.close_conn(&fpin);
-	delete pdu;
+	rd->jfunc.close_conn(&rd->fd);
 }
@@ -82,15 +82,6 @@ static map<string, int> get_pgn_by_name() {
 }
 
 
-/* Interpretable parameter group number values, used to check if a certain PGN
- * value is valid */
-static vector<int> PGNs {
-	PDU, TSC1, EXAC, RQST, ERC1, EBC1, ETC1, EEC2, EEC1, ETC2, GFI2, EI, FD,
-	EBC2, HRVD, TURBO, EEC3, VD, RCFG, TCFG, ECFG, ETEMP, PTO, CCVS, LFE,
-	AMBC, IEC, VEP, TF, RF,
-};
-
-
 /* Names of the interpretable messages */
 static vector<string> names {
 	"PDU", "TSC1", "EXAC", "RQST", "ERC1", "EBC1", "ETC1", "EEC2", "EEC1",
@@ -147,8 +138,9 @@ int main(int argc, char* argv[]) {
 
     /* some predefined variables */
     FILE *fp = fopen(outfile.c_str(), "w");
-    map <int, J1939Interpreter*> interpreters = get_interpreters();
+    static J1939Dispatch interpreters;
     map<string, int> pgn_by_name = get_pgn_by_name();
+    J1939Interpreter *interpreter;
     int pgn_val;
     void *message;
 
@@ -189,31 +181,40 @@ int main(int argc, char* argv[]) {
          * determine the interpreter for printing and publishing from the first
          * token term (i.e. the name of the message) */
         if (tokens[0] =="PDU") {
-        	j1939_pdu_typ *pdu = (j1939_pdu_typ*) interpreters[PDU]->import(tokens);
+        	j1939_pdu_typ *pdu = (j1939_pdu_typ*) interpreters.get(PDU)->import(tokens);
 
             /* compute the PGN value from the PDU format and specific terms */
             pgn_val = TWOBYTES(pdu->pdu_format, pdu->pdu_specific);
 
             /* skip if the interpreter is cannot be deciphered */
-            if (find(PGNs.begin(), PGNs.end(), pgn_val) == PGNs.end())
+            if (!interpreters.is_known(pgn_val)) {
+                delete pdu;
                 continue;
+            }
 
-            /* convert the message to its message-specific format */
-            message = interpreters[pgn_val]->convert(pdu);
+            /* convert the message to its message-specific format, in the
+             * storage of its PGN */
+            message = interpreters.convert(pdu, &interpreter);
+            delete pdu;
         } else {
             /* get the PGN value from the name of the message */
             pgn_val = pgn_by_name[tokens[0]];
 
+            /* skip if the interpreter is cannot be deciphered */
+            if (!interpreters.is_known(pgn_val))
+                continue;
+
             /* import the message */
-            message = interpreters[pgn_val]->import(tokens);
+            interpreter = interpreters.get(pgn_val);
+            message = interpreter->import(tokens);
         }
 
         /* print the message in it's processed format to the output file */
-        interpreters[pgn_val]->print(message, fp, numeric);
+        interpreter->print(message, fp, numeric);
 
         /* if verbose, print to stdout */
         if (verbose)
-        	interpreters[pgn_val]->print(message, stdout, numeric);
+        	interpreter->print(message, stdout, numeric);
     }
 
     return 0;
@@ -0,0 +1,737 @@
+/**\file
+ *
+ * test_can_emulator.cpp
+ *
+ * Unit tests for the interrupt handler, acceptance filters and transmit queue
+ * of the CAN driver in include/can/can_dev.cpp, run against the emulated
+ * SJA1000 of include/can/sja1000_emu.[h,cpp]. The driver objects used by these
+ * tests are built with CAN_EMULATOR defined (see tests/Makefile).
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+#define BOOST_TEST_MODULE "test_can_emulator"
+#include <boost/test/unit_test.hpp>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include "can/can_man.h"
+#include "can/sja1000_emu.h"
+#include "jbus/j1939_utils.h"
+#include "utils/timestamp.h"
+
+/** Channel served by the driver under test. */
+#define CHANNEL 0
+
+/** Input rings, output queue and state of the channel. */
+static can_rx_buff_t in_buff;
+static can_tx_queue_t out_buff;
+static can_dev_state_t state;
+
+
+/** Return the 29 bit identifier of a J1939 frame. */
+static unsigned long j1939_id(int priority, unsigned int pgn, BYTE sa) {
+	return ((unsigned long) priority << 26) | (pgn << 8) | sa;
+}
+
+
+/** Put a frame with 8 data bytes on the emulated bus. */
+static int put_frame(unsigned long id, bool extended, BYTE first_byte) {
+	sja1000_frame_t frame;
+	frame.id = id;
+	frame.extended = extended;
+	frame.size = 8;
+	for (int i = 0; i < 8; i++)
+		frame.data[i] = first_byte + i;
+	return sja1000_emu_receive(CHANNEL, &frame);
+}
+
+
+/** Fill a message to write, with 8 data bytes. */
+static can_msg_t make_msg(unsigned long id) {
+	can_msg_t msg;
+	memset(&msg, 0, sizeof(can_msg_t));
+	msg.id = id;
+	SET_EXTENDED_FRAME(msg);
+	msg.size = 8;
+	return msg;
+}
+
+
+/** A driver running on a freshly reset emulated chip, with a single client. */
+struct EmulatedChannel {
+	CANDeviceManager *dev;
+	can_rx_cursor_t cursor;
+
+	EmulatedChannel() {
+		sja1000_emu_reset(CHANNEL);
+		new (&in_buff) can_rx_buff_t();
+		out_buff.empty();
+		for (int lane = 0; lane < CAN_RX_NUM_LANES; lane++)
+			cursor.lanes[lane] = in_buff.lanes[lane].get_cursor();
+
+		memset(&state, 0, sizeof(state));
+		dev = new CANDeviceManager();
+		dev->set_state(&state);
+		dev->init(CHANNEL, 0, 250, 1);
+	}
+
+	~EmulatedChannel() {
+		delete dev;
+	}
+
+	/** Call the interrupt handler for as long as the chip raises its
+	 * interrupt line, as the interrupt thread does. */
+	int service() {
+		int num_calls = 0;
+		while (sja1000_emu_irq_pending(CHANNEL) && num_calls < 100) {
+			dev->interrupt(&in_buff, &out_buff);
+			num_calls++;
+		}
+		return num_calls;
+	}
+};
+
+
+BOOST_FIXTURE_TEST_SUITE( test_CANEmulator, EmulatedChannel )
+
+BOOST_AUTO_TEST_CASE( test_receive )
+{
+	unsigned long id = j1939_id(6, 0xFEF1, 0x17);	/* CCVS */
+	can_msg_t msg;
+
+	BOOST_CHECK(!sja1000_emu_irq_pending(CHANNEL));
+	BOOST_CHECK(put_frame(id, true, 10) == SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(0x123, false, 20) == SJA1000_EMU_QUEUED);
+	BOOST_CHECK(sja1000_emu_irq_pending(CHANNEL));
+
+	/* A single call empties the Rx FIFO and clears the interrupt. */
+	BOOST_CHECK(dev->interrupt(&in_buff, &out_buff) == 1);
+	BOOST_CHECK(!sja1000_emu_irq_pending(CHANNEL));
+	BOOST_CHECK(sja1000_emu_rx_count(CHANNEL) == 0);
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) == 2);
+
+	/* CCVS is safety-critical, so it is read first. */
+	msg = dev->read(&in_buff, &cursor);
+	BOOST_CHECK(msg.error == 0);
+	BOOST_CHECK(IS_EXTENDED_FRAME(msg));
+	BOOST_CHECK(CAN_ID(msg) == id);
+	BOOST_CHECK(msg.size == 8);
+	for (int i = 0; i < 8; i++)
+		BOOST_CHECK(msg.data[i] == 10 + i);
+
+	msg = dev->read(&in_buff, &cursor);
+	BOOST_CHECK(msg.error == 0);
+	BOOST_CHECK(!IS_EXTENDED_FRAME(msg));
+	BOOST_CHECK(CAN_ID(msg) == 0x123);
+	BOOST_CHECK(msg.data[7] == 27);
+
+	msg = dev->read(&in_buff, &cursor);
+	BOOST_CHECK(msg.error == 1);
+	BOOST_CHECK(dev->get_errs().rx_interrupt_count == 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_filter )
+{
+	can_filter_t filter;
+
+	/* EEC1 from any source: the chip filter is exact. */
+	filter.id = 0x80000000 | j1939_id(0, EEC1, 0);
+	filter.mask = 0x80000000 | 0x03FFFF00;
+	dev->set_filter(filter);
+
+	BOOST_CHECK(put_frame(j1939_id(3, EEC1, 0x00), true, 0) ==
+			SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(j1939_id(3, EEC1, 0x05), true, 0) ==
+			SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(j1939_id(3, EBC1, 0x00), true, 0) ==
+			SJA1000_EMU_REJECTED);
+	BOOST_CHECK(put_frame(0x100, false, 0) == SJA1000_EMU_REJECTED);
+	this->service();
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) == 2);
+	BOOST_CHECK(dev->get_errs().rx_filtered_count == 0);
+	for (int lane = 0; lane < CAN_RX_NUM_LANES; lane++)
+		in_buff.lanes[lane].skip(&cursor.lanes[lane]);
+
+	/* Two 11 bit identifiers. */
+	can_filter_t filter1 = { 0x100, 0x800007FF };
+	can_filter_t filter2 = { 0x200, 0x800007FF };
+	dev->set_dual_filter(filter1, filter2);
+
+	BOOST_CHECK(put_frame(0x100, false, 0) == SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(0x200, false, 0) == SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(0x300, false, 0) == SJA1000_EMU_REJECTED);
+	this->service();
+
+	/* A dual filter only compares ID28-13 of 29 bit frames, so the source
+	 * address is checked by the software filter. */
+	filter1.id = 0x80000000 | j1939_id(3, EEC1, 0x00);
+	filter1.mask = 0x9FFFFFFF;
+	filter2.id = 0x80000000 | j1939_id(3, EBC1, 0x0B);
+	filter2.mask = 0x9FFFFFFF;
+	dev->set_dual_filter(filter1, filter2);
+
+	BOOST_CHECK(put_frame(j1939_id(3, EEC1, 0x00), true, 0) ==
+			SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(j1939_id(3, EEC1, 0x01), true, 0) ==
+			SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(j1939_id(3, EBC1, 0x0B), true, 0) ==
+			SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(j1939_id(3, CCVS, 0x00), true, 0) ==
+			SJA1000_EMU_REJECTED);
+	this->service();
+	BOOST_CHECK(dev->get_errs().rx_filtered_count == 1);
+
+	can_msg_t msgs[8];
+	int num_msgs = dev->read_batch(&in_buff, &cursor, msgs, 8);
+	BOOST_CHECK(num_msgs == 4);
+	BOOST_CHECK(CAN_ID(msgs[0]) == j1939_id(3, EEC1, 0x00));
+	BOOST_CHECK(CAN_ID(msgs[1]) == j1939_id(3, EBC1, 0x0B));
+	BOOST_CHECK(CAN_ID(msgs[2]) == 0x100);
+	BOOST_CHECK(CAN_ID(msgs[3]) == 0x200);
+}
+
+BOOST_AUTO_TEST_CASE( test_client_filter )
+{
+	can_filter_t eec1 = { 0x80000000 | j1939_id(0, EEC1, 0),
+			0x80000000 | 0x03FFFF00 };
+	can_filter_t ebc1 = { 0x80000000 | j1939_id(0, EBC1, 0x0B),
+			0x80000000 | 0x03FFFFFF };
+	can_rx_cursor_t other = cursor;
+	can_msg_t msgs[8];
+	can_msg_t msg;
+
+	/* Each client reads the messages of its own filters from the shared
+	 * rings. */
+	put_frame(j1939_id(3, EEC1, 0x00), true, 0);
+	put_frame(j1939_id(6, EBC1, 0x0B), true, 0);
+	put_frame(j1939_id(6, EBC1, 0x0C), true, 0);
+	put_frame(0x100, false, 0);
+	this->service();
+
+	BOOST_CHECK(dev->read_batch(&in_buff, &cursor, msgs, 8, &eec1, 1) == 1);
+	BOOST_CHECK(CAN_ID(msgs[0]) == j1939_id(3, EEC1, 0x00));
+
+	msg = dev->read(&in_buff, &other, &ebc1, 1);
+	BOOST_CHECK(msg.error == 0);
+	BOOST_CHECK(CAN_ID(msg) == j1939_id(6, EBC1, 0x0B));
+	msg = dev->read(&in_buff, &other, &ebc1, 1);
+	BOOST_CHECK(msg.error == 1);
+	BOOST_CHECK(can_rx_get_count(&in_buff, &other) == 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_filter_reload )
+{
+	can_filter_t filter = { 0x100, 0x800007FF };
+	can_msg_t msg = make_msg(j1939_id(3, 0xF004, 0x20));
+	sja1000_frame_t frame;
+
+	dev->set_filter(filter);
+
+	/* Loading the filter the chip already holds keeps the Rx FIFO and the
+	 * message being sent. */
+	sja1000_emu_hold_tx(CHANNEL, true);
+	BOOST_CHECK(dev->write(&out_buff, &msg) == EOK);
+	BOOST_CHECK(put_frame(0x100, false, 0) == SJA1000_EMU_QUEUED);
+	dev->set_filter(filter);
+	dev->requeue_aborted(&out_buff);
+	BOOST_CHECK(sja1000_emu_rx_count(CHANNEL) == 1);
+	BOOST_CHECK(out_buff.get_count() == 0);
+	BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+	this->service();
+	BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) == 1);
+
+	/* A new filter resets the chip, and the aborted message is sent again. */
+	BOOST_CHECK(dev->write(&out_buff, &msg) == EOK);
+	filter.id = 0x200;
+	dev->set_filter(filter);
+	BOOST_CHECK(!sja1000_emu_complete_tx(CHANNEL));
+	dev->requeue_aborted(&out_buff);
+	BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+	this->service();
+	BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+	BOOST_CHECK(frame.id == j1939_id(3, 0xF004, 0x20));
+	BOOST_CHECK(!sja1000_emu_pop_tx(CHANNEL, &frame));
+	BOOST_CHECK(dev->get_stats().tx_frame_count == 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_overrun )
+{
+	int num_queued = 0;
+
+	/* Frames with 29 bit identifiers and 8 data bytes take 13 bytes of the
+	 * 64 byte Rx FIFO. */
+	while (put_frame(j1939_id(6, 0xFEF1, 0), true, num_queued) ==
+			SJA1000_EMU_QUEUED)
+		num_queued++;
+	BOOST_CHECK(num_queued == SJA1000_EMU_FIFO_SIZE / 13);
+	BOOST_CHECK(put_frame(j1939_id(6, 0xFEF1, 0), true, 0) ==
+			SJA1000_EMU_OVERRUN);
+
+	this->service();
+	BOOST_CHECK(dev->get_errs().rx_message_lost_count == 1);
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) == (unsigned) num_queued);
+
+	/* The overrun was cleared, so the next frames are queued again. */
+	BOOST_CHECK(put_frame(0x100, false, 0) == SJA1000_EMU_QUEUED);
+	this->service();
+	BOOST_CHECK(dev->get_errs().rx_message_lost_count == 1);
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) ==
+			(unsigned) num_queued + 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_transmit )
+{
+	can_msg_t msgs[3] = {
+		make_msg(j1939_id(6, 0xFEF1, 0x20)),
+		make_msg(j1939_id(3, 0xF004, 0x20)),
+		make_msg(j1939_id(0, 0x0000, 0x20)),
+	};
+	sja1000_frame_t frame;
+
+	/* The chip holds one frame at a time, and the queue sends the frame with
+	 * the highest J1939 priority next. */
+	sja1000_emu_hold_tx(CHANNEL, true);
+	msgs[1].data[0] = 0xAB;
+	BOOST_CHECK(dev->write_batch(&out_buff, msgs, 3) == 3);
+	BOOST_CHECK(!sja1000_emu_pop_tx(CHANNEL, &frame));
+	BOOST_CHECK(out_buff.get_count() == 2);
+
+	unsigned long expected[3] = {
+		j1939_id(0, 0x0000, 0x20),
+		j1939_id(3, 0xF004, 0x20),
+		j1939_id(6, 0xFEF1, 0x20),
+	};
+	for (int i = 0; i < 3; i++) {
+		BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+		BOOST_CHECK(sja1000_emu_irq_pending(CHANNEL));
+		this->service();
+		BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+		BOOST_CHECK(frame.extended);
+		BOOST_CHECK(frame.id == expected[i]);
+		BOOST_CHECK(frame.size == 8);
+	}
+	BOOST_CHECK(frame.data[0] == 0);
+	BOOST_CHECK(!sja1000_emu_complete_tx(CHANNEL));
+	BOOST_CHECK(out_buff.get_count() == 0);
+	BOOST_CHECK(dev->get_errs().tx_interrupt_count == 3);
+	BOOST_CHECK(dev->get_stats().tx_frame_count == 3);
+
+	/* Transmissions that complete at once are sent back to back. */
+	sja1000_emu_hold_tx(CHANNEL, false);
+	BOOST_CHECK(dev->write_batch(&out_buff, msgs, 3) == 3);
+	this->service();
+	for (int i = 0; i < 3; i++) {
+		BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+		BOOST_CHECK(frame.id == expected[i]);
+		if (i == 1)
+			BOOST_CHECK(frame.data[0] == 0xAB);
+	}
+	BOOST_CHECK(!sja1000_emu_pop_tx(CHANNEL, &frame));
+}
+
+BOOST_AUTO_TEST_CASE( test_tx_replace )
+{
+	unsigned long tsc1 = j1939_id(3, 0x0000, 0x20);
+	unsigned long tpdt = j1939_id(7, TPDT | 0x00, 0x20);
+	can_msg_t filler = make_msg(j1939_id(6, 0xFEF1, 0x20));
+	can_msg_t msg;
+	sja1000_frame_t frame;
+
+	/* The first frame is loaded into the chip, the others are queued. */
+	sja1000_emu_hold_tx(CHANNEL, true);
+	BOOST_CHECK(dev->write(&out_buff, &filler) == EOK);
+
+	/* Frames with the same identifier are all sent by default. */
+	for (int i = 0; i < 2; i++) {
+		msg = make_msg(tsc1);
+		msg.data[0] = i;
+		BOOST_CHECK(dev->write(&out_buff, &msg) == EOK);
+	}
+	BOOST_CHECK(out_buff.get_count() == 2);
+
+	/* A command written with CAN_TX_REPLACE only replaces another one. */
+	for (int i = 2; i < 4; i++) {
+		msg = make_msg(tsc1);
+		msg.data[0] = i;
+		msg.tx_flags = CAN_TX_REPLACE;
+		BOOST_CHECK(dev->write(&out_buff, &msg) == EOK);
+	}
+	BOOST_CHECK(out_buff.get_count() == 3);
+	BOOST_CHECK(dev->get_errs().tx_replaced_count == 1);
+
+	/* The packets of the transport protocol are never replaced. */
+	for (int i = 1; i <= 2; i++) {
+		msg = make_msg(tpdt);
+		msg.data[0] = i;
+		msg.tx_flags = CAN_TX_REPLACE;
+		BOOST_CHECK(dev->write(&out_buff, &msg) == EOK);
+	}
+	BOOST_CHECK(out_buff.get_count() == 5);
+	BOOST_CHECK(dev->get_errs().tx_replaced_count == 1);
+
+	unsigned long ids[6] = { CAN_ID(filler), tsc1, tsc1, tsc1, tpdt, tpdt };
+	BYTE data[6] = { 0, 0, 1, 3, 1, 2 };
+	for (int i = 0; i < 6; i++) {
+		BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+		this->service();
+		BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+		BOOST_CHECK(frame.id == ids[i]);
+		BOOST_CHECK(frame.data[0] == data[i]);
+	}
+	BOOST_CHECK(!sja1000_emu_complete_tx(CHANNEL));
+}
+
+BOOST_AUTO_TEST_CASE( test_tx_expire )
+{
+	struct timespec wait = { 0, 5000000 };
+	can_msg_t msgs[3] = {
+		make_msg(j1939_id(3, 0xF004, 0x20)),
+		make_msg(j1939_id(6, 0xFEF1, 0x20)),
+		make_msg(j1939_id(6, 0xFEF1, 0x21)),
+	};
+	sja1000_frame_t frame;
+
+	/* A frame that is still queued once its deadline passed is dropped. */
+	sja1000_emu_hold_tx(CHANNEL, true);
+	msgs[1].tx_ttl_ms = 1;
+	BOOST_CHECK(dev->write_batch(&out_buff, msgs, 3) == 3);
+	BOOST_CHECK(out_buff.get_count() == 2);
+	nanosleep(&wait, NULL);
+
+	BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+	this->service();
+	BOOST_CHECK(dev->get_errs().tx_expired_count == 1);
+	BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+	BOOST_CHECK(frame.id == j1939_id(3, 0xF004, 0x20));
+	BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+	this->service();
+	BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+	BOOST_CHECK(frame.id == j1939_id(6, 0xFEF1, 0x21));
+	BOOST_CHECK(!sja1000_emu_complete_tx(CHANNEL));
+	BOOST_CHECK(out_buff.get_count() == 0);
+
+	/* The frame loaded into the chip is not dropped. */
+	msgs[0].tx_ttl_ms = 1;
+	BOOST_CHECK(dev->write(&out_buff, &msgs[0]) == EOK);
+	nanosleep(&wait, NULL);
+	BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+	this->service();
+	BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+	BOOST_CHECK(frame.id == j1939_id(3, 0xF004, 0x20));
+	BOOST_CHECK(dev->get_errs().tx_expired_count == 1);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_tx_order )
+{
+	struct timespec wait = { 0, 5000000 };
+	can_msg_t filler = make_msg(j1939_id(6, 0xFEF1, 0x20));
+	can_msg_t msgs[4] = {
+		make_msg(j1939_id(3, 0xF004, 0x01)),
+		make_msg(j1939_id(0, 0x0000, 0x02)),
+		make_msg(j1939_id(3, 0xF004, 0x03)),
+		make_msg(j1939_id(3, 0xF004, 0x04)),
+	};
+	sja1000_frame_t frame;
+	uint64_t tx_time;
+
+	/* The highest priority goes first, and frames of the same priority in
+	 * the order they were written. A frame held until its transmit time
+	 * waits, whatever its priority. */
+	sja1000_emu_hold_tx(CHANNEL, true);
+	BOOST_CHECK(dev->write(&out_buff, &filler) == EOK);
+	msgs[1].tx_time_ns = get_monotonic_ns() + 4000000;
+	BOOST_CHECK(dev->write_batch(&out_buff, msgs, 4) == 4);
+
+	unsigned long expected[3] = {
+		CAN_ID(filler), j1939_id(3, 0xF004, 0x01), j1939_id(3, 0xF004, 0x03),
+	};
+	for (int i = 0; i < 3; i++) {
+		BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+		this->service();
+		BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+		BOOST_CHECK(frame.id == expected[i]);
+	}
+
+	/* Once its transmit time is reached, the held frame goes before the
+	 * frames of lower priority. */
+	BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+	this->service();
+	BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+	BOOST_CHECK(frame.id == j1939_id(3, 0xF004, 0x04));
+	BOOST_CHECK(dev->get_next_tx_time(&out_buff, &tx_time));
+	BOOST_CHECK(tx_time == msgs[1].tx_time_ns);
+
+	nanosleep(&wait, NULL);
+	dev->tx_timer_expired(&out_buff);
+	BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+	this->service();
+	BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+	BOOST_CHECK(frame.id == j1939_id(0, 0x0000, 0x02));
+	BOOST_CHECK(out_buff.get_count() == 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_bus_off )
+{
+	can_msg_t msgs[2] = {
+		make_msg(j1939_id(3, 0xF004, 0x20)),
+		make_msg(j1939_id(6, 0xFEF1, 0x20)),
+	};
+	sja1000_frame_t frame;
+
+	/* Going bus-off aborts the frame loaded into the chip. */
+	sja1000_emu_hold_tx(CHANNEL, true);
+	BOOST_CHECK(dev->write_batch(&out_buff, msgs, 2) == 2);
+	sja1000_emu_bus_off(CHANNEL);
+	BOOST_CHECK(sja1000_emu_irq_pending(CHANNEL));
+	BOOST_CHECK(put_frame(0x100, false, 0) == SJA1000_EMU_OFFLINE);
+
+	/* The chip is reset and started again, and the aborted frame is sent
+	 * again before the one that was still queued. */
+	BOOST_CHECK(dev->interrupt(&in_buff, &out_buff) == 0);
+	BOOST_CHECK(put_frame(0x100, false, 0) == SJA1000_EMU_QUEUED);
+	for (int i = 0; i < 2; i++) {
+		BOOST_CHECK(sja1000_emu_complete_tx(CHANNEL));
+		this->service();
+		BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+		BOOST_CHECK(frame.id == CAN_ID(msgs[i]));
+	}
+	BOOST_CHECK(!sja1000_emu_complete_tx(CHANNEL));
+	BOOST_CHECK(out_buff.get_count() == 0);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_self_test )
+{
+	can_msg_t msgs[CAN_TX_QSIZE];
+	can_msg_t msg;
+	sja1000_frame_t frame;
+	int num_read = 0;
+
+	/* Every frame sent in self test mode is received back, through the
+	 * driver and into the input rings. */
+	BOOST_CHECK(dev->set_self_test(true) == 0);
+	for (int i = 0; i < CAN_TX_QSIZE; i++) {
+		msgs[i] = make_msg(j1939_id(7, 0xFFFE, i));
+		msgs[i].data[0] = i;
+	}
+	BOOST_CHECK(dev->write_batch(&out_buff, msgs, CAN_TX_QSIZE) ==
+			CAN_TX_QSIZE);
+	this->service();
+	BOOST_CHECK(out_buff.get_count() == 0);
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) == CAN_TX_QSIZE);
+	while ((msg = dev->read(&in_buff, &cursor)).error == 0) {
+		BOOST_CHECK(CAN_ID(msg) == j1939_id(7, 0xFFFE, num_read));
+		BOOST_CHECK(msg.data[0] == num_read);
+		num_read++;
+	}
+	BOOST_CHECK(num_read == CAN_TX_QSIZE);
+	BOOST_CHECK(dev->get_stats().tx_frame_count == CAN_TX_QSIZE);
+	BOOST_CHECK(dev->get_stats().rx_frame_count == CAN_TX_QSIZE);
+
+	/* The acceptance filter still applies to the frames received back. */
+	can_filter_t filter;
+	filter.id = j1939_id(3, 0xF004, 0x00);
+	filter.mask = 0x1FFFFFFF;
+	BOOST_CHECK(dev->set_filter(filter) == 0);
+	BOOST_CHECK(dev->write(&out_buff, &msgs[0]) == EOK);
+	this->service();
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) == 0);
+
+	/* Back in normal mode, the frames are only sent. */
+	while (sja1000_emu_pop_tx(CHANNEL, &frame))
+		;
+	filter.mask = 0;
+	dev->set_filter(filter);
+	BOOST_CHECK(dev->set_self_test(false) == 0);
+	BOOST_CHECK(dev->write(&out_buff, &msgs[0]) == EOK);
+	this->service();
+	BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) == 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_listen_only )
+{
+	static can_dump_ring_t dump;
+	can_msg_t msg;
+	sja1000_frame_t frame;
+
+	/* Every frame reaches both the clients and the dump. */
+	dev->set_dump(&dump);
+	BOOST_CHECK(dev->set_listen_only(true) == 0);
+
+	BOOST_CHECK(put_frame(0x123, false, 0) == SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(0x456, false, 1) == SJA1000_EMU_QUEUED);
+	this->service();
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) == 2);
+	BOOST_CHECK(dump.get_count() == 2);
+	BOOST_CHECK(dump.pop(&msg) && CAN_ID(msg) == 0x123 && msg.data[0] == 0);
+	BOOST_CHECK(dump.pop(&msg) && CAN_ID(msg) == 0x456 && msg.data[0] == 1);
+
+	/* Nothing is sent. */
+	BOOST_CHECK(dev->write(&out_buff, &msg) == EPERM);
+	BOOST_CHECK(dev->write_batch(&out_buff, &msg, 1) == 0);
+	BOOST_CHECK(out_buff.get_count() == 0);
+	BOOST_CHECK(!sja1000_emu_pop_tx(CHANNEL, &frame));
+
+	/* Back in normal mode. */
+	dev->set_dump(NULL);
+	BOOST_CHECK(dev->set_listen_only(false) == 0);
+	msg = make_msg(j1939_id(3, 0xF004, 0x00));
+	BOOST_CHECK(dev->write(&out_buff, &msg) == EOK);
+	this->service();
+	BOOST_CHECK(sja1000_emu_pop_tx(CHANNEL, &frame));
+}
+
+BOOST_AUTO_TEST_CASE( test_route )
+{
+	static can_route_ring_t ring;
+	static can_tx_queue_t out_buff2;
+	can_dev_state_t state2;
+	sja1000_frame_t frame;
+	can_route_t route;
+
+	/* A second channel, which the first forwards EEC1 to. */
+	sja1000_emu_reset(1);
+	out_buff2.empty();
+	memset(&state2, 0, sizeof(state2));
+	CANDeviceManager *dev2 = new CANDeviceManager();
+	dev2->set_state(&state2);
+	dev2->init(1, 0, 250, 1);
+
+	route.id = j1939_id(3, 0xF004, 0x00);
+	route.mask = 0x03FFFF00;	/* the PGN, from any source */
+	route.channel = CHANNEL;
+	route.sa = CAN_ROUTE_KEEP_SA;
+	BOOST_CHECK(dev->add_route(route, &ring) == -1);
+	route.channel = 1;
+	route.sa = 0x100;
+	BOOST_CHECK(dev->add_route(route, &ring) == -1);
+	route.sa = 0x42;
+	BOOST_CHECK(dev->add_route(route, &ring) == 0);
+
+	/* Only EEC1 is forwarded, but the clients still get every frame. */
+	BOOST_CHECK(put_frame(j1939_id(3, 0xF004, 0x00), true, 5) ==
+			SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(j1939_id(6, 0xFEF1, 0x00), true, 9) ==
+			SJA1000_EMU_QUEUED);
+	this->service();
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) == 2);
+	BOOST_CHECK(dev->take_routed() == (1U << 1));
+	BOOST_CHECK(dev->take_routed() == 0);
+	BOOST_CHECK(ring.get_count() == 1);
+
+	/* The other channel sends it at once, with the new source address. */
+	BOOST_CHECK(dev2->forward(&out_buff2, &ring) == 1);
+	BOOST_CHECK(sja1000_emu_pop_tx(1, &frame));
+	BOOST_CHECK(frame.extended);
+	BOOST_CHECK(frame.id == j1939_id(3, 0xF004, 0x42));
+	BOOST_CHECK(frame.data[0] == 5);
+	BOOST_CHECK(!sja1000_emu_pop_tx(1, &frame));
+
+	/* A channel in listen only mode drops the frames forwarded to it. */
+	BOOST_CHECK(dev2->set_listen_only(true) == 0);
+	BOOST_CHECK(put_frame(j1939_id(3, 0xF004, 0x00), true, 5) ==
+			SJA1000_EMU_QUEUED);
+	this->service();
+	BOOST_CHECK(dev->take_routed() == (1U << 1));
+	BOOST_CHECK(dev2->forward(&out_buff2, &ring) == 0);
+	BOOST_CHECK(dev2->get_errs().route_dropped_count == 1);
+	BOOST_CHECK(!sja1000_emu_pop_tx(1, &frame));
+
+	/* Once cleared, nothing is forwarded. */
+	dev->clear_routes();
+	BOOST_CHECK(put_frame(j1939_id(3, 0xF004, 0x00), true, 5) ==
+			SJA1000_EMU_QUEUED);
+	this->service();
+	BOOST_CHECK(dev->take_routed() == 0);
+	BOOST_CHECK(ring.get_count() == 0);
+
+	delete dev2;
+}
+
+BOOST_AUTO_TEST_CASE( test_warm_restart )
+{
+	unsigned int pgn = 0xF004;	/* EEC1 */
+	can_filter_t filter;
+	can_msg_t msg;
+
+	filter.id = j1939_id(3, pgn, 0x00);
+	filter.mask = 0x1FFFFFFF;
+	dev->set_filter(filter);
+	BOOST_CHECK(put_frame(j1939_id(3, pgn, 0x00), true, 0) == SJA1000_EMU_QUEUED);
+	service();
+
+	/* The manager stops with frames left in the Rx FIFO. */
+	BOOST_CHECK(put_frame(j1939_id(3, pgn, 0x00), true, 1) == SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(j1939_id(3, pgn, 0x00), true, 2) == SJA1000_EMU_QUEUED);
+	delete dev;
+
+	/* A new manager takes over the chip and the state, without a reset. */
+	dev = new CANDeviceManager();
+	dev->set_state(&state);
+	BOOST_CHECK(dev->restart(CHANNEL, 0, 250));
+	BOOST_CHECK(sja1000_emu_rx_count(CHANNEL) == 2);
+	BOOST_CHECK(put_frame(j1939_id(3, pgn, 0x00), true, 3) == SJA1000_EMU_QUEUED);
+	BOOST_CHECK(put_frame(j1939_id(6, 0xFEF1, 0x00), true, 4) ==
+			SJA1000_EMU_REJECTED);
+	service();
+
+	/* The client reads every frame, in order. */
+	BOOST_CHECK(can_rx_get_count(&in_buff, &cursor) == 4);
+	for (int i = 0; i < 4; i++) {
+		msg = dev->read(&in_buff, &cursor);
+		BOOST_CHECK(msg.error == 0);
+		BOOST_CHECK(msg.data[0] == i);
+	}
+	BOOST_CHECK(dev->get_stats().rx_frame_count == 4);
+
+	/* A chip that was reset must be initialized again. */
+	sja1000_emu_reset(CHANNEL);
+	BOOST_CHECK(!dev->restart(CHANNEL, 0, 250));
+}
+
+
+BOOST_AUTO_TEST_CASE( test_synthetic_load )
+{
+	const int num_frames = 100000;
+	can_msg_t msgs[CAN_MAX_BATCH];
+	int num_read = 0;
+	int num_lost = 0;
+
+	/* Fill the Rx FIFO at every interrupt, as a saturated bus would, with a
+	 * mix of safety-critical and other frames, and read them back as a client
+	 * would. */
+	uint64_t start = get_monotonic_ns();
+	for (int i = 0; i < num_frames; ) {
+		while (i < num_frames) {
+			unsigned int pgn = (i % 4 == 0) ? EEC1 : 0xFEF1 + (i % 16);
+			int status = put_frame(j1939_id(6, pgn, i & 0xFF), true, i);
+			if (status == SJA1000_EMU_OVERRUN)
+				break;
+			i++;
+		}
+		this->service();
+		num_read += dev->read_batch(&in_buff, &cursor, msgs, CAN_MAX_BATCH);
+	}
+	num_read += dev->read_batch(&in_buff, &cursor, msgs, CAN_MAX_BATCH);
+	uint64_t elapsed = get_monotonic_ns() - start;
+
+	num_lost = dev->get_errs().rx_ring_full_count +
+			dev->get_errs().rx_safety_ring_full_count;
+	BOOST_CHECK(num_read == num_frames);
+	BOOST_CHECK(num_lost == 0);
+	BOOST_CHECK(dev->get_stats().rx_frame_count == (unsigned) num_frames);
+
+	/* A frame with a 29 bit identifier and 8 data bytes takes at least 128 us
+	 * at 1 Mb/s. */
+	printf("test_synthetic_load: %d frames in %llu us, %llu ns per frame\n",
+			num_frames, (unsigned long long) (elapsed / 1000),
+			(unsigned long long) (elapsed / num_frames));
+	BOOST_CHECK(elapsed / num_frames < 128000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
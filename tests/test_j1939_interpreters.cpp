@@ -18,6 +18,7 @@
 #include <string>
 #include <fstream>
 #include <stdio.h>
+#include <string.h>
 
 
 /** Validate the values of in a text file.
@@ -170,6 +171,32 @@ BOOST_AUTO_TEST_CASE( test_convert_tsc1 )
 	delete interpreter;
 }
 
+BOOST_AUTO_TEST_CASE( test_convert_into_tsc1 )
+{
+	// initialize an interpreter and PDU variable to match the data type
+	j1939_pdu_typ *pdu = new j1939_pdu_typ();
+	TSC1Interpreter *interpreter = new TSC1Interpreter();
+	j1939_tsc1_typ tsc1;
+	vector<int> new_data_field;
+
+	// the storage of the caller is reused, so it starts with garbage
+	BOOST_CHECK(interpreter->size() == sizeof(j1939_tsc1_typ));
+	memset(&tsc1, 0xFF, sizeof(tsc1));
+
+	// try a data-point
+	new_data_field = {0b00011011, 0, 0, 120, 0, 0, 0, 0};
+	for (int i=0; i<8; ++i)
+		pdu->data_field[i] = new_data_field[i];
+	pdu->src_address = 10;
+	pdu->pdu_specific = 0;
+	interpreter->convert(pdu, &tsc1);
+	BOOST_CHECK(check_tsc1(&tsc1, 3, 2, 1, 0, -5, 0, 10));
+
+	// free memory
+	delete pdu;
+	delete interpreter;
+}
+
 BOOST_AUTO_TEST_CASE( test_print_tsc1 )
 {
 	// initialize variables
@@ -513,6 +540,35 @@ BOOST_AUTO_TEST_CASE( test_convert_eec1 )
 	delete interpreter;
 }
 
+BOOST_AUTO_TEST_CASE( test_convert_into_eec1 )
+{
+	// initialize an interpreter and PDU variable to match the data type
+	j1939_pdu_typ *pdu = new j1939_pdu_typ();
+	pdu->pdu_format = 240;
+	pdu->pdu_specific = 4;
+	J1939Interpreter *interpreter = new EEC1Interpreter();
+	j1939_eec1_typ eec1;
+	vector<int> new_data_field;
+
+	// the same storage holds one message after the other
+	BOOST_CHECK(interpreter->size() == sizeof(j1939_eec1_typ));
+	new_data_field = {0b00001011, 125, 125, 100, 0, 22, 0, 125};
+	for (int i=0; i<8; ++i)
+		pdu->data_field[i] = new_data_field[i];
+	interpreter->convert(pdu, &eec1);
+	BOOST_CHECK(check_eec1(&eec1, 11, 0, 0, 12.5, 0, 22));
+
+	new_data_field = {0b00000000, 125, 125, 100, 0, 22, 0, 125};
+	for (int i=0; i<8; ++i)
+		pdu->data_field[i] = new_data_field[i];
+	interpreter->convert(pdu, &eec1);
+	BOOST_CHECK(check_eec1(&eec1, 0, 0, 0, 12.5, 0, 22));
+
+	// free memory
+	delete pdu;
+	delete interpreter;
+}
+
 BOOST_AUTO_TEST_CASE( test_print_eec1 )
 {
 	// initialize variables
@@ -2823,3 +2879,70 @@ BOOST_AUTO_TEST_CASE( test_import_ei )
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+
+/* -------------------------------------------------------------------------- */
+/* ----------------------------- J1939Dispatch ------------------------------ */
+/* -------------------------------------------------------------------------- */
+
+BOOST_AUTO_TEST_SUITE( test_J1939Dispatch )
+
+BOOST_AUTO_TEST_CASE( test_get )
+{
+	J1939Dispatch *dispatch = new J1939Dispatch();
+
+	// every interpreter of get_interpreters is found under its PGN
+	map<int, J1939Interpreter*> interpreters = get_interpreters();
+	for (auto it = interpreters.begin(); it != interpreters.end(); ++it) {
+		BOOST_CHECK(dispatch->is_known(it->first));
+		BOOST_CHECK(dispatch->get(it->first)->pgn() == it->first);
+		BOOST_CHECK(dispatch->storage(it->first) != NULL);
+		delete it->second;
+	}
+
+	// unknown PGNs fall back to the PDU interpreter
+	BOOST_CHECK(!dispatch->is_known(0xFEFF));
+	BOOST_CHECK(dispatch->get(0xFEFF)->pgn() == PDU);
+	BOOST_CHECK(dispatch->storage(0xFEFF) == dispatch->storage(PDU));
+
+	// free memory
+	delete dispatch;
+}
+
+BOOST_AUTO_TEST_CASE( test_convert )
+{
+	J1939Dispatch *dispatch = new J1939Dispatch();
+	j1939_pdu_typ *pdu = new j1939_pdu_typ();
+	J1939Interpreter *interpreter;
+	j1939_eec1_typ *eec1;
+	j1939_pdu_typ *unknown;
+	vector<int> new_data_field;
+
+	// a known PGN is converted into its storage
+	pdu->pdu_format = 240;
+	pdu->pdu_specific = 4;
+	new_data_field = {0b00001011, 125, 125, 100, 0, 22, 0, 125};
+	for (int i=0; i<8; ++i)
+		pdu->data_field[i] = new_data_field[i];
+	eec1 = (j1939_eec1_typ*) dispatch->convert(pdu, &interpreter);
+	BOOST_CHECK(interpreter->pgn() == EEC1);
+	BOOST_CHECK((void*) eec1 == dispatch->storage(EEC1));
+	BOOST_CHECK(check_eec1(eec1, 11, 0, 0, 12.5, 0, 22));
+
+	// an unknown PGN is kept in its pdu format
+	pdu->pdu_format = 254;
+	pdu->pdu_specific = 255;
+	pdu->src_address = 3;
+	unknown = (j1939_pdu_typ*) dispatch->convert(pdu, &interpreter);
+	BOOST_CHECK(interpreter->pgn() == PDU);
+	BOOST_CHECK(unknown->pdu_format == 254);
+	BOOST_CHECK(unknown->pdu_specific == 255);
+	BOOST_CHECK(unknown->src_address == 3);
+	BOOST_CHECK(unknown->data_field[5] == 22);
+
+	// free memory
+	delete pdu;
+	delete dispatch;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
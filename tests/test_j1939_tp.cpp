@@ -0,0 +1,254 @@
+/**\file
+ *
+ * test_j1939_tp.cpp
+ *
+ * Unit tests for the reassembly of the J1939 transport protocol in
+ * include/jbus/[j1939_tp.h, j1939_tp.cpp].
+ *
+ * @author Abdul Rahman Kreidieh
+ * @version 1.0.0
+ * @date October 17, 2026
+ */
+
+#define BOOST_TEST_MODULE "test_j1939_tp"
+#include <boost/test/unit_test.hpp>
+#include "jbus/j1939_tp.h"
+#include "jbus/j1939_utils.h"
+#include <string.h>
+
+
+/** Time stamp of the first frame, in ns. */
+#define T0	1000000000ULL
+
+
+/** Build a TP.CM frame announcing a message.
+ *
+ * @param control J1939_TP_BAM or J1939_TP_RTS
+ * @param src source address
+ * @param dst destination address, 255 for a BAM
+ * @param pgn PGN of the message
+ * @param num_bytes size of the message
+ * @param rx_time_ns time stamp of the frame
+ */
+static j1939_pdu_typ make_cm(int control, int src, int dst, int pgn,
+		int num_bytes, uint64_t rx_time_ns) {
+	j1939_pdu_typ pdu;
+	memset(&pdu, 0, sizeof(pdu));
+	pdu.priority = 7;
+	pdu.pdu_format = HIBYTE(TPCM);
+	pdu.pdu_specific = dst;
+	pdu.src_address = src;
+	pdu.data_field[0] = control;
+	pdu.data_field[1] = LOBYTE(num_bytes);
+	pdu.data_field[2] = HIBYTE(num_bytes);
+	pdu.data_field[3] = (num_bytes + 6) / 7;
+	pdu.data_field[4] = 0xFF;
+	pdu.data_field[5] = LOBYTE(pgn);
+	pdu.data_field[6] = HIBYTE(pgn);
+	pdu.data_field[7] = 0;
+	pdu.num_bytes = 8;
+	pdu.rx_time_ns = rx_time_ns;
+	return pdu;
+}
+
+
+/** Build the TP.DT frame of a packet of a message whose byte i is
+ * (i + seed) & 0xFF. */
+static j1939_pdu_typ make_dt(int src, int dst, int seq, int seed,
+		uint64_t rx_time_ns) {
+	j1939_pdu_typ pdu;
+	memset(&pdu, 0, sizeof(pdu));
+	pdu.priority = 7;
+	pdu.pdu_format = HIBYTE(TPDT);
+	pdu.pdu_specific = dst;
+	pdu.src_address = src;
+	pdu.data_field[0] = seq;
+	for (int i=0; i<7; i++)
+		pdu.data_field[1 + i] = ((seq - 1) * 7 + i + seed) & 0xFF;
+	pdu.num_bytes = 8;
+	pdu.rx_time_ns = rx_time_ns;
+	return pdu;
+}
+
+
+/** Check the bytes of a message built with make_dt. */
+static bool check_data(j1939_tp_message_t *message, int seed) {
+	for (int i=0; i<message->num_bytes; i++)
+		if (message->data[i] != ((i + seed) & 0xFF))
+			return false;
+	return true;
+}
+
+
+BOOST_AUTO_TEST_SUITE( test_J1939Reassembler )
+
+BOOST_AUTO_TEST_CASE( test_bam )
+{
+	static J1939Reassembler tp;
+	j1939_tp_message_t *message = NULL;
+	j1939_pdu_typ pdu;
+
+	/* A DM1 with 3 trouble codes takes 3 packets. */
+	pdu = make_cm(J1939_TP_BAM, 0, 0xFF, DM1, 18, T0);
+	BOOST_CHECK(!tp.process(&pdu, &message));
+	BOOST_CHECK_EQUAL(tp.get_num_active(), 1);
+
+	for (int seq=1; seq<=2; seq++) {
+		pdu = make_dt(0, 0xFF, seq, 5, T0 + seq * 50000000);
+		BOOST_CHECK(!tp.process(&pdu, &message));
+	}
+	pdu = make_dt(0, 0xFF, 3, 5, T0 + 150000000);
+	BOOST_CHECK(tp.process(&pdu, &message));
+
+	BOOST_CHECK_EQUAL(message->pgn, DM1);
+	BOOST_CHECK_EQUAL(message->src_address, 0);
+	BOOST_CHECK_EQUAL(message->dst_address, 0xFF);
+	BOOST_CHECK_EQUAL(message->num_bytes, 18);
+	BOOST_CHECK_EQUAL(message->rx_time_ns, T0 + 150000000);
+	BOOST_CHECK(check_data(message, 5));
+	BOOST_CHECK_EQUAL(tp.get_num_active(), 0);
+	tp.release(message);
+
+	/* Other frames are ignored. */
+	pdu = make_dt(0, 0xFF, 1, 5, T0 + 200000000);
+	pdu.pdu_format = HIBYTE(EEC1);
+	pdu.pdu_specific = LOBYTE(EEC1);
+	BOOST_CHECK(!tp.process(&pdu, &message));
+
+	j1939_tp_stats_t stats = tp.get_stats();
+	BOOST_CHECK_EQUAL(stats.completed, 1);
+	BOOST_CHECK_EQUAL(stats.errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_rts_cts )
+{
+	static J1939Reassembler tp;
+	j1939_tp_message_t *message = NULL;
+	j1939_pdu_typ pdu;
+
+	/* Node 3 sends 30 bytes (5 packets) to node 0, 2 packets per CTS. */
+	pdu = make_cm(J1939_TP_RTS, 3, 0, 0xFEE5, 30, T0);
+	BOOST_CHECK(!tp.process(&pdu, &message));
+	pdu = make_cm(J1939_TP_CTS, 0, 3, 0xFEE5, 0, T0);
+	BOOST_CHECK(!tp.process(&pdu, &message));
+
+	pdu = make_dt(3, 0, 1, 9, T0);
+	BOOST_CHECK(!tp.process(&pdu, &message));
+
+	/* Packet 2 is missed, and sent again after the CTS of the receiver. */
+	pdu = make_dt(3, 0, 3, 9, T0);
+	BOOST_CHECK(!tp.process(&pdu, &message));
+	for (int seq=2; seq<5; seq++) {
+		pdu = make_dt(3, 0, seq, 9, T0);
+		BOOST_CHECK(!tp.process(&pdu, &message));
+	}
+	BOOST_CHECK_EQUAL(tp.get_num_active(), 1);
+	pdu = make_dt(3, 0, 5, 9, T0);
+	BOOST_CHECK(tp.process(&pdu, &message));
+
+	BOOST_CHECK_EQUAL(message->pgn, 0xFEE5);
+	BOOST_CHECK_EQUAL(message->src_address, 3);
+	BOOST_CHECK_EQUAL(message->dst_address, 0);
+	BOOST_CHECK_EQUAL(message->num_bytes, 30);
+	BOOST_CHECK(check_data(message, 9));
+	tp.release(message);
+
+	/* An abort from the receiver closes the transfer. */
+	pdu = make_cm(J1939_TP_RTS, 3, 0, 0xFEE5, 30, T0);
+	BOOST_CHECK(!tp.process(&pdu, &message));
+	pdu = make_cm(J1939_TP_ABORT, 0, 3, 0xFEE5, 0, T0);
+	BOOST_CHECK(!tp.process(&pdu, &message));
+	BOOST_CHECK_EQUAL(tp.get_num_active(), 0);
+	BOOST_CHECK_EQUAL(tp.get_stats().aborts, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_bam_storm )
+{
+	static J1939Reassembler tp;
+	j1939_tp_message_t *message = NULL;
+	j1939_pdu_typ pdu;
+	int num_sources = J1939_TP_MAX_SESSIONS;
+	int num_completed = 0;
+
+	/* Every node reports its faults at once, and their packets interleave. */
+	for (int src=0; src<num_sources; src++) {
+		pdu = make_cm(J1939_TP_BAM, src, 0xFF, DM1, 100, T0);
+		BOOST_CHECK(!tp.process(&pdu, &message));
+	}
+	BOOST_CHECK_EQUAL(tp.get_num_active(), num_sources);
+
+	/* No slot is left for another node. */
+	pdu = make_cm(J1939_TP_BAM, num_sources, 0xFF, DM1, 100, T0);
+	BOOST_CHECK(!tp.process(&pdu, &message));
+	BOOST_CHECK_EQUAL(tp.get_stats().dropped, 1);
+
+	for (int seq=1; seq<=15; seq++) {
+		for (int src=0; src<num_sources; src++) {
+			pdu = make_dt(src, 0xFF, seq, src, T0 + seq * 1000000);
+			if (tp.process(&pdu, &message)) {
+				BOOST_CHECK_EQUAL(message->src_address, src);
+				BOOST_CHECK_EQUAL(message->num_bytes, 100);
+				BOOST_CHECK(check_data(message, src));
+				tp.release(message);
+				num_completed++;
+			}
+		}
+	}
+	BOOST_CHECK_EQUAL(num_completed, num_sources);
+	BOOST_CHECK_EQUAL(tp.get_num_active(), 0);
+
+	/* A message is held until released. */
+	pdu = make_cm(J1939_TP_BAM, 1, 0xFF, DM1, 9, T0);
+	tp.process(&pdu, &message);
+	pdu = make_dt(1, 0xFF, 1, 0, T0);
+	tp.process(&pdu, &message);
+	pdu = make_dt(1, 0xFF, 2, 0, T0);
+	BOOST_CHECK(tp.process(&pdu, &message));
+	for (int src=0; src<num_sources; src++) {
+		pdu = make_cm(J1939_TP_BAM, src, 0xFF, DM1, 100, T0);
+		tp.process(&pdu, &message);
+	}
+	BOOST_CHECK_EQUAL(tp.get_num_active(), num_sources - 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_timeouts )
+{
+	static J1939Reassembler tp;
+	j1939_tp_message_t *message = NULL;
+	j1939_pdu_typ pdu;
+
+	pdu = make_cm(J1939_TP_BAM, 1, 0xFF, DM1, 20, T0);
+	tp.process(&pdu, &message);
+	pdu = make_cm(J1939_TP_RTS, 2, 0, DM1, 20, T0);
+	tp.process(&pdu, &message);
+	BOOST_CHECK_EQUAL(tp.get_num_active(), 2);
+
+	/* Each frame restarts the timeout of its transfer. */
+	pdu = make_dt(1, 0xFF, 1, 0, T0 + 700000000ULL);
+	tp.process(&pdu, &message);
+	BOOST_CHECK_EQUAL(tp.expire(T0 + 1000000000ULL), 0);
+
+	/* The RTS times out after 1250 ms, the broadcast 750 ms after its last
+	 * frame. */
+	BOOST_CHECK_EQUAL(tp.expire(T0 + 1200000000ULL), 0);
+	BOOST_CHECK_EQUAL(tp.expire(T0 + 1300000000ULL), 1);
+	BOOST_CHECK_EQUAL(tp.get_num_active(), 1);
+	BOOST_CHECK_EQUAL(tp.expire(T0 + 1500000000ULL), 1);
+	BOOST_CHECK_EQUAL(tp.get_num_active(), 0);
+	BOOST_CHECK_EQUAL(tp.get_stats().timeouts, 2);
+
+	/* The time may jump by more than a turn of the wheel. */
+	pdu = make_cm(J1939_TP_BAM, 1, 0xFF, DM1, 20, T0 + 2000000000ULL);
+	tp.process(&pdu, &message);
+	BOOST_CHECK_EQUAL(tp.expire(T0 + 60000000000ULL), 1);
+
+	/* A broadcast that misses a packet is dropped. */
+	pdu = make_cm(J1939_TP_BAM, 1, 0xFF, DM1, 20, T0 + 60000000000ULL);
+	tp.process(&pdu, &message);
+	pdu = make_dt(1, 0xFF, 2, 0, T0 + 60000000000ULL);
+	BOOST_CHECK(!tp.process(&pdu, &message));
+	BOOST_CHECK_EQUAL(tp.get_num_active(), 0);
+	BOOST_CHECK_EQUAL(tp.get_stats().errors, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,8 @@
  * test_pubsub.cpp
  *
  * Unit tests for publish/subscribe methods in include/utils/[pub_sub.h,
- * publish.cpp, subscribe.cpp].
+ * publish.cpp, subscribe.cpp] and for the PublishCoalescer in
+ * include/utils/coalescer.h.
  *
  * @author Abdul Rahman Kreidieh
  * @version 1.0.0
@@ -13,6 +14,7 @@
 #include <boost/test/unit_test.hpp>
 #include "jbus/j1939_utils.h"
 #include "utils/pub_sub.h"
+#include "utils/coalescer.h"
 #include "tests/tests.h"
 
 BOOST_AUTO_TEST_SUITE( test_PubSub )
@@ -1147,3 +1149,100 @@ BOOST_AUTO_TEST_CASE( test_publishing_subscribing )
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+
+/** PubSub that records the published messages instead of writing them to the
+ * PPS server. */
+class RecordingPubSub : public PubSub
+{
+public:
+	virtual void publish(int type, void *message) {
+		types.push_back(type);
+		eng_spds.push_back(((j1939_eec1_typ*) message)->eng_spd);
+	}
+
+	vector<int> types;
+	vector<double> eng_spds;
+};
+
+BOOST_AUTO_TEST_SUITE( test_PublishCoalescer )
+
+BOOST_AUTO_TEST_CASE( test_update_flush )
+{
+	static PublishCoalescer coalescer;
+	EEC1Interpreter interpreter;
+	RecordingPubSub ps;
+	j1939_eec1_typ eec1;
+	memset(&eec1, 0, sizeof(eec1));
+
+	/* Every value of a pair replaces the previous one. */
+	for (int i=1; i<=10; i++) {
+		eec1.eng_spd = 100 * i;
+		BOOST_CHECK(coalescer.update(EEC1, 0, &interpreter, &eec1));
+	}
+	BOOST_CHECK_EQUAL(coalescer.get_num_pending(), 1);
+
+	/* Another source address is another pair. */
+	eec1.eng_spd = 50;
+	BOOST_CHECK(coalescer.update(EEC1, 3, &interpreter, &eec1));
+	BOOST_CHECK_EQUAL(coalescer.get_num_pending(), 2);
+
+	/* Each pair is published once, with its latest value, in the order it was
+	 * first updated. */
+	BOOST_CHECK_EQUAL(coalescer.flush(&ps), 2);
+	BOOST_CHECK_EQUAL(ps.types.size(), 2);
+	BOOST_CHECK_EQUAL(ps.types[0], EEC1);
+	BOOST_CHECK_EQUAL(ps.eng_spds[0], 1000);
+	BOOST_CHECK_EQUAL(ps.types[1], EEC1);
+	BOOST_CHECK_EQUAL(ps.eng_spds[1], 50);
+
+	/* Nothing is published again until a pair is updated. */
+	BOOST_CHECK_EQUAL(coalescer.get_num_pending(), 0);
+	BOOST_CHECK_EQUAL(coalescer.flush(&ps), 0);
+	eec1.eng_spd = 75;
+	BOOST_CHECK(coalescer.update(EEC1, 3, &interpreter, &eec1));
+	BOOST_CHECK_EQUAL(coalescer.flush(&ps), 1);
+	BOOST_CHECK_EQUAL(ps.eng_spds[2], 75);
+
+	BOOST_CHECK_EQUAL(coalescer.get_num_updates(), 12);
+	BOOST_CHECK_EQUAL(coalescer.get_num_published(), 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_full )
+{
+	static PublishCoalescer coalescer;
+	EEC1Interpreter interpreter;
+	RecordingPubSub ps;
+	j1939_eec1_typ eec1;
+	memset(&eec1, 0, sizeof(eec1));
+
+	/* Every pair fits until the table is full. */
+	for (int i=0; i<COALESCE_MAX_SLOTS; i++)
+		BOOST_CHECK(coalescer.update(i >> 8, i & 0xFF, &interpreter, &eec1));
+	BOOST_CHECK(!coalescer.update(EEC1, 0, &interpreter, &eec1));
+
+	/* The pairs already in the table are still updated. */
+	eec1.eng_spd = 1;
+	BOOST_CHECK(coalescer.update(0, 7, &interpreter, &eec1));
+	BOOST_CHECK_EQUAL(coalescer.flush(&ps), COALESCE_MAX_SLOTS);
+	BOOST_CHECK_EQUAL(ps.eng_spds[7], 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_single_source )
+{
+	static PublishCoalescer coalescer;
+	EEC1Interpreter interpreter;
+	j1939_eec1_typ eec1;
+	memset(&eec1, 0, sizeof(eec1));
+
+	/* The PGNs sent by a single ECU are spread over the table, so that an
+	 * update looks at a few slots only, even with a quarter of it in use. */
+	for (int pass=0; pass<10; pass++)
+		for (int i=0; i<COALESCE_MAX_SLOTS / 4; i++)
+			BOOST_CHECK(coalescer.update(0xF000 + i, 0, &interpreter, &eec1));
+	BOOST_CHECK_EQUAL(coalescer.get_num_pending(), COALESCE_MAX_SLOTS / 4);
+	BOOST_CHECK(coalescer.get_num_probes() <=
+			2 * coalescer.get_num_updates());
+}
+
+BOOST_AUTO_TEST_SUITE_END()